@@ -38,20 +38,13 @@
 #include  "switch_stun.h"
 #include  "globals.h"
 #include  "servers.h"
-#include  "http.h"
 #include  "auth.h"
 #include  "api.h"
-#if defined(HAVE_MOD_JANUS_WS)
-#include  "janus_ws.h"
-#endif
+#include  "event.h"
+#include  "transport.h"
 
 #define TRANSACTION_ID_LENGTH 16
 #define JANUS_STRING  "janus"
-#define JANUS_PLUGIN "janus.plugin.audiobridge"
-#define	MAX_POLL_EVENTS 10
-// The long-poll request has a 30 seconds timeout. If it has no event to report, a simple keep-alive message will be triggered
-#define HTTP_GET_TIMEOUT 60000
-#define HTTP_POST_TIMEOUT 3000
 
 /*
  * Maximum number of descriptors we ever embed in a signed token. The plugin
@@ -60,55 +53,28 @@
  */
 #define MAX_TOKEN_DESCRIPTORS 4
 
-/*
- * URL flavour for HTTP transport. WS transport ignores this and adds the
- * session_id / handle_id into the JSON body instead.
- */
-typedef enum {
-	URL_ROOT,    /* pUrl                            (create)              */
-	URL_SESSION, /* pUrl/<serverId>                 (claim, attach)       */
-	URL_HANDLE   /* pUrl/<serverId>/<senderId>      (everything handle)   */
-} api_url_kind_t;
-
-#if defined(HAVE_MOD_JANUS_WS)
-/*
- * Add a uint64 field as a raw JSON integer. cJSON stores numbers as `double`
- * and its printer may fall back to `%1.15g` (e.g. "8.31461053888952e+15"),
- * which Janus/Jansson parses as a JSON real and rejects for integer-only
- * fields like session_id / handle_id. Emit the value verbatim instead.
- */
-static void api_ws_add_u64(cJSON *root, const char *name, uint64_t value)
-{
-	char buf[32];
-	(void) snprintf(buf, sizeof(buf), "%" SWITCH_UINT64_T_FMT, value);
-	cJSON_AddRawToObject(root, name, buf);
-}
-#endif
-
 typedef struct {
 	const char *pType;
 	janus_id_t serverId;
 	const char *pTransactionId;
 	const char *opaqueId;
-	janus_id_t senderId;
 	switch_bool_t isPlugin;
 	const char *pSecret;
 	/*
-	 * When pHmacSecret is non-NULL, encode() will generate a fresh HMAC-SHA1
-	 * signed token (TTL = hmacTokenTtl seconds, fallback to 300) that embeds
+	 * When pAuthCache is non-NULL, encode() will attach an HMAC-SHA1
+	 * signed token from the cache (signed afresh when due) (TTL = hmacTokenTtl seconds, fallback to 300) that embeds
 	 * the plugin package plus any additional descriptors listed below, and
 	 * attach it to the top-level request as the `token` field. The same
 	 * token is also returned via pSignedTokenOut so the caller can reuse it
 	 * in nested locations such as the audiobridge join body.
 	 */
-	const char *pHmacSecret;
+	auth_cache_t *pAuthCache;
 	int hmacTokenTtl;
 	const char *pExtraDescriptors[MAX_TOKEN_DESCRIPTORS];
 	int nExtraDescriptors;
-	char **pSignedTokenOut; /* optional: receives malloc'd token; caller frees */
+	char *pSignedTokenOut; /* optional: receives a copy of the token; AUTH_TOKEN_MAX bytes */
 	cJSON *pJsonBody;
 	cJSON *pJsonJsep;
-	const char *pCandidate;
 } message_t;
 
 // calling process must delete the returned value
@@ -153,7 +119,7 @@ static cJSON *encode(const message_t message) {
 		}
 	}
 
-	if (message.pHmacSecret) {
+	if (message.pAuthCache) {
 		/*
 		 * Always include the plugin package as the first descriptor so that
 		 * Janus core's per-plugin access check passes. Extra descriptors
@@ -173,23 +139,20 @@ static cJSON *encode(const message_t message) {
 
 		{
 			int ttl = message.hmacTokenTtl > 0 ? message.hmacTokenTtl : API_HMAC_DEFAULT_LIFECYCLE_TTL;
-			char *pToken = authSignToken(message.pHmacSecret, ttl, pDescriptors, ndesc);
-			if (!pToken) {
+			char token[AUTH_TOKEN_MAX];
+
+			if (authCacheSign(message.pAuthCache, ttl, pDescriptors, ndesc, token, sizeof(token)) < 0) {
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot sign token\n");
 				goto error;
 			}
 
-			if (cJSON_AddStringToObject(pJsonRequest, "token", pToken) == NULL) {
+			if (cJSON_AddStringToObject(pJsonRequest, "token", token) == NULL) {
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot create string (token)\n");
-				free(pToken);
 				goto error;
 			}
 
 			if (message.pSignedTokenOut) {
-				/* Hand ownership to the caller; they must free(). */
-				*message.pSignedTokenOut = pToken;
-			} else {
-				free(pToken);
+				memcpy(message.pSignedTokenOut, token, sizeof(token));
 			}
 		}
 	}
@@ -223,198 +186,47 @@ static cJSON *encode(const message_t message) {
 	return NULL;
 }
 
-// calling process should delete return value
-static message_t *decode(cJSON *pJsonResponse) {
-	message_t *pMessage;
-	cJSON *pJsonRspPluginData;
-	cJSON *pJsonRspPlugin;
-	cJSON *pJsonRspCandidate;
-	cJSON *pJsonRspCandidateData;
-	cJSON *pJsonRspCandidateCompleted;
-	cJSON *pJsonRspJanus;
-	cJSON *pJsonRspTransaction;
-	cJSON *pJsonRspServerId;
-	cJSON *pJsonRspSender;
-
-	if (pJsonResponse == NULL) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "No response to decode\n");
-		return NULL;
-	}
-
-	switch_zmalloc(pMessage, sizeof(*pMessage));
-
-	pMessage->pJsonBody = cJSON_GetObjectItemCaseSensitive(pJsonResponse, "data");
-	if (pMessage->pJsonBody && !cJSON_IsObject(pMessage->pJsonBody)) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid type (data)\n");
-		return NULL;
-	} else if (!pMessage->pJsonBody) {
-		if ((pJsonRspPluginData = cJSON_GetObjectItemCaseSensitive(pJsonResponse, "plugindata")) != NULL) {
-			if (cJSON_IsObject(pJsonRspPluginData)) {
-				pJsonRspPlugin = cJSON_GetObjectItemCaseSensitive(pJsonRspPluginData, "plugin");
-			  	if (!cJSON_IsString(pJsonRspPlugin) || strcmp(JANUS_PLUGIN, pJsonRspPlugin->valuestring)) {
-			    	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (plugindata.plugin)\n");
-					return NULL;
-			  	}
-
-			  	pMessage->pJsonBody = cJSON_GetObjectItemCaseSensitive(pJsonRspPluginData, "data");
-			  	if (!cJSON_IsObject(pMessage->pJsonBody)) {
-			    	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid type (plugindata.data)\n");
-					return NULL;
-			  	}
-			} else {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid type (plugindata)\n");
-				return NULL;
-			}
-		} else if ((pJsonRspCandidate = cJSON_GetObjectItemCaseSensitive(pJsonResponse, "candidate")) != NULL) {
-			if (cJSON_IsObject(pJsonRspCandidate)) {
-				//NB. sdpMLineIndex is ignored - we're only doing audio
-
-				if ((pJsonRspCandidateCompleted = cJSON_GetObjectItemCaseSensitive(pJsonRspCandidate, "completed")) != NULL) {
-				  	if (!cJSON_IsBool(pJsonRspCandidateCompleted) || cJSON_IsFalse(pJsonRspCandidateCompleted)) {
-						// assumes that completed is always true value
-				    	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (candidate.completed)\n");
-						return NULL;
-				  	}
-					pMessage->pCandidate = "";
-				} else if ((pJsonRspCandidateData = cJSON_GetObjectItemCaseSensitive(pJsonRspCandidate, "candidate")) != NULL) {
-					if (!cJSON_IsString(pJsonRspCandidateData)) {
-						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (candidate.candidate)\n");
-						return NULL;
-					}
-					pMessage->pCandidate = pJsonRspCandidateData->valuestring;
-				}
-			} else {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid type (candidate)\n");
-				return NULL;
-			}
-		}
-	}
-
-	pMessage->pJsonJsep = cJSON_GetObjectItemCaseSensitive(pJsonResponse, "jsep");
-	if (pMessage->pJsonJsep && !cJSON_IsObject(pMessage->pJsonJsep)) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid type (jsep)\n");
-		return NULL;
-	}
-
-	pJsonRspJanus = cJSON_GetObjectItemCaseSensitive(pJsonResponse, JANUS_STRING);
-	if (pJsonRspJanus) {
-		if (!cJSON_IsString(pJsonRspJanus)) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (janus)\n");
-			return NULL;
-		} else {
-			pMessage->pType = pJsonRspJanus->valuestring;
-			MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "janus=%s\n", pMessage->pType);
-		}
-	}
-
-	pJsonRspTransaction = cJSON_GetObjectItemCaseSensitive(pJsonResponse, "transaction");
-	if (pJsonRspTransaction) {
-		if (!cJSON_IsString(pJsonRspTransaction)) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (transaction)\n");
-			return NULL;
-		} else {
-			pMessage->pTransactionId = pJsonRspTransaction->valuestring;
-			MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "transaction=%s\n", pMessage->pTransactionId);
-		}
-	}
-
-	pJsonRspServerId = cJSON_GetObjectItemCaseSensitive(pJsonResponse, "session_id");
-	if (pJsonRspServerId) {
-		if (!cJSON_IsNumber(pJsonRspServerId)) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (session_id)\n");
-			return NULL;
-		} else {
-			pMessage->serverId = (janus_id_t) pJsonRspServerId->valuedouble;
-			MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "serverId=%" SWITCH_UINT64_T_FMT "\n", pMessage->serverId);
-		}
-	}
-
-	pJsonRspSender = cJSON_GetObjectItemCaseSensitive(pJsonResponse, "sender");
-	if (pJsonRspSender) {
-		if (!cJSON_IsNumber(pJsonRspSender)) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (transaction)\n");
-			return NULL;
-		} else {
-			pMessage->senderId = (janus_id_t) pJsonRspSender->valuedouble;
-			MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "sender=%" SWITCH_UINT64_T_FMT "\n", pMessage->senderId);
-		}
-	}
-
-	return pMessage;
-}
-
 /*
- * Send one Janus request through the transport configured on pServer.
- *   - WS: adds session_id/handle_id and (if set) the stored auth-token to the
- *         request body, then calls janus_ws_rpc_json. Note: when pHmacSecret
- *         is in use, encode() has already added the signed `token` field at
- *         the top level, so we only need to add the stored token in non-HMAC
- *         mode.
- *   - HTTP: builds URL per `kind` and calls httpPost(HTTP_POST_TIMEOUT).
+ * Send one Janus request through the transport configured on pServer
+ * (transport.h), to the session serverId or, with senderId, to its handle.
  *
  * Caller retains ownership of `pJsonRequest` and must cJSON_Delete() the
  * returned response (or NULL on error).
  */
 static cJSON *api_send_request(server_t *pServer, cJSON *pJsonRequest, const char *pTransactionId,
-	janus_id_t serverId, janus_id_t senderId, api_url_kind_t kind, const char *label)
+	janus_id_t serverId, janus_id_t senderId, const char *label)
 {
-#if defined(HAVE_MOD_JANUS_WS)
-	if (pServer->transport == JANUS_TP_WS) {
-		if (serverId) api_ws_add_u64(pJsonRequest, "session_id", (uint64_t) serverId);
-		if (senderId) api_ws_add_u64(pJsonRequest, "handle_id", (uint64_t) senderId);
-		/* Stored-mode token only; HMAC-signed token already added by encode(). */
-		if (!pServer->pHmacSecret && !zstr(pServer->pAuthToken)) {
-			cJSON_AddStringToObject(pJsonRequest, "token", pServer->pAuthToken);
-		}
-		MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Sending WebSocket %s\n", label);
-		return janus_ws_rpc_json(pServer, pJsonRequest, pTransactionId,
-			(switch_interval_time_t) HTTP_POST_TIMEOUT * 1000);
-	}
-#else
-	(void) pTransactionId;
-#endif
-	{
-		char url[1024];
-		int n;
-		switch (kind) {
-		case URL_ROOT:
-			n = snprintf(url, sizeof(url), "%s", pServer->pUrl);
-			break;
-		case URL_SESSION:
-			n = snprintf(url, sizeof(url), "%s/%" SWITCH_UINT64_T_FMT, pServer->pUrl, serverId);
-			break;
-		case URL_HANDLE:
-		default:
-			n = snprintf(url, sizeof(url), "%s/%" SWITCH_UINT64_T_FMT "/%" SWITCH_UINT64_T_FMT,
-				pServer->pUrl, serverId, senderId);
-			break;
-		}
-		if (n < 0 || (size_t) n >= sizeof(url)) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Could not generate URL\n");
-			return NULL;
-		}
-		MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Sending HTTP %s - url=%s\n", label, url);
-		return httpPost(url, HTTP_POST_TIMEOUT, pJsonRequest);
-	}
+	return pServer->pTransport->send(pServer, pJsonRequest, pTransactionId, serverId, senderId, label);
 }
 
 /* Reports each remote participant in an audiobridge "participants" array; ids are normalised to a string (numeric or string_ids rooms). */
-static void api_dispatch_participants(message_t *pResponse, cJSON *pParticipants,
-	api_participant_func_t pParticipantFunc)
+static void api_dispatch_participants(const janus_event_t *pResponse, api_participant_func_t pParticipantFunc)
 {
 	cJSON *pItem = NULL;
 
-	if (!pParticipantFunc || !cJSON_IsArray(pParticipants)) {
+	if (!pParticipantFunc || !cJSON_IsArray(pResponse->pParticipants)) {
 		return;
 	}
 
-	cJSON_ArrayForEach(pItem, pParticipants) {
-		cJSON *pId = cJSON_GetObjectItemCaseSensitive(pItem, "id");
-		cJSON *pSetup = cJSON_GetObjectItemCaseSensitive(pItem, "setup");
+	cJSON_ArrayForEach(pItem, pResponse->pParticipants) {
+		cJSON *pId = NULL;
+		cJSON *pSetup = NULL;
+		cJSON *pField;
 		char idBuf[64];
 		const char *pIdStr = NULL;
 		switch_bool_t setup;
 
+		for (pField = pItem->child; pField; pField = pField->next) {
+			if (!pField->string) {
+				continue;
+			}
+			if (!strcmp(pField->string, "id")) {
+				pId = pField;
+			} else if (!strcmp(pField->string, "setup")) {
+				pSetup = pField;
+			}
+		}
+
 		if (cJSON_IsString(pId)) {
 			pIdStr = pId->valuestring;
 		} else if (cJSON_IsNumber(pId)) {
@@ -430,6 +242,147 @@ static void api_dispatch_participants(message_t *pResponse, cJSON *pParticipants
 	}
 }
 
+/* Hands the jsep answer carried by an event (configure, or a join that sent the offer) to the channel. */
+static void api_dispatch_answer(const janus_event_t *pResponse,
+	switch_status_t (*pAcceptedFunc)(const janus_id_t serverId, const janus_id_t senderId, const char *pSdp),
+	switch_bool_t (*pAnswerOnWebrtcupFunc)(const janus_id_t serverId, const janus_id_t senderId),
+	switch_status_t (*pAnsweredFunc)(const janus_id_t serverId, const janus_id_t senderId))
+{
+	if (!pResponse->pJsepType || strcmp("answer", pResponse->pJsepType)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (jsep.type)\n");
+		return;
+	}
+
+	if (!pResponse->pJsepSdp) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (jsep.sdp)\n");
+		return;
+	}
+
+	if ((*pAcceptedFunc)(pResponse->serverId, pResponse->senderId, pResponse->pJsepSdp)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Couldn't accept\n");
+	}
+
+	if (!pAnswerOnWebrtcupFunc || !pAnswerOnWebrtcupFunc(pResponse->serverId, pResponse->senderId)) {
+		if ((*pAnsweredFunc)(pResponse->serverId, pResponse->senderId)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Couldn't answer\n");
+		}
+	}
+}
+
+/* The audiobridge's "joined" event - ours (with our id) or someone else's (without). */
+static void api_dispatch_joined(const janus_event_t *pResponse,
+	switch_status_t (*pJoinedFunc)(const janus_id_t serverId, const janus_id_t senderId, const janus_id_t roomId, const janus_id_t participantId),
+	switch_status_t (*pAcceptedFunc)(const janus_id_t serverId, const janus_id_t senderId, const char *pSdp),
+	switch_bool_t (*pAnswerOnWebrtcupFunc)(const janus_id_t serverId, const janus_id_t senderId),
+	switch_status_t (*pAnsweredFunc)(const janus_id_t serverId, const janus_id_t senderId),
+	api_participant_func_t pParticipantFunc)
+{
+	janus_id_t roomId;
+	janus_id_t participantId;
+
+	if (!pResponse->pRoom) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Missing response (plugindata.data.room)\n");
+		return;
+	}
+	if (cJSON_IsNumber(pResponse->pRoom)) {
+		roomId = (janus_id_t) pResponse->pRoom->valuedouble;
+	} else if (cJSON_IsString(pResponse->pRoom)) {
+		roomId = 0;
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (plugindata.data.room)\n");
+		return;
+	}
+	MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "roomId=%" SWITCH_UINT64_T_FMT "\n", (janus_id_t) roomId);
+
+	if (!pResponse->pId) {
+		MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Someone else has joined\n");
+		api_dispatch_participants(pResponse, pParticipantFunc);
+		return;
+	}
+
+	if (cJSON_IsNumber(pResponse->pId)) {
+		participantId = (janus_id_t) pResponse->pId->valuedouble;
+		MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "participantId=%" SWITCH_UINT64_T_FMT "\n", (janus_id_t) participantId);
+	} else if (cJSON_IsString(pResponse->pId)) {
+		participantId = 0;
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (plugindata.data.id)\n");
+		return;
+	}
+	if ((*pJoinedFunc)(pResponse->serverId, pResponse->senderId, roomId, participantId)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Couldn't join\n");
+	}
+
+	/* Record our own participant id so we never treat ourselves as the remote peer. */
+	if (pParticipantFunc) {
+		char selfBuf[64];
+		const char *pSelfIdStr = NULL;
+		if (cJSON_IsString(pResponse->pId)) {
+			pSelfIdStr = pResponse->pId->valuestring;
+		} else {
+			(void) switch_snprintf(selfBuf, sizeof(selfBuf), "%" SWITCH_UINT64_T_FMT, (janus_id_t) participantId);
+			pSelfIdStr = selfBuf;
+		}
+		(void) pParticipantFunc(pResponse->serverId, pResponse->senderId, pSelfIdStr, SWITCH_TRUE, SWITCH_TRUE);
+	}
+
+	api_dispatch_participants(pResponse, pParticipantFunc);
+
+	/* a fast join sent the offer with the join, so the answer comes back on the joined event */
+	if (pResponse->pJsonJsep) {
+		api_dispatch_answer(pResponse, pAcceptedFunc, pAnswerOnWebrtcupFunc, pAnsweredFunc);
+	}
+}
+
+/* The audiobridge's "event" event - a configure result, someone leaving, an error or a participant update. */
+static void api_dispatch_audiobridge_event(const janus_event_t *pResponse,
+	switch_status_t (*pAcceptedFunc)(const janus_id_t serverId, const janus_id_t senderId, const char *pSdp),
+	switch_bool_t (*pAnswerOnWebrtcupFunc)(const janus_id_t serverId, const janus_id_t senderId),
+	switch_status_t (*pAnsweredFunc)(const janus_id_t serverId, const janus_id_t senderId),
+	switch_status_t (*pHungupFunc)(const janus_id_t serverId, const janus_id_t senderId, const char *pReason),
+	switch_status_t (*pRoomGoneFunc)(const janus_id_t serverId, const janus_id_t senderId),
+	api_participant_func_t pParticipantFunc)
+{
+	if (pResponse->pResult) {
+		if (!cJSON_IsString(pResponse->pResult) || strcmp("ok", pResponse->pResult->valuestring)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (plugindata.data.result)\n");
+			return;
+		}
+
+		api_dispatch_answer(pResponse, pAcceptedFunc, pAnswerOnWebrtcupFunc, pAnsweredFunc);
+	} else if (pResponse->pLeaving) {
+		if (cJSON_IsNumber(pResponse->pLeaving)) {
+			MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "leaving=%" SWITCH_UINT64_T_FMT "\n", (janus_id_t) pResponse->pLeaving->valuedouble);
+		} else if (cJSON_IsString(pResponse->pLeaving)) {
+			MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "leaving=%s (string id)\n", pResponse->pLeaving->valuestring);
+		} else {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (plugindata.data.leaving)\n");
+		}
+	} else if (pResponse->pPluginErrorCode && pResponse->pPluginError) {
+		if (!cJSON_IsNumber(pResponse->pPluginErrorCode) || !cJSON_IsString(pResponse->pPluginError)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "No error code or reason on join request\n");
+			return;
+		}
+		MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "error_code=%d\n", pResponse->pPluginErrorCode->valueint);
+		MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "error=%s\n", pResponse->pPluginError->valuestring);
+
+		// a room that was cached as existing may have gone since
+		if (pResponse->pPluginErrorCode->valueint == JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM && pRoomGoneFunc &&
+				(*pRoomGoneFunc)(pResponse->serverId, pResponse->senderId) == SWITCH_STATUS_SUCCESS) {
+			return;
+		}
+
+		if ((*pHungupFunc)(pResponse->serverId, pResponse->senderId, pResponse->pPluginError->valuestring)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Couldn't hangup\n");
+		}
+	} else if (cJSON_IsArray(pResponse->pParticipants)) {
+		/* Participant state change (e.g. a peer reaching setup:true) - how we learn the browser can hear audio. */
+		api_dispatch_participants(pResponse, pParticipantFunc);
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Unknown audiobridge event\n");
+	}
+}
+
 switch_status_t api_dispatch_poll_event(cJSON *pEvent,
 	switch_status_t (*pJoinedFunc)(const janus_id_t serverId, const janus_id_t senderId, const janus_id_t roomId, const janus_id_t participantId),
 	switch_status_t (*pAcceptedFunc)(const janus_id_t serverId, const janus_id_t senderId, const char *pSdp),
@@ -437,196 +390,98 @@ switch_status_t api_dispatch_poll_event(cJSON *pEvent,
 	switch_bool_t (*pAnswerOnWebrtcupFunc)(const janus_id_t serverId, const janus_id_t senderId),
 	switch_status_t (*pAnsweredFunc)(const janus_id_t serverId, const janus_id_t senderId),
 	switch_status_t (*pHungupFunc)(const janus_id_t serverId, const janus_id_t senderId, const char *pReason),
+	switch_status_t (*pRoomGoneFunc)(const janus_id_t serverId, const janus_id_t senderId),
 	api_participant_func_t pParticipantFunc)
 {
-	message_t *pResponse = NULL;
-	cJSON *pJsonRspReason;
-	cJSON *pJsonRspType;
-	cJSON *pJsonRspRoomId;
-	cJSON *pJsonRspParticipantId;
-	cJSON *pJsonRspJsepType;
-	cJSON *pJsonRspJsepSdp;
-	cJSON *pJsonRspError;
-	cJSON *pJsonRspErrorCode;
-
-	if (!(pResponse = decode(pEvent))) {
+	janus_event_t response;
+
+	if (eventDecode(pEvent, &response) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response\n");
-		goto end_dispatch;
+		return SWITCH_STATUS_SUCCESS;
 	}
 
-	if (!strcmp(pResponse->pType, "keepalive")) {
+	switch (response.type) {
+	case JANUS_EVENT_KEEPALIVE:
 		MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Its a keepalive - do nothing\n");
-	} else if (!strcmp(pResponse->pType, "ack")) {
+		break;
+	case JANUS_EVENT_ACK:
 		MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Janus ack (no-op)\n");
-	} else if (!strcmp(pResponse->pType, "hangup")) {
+		break;
+	case JANUS_EVENT_HANGUP:
 		MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Its an hangup\n");
 
-		pJsonRspReason = cJSON_GetObjectItemCaseSensitive(pEvent, "reason");
-		if (!cJSON_IsString(pJsonRspReason)) {
+		if (!response.pReason) {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (reason)\n");
-			goto end_dispatch;
+			break;
 		}
 
-		if ((*pHungupFunc)(pResponse->serverId, pResponse->senderId, pJsonRspReason->valuestring)) {
+		if ((*pHungupFunc)(response.serverId, response.senderId, response.pReason)) {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Couldn't hangup\n");
 		}
-	} else if (!strcmp(pResponse->pType, "detached")) {
-		if ((*pHungupFunc)(pResponse->serverId, pResponse->senderId, NULL)) {
+		break;
+	case JANUS_EVENT_DETACHED:
+		if ((*pHungupFunc)(response.serverId, response.senderId, NULL)) {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Couldn't detach\n");
 		}
-	} else if (!strcmp(pResponse->pType, "webrtcup")) {
+		break;
+	case JANUS_EVENT_WEBRTCUP:
 		MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "WebRTC has been setup\n");
-		if (pAnswerOnWebrtcupFunc && pAnswerOnWebrtcupFunc(pResponse->serverId, pResponse->senderId)) {
-			if ((*pAnsweredFunc)(pResponse->serverId, pResponse->senderId)) {
+		if (pAnswerOnWebrtcupFunc && pAnswerOnWebrtcupFunc(response.serverId, response.senderId)) {
+			if ((*pAnsweredFunc)(response.serverId, response.senderId)) {
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Couldn't answer (on webrtcup)\n");
 			}
 		}
-	} else if (!strcmp(pResponse->pType, "media")) {
+		break;
+	case JANUS_EVENT_MEDIA:
 		MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Media is flowing\n");
-	} else if (!strcmp(pResponse->pType, "trickle")) {
+		break;
+	case JANUS_EVENT_TRICKLE:
 		MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Receieved a candidate\n");
 
-		if ((*pTrickleFunc)(pResponse->serverId, pResponse->senderId, pResponse->pCandidate)) {
+		if ((*pTrickleFunc)(response.serverId, response.senderId, response.pCandidate)) {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Couldn't add candidate\n");
 		}
-	} else if (!strcmp(pResponse->pType, "event")) {
-		pJsonRspType = cJSON_GetObjectItemCaseSensitive(pResponse->pJsonBody, "audiobridge");
-		if (!cJSON_IsString(pJsonRspType)) {
+		break;
+	case JANUS_EVENT_EVENT:
+		if (!response.pAudiobridge) {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "No response (plugindata.data.audiobridge)\n");
-			goto end_dispatch;
+			break;
 		}
 
-		if (!strcmp("joined", pJsonRspType->valuestring)) {
-			janus_id_t roomId;
-			janus_id_t participantId;
-
-			pJsonRspRoomId = cJSON_GetObjectItemCaseSensitive(pResponse->pJsonBody, "room");
-			if (!pJsonRspRoomId) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Missing response (plugindata.data.room)\n");
-				goto end_dispatch;
-			}
-			if (cJSON_IsNumber(pJsonRspRoomId)) {
-				roomId = (janus_id_t) pJsonRspRoomId->valuedouble;
-			} else if (cJSON_IsString(pJsonRspRoomId)) {
-				roomId = 0;
-			} else {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (plugindata.data.room)\n");
-				goto end_dispatch;
-			}
-			MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "roomId=%" SWITCH_UINT64_T_FMT "\n", (janus_id_t) roomId);
-
-			pJsonRspParticipantId = cJSON_GetObjectItemCaseSensitive(pResponse->pJsonBody, "id");
-			if (pJsonRspParticipantId) {
-				if (cJSON_IsNumber(pJsonRspParticipantId)) {
-					participantId = (janus_id_t) pJsonRspParticipantId->valuedouble;
-					MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "participantId=%" SWITCH_UINT64_T_FMT "\n", (janus_id_t) participantId);
-				} else if (cJSON_IsString(pJsonRspParticipantId)) {
-					participantId = 0;
-				} else {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (plugindata.data.id)\n");
-					goto end_dispatch;
-				}
-				if ((*pJoinedFunc)(pResponse->serverId, pResponse->senderId, roomId, participantId)) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Couldn't join\n");
-				}
-
-				/* Record our own participant id so we never treat ourselves as the remote peer. */
-				if (pParticipantFunc) {
-					char selfBuf[64];
-					const char *pSelfIdStr = NULL;
-					if (cJSON_IsString(pJsonRspParticipantId)) {
-						pSelfIdStr = pJsonRspParticipantId->valuestring;
-					} else if (cJSON_IsNumber(pJsonRspParticipantId)) {
-						(void) switch_snprintf(selfBuf, sizeof(selfBuf), "%" SWITCH_UINT64_T_FMT, (janus_id_t) participantId);
-						pSelfIdStr = selfBuf;
-					}
-					if (pSelfIdStr) {
-						(void) pParticipantFunc(pResponse->serverId, pResponse->senderId, pSelfIdStr, SWITCH_TRUE, SWITCH_TRUE);
-					}
-				}
-
-				api_dispatch_participants(pResponse,
-					cJSON_GetObjectItemCaseSensitive(pResponse->pJsonBody, "participants"), pParticipantFunc);
-			} else {
-				MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Someone else has joined\n");
-				api_dispatch_participants(pResponse,
-					cJSON_GetObjectItemCaseSensitive(pResponse->pJsonBody, "participants"), pParticipantFunc);
-			}
-		} else if (!strcmp("event", pJsonRspType->valuestring)) {
-			pJsonRspType = cJSON_GetObjectItemCaseSensitive(pResponse->pJsonBody, "result");
-			if (pJsonRspType) {
-				if (!cJSON_IsString(pJsonRspType) || strcmp("ok", pJsonRspType->valuestring)) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (plugindata.data.result)\n");
-					goto end_dispatch;
-				}
-
-				pJsonRspJsepType = cJSON_GetObjectItemCaseSensitive(pResponse->pJsonJsep, "type");
-				if (!cJSON_IsString(pJsonRspJsepType) || strcmp("answer", pJsonRspJsepType->valuestring)) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (jsep.type)\n");
-					goto end_dispatch;
-				}
-
-				pJsonRspJsepSdp = cJSON_GetObjectItemCaseSensitive(pResponse->pJsonJsep, "sdp");
-				if (!cJSON_IsString(pJsonRspJsepSdp)) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (jsep.sdp)\n");
-					goto end_dispatch;
-				}
-
-				if ((*pAcceptedFunc)(pResponse->serverId, pResponse->senderId, pJsonRspJsepSdp->valuestring)) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Couldn't accept\n");
-				}
-
-				if (!pAnswerOnWebrtcupFunc || !pAnswerOnWebrtcupFunc(pResponse->serverId, pResponse->senderId)) {
-					if ((*pAnsweredFunc)(pResponse->serverId, pResponse->senderId)) {
-						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Couldn't answer\n");
-					}
-				}
-			} else if ((pJsonRspType = cJSON_GetObjectItemCaseSensitive(pResponse->pJsonBody, "leaving")) != NULL) {
-				if (cJSON_IsNumber(pJsonRspType)) {
-					MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "leaving=%" SWITCH_UINT64_T_FMT "\n", (janus_id_t) pJsonRspType->valuedouble);
-				} else if (cJSON_IsString(pJsonRspType)) {
-					MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "leaving=%s (string id)\n", pJsonRspType->valuestring);
-				} else {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (plugindata.data.leaving)\n");
-					goto end_dispatch;
-				}
-			} else if ((pJsonRspErrorCode = cJSON_GetObjectItemCaseSensitive(pResponse->pJsonBody, "error_code")) != NULL
-						&& (pJsonRspError = cJSON_GetObjectItemCaseSensitive(pResponse->pJsonBody, "error")) != NULL) {
-				if (!cJSON_IsNumber(pJsonRspErrorCode) || !cJSON_IsString(pJsonRspError)) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "No error code or reason on join request\n");
-					goto end_dispatch;
-				}
-				MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "error_code=%d\n", pJsonRspErrorCode->valueint);
-				MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "error=%s\n", pJsonRspError->valuestring);
-
-				if ((*pHungupFunc)(pResponse->serverId, pResponse->senderId, pJsonRspError->valuestring)) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Couldn't hangup\n");
-				}
-			} else if (cJSON_IsArray(cJSON_GetObjectItemCaseSensitive(pResponse->pJsonBody, "participants"))) {
-				/* Participant state change (e.g. a peer reaching setup:true) - how we learn the browser can hear audio. */
-				api_dispatch_participants(pResponse,
-					cJSON_GetObjectItemCaseSensitive(pResponse->pJsonBody, "participants"), pParticipantFunc);
-			} else {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Unknown audiobridge event\n");
-				goto end_dispatch;
-			}
-		} else if (!strcmp("left", pJsonRspType->valuestring)) {
+		switch (response.audiobridge) {
+		case JANUS_AUDIOBRIDGE_JOINED:
+			api_dispatch_joined(&response, pJoinedFunc, pAcceptedFunc, pAnswerOnWebrtcupFunc, pAnsweredFunc, pParticipantFunc);
+			break;
+		case JANUS_AUDIOBRIDGE_EVENT:
+			api_dispatch_audiobridge_event(&response, pAcceptedFunc, pAnswerOnWebrtcupFunc, pAnsweredFunc, pHungupFunc, pRoomGoneFunc,
+				pParticipantFunc);
+			break;
+		case JANUS_AUDIOBRIDGE_LEFT:
 			MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Caller has left the room\n");
-		} else {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Unknown result - audiobridge=%s\n", pJsonRspType->valuestring);
+			break;
+		default:
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Unknown result - audiobridge=%s\n", response.pAudiobridge);
+			break;
 		}
-	} else {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Unknown event - janus=%s\n", pResponse->pType);
+		break;
+	default:
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Unknown event - janus=%s\n", response.pType ? response.pType : "");
+		break;
 	}
 
-end_dispatch:
-	switch_safe_free(pResponse);
 	return SWITCH_STATUS_SUCCESS;
 }
 
+switch_status_t api_dispatch_event(cJSON *pEvent, const api_dispatch_t *pDispatch)
+{
+	return api_dispatch_poll_event(pEvent, pDispatch->joined, pDispatch->accepted, pDispatch->trickle,
+		pDispatch->answer_on_webrtcup, pDispatch->answered, pDispatch->hungup, pDispatch->room_gone, pDispatch->participant);
+}
+
 janus_id_t apiGetServerId(server_t *pServer) {
   	janus_id_t serverId = 0;
-	message_t request, *pResponse = NULL;
+	message_t request;
+	janus_event_t response;
 
   	cJSON *pJsonRequest = NULL;
  	cJSON *pJsonResponse = NULL;
@@ -642,28 +497,28 @@ janus_id_t apiGetServerId(server_t *pServer) {
 	request.pType = "create";
 	request.pTransactionId = pTransactionId;
 	request.pSecret = pServer->pSecret;
-	request.pHmacSecret = pServer->pHmacSecret;
+	request.pAuthCache = pServer->pAuthCache;
 
 	if (!(pJsonRequest = encode(request))) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot create request\n");
 		goto done;
 	}
 
-	pJsonResponse = api_send_request(pServer, pJsonRequest, pTransactionId, 0, 0, URL_ROOT, "create");
+	pJsonResponse = api_send_request(pServer, pJsonRequest, pTransactionId, 0, 0, "create");
 
-	if (!(pResponse = decode(pJsonResponse))) {
+	if (eventDecode(pJsonResponse, &response) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response\n");
 		goto done;
 	}
 
-	if (!pResponse->pType || strcmp("success", pResponse->pType) ||
-			!pResponse->pTransactionId || strcmp(pTransactionId, pResponse->pTransactionId) ||
-			!pResponse->pJsonBody) {
+	if (response.type != JANUS_EVENT_SUCCESS ||
+			!response.pTransactionId || strcmp(pTransactionId, response.pTransactionId) ||
+			!response.pJsonData) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Value mismatch\n");
     	goto done;
 	}
 
-	pJsonRspId = cJSON_GetObjectItemCaseSensitive(pResponse->pJsonBody, "id");
+	pJsonRspId = response.pId;
 	if (!cJSON_IsNumber(pJsonRspId)) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (id)\n");
 		goto done;
@@ -673,21 +528,18 @@ janus_id_t apiGetServerId(server_t *pServer) {
   	done:
   	cJSON_Delete(pJsonRequest);
   	cJSON_Delete(pJsonResponse);
-	switch_safe_free(pResponse);
 	switch_safe_free(pTransactionId);
 
   	return serverId;
 }
 
 switch_status_t apiClaimServerId(server_t *pServer, janus_id_t serverId) {
-	message_t request, *pResponse = NULL;
+	message_t request;
+	janus_event_t response;
 	switch_status_t result = SWITCH_STATUS_SUCCESS;
 
     cJSON *pJsonRequest = NULL;
     cJSON *pJsonResponse = NULL;
-	cJSON *pJsonRspError;
-	cJSON *pJsonRspErrorCode;
-	cJSON *pJsonRspErrorReason;
 	char *pTransactionId = generateTransactionId();
 
 	switch_assert(pServer);
@@ -699,7 +551,7 @@ switch_status_t apiClaimServerId(server_t *pServer, janus_id_t serverId) {
 	request.pType = "claim";
 	request.pTransactionId = pTransactionId;
 	request.pSecret = pServer->pSecret;
-	request.pHmacSecret = pServer->pHmacSecret;
+	request.pAuthCache = pServer->pAuthCache;
 
 	if (!(pJsonRequest = encode(request))) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot create request\n");
@@ -707,42 +559,39 @@ switch_status_t apiClaimServerId(server_t *pServer, janus_id_t serverId) {
 		goto done;
 	}
 
-	pJsonResponse = api_send_request(pServer, pJsonRequest, pTransactionId, serverId, 0, URL_SESSION, "claim");
+	pJsonResponse = api_send_request(pServer, pJsonRequest, pTransactionId, serverId, 0, "claim");
 
-	if (!(pResponse = decode(pJsonResponse))) {
+	if (eventDecode(pJsonResponse, &response) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response\n");
 			result = SWITCH_STATUS_SOCKERR;
 		goto done;
 	}
 
-	if (!pResponse->pType	|| !pResponse->pTransactionId || strcmp(pTransactionId, pResponse->pTransactionId)) {
+	if (!response.pType	|| !response.pTransactionId || strcmp(pTransactionId, response.pTransactionId)) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Value mismatch\n");
 		result = SWITCH_STATUS_FALSE;
     	goto done;
 	}
 
-	if (!strcmp(pResponse->pType, "success")) {
+	if (response.type == JANUS_EVENT_SUCCESS) {
 		MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Successful claim\n");
 		result = SWITCH_STATUS_SUCCESS;
 		goto done;
-	} else if (!strcmp(pResponse->pType, "error")) {
-		pJsonRspError = cJSON_GetObjectItemCaseSensitive(pJsonResponse, "error");
-		if (cJSON_IsObject(pJsonRspError)) {
-			pJsonRspErrorCode = cJSON_GetObjectItemCaseSensitive(pJsonRspError, "code");
-			if (!cJSON_IsNumber(pJsonRspErrorCode)) {
+	} else if (response.type == JANUS_EVENT_ERROR) {
+		if (response.pJsonError) {
+			if (!cJSON_IsNumber(response.pErrorCode)) {
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "No error code (error.code)\n");
 				result = SWITCH_STATUS_FALSE;
 				goto done;
 			}
-			MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "error.code=%d\n", pJsonRspErrorCode->valueint);
+			MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "error.code=%d\n", response.pErrorCode->valueint);
 
-			pJsonRspErrorReason = cJSON_GetObjectItemCaseSensitive(pJsonRspError, "reason");
-			if (!cJSON_IsString(pJsonRspErrorReason)) {
+			if (!response.pErrorReason) {
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "No reason (error.reason)\n");
 				result = SWITCH_STATUS_FALSE;
 				goto done;
 			}
-			MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "error.reason=%s\n", pJsonRspErrorReason->valuestring);
+			MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "error.reason=%s\n", response.pErrorReason);
 			result = SWITCH_STATUS_NOT_INITALIZED;
 			goto done;
 		} else {
@@ -751,7 +600,7 @@ switch_status_t apiClaimServerId(server_t *pServer, janus_id_t serverId) {
 			goto done;
 		}
 	} else {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Unknown response=%s\n", pResponse->pType);
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Unknown response=%s\n", response.pType);
 		result = SWITCH_STATUS_FALSE;
 		goto done;
 	}
@@ -759,14 +608,14 @@ switch_status_t apiClaimServerId(server_t *pServer, janus_id_t serverId) {
   	done:
 		cJSON_Delete(pJsonRequest);
 		cJSON_Delete(pJsonResponse);
-		switch_safe_free(pResponse);
 		switch_safe_free(pTransactionId);
 
   	return result;
 }
 
 janus_id_t apiGetSenderId(server_t *pServer, const janus_id_t serverId, const char *callId) {
-	message_t request, *pResponse = NULL;
+	message_t request;
+	janus_event_t response;
 	janus_id_t senderId = 0;
 
 	cJSON *pJsonRequest = NULL;
@@ -785,7 +634,7 @@ janus_id_t apiGetSenderId(server_t *pServer, const janus_id_t serverId, const ch
 	request.pTransactionId = pTransactionId;
 	request.opaqueId = callId;
 	request.pSecret = pServer->pSecret;
-	request.pHmacSecret = pServer->pHmacSecret;
+	request.pAuthCache = pServer->pAuthCache;
 	request.isPlugin = SWITCH_TRUE;
 
 	if (!(pJsonRequest = encode(request))) {
@@ -793,20 +642,20 @@ janus_id_t apiGetSenderId(server_t *pServer, const janus_id_t serverId, const ch
 		goto done;
 	}
 
-	pJsonResponse = api_send_request(pServer, pJsonRequest, pTransactionId, serverId, 0, URL_SESSION, "attach");
+	pJsonResponse = api_send_request(pServer, pJsonRequest, pTransactionId, serverId, 0, "attach");
 
-	if (!(pResponse = decode(pJsonResponse))) {
+	if (eventDecode(pJsonResponse, &response) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response\n");
 		goto done;
 	}
 
-	if (!pResponse->pType || strcmp("success", pResponse->pType) ||
-			!pResponse->pTransactionId || strcmp(pTransactionId, pResponse->pTransactionId)) {
+	if (response.type != JANUS_EVENT_SUCCESS ||
+			!response.pTransactionId || strcmp(pTransactionId, response.pTransactionId)) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Value mismatch\n");
 		goto done;
 	}
 
-	pJsonRspId = cJSON_GetObjectItemCaseSensitive(pResponse->pJsonBody, "id");
+	pJsonRspId = response.pId;
 	if (!cJSON_IsNumber(pJsonRspId)) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (id)\n");
 		goto done;
@@ -816,7 +665,6 @@ janus_id_t apiGetSenderId(server_t *pServer, const janus_id_t serverId, const ch
 	done:
 	cJSON_Delete(pJsonRequest);
 	cJSON_Delete(pJsonResponse);
-	switch_safe_free(pResponse);
 	switch_safe_free(pTransactionId);
 
 	return senderId;
@@ -826,14 +674,12 @@ janus_id_t apiCreateRoom(server_t *pServer, const janus_id_t serverId,
 		const janus_id_t senderId, const janus_id_t roomId, const char *pDescription,
 		switch_bool_t record, const char *pRecordingFile, const char *pPin,
 		switch_bool_t allow_ws_participants, const char *pRoomIdStr) {
-	message_t request, *pResponse = NULL;
+	message_t request;
+	janus_event_t response;
 	janus_id_t result = 0;
 
 	cJSON *pJsonRequest = NULL;
 	cJSON *pJsonResponse = NULL;
-	cJSON *pJsonRspResult;
-	cJSON *pJsonRspErrorCode;
-	cJSON *pJsonRspRoomId;
 	char *pTransactionId = generateTransactionId();
 
 	switch_assert(pServer);
@@ -846,7 +692,7 @@ janus_id_t apiCreateRoom(server_t *pServer, const janus_id_t serverId,
 	request.serverId = serverId;
 	request.pTransactionId = pTransactionId;
 	request.pSecret = pServer->pSecret;
-	request.pHmacSecret = pServer->pHmacSecret;
+	request.pAuthCache = pServer->pAuthCache;
 
 	request.pJsonBody = cJSON_CreateObject();
 	if (request.pJsonBody == NULL) {
@@ -909,50 +755,47 @@ janus_id_t apiCreateRoom(server_t *pServer, const janus_id_t serverId,
 		goto done;
 	}
 
-	pJsonResponse = api_send_request(pServer, pJsonRequest, pTransactionId, serverId, senderId, URL_HANDLE, "create room");
+	pJsonResponse = api_send_request(pServer, pJsonRequest, pTransactionId, serverId, senderId, "create room");
 
-	if (!(pResponse = decode(pJsonResponse))) {
+	if (eventDecode(pJsonResponse, &response) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response\n");
 		goto done;
 	}
 
-	if (!pResponse->pType || strcmp("success", pResponse->pType) ||
-			!pResponse->pTransactionId || strcmp(pTransactionId, pResponse->pTransactionId) ||
-			(pResponse->senderId != senderId) || !pResponse->pJsonBody) {
+	if (response.type != JANUS_EVENT_SUCCESS ||
+			!response.pTransactionId || strcmp(pTransactionId, response.pTransactionId) ||
+			(response.senderId != senderId) || !response.pJsonData) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Value mismatch\n");
 		goto done;
 	}
 
-	pJsonRspResult = cJSON_GetObjectItemCaseSensitive(pResponse->pJsonBody, "audiobridge");
-	if (!cJSON_IsString(pJsonRspResult)) {
+	if (!response.pAudiobridge) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "No response (plugindata.data.audiobridge)\n");
 		goto done;
 	}
 
-	if (!strcmp("event", pJsonRspResult->valuestring)) {
-		pJsonRspErrorCode = cJSON_GetObjectItemCaseSensitive(pResponse->pJsonBody, "error_code");
-		if (!cJSON_IsNumber(pJsonRspErrorCode)) {
+	if (response.audiobridge == JANUS_AUDIOBRIDGE_EVENT) {
+		if (!cJSON_IsNumber(response.pPluginErrorCode)) {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "No error code (error_code)\n");
 			goto done;
 		}
 
-		if (pJsonRspErrorCode->valueint == 486) {
+		if (response.pPluginErrorCode->valueint == 486) {
 			MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Room already exists\n");
 			result = (pRoomIdStr && *pRoomIdStr) ? 1 : (roomId != 0 ? roomId : 1); /* never 0: caller uses !apiCreateRoom() */
 		} else {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (error_code) - error=%d\n", pJsonRspErrorCode->valueint);
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (error_code) - error=%d\n", response.pPluginErrorCode->valueint);
 			goto done;
 		}
-	} else if (!strcmp("created", pJsonRspResult->valuestring)) {
-	  pJsonRspRoomId = cJSON_GetObjectItemCaseSensitive(pResponse->pJsonBody, "room");
-	  if (!pJsonRspRoomId) {
+	} else if (response.audiobridge == JANUS_AUDIOBRIDGE_CREATED) {
+	  if (!response.pRoom) {
 	    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Missing response (plugindata.data.room)\n");
 	    goto done;
 	  }
-	  if (cJSON_IsNumber(pJsonRspRoomId)) {
-	    result = (janus_id_t) pJsonRspRoomId->valuedouble;
+	  if (cJSON_IsNumber(response.pRoom)) {
+	    result = (janus_id_t) response.pRoom->valuedouble;
 		MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Create room success (integer room)\n");
-	  } else if (cJSON_IsString(pJsonRspRoomId)) {
+	  } else if (cJSON_IsString(response.pRoom)) {
 	    result = 1; /* string room: success; caller uses (apiCreateRoom() == 0) so must be non-zero */
 	    MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Create room success (string room)\n");
 	  } else {
@@ -967,22 +810,50 @@ janus_id_t apiCreateRoom(server_t *pServer, const janus_id_t serverId,
   done:
 	cJSON_Delete(pJsonRequest);
 	cJSON_Delete(pJsonResponse);
-	switch_safe_free(pResponse);
 	switch_safe_free(pTransactionId);
 
 	return result;
 }
 
+/* Attaches a non-trickled jsep (offer or answer) to a plugin message. */
+static switch_status_t api_add_jsep(message_t *pRequest, const char *pType, const char *pSdp)
+{
+	pRequest->pJsonJsep = cJSON_CreateObject();
+	if (pRequest->pJsonJsep == NULL) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot create jsep\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (cJSON_AddStringToObject(pRequest->pJsonJsep, "type", pType) == NULL) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot create string (jsep.type)\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (cJSON_AddFalseToObject(pRequest->pJsonJsep, "trickle") == NULL) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot create string (jsep.trickle)\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (cJSON_AddStringToObject(pRequest->pJsonJsep, "sdp", pSdp) == NULL) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot create string (jsep.sdp)\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 switch_status_t apiJoin(server_t *pServer, int hmacTokenTtl,
 		const janus_id_t serverId, const janus_id_t senderId, const janus_id_t roomId,
-		const char *pDisplay, const char *pPin, const char *pToken, const char *callId, const char *pRoomIdStr) {
-	message_t request, *pResponse = NULL;
+		const char *pDisplay, const char *pPin, const char *pToken, const char *callId, const char *pRoomIdStr,
+		const switch_bool_t muted, switch_bool_t record, const char *pRecordingFile, const char *pSdp) {
+	message_t request;
+	janus_event_t response;
  	switch_status_t result = SWITCH_STATUS_SUCCESS;
 
   	cJSON *pJsonRequest = NULL;
   	cJSON *pJsonResponse = NULL;
 	char *pTransactionId = generateTransactionId();
-	char *pSignedToken = NULL; /* owned here, freed in "done:" */
+	char signedToken[AUTH_TOKEN_MAX] = "";
 	char roomDesc[96];
 
 	switch_assert(pServer);
@@ -995,7 +866,7 @@ switch_status_t apiJoin(server_t *pServer, int hmacTokenTtl,
 	request.serverId = serverId;
 	request.pTransactionId = pTransactionId;
 	request.pSecret = pServer->pSecret;
-	request.pHmacSecret = pServer->pHmacSecret;
+	request.pAuthCache = pServer->pAuthCache;
 	request.hmacTokenTtl = hmacTokenTtl > 0 ? hmacTokenTtl : API_HMAC_DEFAULT_CALL_TTL;
 
 	/*
@@ -1007,7 +878,7 @@ switch_status_t apiJoin(server_t *pServer, int hmacTokenTtl,
 	 * it. The inbound `pToken` (stored-mode token from the
 	 * `janus-user-token` channel variable) is ignored in signed mode.
 	 */
-	if (pServer->pHmacSecret) {
+	if (pServer->pAuthCache) {
 		if (pRoomIdStr && *pRoomIdStr) {
 			(void) switch_snprintf(roomDesc, sizeof(roomDesc), "room=%s", pRoomIdStr);
 		} else {
@@ -1016,7 +887,7 @@ switch_status_t apiJoin(server_t *pServer, int hmacTokenTtl,
 		}
 		request.pExtraDescriptors[0] = roomDesc;
 		request.nExtraDescriptors = 1;
-		request.pSignedTokenOut = &pSignedToken;
+		request.pSignedTokenOut = signedToken;
 
 		if (pToken) {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG,
@@ -1084,6 +955,38 @@ switch_status_t apiJoin(server_t *pServer, int hmacTokenTtl,
 		}
 	}
 
+	/*
+	 * Fast join: the offer and the options that would otherwise go in the
+	 * configure request travel with the join, so Janus answers on the
+	 * joined event and the configure round trip is saved.
+	 */
+	if (pSdp) {
+		if (cJSON_AddBoolToObject(request.pJsonBody, "muted", (cJSON_bool) muted) == NULL) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot create boolean (body.muted)\n");
+			result = SWITCH_STATUS_FALSE;
+			goto done;
+		}
+
+		if (cJSON_AddBoolToObject(request.pJsonBody, "record", (cJSON_bool) record) == NULL) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot create boolean (body.record)\n");
+			result = SWITCH_STATUS_FALSE;
+			goto done;
+		}
+
+		if (pRecordingFile) {
+			if (cJSON_AddStringToObject(request.pJsonBody, "filename", pRecordingFile) == NULL) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot create string (body.filename)\n");
+				result = SWITCH_STATUS_FALSE;
+				goto done;
+			}
+		}
+
+		if (api_add_jsep(&request, "offer", pSdp) != SWITCH_STATUS_SUCCESS) {
+			result = SWITCH_STATUS_FALSE;
+			goto done;
+		}
+	}
+
 	if (!(pJsonRequest = encode(request))) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot create request\n");
 		result = SWITCH_STATUS_FALSE;
@@ -1095,24 +998,24 @@ switch_status_t apiJoin(server_t *pServer, int hmacTokenTtl,
 	 * body.token so the audiobridge plugin's signed_tokens check (which
 	 * reads from the plugin body, not the top-level) accepts the join.
 	 */
-	if (pSignedToken) {
-		if (cJSON_AddStringToObject(request.pJsonBody, "token", pSignedToken) == NULL) {
+	if (*signedToken) {
+		if (cJSON_AddStringToObject(request.pJsonBody, "token", signedToken) == NULL) {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot create string (body.token)\n");
 			result = SWITCH_STATUS_FALSE;
 			goto done;
 		}
 	}
 
-	pJsonResponse = api_send_request(pServer, pJsonRequest, pTransactionId, serverId, senderId, URL_HANDLE, "join");
+	pJsonResponse = api_send_request(pServer, pJsonRequest, pTransactionId, serverId, senderId, "join");
 
-	if (!(pResponse = decode(pJsonResponse))) {
+	if (eventDecode(pJsonResponse, &response) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response\n");
 		result = SWITCH_STATUS_FALSE;
 		goto done;
 	}
 
-	if (!pResponse->pType || strcmp("ack", pResponse->pType) ||
-			!pResponse->pTransactionId || strcmp(pTransactionId, pResponse->pTransactionId)) {
+	if (response.type != JANUS_EVENT_ACK ||
+			!response.pTransactionId || strcmp(pTransactionId, response.pTransactionId)) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Value mismatch\n");
 		result = SWITCH_STATUS_FALSE;
     	goto done;
@@ -1121,9 +1024,7 @@ switch_status_t apiJoin(server_t *pServer, int hmacTokenTtl,
 	done:
 	cJSON_Delete(pJsonRequest);
 	cJSON_Delete(pJsonResponse);
-	switch_safe_free(pResponse);
 	switch_safe_free(pTransactionId);
-	switch_safe_free(pSignedToken);
 
   	return result;
 }
@@ -1132,7 +1033,8 @@ switch_status_t apiConfigure(server_t *pServer,
 		const janus_id_t serverId, const janus_id_t senderId, const switch_bool_t muted,
 		switch_bool_t record, const char *pRecordingFile,
 		const char *pType, const char *pSdp, const char *callId) {
-	message_t request, *pResponse = NULL;
+	message_t request;
+	janus_event_t response;
 	switch_status_t result = SWITCH_STATUS_SUCCESS;
 
   	cJSON *pJsonRequest = NULL;
@@ -1149,7 +1051,7 @@ switch_status_t apiConfigure(server_t *pServer,
 	request.serverId = serverId;
 	request.pTransactionId = pTransactionId;
 	request.pSecret = pServer->pSecret;
-	request.pHmacSecret = pServer->pHmacSecret;
+	request.pAuthCache = pServer->pAuthCache;
 
 	request.pJsonBody = cJSON_CreateObject();
 
@@ -1194,27 +1096,7 @@ switch_status_t apiConfigure(server_t *pServer,
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "type=%s sdp=%s\n", pType, pSdp);
 
 	if (pType && pSdp) {
-		request.pJsonJsep = cJSON_CreateObject();
-		if (request.pJsonJsep == NULL) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot create jsep\n");
-			result = SWITCH_STATUS_FALSE;
-			goto done;
-		}
-
-		if (cJSON_AddStringToObject(request.pJsonJsep, "type", pType) == NULL) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot create string (jsep.type)\n");
-			result = SWITCH_STATUS_FALSE;
-			goto done;
-		}
-
-		if (cJSON_AddFalseToObject(request.pJsonJsep, "trickle") == NULL) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot create string (jsep.trickle)\n");
-			result = SWITCH_STATUS_FALSE;
-			goto done;
-		}
-
-		if (cJSON_AddStringToObject(request.pJsonJsep, "sdp", pSdp) == NULL) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot create string (jsep.sdp)\n");
+		if (api_add_jsep(&request, pType, pSdp) != SWITCH_STATUS_SUCCESS) {
 			result = SWITCH_STATUS_FALSE;
 			goto done;
 		}
@@ -1226,16 +1108,16 @@ switch_status_t apiConfigure(server_t *pServer,
     	goto done;
   	}
 
-	pJsonResponse = api_send_request(pServer, pJsonRequest, pTransactionId, serverId, senderId, URL_HANDLE, "configure");
+	pJsonResponse = api_send_request(pServer, pJsonRequest, pTransactionId, serverId, senderId, "configure");
 
-	if (!(pResponse = decode(pJsonResponse))) {
+	if (eventDecode(pJsonResponse, &response) != SWITCH_STATUS_SUCCESS) {
     	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response\n");
 		result = SWITCH_STATUS_FALSE;
     	goto done;
   	}
 
-	if (!pResponse->pType || strcmp("ack", pResponse->pType) ||
-			!pResponse->pTransactionId || strcmp(pTransactionId, pResponse->pTransactionId)) {
+	if (response.type != JANUS_EVENT_ACK ||
+			!response.pTransactionId || strcmp(pTransactionId, response.pTransactionId)) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Value mismatch\n");
 		result = SWITCH_STATUS_FALSE;
     	goto done;
@@ -1244,14 +1126,14 @@ switch_status_t apiConfigure(server_t *pServer,
 	done:
 	cJSON_Delete(pJsonRequest);
 	cJSON_Delete(pJsonResponse);
-	switch_safe_free(pResponse);
 	switch_safe_free(pTransactionId);
 
   	return result;
 }
 
 switch_status_t apiLeave(server_t *pServer, const janus_id_t serverId, const janus_id_t senderId, const char *callId) {
-	message_t request, *pResponse = NULL;
+	message_t request;
+	janus_event_t response;
 	switch_status_t result = SWITCH_STATUS_SUCCESS;
 
   	cJSON *pJsonRequest = NULL;
@@ -1268,7 +1150,7 @@ switch_status_t apiLeave(server_t *pServer, const janus_id_t serverId, const jan
 	request.serverId = serverId;
 	request.pTransactionId = pTransactionId;
 	request.pSecret = pServer->pSecret;
-	request.pHmacSecret = pServer->pHmacSecret;
+	request.pAuthCache = pServer->pAuthCache;
 
 	request.pJsonBody = cJSON_CreateObject();
 	if (request.pJsonBody == NULL) {
@@ -1296,16 +1178,16 @@ switch_status_t apiLeave(server_t *pServer, const janus_id_t serverId, const jan
 		goto done;
 	}
 
-	pJsonResponse = api_send_request(pServer, pJsonRequest, pTransactionId, serverId, senderId, URL_HANDLE, "leave");
+	pJsonResponse = api_send_request(pServer, pJsonRequest, pTransactionId, serverId, senderId, "leave");
 
-	if (!(pResponse = decode(pJsonResponse))) {
+	if (eventDecode(pJsonResponse, &response) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response\n");
 		result = SWITCH_STATUS_FALSE;
 		goto done;
 	}
 
-	if (!pResponse->pType || strcmp("ack", pResponse->pType) ||
-			!pResponse->pTransactionId || strcmp(pTransactionId, pResponse->pTransactionId)) {
+	if (response.type != JANUS_EVENT_ACK ||
+			!response.pTransactionId || strcmp(pTransactionId, response.pTransactionId)) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Value mismatch\n");
 		result = SWITCH_STATUS_FALSE;
     	goto done;
@@ -1314,14 +1196,14 @@ switch_status_t apiLeave(server_t *pServer, const janus_id_t serverId, const jan
 	done:
 	cJSON_Delete(pJsonRequest);
   	cJSON_Delete(pJsonResponse);
-	switch_safe_free(pResponse);
 	switch_safe_free(pTransactionId);
 
 	return result;
 }
 
 switch_status_t apiDetach(server_t *pServer, const janus_id_t serverId, const janus_id_t senderId) {
-	message_t request, *pResponse = NULL;
+	message_t request;
+	janus_event_t response;
 	switch_status_t result = SWITCH_STATUS_SUCCESS;
 
   	cJSON *pJsonRequest = NULL;
@@ -1336,7 +1218,7 @@ switch_status_t apiDetach(server_t *pServer, const janus_id_t serverId, const ja
 	request.serverId = serverId;
 	request.pTransactionId = pTransactionId;
 	request.pSecret = pServer->pSecret;
-	request.pHmacSecret = pServer->pHmacSecret;
+	request.pAuthCache = pServer->pAuthCache;
 
 	if (!(pJsonRequest = encode(request))) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot create request\n");
@@ -1344,15 +1226,17 @@ switch_status_t apiDetach(server_t *pServer, const janus_id_t serverId, const ja
 		goto done;
 	}
 
-	pJsonResponse = api_send_request(pServer, pJsonRequest, pTransactionId, serverId, senderId, URL_HANDLE, "detach");
+	pJsonResponse = api_send_request(pServer, pJsonRequest, pTransactionId, serverId, senderId, "detach");
 
-	if (!(pResponse = decode(pJsonResponse))) {
+	if (eventDecode(pJsonResponse, &response) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response\n");
+		// no answer at all is worth retrying
+		result = pJsonResponse ? SWITCH_STATUS_FALSE : SWITCH_STATUS_SOCKERR;
 		goto done;
 	}
 
-	if (!pResponse->pType || strcmp("success", pResponse->pType) ||
-			!pResponse->pTransactionId || strcmp(pTransactionId, pResponse->pTransactionId)) {
+	if (response.type != JANUS_EVENT_SUCCESS ||
+			!response.pTransactionId || strcmp(pTransactionId, response.pTransactionId)) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Value mismatch\n");
 		result = SWITCH_STATUS_FALSE;
     	goto done;
@@ -1361,106 +1245,36 @@ switch_status_t apiDetach(server_t *pServer, const janus_id_t serverId, const ja
 	done:
 	cJSON_Delete(pJsonRequest);
 	cJSON_Delete(pJsonResponse);
-	switch_safe_free(pResponse);
 	switch_safe_free(pTransactionId);
 
   	return result;
 }
 
-switch_status_t apiPoll(server_t *pServer, const janus_id_t serverId,
+switch_status_t apiPoll(server_t *pServer, const janus_id_t serverId, const switch_bool_t block,
 	switch_status_t (*pJoinedFunc)(const janus_id_t serverId, const janus_id_t senderId, const janus_id_t roomId, const janus_id_t participantId),
 	switch_status_t (*pAcceptedFunc)(const janus_id_t serverId, const janus_id_t senderId, const char *pSdp),
 	switch_status_t (*pTrickleFunc)(const janus_id_t serverId, const janus_id_t senderId, const char *pCandidate),
 	switch_bool_t (*pAnswerOnWebrtcupFunc)(const janus_id_t serverId, const janus_id_t senderId),
 	switch_status_t (*pAnsweredFunc)(const janus_id_t serverId, const janus_id_t senderId),
 	switch_status_t (*pHungupFunc)(const janus_id_t serverId, const janus_id_t senderId, const char *pReason),
+	switch_status_t (*pRoomGoneFunc)(const janus_id_t serverId, const janus_id_t senderId),
 	api_participant_func_t pParticipantFunc)
 {
-	switch_status_t result = SWITCH_STATUS_SUCCESS;
-
-	cJSON *pJsonResponse = NULL;
-	cJSON *pEvent;
-
-	char *pSignedToken = NULL;
-	const char *pAuthToken;
-	char url[1024];
+	api_dispatch_t dispatch;
 
 	switch_assert(pServer);
-	switch_assert(pServer->pUrl);
-
-#if defined(HAVE_MOD_JANUS_WS)
-	if (pServer->transport == JANUS_TP_WS) {
-		return janus_ws_pump_once(pServer, serverId,
-			(switch_interval_time_t)HTTP_GET_TIMEOUT * 1000,
-			(switch_interval_time_t)(25 * 1000000),
-			&pServer->ws_last_poll,
-			pJoinedFunc, pAcceptedFunc, pTrickleFunc, pAnswerOnWebrtcupFunc, pAnsweredFunc, pHungupFunc, pParticipantFunc);
-	}
-#endif
-
-	if (snprintf(url, sizeof(url), "%s/%" SWITCH_UINT64_T_FMT "?maxev=%d", pServer->pUrl, serverId, MAX_POLL_EVENTS) < 0) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Could not generate URL\n");
-		result = SWITCH_STATUS_FALSE;
-		goto done;
-	}
-
-	if (pServer->pSecret) {
-		size_t len = strlen(url);
-		if (snprintf(&url[len], sizeof(url) - len, "&apisecret=%s", pServer->pSecret) < 0) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Could not generate secret\n");
-			result = SWITCH_STATUS_FALSE;
-			goto done;
-		}
-	}
-
-	/*
-	 * In signed-mode, every request (including long-poll GETs) needs a
-	 * fresh signed token since old ones can expire mid-session. The
-	 * lifecycle TTL is short on purpose — we regenerate per poll cycle, so
-	 * leaking a URL to logs only exposes a 5-minute window.
-	 */
-	pAuthToken = pServer->pAuthToken;
-	if (pServer->pHmacSecret) {
-		const char *pDescriptors[1] = { JANUS_PLUGIN };
-		pSignedToken = authSignToken(pServer->pHmacSecret, API_HMAC_DEFAULT_LIFECYCLE_TTL, pDescriptors, 1);
-		if (!pSignedToken) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot sign poll token\n");
-			result = SWITCH_STATUS_FALSE;
-			goto done;
-		}
-		pAuthToken = pSignedToken; /* overrides any stored-mode token */
-	}
-
-	if (pAuthToken) {
-		size_t len = strlen(url);
-		if (snprintf(&url[len], sizeof(url) - len, "&token=%s", pAuthToken) < 0) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Could not generate token\n");
-			result = SWITCH_STATUS_FALSE;
-			goto done;
-		}
-	}
-
-	MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Sending HTTP request - url=%s\n", url);
-	pJsonResponse = httpGet(url, HTTP_GET_TIMEOUT);
-
-	if (pJsonResponse == NULL) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response\n");
-		result = SWITCH_STATUS_FALSE;
-		goto done;
-	}
-
-	pEvent = pJsonResponse ? pJsonResponse->child : NULL;
-	while (pEvent) {
-		cJSON *next = pEvent->next;
-		(void) api_dispatch_poll_event(pEvent, pJoinedFunc, pAcceptedFunc, pTrickleFunc, pAnswerOnWebrtcupFunc, pAnsweredFunc, pHungupFunc, pParticipantFunc);
-		pEvent = next;
-	}
-
-done:
-	cJSON_Delete(pJsonResponse);
-	switch_safe_free(pSignedToken);
-
-	return result;
+	switch_assert(pServer->pTransport);
+
+	dispatch.joined             = pJoinedFunc;
+	dispatch.accepted           = pAcceptedFunc;
+	dispatch.trickle            = pTrickleFunc;
+	dispatch.answer_on_webrtcup = pAnswerOnWebrtcupFunc;
+	dispatch.answered           = pAnsweredFunc;
+	dispatch.hungup             = pHungupFunc;
+	dispatch.room_gone          = pRoomGoneFunc;
+	dispatch.participant        = pParticipantFunc;
+
+	return pServer->pTransport->poll(pServer, serverId, block, &dispatch);
 }
 /* For Emacs:
  * Local Variables:
@@ -48,10 +48,28 @@
 #define API_HMAC_DEFAULT_CALL_TTL     7200 /* 2 hours */
 #define API_HMAC_DEFAULT_LIFECYCLE_TTL 300 /* 5 minutes */
 
+// the plugin every request is for, and the descriptor every signed token carries
+#define JANUS_PLUGIN "janus.plugin.audiobridge"
+// the audiobridge error for a request to a room it doesn't have
+#define JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM 485
+
 /* Reports each audiobridge participant; isSelf marks the local leg's own id, setup is TRUE once the peer's PeerConnection is up. */
 typedef switch_status_t (*api_participant_func_t)(const janus_id_t serverId, const janus_id_t senderId,
 	const char *pParticipantIdStr, const switch_bool_t isSelf, const switch_bool_t setup);
 
+/* The set of event callbacks, as handed to the dispatch stage. */
+typedef struct {
+	switch_status_t (*joined)(const janus_id_t, const janus_id_t, const janus_id_t, const janus_id_t);
+	switch_status_t (*accepted)(const janus_id_t, const janus_id_t, const char *);
+	switch_status_t (*trickle)(const janus_id_t, const janus_id_t, const char *);
+	switch_bool_t   (*answer_on_webrtcup)(const janus_id_t, const janus_id_t);
+	switch_status_t (*answered)(const janus_id_t, const janus_id_t);
+	switch_status_t (*hungup)(const janus_id_t, const janus_id_t, const char *);
+	// SWITCH_STATUS_SUCCESS if the call is joining the room again, otherwise it is hung up
+	switch_status_t (*room_gone)(const janus_id_t, const janus_id_t);
+	api_participant_func_t participant;
+} api_dispatch_t;
+
 /* Dispatch one Janus event object (HTTP long-poll element or WebSocket text frame). */
 switch_status_t api_dispatch_poll_event(cJSON *pEvent,
 	switch_status_t (*pJoinedFunc)(const janus_id_t serverId, const janus_id_t senderId, const janus_id_t roomId, const janus_id_t participantId),
@@ -60,7 +78,9 @@ switch_status_t api_dispatch_poll_event(cJSON *pEvent,
 	switch_bool_t (*pAnswerOnWebrtcupFunc)(const janus_id_t serverId, const janus_id_t senderId),
 	switch_status_t (*pAnsweredFunc)(const janus_id_t serverId, const janus_id_t senderId),
 	switch_status_t (*pHungupFunc)(const janus_id_t serverId, const janus_id_t senderId, const char *pReason),
+	switch_status_t (*pRoomGoneFunc)(const janus_id_t serverId, const janus_id_t senderId),
 	api_participant_func_t pParticipantFunc);
+switch_status_t api_dispatch_event(cJSON *pEvent, const api_dispatch_t *pDispatch);
 
 janus_id_t apiGetServerId(server_t *pServer);
 switch_status_t apiClaimServerId(server_t *pServer, janus_id_t serverId);
@@ -71,20 +91,23 @@ janus_id_t apiCreateRoom(server_t *pServer, const janus_id_t serverId,
 	switch_bool_t allow_ws_participants, const char *pRoomIdStr);
 switch_status_t apiJoin(server_t *pServer, int hmacTokenTtl,
 	const janus_id_t serverId, const janus_id_t senderId, const janus_id_t roomId,
-	const char *pDisplay, const char *pPin, const char *pToken, const char *callId, const char *pRoomIdStr);
+	const char *pDisplay, const char *pPin, const char *pToken, const char *callId, const char *pRoomIdStr,
+	const switch_bool_t muted, switch_bool_t record, const char *pRecordingFile, const char *pSdp);
 switch_status_t apiConfigure(server_t *pServer,
 	const janus_id_t serverId, const janus_id_t senderId, const switch_bool_t muted,
 	switch_bool_t record, const char *pRecordingFile,
 	const char *pType, const char *pSdp, const char *callId);
 switch_status_t apiLeave(server_t *pServer, const janus_id_t serverId, const janus_id_t senderId, const char *callId);
 switch_status_t apiDetach(server_t *pServer, const janus_id_t serverId, const janus_id_t senderId);
-switch_status_t apiPoll(server_t *pServer, const janus_id_t serverId,
+// with block set waits a while for events, otherwise only handles those already received
+switch_status_t apiPoll(server_t *pServer, const janus_id_t serverId, const switch_bool_t block,
 	switch_status_t (*pJoinedFunc)(const janus_id_t serverId, const janus_id_t senderId, const janus_id_t roomId, const janus_id_t participantId),
 	switch_status_t (*pAcceptedFunc)(const janus_id_t serverId, const janus_id_t senderId, const char *pSdp),
 	switch_status_t (*pTrickleFunc)(const janus_id_t serverId, const janus_id_t senderId, const char *pCandidate),
 	switch_bool_t (*pAnswerOnWebrtcupFunc)(const janus_id_t serverId, const janus_id_t senderId),
 	switch_status_t (*pAnsweredFunc)(const janus_id_t serverId, const janus_id_t senderId),
 	switch_status_t (*pHungupFunc)(const janus_id_t serverId, const janus_id_t senderId, const char *pReason),
+	switch_status_t (*pRoomGoneFunc)(const janus_id_t serverId, const janus_id_t senderId),
 	api_participant_func_t pParticipantFunc);
 
 #endif //_API_H_
@@ -33,14 +33,46 @@
 #include  <stdio.h>
 #include  <time.h>
 
+/*
+ * authSign() keeps the SHA1 state of the prepared key pads and copies it
+ * for each token, which needs the plain (3.0 deprecated) SHA1 interface -
+ * EVP contexts can only be copied into a freshly allocated one.
+ */
+#define OPENSSL_SUPPRESS_DEPRECATED
+
 #include  <openssl/hmac.h>
 #include  <openssl/evp.h>
+#include  <openssl/sha.h>
 
 #include  "switch.h"
 #include  "globals.h"
 #include  "auth.h"
 
 #define AUTH_REALM "janus"
+#define AUTH_SHA1_BLOCK 64
+
+/* expired tokens are swept out of a cache after this many have been signed */
+#define AUTH_CACHE_PRUNE_INTERVAL 256
+
+struct auth_ctx_s {
+	SHA_CTX inner; /* after hashing key ^ ipad */
+	SHA_CTX outer; /* after hashing key ^ opad */
+};
+
+typedef struct {
+	time_t refresh; /* re-sign from this time on */
+	time_t expires;
+	switch_bool_t signing; /* a caller is re-signing it */
+	char token[AUTH_TOKEN_MAX];
+} auth_cache_entry_t;
+
+struct auth_cache_s {
+	const auth_ctx_t *pCtx;
+	unsigned int refreshPercent;
+	switch_mutex_t *pMutex;
+	switch_hash_t *pTokens; /* "<ttl>|<desc>,<desc>..." -> auth_cache_entry_t */
+	unsigned int signs;
+};
 
 char *authSignToken(const char *pSecret, int ttlSeconds,
 		const char *const *ppDescriptors, int ndesc) {
@@ -150,6 +182,247 @@ fail:
 	return NULL;
 }
 
+auth_ctx_t *authCreate(switch_memory_pool_t *pPool, const char *pSecret) {
+	unsigned char key[AUTH_SHA1_BLOCK];
+	unsigned char pad[AUTH_SHA1_BLOCK];
+	size_t keyLen;
+	auth_ctx_t *pCtx;
+	int i;
+
+	if (!pPool || !pSecret || !*pSecret) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
+				"authCreate: invalid arguments (secret=%s)\n", pSecret ? "set" : "null");
+		return NULL;
+	}
+
+	/* RFC 2104: keys longer than the block are hashed first, shorter ones zero padded. */
+	memset(key, 0, sizeof(key));
+	keyLen = strlen(pSecret);
+	if (keyLen > sizeof(key)) {
+		SHA1((const unsigned char *) pSecret, keyLen, key);
+	} else {
+		memcpy(key, pSecret, keyLen);
+	}
+
+	if (!(pCtx = switch_core_alloc(pPool, sizeof(*pCtx)))) {
+		return NULL;
+	}
+
+	for (i = 0; i < AUTH_SHA1_BLOCK; i++) {
+		pad[i] = key[i] ^ 0x36;
+	}
+	SHA1_Init(&pCtx->inner);
+	SHA1_Update(&pCtx->inner, pad, sizeof(pad));
+
+	for (i = 0; i < AUTH_SHA1_BLOCK; i++) {
+		pad[i] = key[i] ^ 0x5c;
+	}
+	SHA1_Init(&pCtx->outer);
+	SHA1_Update(&pCtx->outer, pad, sizeof(pad));
+
+	OPENSSL_cleanse(key, sizeof(key));
+	OPENSSL_cleanse(pad, sizeof(pad));
+
+	return pCtx;
+}
+
+int authSign(const auth_ctx_t *pCtx, int ttlSeconds,
+		const char *const *ppDescriptors, int ndesc, char *pBuf, size_t size) {
+	unsigned char sig[SHA_DIGEST_LENGTH];
+	char digits[24];
+	SHA_CTX sha;
+	size_t len = 0, n;
+	long long expiry;
+	int d = 0;
+	int i;
+
+	if (!pCtx || ttlSeconds <= 0 || !pBuf) {
+		return -1;
+	}
+
+	/* Data part: "<expiry>,janus[,desc1,desc2...]" */
+	expiry = (long long) time(NULL) + (long long) ttlSeconds;
+	do {
+		digits[d++] = (char) ('0' + expiry % 10);
+		expiry /= 10;
+	} while (expiry > 0 && d < (int) sizeof(digits));
+	if ((size_t) d + 1 + strlen(AUTH_REALM) >= size) {
+		return -1;
+	}
+	while (d > 0) {
+		pBuf[len++] = digits[--d];
+	}
+	pBuf[len++] = ',';
+	memcpy(pBuf + len, AUTH_REALM, strlen(AUTH_REALM));
+	len += strlen(AUTH_REALM);
+
+	for (i = 0; i < ndesc; i++) {
+		if (!ppDescriptors || !ppDescriptors[i] || !*ppDescriptors[i]) {
+			continue;
+		}
+		n = strlen(ppDescriptors[i]);
+		if (len + 1 + n >= size) {
+			return -1;
+		}
+		pBuf[len++] = ',';
+		memcpy(pBuf + len, ppDescriptors[i], n);
+		len += n;
+	}
+
+	/* ':' + unpadded-length base64 of the 20 byte digest + NUL */
+	if (len + 1 + 4 * ((SHA_DIGEST_LENGTH + 2) / 3) + 1 > size) {
+		return -1;
+	}
+
+	/* HMAC-SHA1 = H(key ^ opad || H(key ^ ipad || data)) from the prepared pad states. */
+	sha = pCtx->inner;
+	SHA1_Update(&sha, pBuf, len);
+	SHA1_Final(sig, &sha);
+	sha = pCtx->outer;
+	SHA1_Update(&sha, sig, sizeof(sig));
+	SHA1_Final(sig, &sha);
+
+	pBuf[len++] = ':';
+	/* EVP_EncodeBlock writes padded base64 and the terminating NUL */
+	n = (size_t) EVP_EncodeBlock((unsigned char *) pBuf + len, sig, (int) sizeof(sig));
+	len += n;
+
+	return (int) len;
+}
+
+auth_cache_t *authCacheCreate(switch_memory_pool_t *pPool, const auth_ctx_t *pCtx, unsigned int refreshPercent) {
+	auth_cache_t *pCache;
+
+	if (!pPool || !pCtx) {
+		return NULL;
+	}
+
+	if (!(pCache = switch_core_alloc(pPool, sizeof(*pCache)))) {
+		return NULL;
+	}
+	pCache->pCtx = pCtx;
+	pCache->refreshPercent = refreshPercent > AUTH_CACHE_MAX_REFRESH ? AUTH_CACHE_MAX_REFRESH : refreshPercent;
+
+	if (switch_mutex_init(&pCache->pMutex, SWITCH_MUTEX_NESTED, pPool) != SWITCH_STATUS_SUCCESS ||
+			switch_core_hash_init(&pCache->pTokens) != SWITCH_STATUS_SUCCESS) {
+		return NULL;
+	}
+
+	return pCache;
+}
+
+static switch_bool_t authCacheRemoveAll(const void *pKey, const void *pVal, void *pData) {
+	free((void *) pVal);
+	return SWITCH_TRUE;
+}
+
+static switch_bool_t authCacheRemoveExpired(const void *pKey, const void *pVal, void *pData) {
+	const auth_cache_entry_t *pEntry = (const auth_cache_entry_t *) pVal;
+
+	if (pEntry->signing || pEntry->expires > *(const time_t *) pData) {
+		return SWITCH_FALSE;
+	}
+	free((void *) pVal);
+	return SWITCH_TRUE;
+}
+
+int authCacheSign(auth_cache_t *pCache, int ttlSeconds,
+		const char *const *ppDescriptors, int ndesc, char *pBuf, size_t size) {
+	char key[AUTH_TOKEN_MAX];
+	char token[AUTH_TOKEN_MAX];
+	auth_cache_entry_t *pEntry;
+	time_t now;
+	size_t len;
+	int tokenLen;
+	int i;
+
+	if (!pCache || ttlSeconds <= 0 || !pBuf) {
+		return -1;
+	}
+
+	if (!pCache->refreshPercent) {
+		return authSign(pCache->pCtx, ttlSeconds, ppDescriptors, ndesc, pBuf, size);
+	}
+
+	len = (size_t) snprintf(key, sizeof(key), "%d|", ttlSeconds);
+	for (i = 0; i < ndesc; i++) {
+		size_t n;
+
+		if (!ppDescriptors || !ppDescriptors[i] || !*ppDescriptors[i]) {
+			continue;
+		}
+		n = strlen(ppDescriptors[i]);
+		if (len + n + 2 > sizeof(key)) {
+			return -1;
+		}
+		memcpy(key + len, ppDescriptors[i], n);
+		len += n;
+		key[len++] = ',';
+	}
+	key[len] = '\0';
+
+	now = time(NULL);
+
+	switch_mutex_lock(pCache->pMutex);
+	pEntry = (auth_cache_entry_t *) switch_core_hash_find(pCache->pTokens, key);
+	if (pEntry && pEntry->expires > now && (pEntry->refresh > now || pEntry->signing)) {
+		/* still fresh, or past its refresh point with another caller re-signing it */
+		tokenLen = (int) strlen(pEntry->token);
+		if ((size_t) tokenLen >= size) {
+			tokenLen = -1;
+		} else {
+			memcpy(pBuf, pEntry->token, (size_t) tokenLen + 1);
+		}
+		switch_mutex_unlock(pCache->pMutex);
+		return tokenLen;
+	}
+	if (pEntry) {
+		pEntry->signing = SWITCH_TRUE;
+	}
+	switch_mutex_unlock(pCache->pMutex);
+
+	tokenLen = authSign(pCache->pCtx, ttlSeconds, ppDescriptors, ndesc, token, sizeof(token));
+
+	switch_mutex_lock(pCache->pMutex);
+	if (!(pEntry = (auth_cache_entry_t *) switch_core_hash_find(pCache->pTokens, key))) {
+		switch_zmalloc(pEntry, sizeof(*pEntry));
+		(void) switch_core_hash_insert(pCache->pTokens, key, pEntry);
+	}
+	pEntry->signing = SWITCH_FALSE;
+	if (tokenLen > 0) {
+		memcpy(pEntry->token, token, (size_t) tokenLen + 1);
+		pEntry->expires = now + ttlSeconds;
+		pEntry->refresh = now + (time_t) ((long long) ttlSeconds * pCache->refreshPercent / 100);
+		/* re-sign while the token still has some life left, so a request
+		 * sent just before the refresh point doesn't reach Janus expired */
+		if (pEntry->refresh > pEntry->expires - AUTH_CACHE_MIN_MARGIN) {
+			pEntry->refresh = pEntry->expires - AUTH_CACHE_MIN_MARGIN;
+		}
+	}
+	if (!(++ pCache->signs % AUTH_CACHE_PRUNE_INTERVAL)) {
+		(void) switch_core_hash_delete_multi(pCache->pTokens, authCacheRemoveExpired, &now);
+	}
+	switch_mutex_unlock(pCache->pMutex);
+
+	if (tokenLen < 0 || (size_t) tokenLen >= size) {
+		return -1;
+	}
+	memcpy(pBuf, token, (size_t) tokenLen + 1);
+
+	return tokenLen;
+}
+
+void authCacheDestroy(auth_cache_t *pCache) {
+	if (!pCache) {
+		return;
+	}
+
+	switch_mutex_lock(pCache->pMutex);
+	(void) switch_core_hash_delete_multi(pCache->pTokens, authCacheRemoveAll, NULL);
+	switch_core_hash_destroy(&pCache->pTokens);
+	switch_mutex_unlock(pCache->pMutex);
+}
+
 /* For Emacs:
  * Local Variables:
  * mode:c
@@ -55,6 +55,84 @@
 char *authSignToken(const char *pSecret, int ttlSeconds,
 		const char *const *ppDescriptors, int ndesc);
 
+/*! Room for a token signed by authSign() with a handful of descriptors. */
+#define AUTH_TOKEN_MAX 512
+
+/*! \brief Signing context for one HMAC key.
+ *
+ * Holds the SHA1 state after the inner and outer key pads have been hashed,
+ * so signing a token only hashes the data part and the inner digest. The
+ * context is never modified after authCreate() and may be shared by any
+ * number of threads.
+ */
+typedef struct auth_ctx_s auth_ctx_t;
+
+/*! \brief Prepare a signing context for pSecret.
+ *
+ * \param pPool    Pool the context is allocated from; it lives as long as
+ *                 the pool.
+ * \param pSecret  NUL-terminated HMAC key. Must be non-NULL and non-empty.
+ *
+ * \returns The context, or NULL on failure.
+ */
+auth_ctx_t *authCreate(switch_memory_pool_t *pPool, const char *pSecret);
+
+/*! \brief Generate a Janus HMAC-SHA1 signed token without allocating.
+ *
+ * Produces the same token as authSignToken() for the context's key.
+ *
+ * \param pCtx         Context from authCreate().
+ * \param ttlSeconds   Token lifetime in seconds from now. Must be > 0.
+ * \param ppDescriptors, ndesc  As for authSignToken().
+ * \param pBuf         Receives the NUL-terminated token.
+ * \param size         Size of pBuf; AUTH_TOKEN_MAX is enough for the
+ *                     plugin package and a room descriptor.
+ *
+ * \returns The length of the token, or -1 if it doesn't fit or on failure.
+ */
+int authSign(const auth_ctx_t *pCtx, int ttlSeconds,
+		const char *const *ppDescriptors, int ndesc, char *pBuf, size_t size);
+
+/*! Default share of a cached token's lifetime after which it is re-signed. */
+#define AUTH_CACHE_DEFAULT_REFRESH 50
+
+/*! Largest refresh share; a token is never reused into its last tenth. */
+#define AUTH_CACHE_MAX_REFRESH 90
+
+/*! Seconds of lifetime a reused token is always left with, whatever the share. */
+#define AUTH_CACHE_MIN_MARGIN 10
+
+/*! \brief Cache of signed tokens, one per TTL and descriptor set.
+ *
+ * A token is handed out again until refreshPercent of its lifetime has
+ * passed. The first caller to find it past that point signs a new one
+ * while the others keep using the old token, which still has the rest of
+ * its lifetime to run. Safe to use from any number of threads.
+ */
+typedef struct auth_cache_s auth_cache_t;
+
+/*! \brief Create a token cache signing with pCtx.
+ *
+ * \param pPool           Pool the cache is allocated from.
+ * \param pCtx            Signing context from authCreate().
+ * \param refreshPercent  Share (1-90) of a token's lifetime it is reused
+ *                        for, less AUTH_CACHE_MIN_MARGIN seconds; 0 signs
+ *                        a new token every time.
+ *
+ * \returns The cache, or NULL on failure.
+ */
+auth_cache_t *authCacheCreate(switch_memory_pool_t *pPool, const auth_ctx_t *pCtx, unsigned int refreshPercent);
+
+/*! \brief Copy a token for the descriptors into pBuf, signing one if needed.
+ *
+ * Takes the same arguments and returns the same as authSign().
+ */
+int authCacheSign(auth_cache_t *pCache, int ttlSeconds,
+		const char *const *ppDescriptors, int ndesc, char *pBuf, size_t size);
+
+/*! \brief Drop the cached tokens, e.g. to release the keys they were signed with. */
+void authCacheDestroy(auth_cache_t *pCache);
+
 #endif /* _AUTH_H_ */
 /* For Emacs:
  * Local Variables:
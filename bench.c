@@ -0,0 +1,1729 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ * bench.c -- Microbenchmarks for janus endpoint module
+ *
+ * Run from the console (janus bench ...) against the code that is loaded,
+ * so they measure the module as built rather than a test harness
+ *
+ */
+#include  "switch.h"
+
+#if defined(__linux__)
+#include  <netinet/in.h>
+#include  <poll.h>
+#include  <sys/socket.h>
+#include  <sys/un.h>
+#include  <unistd.h>
+#endif
+
+#include  <openssl/evp.h>
+#include  <openssl/sha.h>
+
+#include  "globals.h"
+#include  "hash.h"
+#include  "auth.h"
+#include  "registry.h"
+#include  "http.h"
+#include  "transport.h"
+#include  "janus_http.h"
+#include  "janus_unix.h"
+#include  "janus_ws.h"
+#include  "api.h"
+#include  "event.h"
+#include  "bench.h"
+
+#define BENCH_READERS 4
+
+typedef struct bench_hash_ops_s bench_hash_ops_t;
+
+typedef struct {
+	const bench_hash_ops_t *pOps;
+	void *pTable;
+	const janus_id_t *pIds;
+	uint32_t count;
+	uint32_t found;
+} bench_reader_t;
+
+struct bench_hash_ops_s {
+	const char *name;
+	void *(*create)(switch_memory_pool_t *pPool);
+	void (*insert)(void *pTable, const janus_id_t id, void *pData);
+	void *(*find)(void *pTable, const janus_id_t id);
+	void (*delete)(void *pTable, const janus_id_t id);
+	void (*destroy)(void *pTable);
+};
+
+// the native table
+static void *nativeCreate(switch_memory_pool_t *pPool) {
+	hash_t *pHash = switch_core_alloc(pPool, sizeof(*pHash));
+	return hashCreate(pHash, pPool) == SWITCH_STATUS_SUCCESS ? pHash : NULL;
+}
+
+static void nativeInsert(void *pTable, const janus_id_t id, void *pData) {
+	(void) hashInsert((hash_t *) pTable, id, pData);
+}
+
+static void *nativeFind(void *pTable, const janus_id_t id) {
+	return hashFind((hash_t *) pTable, id);
+}
+
+static void nativeDelete(void *pTable, const janus_id_t id) {
+	(void) hashDelete((hash_t *) pTable, id);
+}
+
+static void nativeDestroy(void *pTable) {
+	(void) hashDestroy((hash_t *) pTable);
+}
+
+// the string keyed core hash (as hash.c used to be) for comparison
+typedef struct {
+	switch_mutex_t *pMutex;
+	switch_hash_t *pTable;
+} bench_core_hash_t;
+
+static void *coreCreate(switch_memory_pool_t *pPool) {
+	bench_core_hash_t *pHash = switch_core_alloc(pPool, sizeof(*pHash));
+	switch_mutex_init(&pHash->pMutex, SWITCH_MUTEX_NESTED, pPool);
+	return switch_core_hash_init(&pHash->pTable) == SWITCH_STATUS_SUCCESS ? pHash : NULL;
+}
+
+static void coreInsert(void *pTable, const janus_id_t id, void *pData) {
+	bench_core_hash_t *pHash = (bench_core_hash_t *) pTable;
+	char *pIdStr = switch_mprintf("%" SWITCH_UINT64_T_FMT, id);
+	(void) switch_core_hash_insert_locked(pHash->pTable, pIdStr, pData, pHash->pMutex);
+	switch_safe_free(pIdStr);
+}
+
+static void *coreFind(void *pTable, const janus_id_t id) {
+	bench_core_hash_t *pHash = (bench_core_hash_t *) pTable;
+	char *pIdStr = switch_mprintf("%" SWITCH_UINT64_T_FMT, id);
+	void *pResult = switch_core_hash_find_locked(pHash->pTable, pIdStr, pHash->pMutex);
+	switch_safe_free(pIdStr);
+	return pResult;
+}
+
+static void coreDelete(void *pTable, const janus_id_t id) {
+	bench_core_hash_t *pHash = (bench_core_hash_t *) pTable;
+	char *pIdStr = switch_mprintf("%" SWITCH_UINT64_T_FMT, id);
+	(void) switch_core_hash_delete_locked(pHash->pTable, pIdStr, pHash->pMutex);
+	switch_safe_free(pIdStr);
+}
+
+static void coreDestroy(void *pTable) {
+	bench_core_hash_t *pHash = (bench_core_hash_t *) pTable;
+	(void) switch_core_hash_destroy(&pHash->pTable);
+	(void) switch_mutex_destroy(pHash->pMutex);
+}
+
+static const bench_hash_ops_t hashImpls[] = {
+	{ "core", coreCreate, coreInsert, coreFind, coreDelete, coreDestroy },
+	{ "native", nativeCreate, nativeInsert, nativeFind, nativeDelete, nativeDestroy },
+};
+
+// non-zero pseudo random ids, repeatable for a given seed
+static void fillIds(janus_id_t *pIds, const uint32_t count, uint64_t seed) {
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		pIds[i] = seed | 1;
+	}
+}
+
+static void *SWITCH_THREAD_FUNC bench_reader_run(switch_thread_t *pThread, void *pObj) {
+	bench_reader_t *pReader = (bench_reader_t *) pObj;
+	uint32_t i;
+
+	(void) pThread;
+
+	for (i = 0; i < pReader->count; i++) {
+		if (pReader->pOps->find(pReader->pTable, pReader->pIds[i])) {
+			pReader->found++;
+		}
+	}
+
+	return NULL;
+}
+
+static double nsPerOp(const switch_time_t start, const uint64_t ops) {
+	return ops ? (double) (switch_time_now() - start) * 1000.0 / (double) ops : 0.0;
+}
+
+static void benchHashOne(switch_stream_handle_t *stream, const bench_hash_ops_t *pOps, const janus_id_t *pIds,
+		const janus_id_t *pMissIds, const uint32_t count) {
+	switch_memory_pool_t *pPool = NULL;
+	switch_thread_t *pThreads[BENCH_READERS];
+	bench_reader_t readers[BENCH_READERS];
+	switch_threadattr_t *pThreadAttr = NULL;
+	double insertNs, findNs, missNs, sharedNs, deleteNs;
+	switch_time_t start;
+	void *pTable;
+	uint32_t i, found = 0;
+
+	if (switch_core_new_memory_pool(&pPool) != SWITCH_STATUS_SUCCESS) {
+		stream->write_function(stream, "ERR Couldn't create memory pool\n");
+		return;
+	}
+
+	if (!(pTable = pOps->create(pPool))) {
+		stream->write_function(stream, "ERR Couldn't create %s table\n", pOps->name);
+		goto done;
+	}
+
+	start = switch_time_now();
+	for (i = 0; i < count; i++) {
+		pOps->insert(pTable, pIds[i], (void *) &pIds[i]);
+	}
+	insertNs = nsPerOp(start, count);
+
+	start = switch_time_now();
+	for (i = 0; i < count; i++) {
+		if (pOps->find(pTable, pIds[i])) {
+			found++;
+		}
+	}
+	findNs = nsPerOp(start, count);
+
+	start = switch_time_now();
+	for (i = 0; i < count; i++) {
+		if (pOps->find(pTable, pMissIds[i])) {
+			found--;
+		}
+	}
+	missNs = nsPerOp(start, count);
+
+	// the same lookups from several threads at once - the poll thread and
+	// dispatch workers all read the tables concurrently
+	start = switch_time_now();
+	for (i = 0; i < BENCH_READERS; i++) {
+		readers[i].pOps = pOps;
+		readers[i].pTable = pTable;
+		readers[i].pIds = pIds;
+		readers[i].count = count;
+		readers[i].found = 0;
+		switch_threadattr_create(&pThreadAttr, pPool);
+		switch_threadattr_stacksize_set(pThreadAttr, SWITCH_THREAD_STACKSIZE);
+		switch_thread_create(&pThreads[i], pThreadAttr, bench_reader_run, &readers[i], pPool);
+	}
+	for (i = 0; i < BENCH_READERS; i++) {
+		switch_status_t returnValue;
+		(void) switch_thread_join(&returnValue, pThreads[i]);
+	}
+	sharedNs = nsPerOp(start, (uint64_t) count * BENCH_READERS);
+
+	start = switch_time_now();
+	for (i = 0; i < count; i++) {
+		pOps->delete(pTable, pIds[i]);
+	}
+	deleteNs = nsPerOp(start, count);
+
+	pOps->destroy(pTable);
+
+	stream->write_function(stream, "%s|%u|%.1f|%.1f|%.1f|%.1f|%.1f|%s\n", pOps->name, count,
+		insertNs, findNs, missNs, sharedNs, deleteNs, found == count ? "ok" : "MISMATCH");
+
+done:
+	switch_core_destroy_memory_pool(&pPool);
+}
+
+static switch_status_t benchHash(switch_stream_handle_t *stream, const uint32_t entries) {
+	static const uint32_t defaultSizes[] = { 10000, 100000, 1000000 };
+	const uint32_t *pSizes = entries ? &entries : defaultSizes;
+	const unsigned int sizes = entries ? 1 : sizeof(defaultSizes) / sizeof(defaultSizes[0]);
+	unsigned int i, j;
+
+	stream->write_function(stream, "impl|entries|insertNs|findNs|missNs|find%uThreadsNs|deleteNs|check\n", BENCH_READERS);
+
+	for (i = 0; i < sizes; i++) {
+		janus_id_t *pIds = malloc(sizeof(janus_id_t) * pSizes[i]);
+		janus_id_t *pMissIds = malloc(sizeof(janus_id_t) * pSizes[i]);
+
+		if (!pIds || !pMissIds) {
+			stream->write_function(stream, "ERR Couldn't allocate %u ids\n", pSizes[i]);
+			switch_safe_free(pIds);
+			switch_safe_free(pMissIds);
+			return SWITCH_STATUS_MEMERR;
+		}
+
+		fillIds(pIds, pSizes[i], 0x9e3779b97f4a7c15ULL);
+		// even ids can never match the (odd) inserted ones
+		fillIds(pMissIds, pSizes[i], 0x2545f4914f6cdd1dULL);
+		for (j = 0; j < pSizes[i]; j++) {
+			pMissIds[j] &= ~(janus_id_t) 1;
+			pMissIds[j] |= 2;
+		}
+
+		for (j = 0; j < sizeof(hashImpls) / sizeof(hashImpls[0]); j++) {
+			benchHashOne(stream, &hashImpls[j], pIds, pMissIds, pSizes[i]);
+		}
+
+		free(pIds);
+		free(pMissIds);
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+// Signs the tokens sent with every request in HMAC mode: the one-shot
+// authSignToken() (key schedule rebuilt and three buffers allocated per
+// token) against authSign() with a prepared context and a stack buffer
+#define BENCH_AUTH_SECRET "the-hmac-signing-key"
+#define BENCH_AUTH_DEFAULT_TOKENS 100000
+
+static switch_status_t benchAuth(switch_stream_handle_t *stream, const uint32_t tokens) {
+	const uint32_t count = tokens ? tokens : BENCH_AUTH_DEFAULT_TOKENS;
+	const char *pDescriptors[2] = { "janus.plugin.audiobridge", "room=1234" };
+	switch_memory_pool_t *pPool = NULL;
+	char buf[AUTH_TOKEN_MAX];
+	auth_ctx_t *pCtx;
+	switch_time_t start, elapsed;
+	char *pToken;
+	uint32_t i;
+	const char *pCheck;
+
+	if (switch_core_new_memory_pool(&pPool) != SWITCH_STATUS_SUCCESS) {
+		stream->write_function(stream, "ERR Couldn't create memory pool\n");
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	if (!(pCtx = authCreate(pPool, BENCH_AUTH_SECRET))) {
+		stream->write_function(stream, "ERR Couldn't create signing context\n");
+		switch_core_destroy_memory_pool(&pPool);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	// both must produce the same token (unless the second ticks over between them)
+	pToken = authSignToken(BENCH_AUTH_SECRET, 300, pDescriptors, 2);
+	pCheck = (pToken && authSign(pCtx, 300, pDescriptors, 2, buf, sizeof(buf)) > 0 && !strcmp(pToken, buf)) ? "ok" : "MISMATCH";
+	switch_safe_free(pToken);
+
+	stream->write_function(stream, "impl|tokens|tokensPerSec|nsPerToken|check\n");
+
+	start = switch_time_now();
+	for (i = 0; i < count; i++) {
+		pToken = authSignToken(BENCH_AUTH_SECRET, 300, pDescriptors, 2);
+		switch_safe_free(pToken);
+	}
+	elapsed = switch_time_now() - start;
+	stream->write_function(stream, "oneshot|%u|%.0f|%.1f|%s\n", count,
+		elapsed ? (double) count * 1000000.0 / (double) elapsed : 0.0, (double) elapsed * 1000.0 / (double) count, pCheck);
+
+	start = switch_time_now();
+	for (i = 0; i < count; i++) {
+		(void) authSign(pCtx, 300, pDescriptors, 2, buf, sizeof(buf));
+	}
+	elapsed = switch_time_now() - start;
+	stream->write_function(stream, "context|%u|%.0f|%.1f|%s\n", count,
+		elapsed ? (double) count * 1000000.0 / (double) elapsed : 0.0, (double) elapsed * 1000.0 / (double) count, pCheck);
+
+	switch_core_destroy_memory_pool(&pPool);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+// Applies registry refreshes for a fleet of simulated pods: the old full
+// walk (a hash of the pods seen, then every server checked against it)
+// against the sorted snapshot diff, for a first refresh, a refresh where
+// nothing changed (pods listed in a different order) and one where 1% of
+// the pods moved, 1% went away and 1% are new
+#define BENCH_REGISTRY_DEFAULT_PODS 1000
+
+typedef struct {
+	uint32_t added;
+	uint32_t changed;
+	uint32_t removed;
+} bench_registry_counts_t;
+
+// the pods of one refresh, in the (shuffled) order DNS might return them
+static void benchRegistryPods(char (*pNames)[64], char (*pIps)[INET_ADDRSTRLEN], const uint32_t pods,
+		const switch_bool_t churn, uint64_t seed, uint32_t *pCount) {
+	uint32_t i, count = 0;
+
+	for (i = 0; i < pods; i++) {
+		if (churn && i % 100 == 1) {
+			continue;
+		}
+		(void) snprintf(pNames[count], 64, "janus-%05u", i);
+		(void) snprintf(pIps[count], INET_ADDRSTRLEN, "10.%u.%u.%u", churn && i % 100 == 0 ? 200 : 0,
+			(i >> 8) & 0xff, i & 0xff);
+		count++;
+	}
+	if (churn) {
+		for (i = 0; i < pods / 100; i++) {
+			(void) snprintf(pNames[count], 64, "janus-%05u", pods + i);
+			(void) snprintf(pIps[count], INET_ADDRSTRLEN, "10.100.%u.%u", (i >> 8) & 0xff, i & 0xff);
+			count++;
+		}
+	}
+
+	for (i = count; i > 1; i--) {
+		char name[64], ip[INET_ADDRSTRLEN];
+		uint32_t j;
+
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		j = (uint32_t) (seed % i);
+		memcpy(name, pNames[i - 1], 64);
+		memcpy(ip, pIps[i - 1], INET_ADDRSTRLEN);
+		memcpy(pNames[i - 1], pNames[j], 64);
+		memcpy(pIps[i - 1], pIps[j], INET_ADDRSTRLEN);
+		memcpy(pNames[j], name, 64);
+		memcpy(pIps[j], ip, INET_ADDRSTRLEN);
+	}
+
+	*pCount = count;
+}
+
+static switch_bool_t benchRegistryChange(const registry_change_t change, const registry_endpoint_t *pOld,
+		const registry_endpoint_t *pNew, void *pUserData) {
+	bench_registry_counts_t *pCounts = (bench_registry_counts_t *) pUserData;
+
+	(void) pOld;
+	(void) pNew;
+
+	if (change == REGISTRY_ADDED) {
+		pCounts->added++;
+	} else if (change == REGISTRY_CHANGED) {
+		pCounts->changed++;
+	} else {
+		pCounts->removed++;
+	}
+
+	return SWITCH_TRUE;
+}
+
+// the servers are a name -> ip hash, as the server list is
+static switch_time_t benchRegistryWalk(switch_hash_t *pServers, switch_memory_pool_t *pPool, char (*pNames)[64],
+		char (*pIps)[INET_ADDRSTRLEN], const uint32_t count, bench_registry_counts_t *pCounts) {
+	switch_hash_t *pSeen = NULL;
+	switch_hash_index_t *pIndex;
+	switch_time_t start = switch_time_now();
+	const char **ppRemoved;
+	uint32_t i, removed = 0;
+
+	memset(pCounts, 0, sizeof(*pCounts));
+	switch_core_hash_init(&pSeen);
+
+	for (i = 0; i < count; i++) {
+		const char *pIp = switch_core_hash_find(pServers, pNames[i]);
+
+		if (!pIp) {
+			switch_core_hash_insert(pServers, pNames[i], switch_core_strdup(pPool, pIps[i]));
+			pCounts->added++;
+		} else if (strcmp(pIp, pIps[i])) {
+			switch_core_hash_insert(pServers, pNames[i], switch_core_strdup(pPool, pIps[i]));
+			pCounts->changed++;
+		}
+		switch_core_hash_insert(pSeen, pNames[i], (void *) 1);
+	}
+
+	ppRemoved = switch_core_alloc(pPool, sizeof(char *) * (count + count / 50 + 1));
+	for (pIndex = switch_core_hash_first(pServers); pIndex; pIndex = switch_core_hash_next(&pIndex)) {
+		const void *pKey;
+		void *pVal;
+
+		switch_core_hash_this(pIndex, &pKey, NULL, &pVal);
+		if (!switch_core_hash_find(pSeen, (const char *) pKey)) {
+			ppRemoved[removed++] = switch_core_strdup(pPool, (const char *) pKey);
+		}
+	}
+	for (i = 0; i < removed; i++) {
+		(void) switch_core_hash_delete(pServers, ppRemoved[i]);
+	}
+	pCounts->removed = removed;
+
+	switch_core_hash_destroy(&pSeen);
+
+	return switch_time_now() - start;
+}
+
+static switch_time_t benchRegistryDiff(registry_snapshot_t **ppCurrent, char (*pNames)[64],
+		char (*pIps)[INET_ADDRSTRLEN], const uint32_t count, bench_registry_counts_t *pCounts) {
+	switch_time_t start = switch_time_now();
+	registry_snapshot_t *pSnapshot;
+	char url[128];
+	uint32_t i;
+
+	memset(pCounts, 0, sizeof(*pCounts));
+	if (!(pSnapshot = registryCreate(count))) {
+		return 0;
+	}
+
+	for (i = 0; i < count; i++) {
+		(void) snprintf(url, sizeof(url), "http://%s:8088/janus", pIps[i]);
+		(void) registryAdd(pSnapshot, pNames[i], pIps[i], url, 0);
+	}
+	registrySeal(pSnapshot);
+	(void) registryDiff(*ppCurrent, pSnapshot, benchRegistryChange, pCounts);
+
+	registryDestroy(ppCurrent);
+	*ppCurrent = pSnapshot;
+
+	return switch_time_now() - start;
+}
+
+static switch_status_t benchRegistry(switch_stream_handle_t *stream, const uint32_t pods) {
+	static const char *pScenarios[] = { "initial", "unchanged", "churn" };
+	const uint32_t count = pods ? pods : BENCH_REGISTRY_DEFAULT_PODS;
+	const uint32_t size = count + count / 100;
+	char (*pNames)[64] = malloc(64 * size);
+	char (*pIps)[INET_ADDRSTRLEN] = malloc(INET_ADDRSTRLEN * size);
+	switch_memory_pool_t *pPool = NULL;
+	switch_hash_t *pServers = NULL;
+	registry_snapshot_t *pCurrent = NULL;
+	bench_registry_counts_t walkCounts, diffCounts;
+	switch_time_t walkUs, diffUs;
+	uint32_t i, listed;
+
+	if (!pNames || !pIps || switch_core_new_memory_pool(&pPool) != SWITCH_STATUS_SUCCESS) {
+		stream->write_function(stream, "ERR Couldn't allocate %u pods\n", count);
+		switch_safe_free(pNames);
+		switch_safe_free(pIps);
+		return SWITCH_STATUS_MEMERR;
+	}
+	switch_core_hash_init(&pServers);
+
+	stream->write_function(stream, "refresh|pods|added|changed|removed|walkUs|diffUs|version|check\n");
+
+	for (i = 0; i < sizeof(pScenarios) / sizeof(pScenarios[0]); i++) {
+		benchRegistryPods(pNames, pIps, count, i == 2 ? SWITCH_TRUE : SWITCH_FALSE, 0x9e3779b97f4a7c15ULL + i, &listed);
+
+		walkUs = benchRegistryWalk(pServers, pPool, pNames, pIps, listed, &walkCounts);
+		diffUs = benchRegistryDiff(&pCurrent, pNames, pIps, listed, &diffCounts);
+
+		stream->write_function(stream, "%s|%u|%u|%u|%u|%" SWITCH_INT64_T_FMT "|%" SWITCH_INT64_T_FMT "|%u|%s\n",
+			pScenarios[i], listed, diffCounts.added, diffCounts.changed, diffCounts.removed, walkUs, diffUs,
+			pCurrent ? pCurrent->version : 0,
+			pCurrent && !memcmp(&walkCounts, &diffCounts, sizeof(walkCounts)) && pCurrent->count == listed ? "ok" : "MISMATCH");
+	}
+
+	registryDestroy(&pCurrent);
+	switch_core_hash_destroy(&pServers);
+	switch_core_destroy_memory_pool(&pPool);
+	free(pNames);
+	free(pIps);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#if defined(HAVE_MOD_JANUS_UNIX)
+// Round trips of a Janus request to a co-located Janus: HTTP/1.1 to a
+// loopback port (through a server's HTTP pool and the engine, when it is
+// running) against the pfunix Unix socket transport, each sent through its
+// transport's send as api.c does.  The stand-in Janus just echoes the
+// transaction back, so the times are the transports' own
+#define BENCH_UNIX_DEFAULT_REQUESTS 10000
+#define BENCH_JANUS_POLL_MS 100
+
+typedef enum {
+	BENCH_JANUS_HTTP,
+	BENCH_JANUS_UNIX,
+	BENCH_JANUS_WS
+} bench_janus_mode_t;
+
+typedef struct {
+	int listenFd;
+	bench_janus_mode_t mode;
+	volatile int stop;
+} bench_janus_t;
+
+// one thread's share of the requests - see benchRpcRun
+typedef struct {
+	server_t *pServer;
+	uint32_t first;
+	uint32_t requests;
+	uint32_t failed;
+	int64_t latencySum;
+	int64_t latencyMax;
+} bench_rpc_t;
+
+static size_t benchJanusReply(const char *pRequest, char *pReply, const size_t size) {
+	const char *pTxn = strstr(pRequest, "\"transaction\":\"");
+	int len = 0, n;
+
+	if (pTxn) {
+		pTxn += strlen("\"transaction\":\"");
+		len = (int) strcspn(pTxn, "\"");
+	}
+	n = snprintf(pReply, size, "{\"janus\":\"success\",\"transaction\":\"%.*s\",\"data\":{\"id\":1}}", len, pTxn ? pTxn : "");
+
+	return (n < 0 || (size_t) n >= size) ? 0 : (size_t) n;
+}
+
+// waits for the descriptor to be readable - SWITCH_FALSE once the bench is over
+static switch_bool_t benchJanusWait(bench_janus_t *pJanus, const int fd) {
+	while (!pJanus->stop) {
+		struct pollfd pfd = { fd, POLLIN, 0 };
+
+		if (poll(&pfd, 1, BENCH_JANUS_POLL_MS) > 0) {
+			return SWITCH_TRUE;
+		}
+	}
+	return SWITCH_FALSE;
+}
+
+static void benchJanusServeHttp(bench_janus_t *pJanus, const int fd) {
+	char request[8192];
+	size_t used = 0;
+
+	request[0] = '\0';
+
+	for (;;) {
+		char reply[512], response[768];
+		const char *pBody, *pLength;
+		size_t need, len;
+		int n;
+
+		// the headers, then as much body as they announce
+		while (!(pBody = strstr(request, "\r\n\r\n"))) {
+			ssize_t got;
+
+			if (used >= sizeof(request) - 1 || !benchJanusWait(pJanus, fd) ||
+					(got = recv(fd, &request[used], sizeof(request) - 1 - used, 0)) <= 0) {
+				return;
+			}
+			used += (size_t) got;
+			request[used] = '\0';
+		}
+		pBody += 4;
+		pLength = strstr(request, "Content-Length:");
+		need = (size_t) (pBody - request) + ((pLength && pLength < pBody) ? strtoul(pLength + 15, NULL, 10) : 0);
+		if (need >= sizeof(request)) {
+			return;
+		}
+		while (used < need) {
+			ssize_t got;
+
+			if (!benchJanusWait(pJanus, fd) || (got = recv(fd, &request[used], sizeof(request) - 1 - used, 0)) <= 0) {
+				return;
+			}
+			used += (size_t) got;
+			request[used] = '\0';
+		}
+
+		len = benchJanusReply(pBody, reply, sizeof(reply));
+		n = snprintf(response, sizeof(response),
+			"HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %u\r\n\r\n%s", (unsigned int) len, reply);
+		if (n < 0 || send(fd, response, (size_t) n, MSG_NOSIGNAL) != n) {
+			return;
+		}
+
+		// keep anything sent after this request
+		memmove(request, &request[need], used - need + 1);
+		used -= need;
+	}
+}
+
+static void benchJanusServeUnix(bench_janus_t *pJanus, const int fd) {
+	char request[8192], reply[512];
+	ssize_t got;
+
+	while (benchJanusWait(pJanus, fd) && (got = recv(fd, request, sizeof(request) - 1, 0)) > 0) {
+		size_t len;
+
+		request[got] = '\0';
+		len = benchJanusReply(request, reply, sizeof(reply));
+		if (send(fd, reply, len, MSG_NOSIGNAL) != (ssize_t) len) {
+			break;
+		}
+	}
+}
+
+#if defined(HAVE_MOD_JANUS_WS)
+// reads exactly len bytes - SWITCH_FALSE if the connection or the bench ends first
+static switch_bool_t benchJanusRecv(bench_janus_t *pJanus, const int fd, uint8_t *pBuffer, const size_t len) {
+	size_t used = 0;
+
+	while (used < len) {
+		ssize_t got;
+
+		if (!benchJanusWait(pJanus, fd) || (got = recv(fd, &pBuffer[used], len - used, 0)) <= 0) {
+			return SWITCH_FALSE;
+		}
+		used += (size_t) got;
+	}
+	return SWITCH_TRUE;
+}
+
+// Just enough of RFC 6455 for janus_ws.c as a client: the upgrade, then
+// each (masked) text frame is answered with an unmasked one
+static void benchJanusServeWs(bench_janus_t *pJanus, const int fd) {
+	static const char guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+	char request[4096], accept[64], response[256];
+	uint8_t digest[SHA_DIGEST_LENGTH];
+	const char *pKey;
+	size_t used = 0;
+	int n;
+
+	request[0] = '\0';
+	while (!strstr(request, "\r\n\r\n")) {
+		ssize_t got;
+
+		if (used >= sizeof(request) - 1 || !benchJanusWait(pJanus, fd) ||
+				(got = recv(fd, &request[used], sizeof(request) - 1 - used, 0)) <= 0) {
+			return;
+		}
+		used += (size_t) got;
+		request[used] = '\0';
+	}
+	if (!(pKey = strstr(request, "Sec-WebSocket-Key:"))) {
+		return;
+	}
+	pKey += strlen("Sec-WebSocket-Key:");
+	pKey += strspn(pKey, " ");
+	n = snprintf(response, sizeof(response), "%.*s%s", (int) strcspn(pKey, "\r\n"), pKey, guid);
+	if (n < 0 || (size_t) n >= sizeof(response)) {
+		return;
+	}
+	SHA1((const unsigned char *) response, (size_t) n, digest);
+	(void) EVP_EncodeBlock((unsigned char *) accept, digest, sizeof(digest));
+
+	n = snprintf(response, sizeof(response), "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+		"Sec-WebSocket-Accept: %s\r\nSec-WebSocket-Protocol: janus-protocol\r\n\r\n", accept);
+	if (n < 0 || send(fd, response, (size_t) n, MSG_NOSIGNAL) != n) {
+		return;
+	}
+
+	for (;;) {
+		uint8_t header[14], mask[4], frame[4 + 512];
+		char text[8192], reply[512];
+		uint64_t len;
+		size_t replyLen, i;
+		int head;
+
+		if (!benchJanusRecv(pJanus, fd, header, 2)) {
+			return;
+		}
+		len = header[1] & 0x7f;
+		if (len == 126) {
+			if (!benchJanusRecv(pJanus, fd, header, 2)) {
+				return;
+			}
+			len = ((uint64_t) header[0] << 8) | header[1];
+		} else if (len == 127) {
+			// nothing janus_ws.c sends comes near 64KB
+			return;
+		}
+		if (len >= sizeof(text) || !(header[1] & 0x80) || !benchJanusRecv(pJanus, fd, mask, sizeof(mask)) ||
+				!benchJanusRecv(pJanus, fd, (uint8_t *) text, (size_t) len)) {
+			return;
+		}
+		if ((header[0] & 0x0f) == 0x8) {
+			return;
+		}
+		if ((header[0] & 0x0f) != 0x1) {
+			continue;
+		}
+		for (i = 0; i < len; i++) {
+			text[i] ^= mask[i % 4];
+		}
+		text[len] = '\0';
+
+		replyLen = benchJanusReply(text, reply, sizeof(reply));
+		frame[0] = 0x81;
+		if (replyLen < 126) {
+			frame[1] = (uint8_t) replyLen;
+			head = 2;
+		} else {
+			frame[1] = 126;
+			frame[2] = (uint8_t) (replyLen >> 8);
+			frame[3] = (uint8_t) replyLen;
+			head = 4;
+		}
+		memcpy(&frame[head], reply, replyLen);
+		if (send(fd, frame, head + replyLen, MSG_NOSIGNAL) != (ssize_t) (head + replyLen)) {
+			return;
+		}
+	}
+}
+#endif
+
+// a stand-in Janus serving one connection at a time
+static void *SWITCH_THREAD_FUNC bench_janus_run(switch_thread_t *pThread, void *pObj) {
+	bench_janus_t *pJanus = (bench_janus_t *) pObj;
+
+	(void) pThread;
+
+	while (benchJanusWait(pJanus, pJanus->listenFd)) {
+		const int fd = accept(pJanus->listenFd, NULL, NULL);
+
+		if (fd < 0) {
+			continue;
+		}
+		switch (pJanus->mode) {
+		case BENCH_JANUS_HTTP:
+			benchJanusServeHttp(pJanus, fd);
+			break;
+		case BENCH_JANUS_UNIX:
+			benchJanusServeUnix(pJanus, fd);
+			break;
+#if defined(HAVE_MOD_JANUS_WS)
+		case BENCH_JANUS_WS:
+			benchJanusServeWs(pJanus, fd);
+			break;
+#endif
+		default:
+			break;
+		}
+		close(fd);
+	}
+
+	return NULL;
+}
+
+static void benchRpcSend(bench_rpc_t *pRpc) {
+	uint32_t i;
+
+	for (i = pRpc->first; i < pRpc->first + pRpc->requests; i++) {
+		const switch_time_t sent = switch_time_now();
+		char transaction[16];
+		cJSON *pRequest, *pResponse, *pTxn;
+		int64_t latency;
+
+		// shaped like an attach, the commonest request during call setup
+		(void) snprintf(transaction, sizeof(transaction), "%08x", i);
+		pRequest = cJSON_CreateObject();
+		cJSON_AddStringToObject(pRequest, "janus", "attach");
+		cJSON_AddStringToObject(pRequest, "plugin", "janus.plugin.audiobridge");
+		cJSON_AddStringToObject(pRequest, "transaction", transaction);
+
+		pResponse = pRpc->pServer->pTransport->send(pRpc->pServer, pRequest, transaction, 0, 0, "attach");
+		latency = switch_time_now() - sent;
+
+		pTxn = pResponse ? cJSON_GetObjectItemCaseSensitive(pResponse, "transaction") : NULL;
+		if (!cJSON_IsString(pTxn) || strcmp(pTxn->valuestring, transaction)) {
+			pRpc->failed++;
+		}
+		cJSON_Delete(pResponse);
+		cJSON_Delete(pRequest);
+
+		pRpc->latencySum += latency;
+		if (latency > pRpc->latencyMax) {
+			pRpc->latencyMax = latency;
+		}
+	}
+}
+
+static void *SWITCH_THREAD_FUNC bench_rpc_run(switch_thread_t *pThread, void *pObj) {
+	(void) pThread;
+
+	benchRpcSend((bench_rpc_t *) pObj);
+
+	return NULL;
+}
+
+// sends the requests through the server's transport, shared between the
+// given number of threads each waiting for one reply at a time
+static void benchRpcRun(switch_stream_handle_t *stream, const char *pName, server_t *pServer, const uint32_t requests,
+		const uint32_t threads) {
+	switch_memory_pool_t *pPool = NULL;
+	bench_rpc_t *pRpcs;
+	switch_thread_t **ppThreads;
+	switch_time_t start, elapsed;
+	int64_t latencySum = 0, latencyMax = 0;
+	uint32_t failed = 0, sent = 0, i;
+
+	if (switch_core_new_memory_pool(&pPool) != SWITCH_STATUS_SUCCESS) {
+		stream->write_function(stream, "ERR Couldn't create memory pool\n");
+		return;
+	}
+	pRpcs = switch_core_alloc(pPool, sizeof(*pRpcs) * threads);
+	ppThreads = switch_core_alloc(pPool, sizeof(*ppThreads) * threads);
+
+	for (i = 0; i < threads; i++) {
+		pRpcs[i].pServer = pServer;
+		pRpcs[i].first = i * (requests / threads);
+		pRpcs[i].requests = requests / threads + (i == threads - 1 ? requests % threads : 0);
+	}
+
+	start = switch_time_now();
+	if (threads == 1) {
+		benchRpcSend(&pRpcs[0]);
+	} else {
+		for (i = 0; i < threads; i++) {
+			switch_threadattr_t *pThreadAttr = NULL;
+
+			switch_threadattr_create(&pThreadAttr, pPool);
+			switch_threadattr_stacksize_set(pThreadAttr, SWITCH_THREAD_STACKSIZE);
+			switch_thread_create(&ppThreads[i], pThreadAttr, bench_rpc_run, &pRpcs[i], pPool);
+		}
+		for (i = 0; i < threads; i++) {
+			switch_status_t returnValue;
+			(void) switch_thread_join(&returnValue, ppThreads[i]);
+		}
+	}
+	elapsed = switch_time_now() - start;
+
+	for (i = 0; i < threads; i++) {
+		sent += pRpcs[i].requests;
+		failed += pRpcs[i].failed;
+		latencySum += pRpcs[i].latencySum;
+		if (pRpcs[i].latencyMax > latencyMax) {
+			latencyMax = pRpcs[i].latencyMax;
+		}
+	}
+
+	stream->write_function(stream, "%s|%u|%u|%u|%.1f|%" SWITCH_INT64_T_FMT "|%.0f\n", pName, threads, sent, failed,
+		sent ? (double) latencySum / sent : 0.0, (int64_t) latencyMax,
+		elapsed > 0 ? (double) sent * 1000000.0 / elapsed : 0.0);
+
+	switch_core_destroy_memory_pool(&pPool);
+}
+
+// listens for the stand-in Janus and starts serving
+static switch_status_t benchJanusStart(bench_janus_t *pJanus, switch_memory_pool_t *pPool, switch_thread_t **ppThread) {
+	switch_threadattr_t *pThreadAttr = NULL;
+
+	if (listen(pJanus->listenFd, 4)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_threadattr_create(&pThreadAttr, pPool);
+	switch_threadattr_stacksize_set(pThreadAttr, SWITCH_THREAD_STACKSIZE);
+	return switch_thread_create(ppThread, pThreadAttr, bench_janus_run, pJanus, pPool);
+}
+
+static void benchJanusStop(bench_janus_t *pJanus, switch_thread_t *pThread) {
+	switch_status_t returnValue;
+
+	pJanus->stop = 1;
+	if (pThread) {
+		(void) switch_thread_join(&returnValue, pThread);
+	}
+	close(pJanus->listenFd);
+}
+
+// just enough of a server for a transport to send requests on
+static server_t *benchServer(switch_memory_pool_t *pPool, const transport_t *pTransport, const char *pUrl) {
+	server_t *pServer = switch_core_alloc(pPool, sizeof(*pServer));
+
+	pServer->name = switch_core_strdup(pPool, "bench");
+	pServer->pUrl = switch_core_strdup(pPool, pUrl);
+	pServer->pTransport = pTransport;
+	switch_mutex_init(&pServer->mutex, SWITCH_MUTEX_NESTED, pPool);
+
+	return pServer;
+}
+
+static void benchUnixHttp(switch_stream_handle_t *stream, switch_memory_pool_t *pPool, const uint32_t requests) {
+	struct sockaddr_in addr;
+	socklen_t addrLen = sizeof(addr);
+	switch_thread_t *pThread = NULL;
+	bench_janus_t janus;
+	server_t *pServer;
+	char url[64];
+
+	memset(&janus, 0, sizeof(janus));
+	janus.mode = BENCH_JANUS_HTTP;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ((janus.listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+		stream->write_function(stream, "ERR Couldn't create HTTP listener\n");
+		return;
+	}
+	if (bind(janus.listenFd, (struct sockaddr *) &addr, sizeof(addr)) ||
+			getsockname(janus.listenFd, (struct sockaddr *) &addr, &addrLen) ||
+			benchJanusStart(&janus, pPool, &pThread) != SWITCH_STATUS_SUCCESS) {
+		stream->write_function(stream, "ERR Couldn't start HTTP listener\n");
+		benchJanusStop(&janus, pThread);
+		return;
+	}
+
+	(void) snprintf(url, sizeof(url), "http://127.0.0.1:%u/janus", (unsigned int) ntohs(addr.sin_port));
+	pServer = benchServer(pPool, &janus_http_transport, url);
+	pServer->pHttpPool = httpPoolCreate("bench", HTTP_POOL_DEFAULT_SIZE, HTTP_POOL_DEFAULT_IDLE_TIMEOUT, SWITCH_FALSE);
+
+	benchRpcRun(stream, httpEngineRunning() ? "http-engine" : "http", pServer, requests, 1);
+
+	httpPoolDestroy(&pServer->pHttpPool);
+	benchJanusStop(&janus, pThread);
+}
+
+static void benchUnixSocket(switch_stream_handle_t *stream, switch_memory_pool_t *pPool, const uint32_t requests) {
+	struct sockaddr_un addr;
+	switch_thread_t *pThread = NULL;
+	bench_janus_t janus;
+	server_t *pServer;
+
+	memset(&janus, 0, sizeof(janus));
+	janus.mode = BENCH_JANUS_UNIX;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	(void) snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/mod_janus_bench_%ld.sock", (long) getpid());
+	(void) unlink(addr.sun_path);
+
+	if ((janus.listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) < 0) {
+		stream->write_function(stream, "ERR Couldn't create Unix socket listener\n");
+		return;
+	}
+	if (bind(janus.listenFd, (struct sockaddr *) &addr, sizeof(addr)) ||
+			benchJanusStart(&janus, pPool, &pThread) != SWITCH_STATUS_SUCCESS) {
+		stream->write_function(stream, "ERR Couldn't start Unix socket listener\n");
+		benchJanusStop(&janus, pThread);
+		(void) unlink(addr.sun_path);
+		return;
+	}
+
+	pServer = benchServer(pPool, &janus_unix_transport, switch_core_sprintf(pPool, "%s%s", JANUS_UNIX_SCHEME, addr.sun_path));
+
+	if (pServer->pTransport->open(pServer) == SWITCH_STATUS_SUCCESS) {
+		benchRpcRun(stream, "unix", pServer, requests, 1);
+		pServer->pTransport->close(pServer);
+	} else {
+		stream->write_function(stream, "ERR Couldn't connect to the Unix socket\n");
+	}
+
+	benchJanusStop(&janus, pThread);
+	(void) unlink(addr.sun_path);
+}
+
+static switch_status_t benchUnix(switch_stream_handle_t *stream, const uint32_t requests) {
+	switch_memory_pool_t *pPool = NULL;
+
+	if (switch_core_new_memory_pool(&pPool) != SWITCH_STATUS_SUCCESS) {
+		stream->write_function(stream, "ERR Couldn't create memory pool\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	stream->write_function(stream, "transport|threads|requests|failed|avgUs|maxUs|requestsPerSec\n");
+	benchUnixHttp(stream, pPool, requests ? requests : BENCH_UNIX_DEFAULT_REQUESTS);
+	benchUnixSocket(stream, pPool, requests ? requests : BENCH_UNIX_DEFAULT_REQUESTS);
+
+	switch_core_destroy_memory_pool(&pPool);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#if defined(HAVE_MOD_JANUS_WS)
+// Round trips through janus_ws.c itself to a stand-in Janus on a loopback
+// port: one caller at a time, then several callers sharing the socket as
+// concurrent call setups do, each waiting for its own reply while the
+// reader hands the replies out
+#define BENCH_WS_DEFAULT_REQUESTS 10000
+#define BENCH_WS_THREADS 4
+
+static switch_status_t benchWs(switch_stream_handle_t *stream, const uint32_t requests) {
+	const uint32_t count = requests ? requests : BENCH_WS_DEFAULT_REQUESTS;
+	switch_memory_pool_t *pPool = NULL;
+	struct sockaddr_in addr;
+	socklen_t addrLen = sizeof(addr);
+	switch_thread_t *pThread = NULL;
+	bench_janus_t janus;
+	server_t *pServer;
+	char url[64];
+
+	if (switch_core_new_memory_pool(&pPool) != SWITCH_STATUS_SUCCESS) {
+		stream->write_function(stream, "ERR Couldn't create memory pool\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	memset(&janus, 0, sizeof(janus));
+	janus.mode = BENCH_JANUS_WS;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ((janus.listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+		stream->write_function(stream, "ERR Couldn't create WebSocket listener\n");
+		switch_core_destroy_memory_pool(&pPool);
+		return SWITCH_STATUS_FALSE;
+	}
+	if (bind(janus.listenFd, (struct sockaddr *) &addr, sizeof(addr)) ||
+			getsockname(janus.listenFd, (struct sockaddr *) &addr, &addrLen) ||
+			benchJanusStart(&janus, pPool, &pThread) != SWITCH_STATUS_SUCCESS) {
+		stream->write_function(stream, "ERR Couldn't start WebSocket listener\n");
+		benchJanusStop(&janus, pThread);
+		switch_core_destroy_memory_pool(&pPool);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	(void) snprintf(url, sizeof(url), "ws://127.0.0.1:%u/", (unsigned int) ntohs(addr.sin_port));
+	pServer = benchServer(pPool, &janus_ws_transport, url);
+
+	if (pServer->pTransport->open(pServer) == SWITCH_STATUS_SUCCESS) {
+		stream->write_function(stream, "transport|threads|requests|failed|avgUs|maxUs|requestsPerSec\n");
+		benchRpcRun(stream, "ws", pServer, count, 1);
+		benchRpcRun(stream, "ws", pServer, count, BENCH_WS_THREADS);
+		pServer->pTransport->close(pServer);
+	} else {
+		stream->write_function(stream, "ERR Couldn't connect to the WebSocket\n");
+	}
+
+	benchJanusStop(&janus, pThread);
+	switch_core_destroy_memory_pool(&pPool);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+#endif
+#endif
+
+// Call setup throughput against a real Janus (or a proxy in front of it):
+// the given number of requests, shaped like setup requests, are kept the
+// given number at a time in flight through a server's pool, first over
+// HTTP/1.1 and then multiplexed over HTTP/2.  A Janus answers "info" with
+// the transaction it was given, without a session or any secret
+#define BENCH_HTTP2_DEFAULT_REQUESTS 2000
+#define BENCH_HTTP2_DEFAULT_CONCURRENCY 32
+#define BENCH_HTTP2_TIMEOUT_MS 10000
+
+typedef struct {
+	switch_mutex_t *pMutex;
+	switch_thread_cond_t *pCond;
+	uint32_t outstanding;
+	uint32_t failed;
+	int64_t latencySum;
+	int64_t latencyMax;
+} bench_http2_t;
+
+typedef struct {
+	bench_http2_t *pBench;
+	switch_time_t sent;
+	char transaction[16];
+} bench_http2_request_t;
+
+// runs on an engine thread (or in httpSubmit without the engine)
+static void benchHttp2Complete(cJSON *pJsonResponse, void *pUserData) {
+	bench_http2_request_t *pRequest = (bench_http2_request_t *) pUserData;
+	bench_http2_t *pBench = pRequest->pBench;
+	const int64_t latency = switch_time_now() - pRequest->sent;
+	cJSON *pTxn = pJsonResponse ? cJSON_GetObjectItemCaseSensitive(pJsonResponse, "transaction") : NULL;
+
+	switch_mutex_lock(pBench->pMutex);
+	if (!cJSON_IsString(pTxn) || strcmp(pTxn->valuestring, pRequest->transaction)) {
+		pBench->failed++;
+	}
+	pBench->latencySum += latency;
+	if (latency > pBench->latencyMax) {
+		pBench->latencyMax = latency;
+	}
+	pBench->outstanding--;
+	switch_thread_cond_signal(pBench->pCond);
+	switch_mutex_unlock(pBench->pMutex);
+
+	cJSON_Delete(pJsonResponse);
+	free(pRequest);
+}
+
+static void benchHttp2Run(switch_stream_handle_t *stream, switch_memory_pool_t *pPool, const char *pUrl,
+		const switch_bool_t http2, const uint32_t requests, const uint32_t concurrency) {
+	http_pool_t *pHttpPool = httpPoolCreate("bench", concurrency, HTTP_POOL_DEFAULT_IDLE_TIMEOUT, http2);
+	unsigned int connects = 0;
+	switch_time_t start, elapsed;
+	bench_http2_t bench;
+	uint32_t i;
+
+	memset(&bench, 0, sizeof(bench));
+	switch_mutex_init(&bench.pMutex, SWITCH_MUTEX_NESTED, pPool);
+	switch_thread_cond_create(&bench.pCond, pPool);
+
+	start = switch_time_now();
+	for (i = 0; i < requests; i++) {
+		bench_http2_request_t *pRequest;
+		cJSON *pJsonRequest;
+
+		switch_mutex_lock(bench.pMutex);
+		while (bench.outstanding >= concurrency) {
+			switch_thread_cond_wait(bench.pCond, bench.pMutex);
+		}
+		bench.outstanding++;
+		switch_mutex_unlock(bench.pMutex);
+
+		switch_zmalloc(pRequest, sizeof(*pRequest));
+		pRequest->pBench = &bench;
+		(void) snprintf(pRequest->transaction, sizeof(pRequest->transaction), "%08x", i);
+
+		pJsonRequest = cJSON_CreateObject();
+		cJSON_AddStringToObject(pJsonRequest, "janus", "info");
+		cJSON_AddStringToObject(pJsonRequest, "transaction", pRequest->transaction);
+
+		pRequest->sent = switch_time_now();
+		if (httpSubmit(pHttpPool, pUrl, BENCH_HTTP2_TIMEOUT_MS, pJsonRequest, benchHttp2Complete, pRequest) != SWITCH_STATUS_SUCCESS) {
+			switch_mutex_lock(bench.pMutex);
+			bench.failed++;
+			bench.outstanding--;
+			switch_mutex_unlock(bench.pMutex);
+			free(pRequest);
+		}
+		cJSON_Delete(pJsonRequest);
+	}
+
+	switch_mutex_lock(bench.pMutex);
+	while (bench.outstanding) {
+		switch_thread_cond_wait(bench.pCond, bench.pMutex);
+	}
+	switch_mutex_unlock(bench.pMutex);
+	elapsed = switch_time_now() - start;
+
+	httpPoolStats(pHttpPool, NULL, NULL, &connects);
+	httpPoolDestroy(&pHttpPool);
+
+	stream->write_function(stream, "%s|%u|%u|%u|%.1f|%" SWITCH_INT64_T_FMT "|%.0f|%u\n", http2 ? "http/2" : "http/1.1",
+		requests, concurrency, bench.failed, requests ? (double) bench.latencySum / requests : 0.0, (int64_t) bench.latencyMax,
+		elapsed > 0 ? (double) requests * 1000000.0 / elapsed : 0.0, connects);
+}
+
+static switch_status_t benchHttp2(switch_stream_handle_t *stream, const char *pUrl, const uint32_t requests,
+		const uint32_t concurrency) {
+	switch_memory_pool_t *pPool = NULL;
+
+	if (zstr(pUrl)) {
+		stream->write_function(stream, "USAGE janus bench http2 <url> [requests] [concurrency]\n");
+		return SWITCH_STATUS_FALSE;
+	}
+	if (switch_core_new_memory_pool(&pPool) != SWITCH_STATUS_SUCCESS) {
+		stream->write_function(stream, "ERR Couldn't create memory pool\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (!httpEngineRunning()) {
+		stream->write_function(stream, "WARNING the HTTP engine isn't running so requests go one at a time\n");
+	}
+	stream->write_function(stream, "protocol|requests|concurrency|failed|avgUs|maxUs|requestsPerSec|connections\n");
+	benchHttp2Run(stream, pPool, pUrl, SWITCH_FALSE, requests ? requests : BENCH_HTTP2_DEFAULT_REQUESTS,
+		concurrency ? concurrency : BENCH_HTTP2_DEFAULT_CONCURRENCY);
+	benchHttp2Run(stream, pPool, pUrl, SWITCH_TRUE, requests ? requests : BENCH_HTTP2_DEFAULT_REQUESTS,
+		concurrency ? concurrency : BENCH_HTTP2_DEFAULT_CONCURRENCY);
+
+	switch_core_destroy_memory_pool(&pPool);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+// Parses a long-poll response of the given number of audiobridge events
+// (default 160, the most a poll asks for) each listing 50 participants, fed
+// in 16KB chunks as curl hands them over: parsed whole once it has all been
+// received, into a new buffer for every response, against the stream parser
+// handing over each event as it completes, reusing one buffer.  Reports the
+// time from the first chunk to the first event and to the last (usec).  Over
+// a real link the whole parse also waits for the rest of the body to arrive
+#define BENCH_STREAM_DEFAULT_EVENTS 160
+#define BENCH_STREAM_PARTICIPANTS 50
+#define BENCH_STREAM_CHUNK 16384
+#define BENCH_STREAM_ROUNDS 50
+
+typedef struct {
+	switch_time_t start;
+	switch_time_t first;
+	uint32_t events;
+} bench_stream_t;
+
+static switch_bool_t benchStreamEvent(cJSON *pEvent, void *pUserData) {
+	bench_stream_t *pBench = (bench_stream_t *) pUserData;
+
+	if (!pBench->events++) {
+		pBench->first = switch_time_now() - pBench->start;
+	}
+	cJSON_Delete(pEvent);
+
+	return SWITCH_TRUE;
+}
+
+static char *benchStreamBody(const uint32_t events) {
+	cJSON *pBody = cJSON_CreateArray();
+	char *pBodyStr;
+	uint32_t i, j;
+
+	for (i = 0; i < events; i++) {
+		cJSON *pEvent = cJSON_CreateObject();
+		cJSON *pPluginData = cJSON_CreateObject();
+		cJSON *pData = cJSON_CreateObject();
+		cJSON *pParticipants = cJSON_CreateArray();
+		char display[32];
+
+		cJSON_AddStringToObject(pEvent, "janus", "event");
+		cJSON_AddNumberToObject(pEvent, "session_id", 1234567);
+		cJSON_AddNumberToObject(pEvent, "sender", 1000 + i);
+		cJSON_AddStringToObject(pPluginData, "plugin", "janus.plugin.audiobridge");
+		cJSON_AddStringToObject(pData, "audiobridge", "event");
+		cJSON_AddNumberToObject(pData, "room", 1234);
+		for (j = 0; j < BENCH_STREAM_PARTICIPANTS; j++) {
+			cJSON *pParticipant = cJSON_CreateObject();
+
+			(void) snprintf(display, sizeof(display), "caller \"%u\"", j);
+			cJSON_AddNumberToObject(pParticipant, "id", 5000 + j);
+			cJSON_AddStringToObject(pParticipant, "display", display);
+			cJSON_AddBoolToObject(pParticipant, "setup", cJSON_True);
+			cJSON_AddBoolToObject(pParticipant, "muted", cJSON_False);
+			cJSON_AddItemToArray(pParticipants, pParticipant);
+		}
+		cJSON_AddItemToObject(pData, "participants", pParticipants);
+		cJSON_AddItemToObject(pPluginData, "data", pData);
+		cJSON_AddItemToObject(pEvent, "plugindata", pPluginData);
+		cJSON_AddItemToArray(pBody, pEvent);
+	}
+
+	pBodyStr = cJSON_PrintUnformatted(pBody);
+	cJSON_Delete(pBody);
+
+	return pBodyStr;
+}
+
+static switch_status_t benchStream(switch_stream_handle_t *stream, const uint32_t events) {
+	const uint32_t count = events ? events : BENCH_STREAM_DEFAULT_EVENTS;
+	char *pBodyStr = benchStreamBody(count);
+	http_stream_t *pStream = httpStreamCreate();
+	int64_t wholeFirst = 0, wholeAll = 0, streamFirst = 0, streamAll = 0;
+	uint32_t wholeEvents = 0, streamEvents = 0;
+	size_t len, offset;
+	uint32_t round;
+
+	if (!pBodyStr) {
+		stream->write_function(stream, "ERR Couldn't build response\n");
+		httpStreamDestroy(&pStream);
+		return SWITCH_STATUS_MEMERR;
+	}
+	len = strlen(pBodyStr);
+
+	for (round = 0; round < BENCH_STREAM_ROUNDS; round++) {
+		switch_buffer_t *pBuffer = NULL;
+		const char *pWhole;
+		bench_stream_t bench;
+		cJSON *pJson, *pEvent;
+		switch_time_t start;
+
+		// as write_callback and httpRequestResult did
+		start = switch_time_now();
+		switch_buffer_create_dynamic(&pBuffer, 1000, 1000, 0);
+		for (offset = 0; offset < len; offset += BENCH_STREAM_CHUNK) {
+			(void) switch_buffer_write(pBuffer, &pBodyStr[offset], (len - offset < BENCH_STREAM_CHUNK) ? len - offset : BENCH_STREAM_CHUNK);
+		}
+		(void) switch_buffer_write(pBuffer, "\0", 1);
+		(void) switch_buffer_peek_zerocopy(pBuffer, (const void **) &pWhole);
+		pJson = cJSON_Parse(pWhole);
+		wholeFirst += switch_time_now() - start;
+		wholeEvents = 0;
+		while (pJson && (pEvent = pJson->child)) {
+			cJSON_Delete(cJSON_DetachItemViaPointer(pJson, pEvent));
+			wholeEvents++;
+		}
+		cJSON_Delete(pJson);
+		switch_buffer_destroy(&pBuffer);
+		wholeAll += switch_time_now() - start;
+
+		memset(&bench, 0, sizeof(bench));
+		bench.start = switch_time_now();
+		httpStreamReset(pStream, benchStreamEvent, &bench);
+		for (offset = 0; offset < len; offset += BENCH_STREAM_CHUNK) {
+			(void) httpStreamFeed(pStream, &pBodyStr[offset], (len - offset < BENCH_STREAM_CHUNK) ? len - offset : BENCH_STREAM_CHUNK);
+		}
+		cJSON_Delete(httpStreamFinish(pStream));
+		streamFirst += bench.first;
+		streamAll += switch_time_now() - bench.start;
+		streamEvents = bench.events;
+	}
+
+	stream->write_function(stream, "impl|events|bytes|firstEventUs|allEventsUs|check\n");
+	stream->write_function(stream, "whole|%u|%" SWITCH_SIZE_T_FMT "|%.1f|%.1f|%s\n", wholeEvents, len,
+		(double) wholeFirst / BENCH_STREAM_ROUNDS, (double) wholeAll / BENCH_STREAM_ROUNDS, wholeEvents == count ? "ok" : "MISMATCH");
+	stream->write_function(stream, "stream|%u|%" SWITCH_SIZE_T_FMT "|%.1f|%.1f|%s\n", streamEvents, len,
+		(double) streamFirst / BENCH_STREAM_ROUNDS, (double) streamAll / BENCH_STREAM_ROUNDS, streamEvents == count ? "ok" : "MISMATCH");
+
+	httpStreamDestroy(&pStream);
+	free(pBodyStr);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+// Decodes the Janus messages in a fixtures file - bench/janus-messages.jsonl
+// in the source tree - the given number of times over (default 20000) and
+// checks each one against the fields the file says it decodes to.  A line is
+// {"message": ..., "expect": {...}}, or a bare message, which is timed but
+// not checked; anything before the first brace is skipped, so the "recv"
+// lines of a debug log can be used as they are.  The decode is timed, and
+// the parse of the same messages for comparison
+#define BENCH_DECODE_DEFAULT_ROUNDS 20000
+
+typedef struct {
+	unsigned int line;
+	cJSON *pRoot;
+	cJSON *pMessage;
+	cJSON *pExpect;    // NULL when the line is a bare message
+	char *pText;       // the message alone, for the parse
+	switch_bool_t decodes;
+} bench_decode_message_t;
+
+// the names of janus_event_type_t and janus_audiobridge_type_t in order -
+// spelled out here rather than taken from event.c, which is what is checked
+static const char *benchEventTypeNames[] = {
+	"unknown", "keepalive", "ack", "success", "error", "event", "trickle", "webrtcup", "media", "slowlink",
+	"hangup", "detached", "timeout", "server_info"
+};
+
+static const char *benchAudiobridgeNames[] = {
+	"unknown", "joined", "event", "left", "created", "destroyed", "edited", "success", "roomchanged", "talking",
+	"stopped-talking"
+};
+
+static uint32_t benchDecodeMismatch(switch_stream_handle_t *stream, const unsigned int line, const char *pField,
+		const char *pExpected, const char *pDecoded) {
+	stream->write_function(stream, "MISMATCH line %u %s: expected %s, decoded %s\n", line, pField, pExpected, pDecoded);
+	return 1;
+}
+
+static const char *benchDecodeString(const cJSON *pItem) {
+	return cJSON_IsString(pItem) ? pItem->valuestring : NULL;
+}
+
+// null expects the field to be absent
+static uint32_t benchDecodeCheckString(switch_stream_handle_t *stream, const unsigned int line, const cJSON *pExpected,
+		const char *pDecoded) {
+	if (cJSON_IsNull(pExpected)) {
+		return pDecoded ? benchDecodeMismatch(stream, line, pExpected->string, "null", pDecoded) : 0;
+	}
+	if (!cJSON_IsString(pExpected)) {
+		return benchDecodeMismatch(stream, line, pExpected->string, "(not a string)", pDecoded ? pDecoded : "null");
+	}
+	if (!pDecoded || strcmp(pExpected->valuestring, pDecoded)) {
+		return benchDecodeMismatch(stream, line, pExpected->string, pExpected->valuestring, pDecoded ? pDecoded : "null");
+	}
+	return 0;
+}
+
+// a number, or what stands in its place, for a mismatch
+static const char *benchDecodeNumberText(char *pBuf, const size_t len, const cJSON *pItem) {
+	if (cJSON_IsNumber(pItem)) {
+		(void) switch_snprintf(pBuf, len, "%.0f", pItem->valuedouble);
+		return pBuf;
+	}
+	return (!pItem || cJSON_IsNull(pItem)) ? "null" : "(not a number)";
+}
+
+static uint32_t benchDecodeCheckNumber(switch_stream_handle_t *stream, const unsigned int line, const cJSON *pExpected,
+		const cJSON *pDecoded) {
+	char expected[32], decoded[32];
+
+	if (cJSON_IsNull(pExpected) && !pDecoded) {
+		return 0;
+	}
+	if (cJSON_IsNumber(pExpected) && cJSON_IsNumber(pDecoded) && pExpected->valuedouble == pDecoded->valuedouble) {
+		return 0;
+	}
+	return benchDecodeMismatch(stream, line, pExpected->string, benchDecodeNumberText(expected, sizeof(expected), pExpected),
+		benchDecodeNumberText(decoded, sizeof(decoded), pDecoded));
+}
+
+static uint32_t benchDecodeCheckId(switch_stream_handle_t *stream, const unsigned int line, const cJSON *pExpected,
+		const janus_id_t decoded) {
+	char expected[32], found[32];
+
+	if (cJSON_IsNumber(pExpected) && (janus_id_t) pExpected->valuedouble == decoded) {
+		return 0;
+	}
+	(void) switch_snprintf(found, sizeof(found), "%" SWITCH_UINT64_T_FMT, decoded);
+	return benchDecodeMismatch(stream, line, pExpected->string, benchDecodeNumberText(expected, sizeof(expected), pExpected), found);
+}
+
+// the number of participants, or null for none
+static uint32_t benchDecodeCheckCount(switch_stream_handle_t *stream, const unsigned int line, const cJSON *pExpected,
+		const cJSON *pDecoded) {
+	char expected[32], decoded[32];
+
+	if (cJSON_IsNull(pExpected) && !pDecoded) {
+		return 0;
+	}
+	if (cJSON_IsNumber(pExpected) && cJSON_IsArray(pDecoded) && cJSON_GetArraySize(pDecoded) == pExpected->valueint) {
+		return 0;
+	}
+	if (cJSON_IsArray(pDecoded)) {
+		(void) switch_snprintf(decoded, sizeof(decoded), "%d", cJSON_GetArraySize(pDecoded));
+	} else {
+		switch_copy_string(decoded, pDecoded ? "(not an array)" : "null", sizeof(decoded));
+	}
+	return benchDecodeMismatch(stream, line, pExpected->string, benchDecodeNumberText(expected, sizeof(expected), pExpected), decoded);
+}
+
+static uint32_t benchDecodeCheckName(switch_stream_handle_t *stream, const unsigned int line, const cJSON *pExpected,
+		const char **ppNames, const size_t count, const unsigned int decoded) {
+	return benchDecodeCheckString(stream, line, pExpected, decoded < count ? ppNames[decoded] : "(out of range)");
+}
+
+// decodes the message and compares it with each field the line expects
+static uint32_t benchDecodeCheck(switch_stream_handle_t *stream, bench_decode_message_t *pMessage) {
+	const unsigned int line = pMessage->line;
+	const cJSON *pDecode = cJSON_GetObjectItemCaseSensitive(pMessage->pExpect, "decode");
+	const switch_bool_t expected = cJSON_IsFalse(pDecode) ? SWITCH_FALSE : SWITCH_TRUE;
+	janus_event_t event;
+	uint32_t mismatches = 0;
+	cJSON *pItem;
+
+	pMessage->decodes = (eventDecode(pMessage->pMessage, &event) == SWITCH_STATUS_SUCCESS) ? SWITCH_TRUE : SWITCH_FALSE;
+
+	if (!pMessage->pExpect) {
+		return 0;
+	}
+	if (pMessage->decodes != expected) {
+		return benchDecodeMismatch(stream, line, "decode", expected ? "success" : "failure", pMessage->decodes ? "success" : "failure");
+	}
+	if (!pMessage->decodes) {
+		return 0;
+	}
+
+	for (pItem = pMessage->pExpect->child; pItem; pItem = pItem->next) {
+		const char *pField = pItem->string;
+
+		if (!strcmp(pField, "decode")) {
+			continue;
+		} else if (!strcmp(pField, "type")) {
+			mismatches += benchDecodeCheckName(stream, line, pItem, benchEventTypeNames,
+				sizeof(benchEventTypeNames) / sizeof(benchEventTypeNames[0]), event.type);
+		} else if (!strcmp(pField, "session_id")) {
+			mismatches += benchDecodeCheckId(stream, line, pItem, event.serverId);
+		} else if (!strcmp(pField, "sender")) {
+			mismatches += benchDecodeCheckId(stream, line, pItem, event.senderId);
+		} else if (!strcmp(pField, "transaction")) {
+			mismatches += benchDecodeCheckString(stream, line, pItem, event.pTransactionId);
+		} else if (!strcmp(pField, "reason")) {
+			mismatches += benchDecodeCheckString(stream, line, pItem, event.pReason);
+		} else if (!strcmp(pField, "error_code")) {
+			mismatches += benchDecodeCheckNumber(stream, line, pItem, event.pErrorCode);
+		} else if (!strcmp(pField, "error_reason")) {
+			mismatches += benchDecodeCheckString(stream, line, pItem, event.pErrorReason);
+		} else if (!strcmp(pField, "audiobridge")) {
+			mismatches += benchDecodeCheckName(stream, line, pItem, benchAudiobridgeNames,
+				sizeof(benchAudiobridgeNames) / sizeof(benchAudiobridgeNames[0]), event.audiobridge);
+		} else if (!strcmp(pField, "room")) {
+			mismatches += benchDecodeCheckNumber(stream, line, pItem, event.pRoom);
+		} else if (!strcmp(pField, "id")) {
+			mismatches += benchDecodeCheckNumber(stream, line, pItem, event.pId);
+		} else if (!strcmp(pField, "participants")) {
+			mismatches += benchDecodeCheckCount(stream, line, pItem, event.pParticipants);
+		} else if (!strcmp(pField, "result")) {
+			mismatches += benchDecodeCheckString(stream, line, pItem, benchDecodeString(event.pResult));
+		} else if (!strcmp(pField, "leaving")) {
+			mismatches += benchDecodeCheckNumber(stream, line, pItem, event.pLeaving);
+		} else if (!strcmp(pField, "plugin_error_code")) {
+			mismatches += benchDecodeCheckNumber(stream, line, pItem, event.pPluginErrorCode);
+		} else if (!strcmp(pField, "plugin_error")) {
+			mismatches += benchDecodeCheckString(stream, line, pItem, benchDecodeString(event.pPluginError));
+		} else if (!strcmp(pField, "jsep_type")) {
+			mismatches += benchDecodeCheckString(stream, line, pItem, event.pJsepType);
+		} else if (!strcmp(pField, "jsep_sdp")) {
+			mismatches += benchDecodeCheckString(stream, line, pItem, event.pJsepSdp);
+		} else if (!strcmp(pField, "candidate")) {
+			mismatches += benchDecodeCheckString(stream, line, pItem, event.pCandidate);
+		} else {
+			stream->write_function(stream, "ERR line %u: no such field %s\n", line, pField);
+			mismatches++;
+		}
+	}
+
+	return mismatches;
+}
+
+static void benchDecodeFree(bench_decode_message_t *pMessages, const uint32_t count) {
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		cJSON_free(pMessages[i].pText);
+		cJSON_Delete(pMessages[i].pRoot);
+	}
+	free(pMessages);
+}
+
+// SWITCH_STATUS_FALSE when the file can't be read or a line isn't JSON
+static switch_status_t benchDecodeLoad(switch_stream_handle_t *stream, const char *pPath,
+		bench_decode_message_t **ppMessages, uint32_t *pCount) {
+	bench_decode_message_t *pMessages = NULL;
+	uint32_t count = 0, size = 0;
+	unsigned int line = 0;
+	char *pLine = NULL;
+	size_t lineSize = 0;
+	FILE *pFile;
+
+	if (!(pFile = fopen(pPath, "r"))) {
+		stream->write_function(stream, "ERR Couldn't open %s\n", pPath);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	while (getline(&pLine, &lineSize, pFile) >= 0) {
+		bench_decode_message_t *pMessage;
+		const char *pJson;
+		cJSON *pRoot;
+
+		line++;
+		if (*pLine == '#' || !(pJson = strchr(pLine, '{'))) {
+			continue;
+		}
+		if (!(pRoot = cJSON_Parse(pJson))) {
+			stream->write_function(stream, "ERR line %u isn't JSON\n", line);
+			goto fail;
+		}
+		if (count == size) {
+			bench_decode_message_t *pGrown;
+
+			size = size ? size * 2 : 64;
+			if (!(pGrown = realloc(pMessages, size * sizeof(*pMessages)))) {
+				cJSON_Delete(pRoot);
+				goto fail;
+			}
+			pMessages = pGrown;
+		}
+
+		pMessage = &pMessages[count++];
+		memset(pMessage, 0, sizeof(*pMessage));
+		pMessage->line = line;
+		pMessage->pRoot = pRoot;
+		if (cJSON_IsObject(pMessage->pMessage = cJSON_GetObjectItemCaseSensitive(pRoot, "message"))) {
+			pMessage->pExpect = cJSON_GetObjectItemCaseSensitive(pRoot, "expect");
+			if (pMessage->pExpect && !cJSON_IsObject(pMessage->pExpect)) {
+				stream->write_function(stream, "ERR line %u: expect isn't an object\n", line);
+				goto fail;
+			}
+		} else {
+			pMessage->pMessage = pRoot;
+		}
+		if (!(pMessage->pText = cJSON_PrintUnformatted(pMessage->pMessage))) {
+			goto fail;
+		}
+	}
+
+	free(pLine);
+	fclose(pFile);
+
+	if (!count) {
+		stream->write_function(stream, "ERR No messages in %s\n", pPath);
+		free(pMessages);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	*ppMessages = pMessages;
+	*pCount = count;
+	return SWITCH_STATUS_SUCCESS;
+
+fail:
+	free(pLine);
+	fclose(pFile);
+	benchDecodeFree(pMessages, count);
+	return SWITCH_STATUS_FALSE;
+}
+
+static switch_status_t benchDecode(switch_stream_handle_t *stream, const char *pPath, const uint32_t rounds) {
+	const uint32_t count = rounds ? rounds : BENCH_DECODE_DEFAULT_ROUNDS;
+	bench_decode_message_t *pMessages = NULL;
+	uint32_t messages = 0, checked = 0, refused = 0, mismatches = 0, timed = 0;
+	double parseNs, decodeNs;
+	switch_time_t start;
+	janus_event_t event;
+	size_t bytes = 0;
+	uint32_t i, round;
+
+	if (zstr(pPath)) {
+		stream->write_function(stream, "USAGE %s\n", JANUS_BENCH_SYNTAX);
+		return SWITCH_STATUS_FALSE;
+	}
+	if (benchDecodeLoad(stream, pPath, &pMessages, &messages) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	for (i = 0; i < messages; i++) {
+		mismatches += benchDecodeCheck(stream, &pMessages[i]);
+		if (pMessages[i].pExpect) {
+			checked++;
+		}
+		if (pMessages[i].decodes) {
+			bytes += strlen(pMessages[i].pText);
+			timed++;
+		} else {
+			refused++;
+		}
+	}
+
+	// only what decodes is timed, so a refusal's warning isn't logged every round
+	start = switch_time_now();
+	for (round = 0; round < count; round++) {
+		for (i = 0; i < messages; i++) {
+			if (pMessages[i].decodes) {
+				cJSON_Delete(cJSON_Parse(pMessages[i].pText));
+			}
+		}
+	}
+	parseNs = nsPerOp(start, (uint64_t) count * timed);
+
+	start = switch_time_now();
+	for (round = 0; round < count; round++) {
+		for (i = 0; i < messages; i++) {
+			if (pMessages[i].decodes) {
+				(void) eventDecode(pMessages[i].pMessage, &event);
+			}
+		}
+	}
+	decodeNs = nsPerOp(start, (uint64_t) count * timed);
+
+	benchDecodeFree(pMessages, messages);
+
+	stream->write_function(stream, "messages|checked|mismatches|refused|bytes|parseNsPerMessage|decodeNsPerMessage|check\n");
+	stream->write_function(stream, "%u|%u|%u|%u|%" SWITCH_SIZE_T_FMT "|%.1f|%.1f|%s\n", messages, checked, mismatches, refused,
+		bytes, parseNs, decodeNs, mismatches ? "MISMATCH" : "ok");
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t benchCommand(int argc, char **argv, switch_stream_handle_t *stream) {
+	if (argc >= 1 && argv[0] && !strcasecmp(argv[0], "hash")) {
+		return benchHash(stream, (argc >= 2 && argv[1]) ? (uint32_t) atol(argv[1]) : 0);
+	} else if (argc >= 1 && argv[0] && !strcasecmp(argv[0], "auth")) {
+		return benchAuth(stream, (argc >= 2 && argv[1]) ? (uint32_t) atol(argv[1]) : 0);
+	} else if (argc >= 1 && argv[0] && !strcasecmp(argv[0], "registry")) {
+		return benchRegistry(stream, (argc >= 2 && argv[1]) ? (uint32_t) atol(argv[1]) : 0);
+#if defined(HAVE_MOD_JANUS_UNIX)
+	} else if (argc >= 1 && argv[0] && !strcasecmp(argv[0], "unix")) {
+		return benchUnix(stream, (argc >= 2 && argv[1]) ? (uint32_t) atol(argv[1]) : 0);
+#if defined(HAVE_MOD_JANUS_WS)
+	} else if (argc >= 1 && argv[0] && !strcasecmp(argv[0], "ws")) {
+		return benchWs(stream, (argc >= 2 && argv[1]) ? (uint32_t) atol(argv[1]) : 0);
+#endif
+#endif
+	} else if (argc >= 1 && argv[0] && !strcasecmp(argv[0], "stream")) {
+		return benchStream(stream, (argc >= 2 && argv[1]) ? (uint32_t) atol(argv[1]) : 0);
+	} else if (argc >= 1 && argv[0] && !strcasecmp(argv[0], "decode")) {
+		return benchDecode(stream, argc >= 2 ? argv[1] : NULL, (argc >= 3 && argv[2]) ? (uint32_t) atol(argv[2]) : 0);
+	} else if (argc >= 1 && argv[0] && !strcasecmp(argv[0], "http2")) {
+		return benchHttp2(stream, argc >= 2 ? argv[1] : NULL, (argc >= 3 && argv[2]) ? (uint32_t) atol(argv[2]) : 0,
+			(argc >= 4 && argv[3]) ? (uint32_t) atol(argv[3]) : 0);
+	}
+
+	stream->write_function(stream, "USAGE %s\n", JANUS_BENCH_SYNTAX);
+	return SWITCH_STATUS_FALSE;
+}
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
@@ -0,0 +1,53 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ * bench.h -- Microbenchmark headers for janus endpoint module
+ *
+ */
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include  "switch.h"
+
+#define JANUS_BENCH_SYNTAX "janus bench [hash [entries]|auth [tokens]|registry [pods]|ws [requests]|unix [requests]|http2 <url> [requests] [concurrency]|stream [events]|decode <fixtures> [rounds]]"
+
+// runs the benchmark named by argv[0] and writes the results to the stream
+switch_status_t benchCommand(int argc, char **argv, switch_stream_handle_t *stream);
+
+#endif //_BENCH_H_
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
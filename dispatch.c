@@ -0,0 +1,306 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ * dispatch.c -- Event dispatch functions for janus endpoint module
+ *
+ */
+#include  "cJSON.h"
+#include  "switch.h"
+
+#include  "globals.h"
+#include  "dispatch.h"
+
+// a worker's backlog is never capped - refusing or side-stepping a job would
+// let a call's later events overtake it - but one this deep is worth a warning
+#define DISPATCH_BACKLOG_WARN 1000
+
+typedef struct dispatch_job_s {
+	server_t *pServer;
+	cJSON *pEvent;
+	api_dispatch_t funcs;
+	switch_time_t queued;
+	struct dispatch_job_s *pNext;
+} dispatch_job_t;
+
+typedef struct {
+	unsigned int index;
+	switch_mutex_t *pMutex;
+	switch_thread_cond_t *pCond;
+	// jobs in the order they arrived
+	dispatch_job_t *pHead;
+	dispatch_job_t *pTail;
+	unsigned int backlog;
+	switch_bool_t stopping;
+	switch_thread_t *pThread;
+} dispatch_worker_t;
+
+static struct {
+	switch_mutex_t *pMutex; // guards count so no job is added once dispatchStop has begun
+	dispatch_worker_t *pWorkers;
+	unsigned int count;
+} dispatch;
+
+static void dispatchRun(dispatch_job_t *pJob) {
+	(void) api_dispatch_event(pJob->pEvent, &pJob->funcs);
+	cJSON_Delete(pJob->pEvent);
+}
+
+static void *SWITCH_THREAD_FUNC dispatch_run(switch_thread_t *pThread, void *pObj) {
+	dispatch_worker_t *pWorker = (dispatch_worker_t *) pObj;
+
+	(void) pThread;
+
+	DEBUG(SWITCH_CHANNEL_LOG, "Dispatch worker=%u started\n", pWorker->index);
+
+	for (;;) {
+		dispatch_job_t *pJob;
+		server_t *pServer;
+		switch_time_t lag;
+
+		switch_mutex_lock(pWorker->pMutex);
+		while (!pWorker->pHead && !pWorker->stopping) {
+			(void) switch_thread_cond_wait(pWorker->pCond, pWorker->pMutex);
+		}
+		// only stops once everything queued has been run
+		if (!(pJob = pWorker->pHead)) {
+			switch_mutex_unlock(pWorker->pMutex);
+			break;
+		}
+		if (!(pWorker->pHead = pJob->pNext)) {
+			pWorker->pTail = NULL;
+		}
+		pWorker->backlog--;
+		switch_mutex_unlock(pWorker->pMutex);
+
+		pServer = pJob->pServer;
+		lag = switch_time_now() - pJob->queued;
+
+		switch_mutex_lock(pServer->mutex);
+		pServer->dispatchLagAvg += (lag - pServer->dispatchLagAvg) / 8;
+		if (lag > pServer->dispatchLagMax) {
+			pServer->dispatchLagMax = lag;
+		}
+		switch_mutex_unlock(pServer->mutex);
+
+		dispatchRun(pJob);
+		free(pJob);
+
+		// only counted as done once the callbacks have returned - see dispatchFlush
+		switch_mutex_lock(pServer->mutex);
+		if (!--pServer->dispatchQueued) {
+			(void) switch_thread_cond_broadcast(pServer->pDispatchCond);
+		}
+		switch_mutex_unlock(pServer->mutex);
+	}
+
+	DEBUG(SWITCH_CHANNEL_LOG, "Dispatch worker=%u stopped\n", pWorker->index);
+
+	return NULL;
+}
+
+switch_status_t dispatchStart(const unsigned int threads) {
+	switch_threadattr_t *pThreadAttr = NULL;
+	unsigned int i;
+
+	if (!dispatch.pMutex) {
+		switch_mutex_init(&dispatch.pMutex, SWITCH_MUTEX_NESTED, globals.pModulePool);
+	}
+
+	if (dispatch.count || !threads) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	dispatch.pWorkers = switch_core_alloc(globals.pModulePool, sizeof(*dispatch.pWorkers) * threads);
+
+	for (i = 0; i < threads; i++) {
+		dispatch_worker_t *pWorker = &dispatch.pWorkers[i];
+
+		pWorker->index = i;
+		pWorker->pHead = pWorker->pTail = NULL;
+		pWorker->backlog = 0;
+		pWorker->stopping = SWITCH_FALSE;
+		switch_mutex_init(&pWorker->pMutex, SWITCH_MUTEX_NESTED, globals.pModulePool);
+		if (switch_thread_cond_create(&pWorker->pCond, globals.pModulePool) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't create dispatch condition\n");
+			return SWITCH_STATUS_FALSE;
+		}
+	}
+
+	for (i = 0; i < threads; i++) {
+		switch_threadattr_create(&pThreadAttr, globals.pModulePool);
+		switch_threadattr_stacksize_set(pThreadAttr, SWITCH_THREAD_STACKSIZE);
+		switch_thread_create(&dispatch.pWorkers[i].pThread, pThreadAttr, dispatch_run, &dispatch.pWorkers[i], globals.pModulePool);
+	}
+
+	switch_mutex_lock(dispatch.pMutex);
+	dispatch.count = threads;
+	switch_mutex_unlock(dispatch.pMutex);
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Event dispatch started with %u worker(s)\n", threads);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+switch_bool_t dispatchRunning(void) {
+	switch_bool_t running;
+
+	if (!dispatch.pMutex) {
+		return SWITCH_FALSE;
+	}
+
+	switch_mutex_lock(dispatch.pMutex);
+	running = dispatch.count ? SWITCH_TRUE : SWITCH_FALSE;
+	switch_mutex_unlock(dispatch.pMutex);
+
+	return running;
+}
+
+// queued events are dispatched before the workers exit
+void dispatchStop(void) {
+	unsigned int i, count;
+
+	if (!dispatch.pMutex) {
+		return;
+	}
+
+	// new events are now dispatched on the calling thread.  Taken under the
+	// lock so that a job being added as this runs is in a list before the
+	// workers are told to stop
+	switch_mutex_lock(dispatch.pMutex);
+	count = dispatch.count;
+	dispatch.count = 0;
+	switch_mutex_unlock(dispatch.pMutex);
+
+	if (!count) {
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		dispatch_worker_t *pWorker = &dispatch.pWorkers[i];
+
+		switch_mutex_lock(pWorker->pMutex);
+		pWorker->stopping = SWITCH_TRUE;
+		(void) switch_thread_cond_signal(pWorker->pCond);
+		switch_mutex_unlock(pWorker->pMutex);
+	}
+
+	for (i = 0; i < count; i++) {
+		switch_status_t returnValue;
+		(void) switch_thread_join(&returnValue, dispatch.pWorkers[i].pThread);
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Event dispatch stopped\n");
+}
+
+void dispatchFlush(server_t *pServer) {
+	switch_assert(pServer);
+
+	switch_mutex_lock(pServer->mutex);
+	while (pServer->dispatchQueued) {
+		(void) switch_thread_cond_wait(pServer->pDispatchCond, pServer->mutex);
+	}
+	switch_mutex_unlock(pServer->mutex);
+}
+
+void dispatchEvent(server_t *pServer, cJSON *pEvent, const api_dispatch_t *pDispatch) {
+	dispatch_worker_t *pWorker = NULL;
+	dispatch_job_t *pJob;
+	janus_id_t senderId = 0;
+	unsigned int backlog = 0;
+	cJSON *pSender;
+
+	switch_assert(pServer);
+	switch_assert(pDispatch);
+
+	if (!pEvent) {
+		return;
+	}
+
+	switch_zmalloc(pJob, sizeof(*pJob));
+	pJob->pServer = pServer;
+	pJob->pEvent = pEvent;
+	pJob->funcs = *pDispatch;
+
+	// session level events (keepalives etc.) have no sender and go to the
+	// first worker
+	pSender = cJSON_GetObjectItemCaseSensitive(pEvent, "sender");
+	if (cJSON_IsNumber(pSender)) {
+		senderId = (janus_id_t) pSender->valuedouble;
+	}
+
+	pJob->queued = switch_time_now();
+
+	// counted before it can be seen by a worker so dispatchQueued never goes
+	// below zero
+	switch_mutex_lock(pServer->mutex);
+	pServer->dispatchQueued++;
+	switch_mutex_unlock(pServer->mutex);
+
+	if (dispatch.pMutex) {
+		switch_mutex_lock(dispatch.pMutex);
+		if (dispatch.count) {
+			pWorker = &dispatch.pWorkers[senderId % dispatch.count];
+
+			switch_mutex_lock(pWorker->pMutex);
+			if (pWorker->pTail) {
+				pWorker->pTail->pNext = pJob;
+			} else {
+				pWorker->pHead = pJob;
+			}
+			pWorker->pTail = pJob;
+			backlog = ++pWorker->backlog;
+			(void) switch_thread_cond_signal(pWorker->pCond);
+			switch_mutex_unlock(pWorker->pMutex);
+		}
+		switch_mutex_unlock(dispatch.pMutex);
+	}
+
+	if (!pWorker) {
+		dispatchRun(pJob);
+		free(pJob);
+
+		switch_mutex_lock(pServer->mutex);
+		if (!--pServer->dispatchQueued) {
+			(void) switch_thread_cond_broadcast(pServer->pDispatchCond);
+		}
+		switch_mutex_unlock(pServer->mutex);
+	} else if (backlog == DISPATCH_BACKLOG_WARN) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Dispatch worker=%u has %u events waiting\n", pWorker->index, backlog);
+	}
+}
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
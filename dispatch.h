@@ -0,0 +1,65 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ * dispatch.h -- Event dispatch headers for janus endpoint module
+ *
+ */
+#ifndef _DISPATCH_H_
+#define _DISPATCH_H_
+
+#include  "switch.h"
+#include  "cJSON.h"
+#include  "servers.h"
+#include  "api.h"
+
+#define DISPATCH_DEFAULT_THREADS 4
+
+// Janus events are handed to a pool of workers, sharded by senderId so that
+// each call sees its events in order while different calls run in parallel.
+// With no workers running events are dispatched on the calling thread
+switch_status_t dispatchStart(const unsigned int threads);
+void dispatchStop(void);
+switch_bool_t dispatchRunning(void);
+
+// takes ownership of pEvent; the callbacks are copied
+void dispatchEvent(server_t *pServer, cJSON *pEvent, const api_dispatch_t *pDispatch);
+// waits until every event queued for the server has been dispatched
+void dispatchFlush(server_t *pServer);
+
+#endif //_DISPATCH_H_
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
@@ -0,0 +1,401 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ *
+ * event.c -- Janus message decoding for janus endpoint module
+ *
+ * Each object of a message is walked once, picking out the members that
+ * mod_janus uses, instead of a cJSON_GetObjectItemCaseSensitive() scan of
+ * the object for every member
+ *
+ */
+#include  "switch.h"
+#include  "cJSON.h"
+
+#include  "globals.h"
+#include  "api.h"
+#include  "event.h"
+
+// The janus and audiobridge names each hash to a different one of 32 slots
+// from their length and first and last characters alone, so a lookup is a
+// hash and a single strcmp.  Check for collisions when adding a name
+#define EVENT_HASH_SIZE 32
+
+typedef struct {
+	const char *pName;
+	int type;
+} event_name_t;
+
+static const event_name_t eventTypes[EVENT_HASH_SIZE] = {
+	[0]  = { "error",       JANUS_EVENT_ERROR },
+	[3]  = { "success",     JANUS_EVENT_SUCCESS },
+	[5]  = { "media",       JANUS_EVENT_MEDIA },
+	[6]  = { "event",       JANUS_EVENT_EVENT },
+	[12] = { "slowlink",    JANUS_EVENT_SLOWLINK },
+	[15] = { "webrtcup",    JANUS_EVENT_WEBRTCUP },
+	[19] = { "keepalive",   JANUS_EVENT_KEEPALIVE },
+	[21] = { "ack",         JANUS_EVENT_ACK },
+	[23] = { "timeout",     JANUS_EVENT_TIMEOUT },
+	[24] = { "detached",    JANUS_EVENT_DETACHED },
+	[26] = { "trickle",     JANUS_EVENT_TRICKLE },
+	[27] = { "server_info", JANUS_EVENT_SERVER_INFO },
+	[30] = { "hangup",      JANUS_EVENT_HANGUP }
+};
+
+static const event_name_t audiobridgeTypes[EVENT_HASH_SIZE] = {
+	[0]  = { "talking",         JANUS_AUDIOBRIDGE_TALKING },
+	[3]  = { "success",         JANUS_AUDIOBRIDGE_SUCCESS },
+	[6]  = { "event",           JANUS_AUDIOBRIDGE_EVENT },
+	[7]  = { "stopped-talking", JANUS_AUDIOBRIDGE_STOPPED_TALKING },
+	[9]  = { "roomchanged",     JANUS_AUDIOBRIDGE_ROOMCHANGED },
+	[12] = { "left",            JANUS_AUDIOBRIDGE_LEFT },
+	[22] = { "created",         JANUS_AUDIOBRIDGE_CREATED },
+	[23] = { "edited",          JANUS_AUDIOBRIDGE_EDITED },
+	[25] = { "destroyed",       JANUS_AUDIOBRIDGE_DESTROYED },
+	[28] = { "joined",          JANUS_AUDIOBRIDGE_JOINED }
+};
+
+static int eventLookup(const event_name_t *pTable, const char *pName) {
+	const event_name_t *pEntry;
+	size_t len;
+
+	if (!pName || !(len = strlen(pName))) {
+		return 0;
+	}
+
+	pEntry = &pTable[((unsigned char) pName[0] + 19 * (unsigned char) pName[len - 1] + (unsigned int) len) & (EVENT_HASH_SIZE - 1)];
+
+	return (pEntry->pName && !strcmp(pEntry->pName, pName)) ? pEntry->type : 0;
+}
+
+janus_event_type_t eventType(const char *pType) {
+	return (janus_event_type_t) eventLookup(eventTypes, pType);
+}
+
+janus_audiobridge_type_t eventAudiobridgeType(const char *pType) {
+	return (janus_audiobridge_type_t) eventLookup(audiobridgeTypes, pType);
+}
+
+static const char *eventString(const cJSON *pItem) {
+	return cJSON_IsString(pItem) ? pItem->valuestring : NULL;
+}
+
+// the audiobridge's data - the callers check the types of what they use
+static void eventDecodeData(janus_event_t *pEvent) {
+	cJSON *pItem;
+
+	for (pItem = pEvent->pJsonData->child; pItem; pItem = pItem->next) {
+		const char *pKey = pItem->string;
+
+		if (!pKey) {
+			continue;
+		}
+		switch (pKey[0]) {
+		case 'a':
+			if (!strcmp(pKey, "audiobridge") && (pEvent->pAudiobridge = eventString(pItem))) {
+				pEvent->audiobridge = eventAudiobridgeType(pEvent->pAudiobridge);
+			}
+			break;
+		case 'e':
+			if (!strcmp(pKey, "error_code")) {
+				pEvent->pPluginErrorCode = pItem;
+			} else if (!strcmp(pKey, "error")) {
+				pEvent->pPluginError = pItem;
+			}
+			break;
+		case 'i':
+			if (!strcmp(pKey, "id")) {
+				pEvent->pId = pItem;
+			}
+			break;
+		case 'l':
+			if (!strcmp(pKey, "leaving")) {
+				pEvent->pLeaving = pItem;
+			}
+			break;
+		case 'p':
+			if (!strcmp(pKey, "participants")) {
+				pEvent->pParticipants = pItem;
+			}
+			break;
+		case 'r':
+			if (!strcmp(pKey, "room")) {
+				pEvent->pRoom = pItem;
+			} else if (!strcmp(pKey, "result")) {
+				pEvent->pResult = pItem;
+			}
+			break;
+		}
+	}
+}
+
+static switch_status_t eventDecodePluginData(janus_event_t *pEvent, cJSON *pPluginData) {
+	cJSON *pPlugin = NULL;
+	cJSON *pItem;
+
+	if (!cJSON_IsObject(pPluginData)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid type (plugindata)\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	for (pItem = pPluginData->child; pItem; pItem = pItem->next) {
+		if (!pItem->string) {
+			continue;
+		}
+		if (!strcmp(pItem->string, "plugin")) {
+			pPlugin = pItem;
+		} else if (!strcmp(pItem->string, "data")) {
+			pEvent->pJsonData = pItem;
+		}
+	}
+
+	if (!cJSON_IsString(pPlugin) || strcmp(JANUS_PLUGIN, pPlugin->valuestring)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (plugindata.plugin)\n");
+		return SWITCH_STATUS_FALSE;
+	}
+	if (!cJSON_IsObject(pEvent->pJsonData)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid type (plugindata.data)\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t eventDecodeCandidate(janus_event_t *pEvent, cJSON *pCandidate) {
+	cJSON *pCompleted = NULL;
+	cJSON *pData = NULL;
+	cJSON *pItem;
+
+	if (!cJSON_IsObject(pCandidate)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid type (candidate)\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	//NB. sdpMLineIndex is ignored - we're only doing audio
+	for (pItem = pCandidate->child; pItem; pItem = pItem->next) {
+		if (!pItem->string) {
+			continue;
+		}
+		if (!strcmp(pItem->string, "completed")) {
+			pCompleted = pItem;
+		} else if (!strcmp(pItem->string, "candidate")) {
+			pData = pItem;
+		}
+	}
+
+	if (pCompleted) {
+		if (!cJSON_IsTrue(pCompleted)) {
+			// assumes that completed is always true value
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (candidate.completed)\n");
+			return SWITCH_STATUS_FALSE;
+		}
+		pEvent->pCandidate = "";
+	} else if (pData) {
+		if (!(pEvent->pCandidate = eventString(pData))) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (candidate.candidate)\n");
+			return SWITCH_STATUS_FALSE;
+		}
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+// an object's string members
+static void eventDecodePair(cJSON *pObject, const char *pName1, const char **ppValue1, const char *pName2, const char **ppValue2) {
+	cJSON *pItem;
+
+	for (pItem = pObject->child; pItem; pItem = pItem->next) {
+		if (!pItem->string) {
+			continue;
+		}
+		if (!strcmp(pItem->string, pName1)) {
+			*ppValue1 = eventString(pItem);
+		} else if (!strcmp(pItem->string, pName2)) {
+			*ppValue2 = eventString(pItem);
+		}
+	}
+}
+
+switch_status_t eventDecode(cJSON *pJson, janus_event_t *pEvent) {
+	cJSON *pJanus = NULL;
+	cJSON *pTransaction = NULL;
+	cJSON *pServerId = NULL;
+	cJSON *pSender = NULL;
+	cJSON *pPluginData = NULL;
+	cJSON *pCandidate = NULL;
+	cJSON *pError = NULL;
+	cJSON *pItem;
+
+	switch_assert(pEvent);
+
+	memset(pEvent, 0, sizeof(*pEvent));
+
+	if (pJson == NULL) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "No response to decode\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	for (pItem = pJson->child; pItem; pItem = pItem->next) {
+		const char *pKey = pItem->string;
+
+		if (!pKey) {
+			continue;
+		}
+		switch (pKey[0]) {
+		case 'c':
+			if (!strcmp(pKey, "candidate")) {
+				pCandidate = pItem;
+			}
+			break;
+		case 'd':
+			if (!strcmp(pKey, "data")) {
+				pEvent->pJsonData = pItem;
+			}
+			break;
+		case 'e':
+			if (!strcmp(pKey, "error")) {
+				pError = pItem;
+			}
+			break;
+		case 'j':
+			if (!strcmp(pKey, "janus")) {
+				pJanus = pItem;
+			} else if (!strcmp(pKey, "jsep")) {
+				pEvent->pJsonJsep = pItem;
+			}
+			break;
+		case 'p':
+			if (!strcmp(pKey, "plugindata")) {
+				pPluginData = pItem;
+			}
+			break;
+		case 'r':
+			if (!strcmp(pKey, "reason")) {
+				pEvent->pReason = eventString(pItem);
+			}
+			break;
+		case 's':
+			if (!strcmp(pKey, "sender")) {
+				pSender = pItem;
+			} else if (!strcmp(pKey, "session_id")) {
+				pServerId = pItem;
+			}
+			break;
+		case 't':
+			if (!strcmp(pKey, "transaction")) {
+				pTransaction = pItem;
+			}
+			break;
+		}
+	}
+
+	if (pEvent->pJsonData) {
+		if (!cJSON_IsObject(pEvent->pJsonData)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid type (data)\n");
+			return SWITCH_STATUS_FALSE;
+		}
+	} else if (pPluginData) {
+		if (eventDecodePluginData(pEvent, pPluginData) != SWITCH_STATUS_SUCCESS) {
+			return SWITCH_STATUS_FALSE;
+		}
+	} else if (pCandidate) {
+		if (eventDecodeCandidate(pEvent, pCandidate) != SWITCH_STATUS_SUCCESS) {
+			return SWITCH_STATUS_FALSE;
+		}
+	}
+	if (pEvent->pJsonData) {
+		eventDecodeData(pEvent);
+	}
+
+	if (pEvent->pJsonJsep) {
+		if (!cJSON_IsObject(pEvent->pJsonJsep)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid type (jsep)\n");
+			return SWITCH_STATUS_FALSE;
+		}
+		eventDecodePair(pEvent->pJsonJsep, "type", &pEvent->pJsepType, "sdp", &pEvent->pJsepSdp);
+	}
+
+	if (pJanus) {
+		if (!(pEvent->pType = eventString(pJanus))) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (janus)\n");
+			return SWITCH_STATUS_FALSE;
+		}
+		pEvent->type = eventType(pEvent->pType);
+	}
+
+	if (pTransaction && !(pEvent->pTransactionId = eventString(pTransaction))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (transaction)\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (pServerId) {
+		if (!cJSON_IsNumber(pServerId)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (session_id)\n");
+			return SWITCH_STATUS_FALSE;
+		}
+		pEvent->serverId = (janus_id_t) pServerId->valuedouble;
+	}
+
+	if (pSender) {
+		if (!cJSON_IsNumber(pSender)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response (sender)\n");
+			return SWITCH_STATUS_FALSE;
+		}
+		pEvent->senderId = (janus_id_t) pSender->valuedouble;
+	}
+
+	if (cJSON_IsObject(pError)) {
+		pEvent->pJsonError = pError;
+		for (pItem = pError->child; pItem; pItem = pItem->next) {
+			if (!pItem->string) {
+				continue;
+			}
+			if (!strcmp(pItem->string, "code")) {
+				pEvent->pErrorCode = pItem;
+			} else if (!strcmp(pItem->string, "reason")) {
+				pEvent->pErrorReason = eventString(pItem);
+			}
+		}
+	}
+
+	MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "janus=%s transaction=%s serverId=%" SWITCH_UINT64_T_FMT " sender=%" SWITCH_UINT64_T_FMT "\n",
+		pEvent->pType ? pEvent->pType : "", pEvent->pTransactionId ? pEvent->pTransactionId : "", pEvent->serverId, pEvent->senderId);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
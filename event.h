@@ -0,0 +1,127 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ *
+ * event.h -- Janus message decoding headers for janus endpoint module
+ *
+ */
+#ifndef _EVENT_H_
+#define _EVENT_H_
+
+#include  "switch.h"
+#include  "cJSON.h"
+#include  "hash.h"
+
+// the janus field of a message
+typedef enum {
+	JANUS_EVENT_UNKNOWN = 0,
+	JANUS_EVENT_KEEPALIVE,
+	JANUS_EVENT_ACK,
+	JANUS_EVENT_SUCCESS,
+	JANUS_EVENT_ERROR,
+	JANUS_EVENT_EVENT,
+	JANUS_EVENT_TRICKLE,
+	JANUS_EVENT_WEBRTCUP,
+	JANUS_EVENT_MEDIA,
+	JANUS_EVENT_SLOWLINK,
+	JANUS_EVENT_HANGUP,
+	JANUS_EVENT_DETACHED,
+	JANUS_EVENT_TIMEOUT,
+	JANUS_EVENT_SERVER_INFO
+} janus_event_type_t;
+
+// the audiobridge field of the plugin's data
+typedef enum {
+	JANUS_AUDIOBRIDGE_UNKNOWN = 0,
+	JANUS_AUDIOBRIDGE_JOINED,
+	JANUS_AUDIOBRIDGE_EVENT,
+	JANUS_AUDIOBRIDGE_LEFT,
+	JANUS_AUDIOBRIDGE_CREATED,
+	JANUS_AUDIOBRIDGE_DESTROYED,
+	JANUS_AUDIOBRIDGE_EDITED,
+	JANUS_AUDIOBRIDGE_SUCCESS,
+	JANUS_AUDIOBRIDGE_ROOMCHANGED,
+	JANUS_AUDIOBRIDGE_TALKING,
+	JANUS_AUDIOBRIDGE_STOPPED_TALKING
+} janus_audiobridge_type_t;
+
+// One Janus message (a response or an event) decoded in a single walk over
+// each of its objects.  Strings and objects point into the cJSON tree, which
+// must outlive this.  Anything absent, or of the wrong type where the type
+// isn't checked by eventDecode(), is NULL or 0
+typedef struct {
+	janus_event_type_t type;
+	const char *pType;
+	janus_id_t serverId;
+	janus_id_t senderId;
+	const char *pTransactionId;
+	// hangup
+	const char *pReason;
+	// error, when it is an object, and its code and reason
+	cJSON *pJsonError;
+	cJSON *pErrorCode;
+	const char *pErrorReason;
+
+	// data, or plugindata.data from the audiobridge
+	cJSON *pJsonData;
+	janus_audiobridge_type_t audiobridge;
+	const char *pAudiobridge;
+	cJSON *pId;
+	cJSON *pRoom;
+	cJSON *pParticipants;
+	cJSON *pResult;
+	cJSON *pLeaving;
+	cJSON *pPluginErrorCode;
+	cJSON *pPluginError;
+
+	cJSON *pJsonJsep;
+	const char *pJsepType;
+	const char *pJsepSdp;
+
+	// "" once the candidates are complete
+	const char *pCandidate;
+} janus_event_t;
+
+// fails, having logged why, if the message isn't one mod_janus can use
+switch_status_t eventDecode(cJSON *pJson, janus_event_t *pEvent);
+// JANUS_EVENT_UNKNOWN for anything else
+janus_event_type_t eventType(const char *pType);
+janus_audiobridge_type_t eventAudiobridgeType(const char *pType);
+
+#endif //_EVENT_H_
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
@@ -37,6 +37,7 @@
 #include  "hash.h"
 
 typedef struct server_s server_t;
+typedef struct registry_snapshot_s registry_snapshot_t;
 
 typedef struct {
   switch_memory_pool_t *pModulePool;
@@ -58,8 +59,28 @@ typedef struct {
   server_t *pod_defaults;
   switch_thread_t *registry_thread;
   switch_bool_t registry_terminating;
+  /* signalled (under registry_mutex) to cut the registry thread's sleep short */
+  switch_thread_cond_t *registry_stop_cond;
+  /* pods found by the last refresh; swapped under registry_mutex */
+  switch_mutex_t *registry_mutex;
+  registry_snapshot_t *pRegistry;
+  /* dial-time refreshes share the one in flight; pods they could not find are remembered briefly */
+  switch_thread_cond_t *registry_cond;
+  switch_bool_t registry_refreshing;
+  unsigned int registry_generation;
+  switch_hash_t *pRegistryUnknown;
+  unsigned int registry_unknown_count;
   void (*start_server_thread)(server_t *pServer, switch_bool_t wait_for_active);
   void (*stop_server_thread)(server_t *pServer);
+
+  /* curl-multi threads driving all Janus HTTP requests; 0 = blocking requests */
+  unsigned int http_engine_threads;
+  /* workers running Janus event callbacks; 0 = run them on the server thread */
+  unsigned int dispatch_threads;
+  /* workers detaching the handles of hung up calls; 0 = detach on the session thread */
+  unsigned int teardown_threads;
+  /* threads stepping all servers; 0 = a thread per server */
+  unsigned int server_loop_threads;
 } globals_t;
 
 // define as a macro so we can eliminate one nested function
@@ -0,0 +1,254 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ * handles.c -- Pre-attached plugin handle functions for janus endpoint module
+ *
+ */
+#include  "switch.h"
+
+#include  "globals.h"
+#include  "api.h"
+#include  "handles.h"
+
+#define HANDLES_QUEUE_SIZE 256
+#define HANDLES_THREADS 4
+#define HANDLES_OPAQUE_ID "mod_janus-pool"
+
+static struct {
+	switch_queue_t *pQueue;
+	switch_thread_t *pThreads[HANDLES_THREADS];
+	switch_bool_t running;
+} handles;
+
+// called with pServer->mutex held
+static void handlesRequestRefill(server_t *pServer) {
+	if (!handles.running || pServer->handleRefilling || !pServer->handleServerId ||
+			pServer->handleCount >= pServer->handlePoolSize) {
+		return;
+	}
+
+	if (switch_queue_trypush(handles.pQueue, pServer) == SWITCH_STATUS_SUCCESS) {
+		pServer->handleRefilling = SWITCH_TRUE;
+	}
+}
+
+// Attaches one handle, then puts the server back at the end of the queue if
+// it needs more.  A server is only ever on one worker, so a Janus that is slow
+// to answer holds up one worker for one attach rather than all the refills
+static void handlesRefill(server_t *pServer) {
+	janus_id_t serverId, senderId;
+
+	switch_mutex_lock(pServer->mutex);
+	serverId = pServer->handleServerId;
+	if (!serverId || pServer->handleCount >= pServer->handlePoolSize ||
+			switch_test_flag(pServer, SFLAG_TERMINATING)) {
+		pServer->handleRefilling = SWITCH_FALSE;
+		switch_mutex_unlock(pServer->mutex);
+		return;
+	}
+	switch_mutex_unlock(pServer->mutex);
+
+	senderId = apiGetSenderId(pServer, serverId, HANDLES_OPAQUE_ID);
+
+	switch_mutex_lock(pServer->mutex);
+	if (!senderId) {
+		// try again when the next handle is taken
+		pServer->handleRefilling = SWITCH_FALSE;
+		switch_mutex_unlock(pServer->mutex);
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Server=%s couldn't attach pooled handle\n", pServer->name);
+		return;
+	}
+	if (pServer->handleServerId == serverId && pServer->handleCount < pServer->handlePoolSize) {
+		pServer->pHandles[pServer->handleCount++] = senderId;
+		senderId = 0;
+	}
+	pServer->handleRefilling = SWITCH_FALSE;
+	handlesRequestRefill(pServer);
+	switch_mutex_unlock(pServer->mutex);
+
+	if (senderId) {
+		// the session changed or the pool was filled while attaching
+		(void) apiDetach(pServer, serverId, senderId);
+	}
+}
+
+static void *SWITCH_THREAD_FUNC handles_run(switch_thread_t *pThread, void *pObj) {
+	void *pPop;
+
+	(void) pThread;
+	(void) pObj;
+
+	DEBUG(SWITCH_CHANNEL_LOG, "Handle pool worker started\n");
+
+	for (;;) {
+		pPop = NULL;
+		if (switch_queue_pop(handles.pQueue, &pPop) != SWITCH_STATUS_SUCCESS) {
+			continue;
+		}
+		// a NULL server asks the worker to stop
+		if (!pPop) {
+			break;
+		}
+		handlesRefill((server_t *) pPop);
+	}
+
+	DEBUG(SWITCH_CHANNEL_LOG, "Handle pool worker stopped\n");
+
+	return NULL;
+}
+
+switch_status_t handlesStart(void) {
+	switch_threadattr_t *pThreadAttr = NULL;
+	unsigned int i;
+
+	if (handles.running) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (!handles.pQueue && switch_queue_create(&handles.pQueue, HANDLES_QUEUE_SIZE, globals.pModulePool) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't create handle pool queue\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	for (i = 0; i < HANDLES_THREADS; i++) {
+		switch_threadattr_create(&pThreadAttr, globals.pModulePool);
+		switch_threadattr_stacksize_set(pThreadAttr, SWITCH_THREAD_STACKSIZE);
+		switch_thread_create(&handles.pThreads[i], pThreadAttr, handles_run, NULL, globals.pModulePool);
+	}
+
+	handles.running = SWITCH_TRUE;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+void handlesStop(void) {
+	switch_status_t returnValue;
+	unsigned int i;
+
+	if (!handles.running) {
+		return;
+	}
+
+	handles.running = SWITCH_FALSE;
+	for (i = 0; i < HANDLES_THREADS; i++) {
+		(void) switch_queue_push(handles.pQueue, NULL);
+	}
+	for (i = 0; i < HANDLES_THREADS; i++) {
+		(void) switch_thread_join(&returnValue, handles.pThreads[i]);
+		handles.pThreads[i] = NULL;
+	}
+}
+
+void handlesReset(server_t *pServer, const janus_id_t serverId) {
+	switch_assert(pServer);
+
+	if (!pServer->handlePoolSize) {
+		return;
+	}
+
+	switch_mutex_lock(pServer->mutex);
+	if (!pServer->pHandles) {
+		pServer->pHandles = switch_core_alloc(globals.pModulePool, sizeof(janus_id_t) * pServer->handlePoolSize);
+	}
+	// a reclaimed session keeps its handles, anything else starts again
+	if (pServer->handleServerId != serverId) {
+		pServer->handleCount = 0;
+		pServer->handleServerId = serverId;
+	}
+	handlesRequestRefill(pServer);
+	switch_mutex_unlock(pServer->mutex);
+}
+
+void handlesClear(server_t *pServer) {
+	switch_assert(pServer);
+
+	switch_mutex_lock(pServer->mutex);
+	pServer->handleCount = 0;
+	pServer->handleServerId = 0;
+	switch_mutex_unlock(pServer->mutex);
+}
+
+void handlesDetach(server_t *pServer) {
+	janus_id_t serverId;
+	unsigned int count;
+
+	switch_assert(pServer);
+
+	switch_mutex_lock(pServer->mutex);
+	serverId = pServer->handleServerId;
+	count = pServer->handleCount;
+	// a refill in flight detaches what it attaches once it sees this
+	pServer->handleCount = 0;
+	pServer->handleServerId = 0;
+	switch_mutex_unlock(pServer->mutex);
+
+	// the pool is no longer touched by anyone else, so it can be read unlocked
+	while (serverId && count) {
+		janus_id_t senderId = pServer->pHandles[--count];
+
+		if (apiDetach(pServer, serverId, senderId) != SWITCH_STATUS_SUCCESS) {
+			// the rest go with the session when Janus times it out
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Server=%s couldn't detach %u pooled handle(s)\n",
+				pServer->name, count + 1);
+			break;
+		}
+	}
+}
+
+janus_id_t handlesTake(server_t *pServer, const janus_id_t serverId) {
+	janus_id_t senderId = 0;
+
+	switch_assert(pServer);
+
+	if (!pServer->handlePoolSize) {
+		return 0;
+	}
+
+	switch_mutex_lock(pServer->mutex);
+	if (pServer->handleServerId == serverId && pServer->handleCount) {
+		senderId = pServer->pHandles[--pServer->handleCount];
+		pServer->handleHits++;
+	} else {
+		pServer->handleMisses++;
+	}
+	handlesRequestRefill(pServer);
+	switch_mutex_unlock(pServer->mutex);
+
+	return senderId;
+}
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
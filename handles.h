@@ -0,0 +1,70 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ * handles.h -- Pre-attached plugin handle headers for janus endpoint module
+ *
+ */
+#ifndef _HANDLES_H_
+#define _HANDLES_H_
+
+#include  "switch.h"
+#include  "servers.h"
+
+#define HANDLE_POOL_DEFAULT_SIZE 4
+
+// Each server keeps a few audiobridge handles attached ahead of time so that
+// a new call doesn't wait for an attach round trip.  The pools are topped up
+// by a few background workers, one handle at a time and in turn, so a server
+// that is slow to attach doesn't hold up the others.  With the workers stopped
+// every call attaches inline
+switch_status_t handlesStart(void);
+void handlesStop(void);
+
+// the server has a new (or reclaimed) Janus session - handles attached to
+// any other session are dropped and the pool refilled
+void handlesReset(server_t *pServer, const janus_id_t serverId);
+// the session has gone - drop the pooled handles
+void handlesClear(server_t *pServer);
+// the server is stopping while its session may still be up - detach the
+// pooled handles rather than leave them until Janus times the session out
+void handlesDetach(server_t *pServer);
+// returns a handle attached to serverId or 0 if none is ready
+janus_id_t handlesTake(server_t *pServer, const janus_id_t serverId);
+
+#endif //_HANDLES_H_
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
@@ -29,21 +29,155 @@
  *
  * hash.c -- Hash functions for janus endpoint module
  *
- * Thin wrapper that takes a key as a uin64_t and translates it
- * to a string that is acceptable by the standard hash functions
+ * Open-addressing table keyed directly on the 64-bit Janus id.
+ *
+ * Readers never take the mutex and never allocate - they sample the sequence
+ * counter, probe the table and retry if a writer was active in the meantime.
+ * Writers are serialised by the mutex and bump the counter either side of
+ * each change.  A table that has been outgrown is kept on the retired list
+ * rather than freed so that a reader still probing it only ever sees stale
+ * data (which the sequence check rejects), never freed memory.  For the
+ * same reason a table that may still be looked up is emptied in place by
+ * hashClear(), or set aside by hashRetire() until the module unloads; only
+ * hashDestroy() frees one straight away.
  *
  */
 #include  "globals.h"
 #include  "hash.h"
+#include  <sched.h>
+
+#define HASH_INITIAL_SIZE 64
+// times a reader checks for a writer to finish before giving up its CPU
+#define HASH_SPIN_LIMIT 64
+
+// tables set aside by hashRetire(), chained through pRetired
+static hash_table_t *pRetiredTables = NULL;
+
+static inline void cpuRelax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+static inline uint32_t idToSlot(const janus_id_t id, const uint32_t mask) {
+  // ids are random but mix them anyway so sequential ids don't cluster
+  uint64_t x = id;
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  return (uint32_t) x & mask;
+}
 
-// calling process must free the returned value
-static char *idToStr(const janus_id_t id) {
-  char *pResult = switch_mprintf("%" SWITCH_UINT64_T_FMT, id);
-  if (pResult == NULL) {
-    fprintf(stderr,"ABORT! Realloc failure at: %s:%d", __FILE__, __LINE__);
-    abort();
+static hash_table_t *tableAlloc(const uint32_t size) {
+  hash_table_t *pTable;
+
+  if (!(pTable = calloc(1, sizeof(*pTable)))) {
+    return NULL;
+  }
+  if (!(pTable->pSlots = calloc(size, sizeof(hash_slot_t)))) {
+    free(pTable);
+    return NULL;
+  }
+  pTable->mask = size - 1;
+
+  return pTable;
+}
+
+static void tableFree(hash_table_t *pTable) {
+  while (pTable) {
+    hash_table_t *pNext = pTable->pRetired;
+    free(pTable->pSlots);
+    free(pTable);
+    pTable = pNext;
   }
-  return pResult;
+}
+
+// copies the live entries of pFrom into the empty slots of pTo
+static void tableCopy(hash_slot_t *pTo, const uint32_t toMask, const hash_table_t *pFrom) {
+  uint32_t i;
+
+  for (i = 0; i <= pFrom->mask; i++) {
+    const hash_slot_t *pSlot = &pFrom->pSlots[i];
+    uint32_t j;
+
+    if (!pSlot->pData) {
+      continue;
+    }
+    for (j = idToSlot(pSlot->id, toMask); pTo[j].id; j = (j + 1) & toMask);
+    pTo[j] = *pSlot;
+  }
+}
+
+static inline void writeBegin(hash_t *pHash) {
+  __atomic_store_n(&pHash->seq, pHash->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void writeEnd(hash_t *pHash) {
+  __atomic_store_n(&pHash->seq, pHash->seq + 1, __ATOMIC_RELEASE);
+}
+
+// waits for any write section to end - a writer that has been preempted
+// mid-change could otherwise keep the reader spinning for its whole timeslice
+static inline uint32_t readBegin(const hash_t *pHash) {
+  unsigned int spins = 0;
+  uint32_t seq;
+
+  while ((seq = __atomic_load_n(&pHash->seq, __ATOMIC_ACQUIRE)) & 1) {
+    if (++spins < HASH_SPIN_LIMIT) {
+      cpuRelax();
+    } else {
+      spins = 0;
+      (void) sched_yield();
+    }
+  }
+
+  return seq;
+}
+
+static inline void slotSet(hash_slot_t *pSlot, const janus_id_t id, void *pData) {
+  __atomic_store_n(&pSlot->id, id, __ATOMIC_RELAXED);
+  __atomic_store_n(&pSlot->pData, pData, __ATOMIC_RELAXED);
+}
+
+// called with the mutex held and inside a write section - makes room for one more entry
+static switch_status_t makeRoom(hash_t *pHash) {
+  hash_table_t *pTable = pHash->pTable;
+  uint32_t size = pTable->mask + 1;
+  uint32_t newSize = size;
+  hash_slot_t *pSlots;
+
+  // keep the load (including deleted slots) below 3/4
+  if ((pHash->used + 1) * 4 <= size * 3) {
+    return SWITCH_STATUS_SUCCESS;
+  }
+
+  while ((pHash->count + 1) * 2 > newSize) {
+    newSize <<= 1;
+  }
+
+  if (newSize != size) {
+    hash_table_t *pNew = tableAlloc(newSize);
+    if (!pNew) {
+      return SWITCH_STATUS_MEMERR;
+    }
+    tableCopy(pNew->pSlots, pNew->mask, pTable);
+    pNew->pRetired = pTable;
+    __atomic_store_n(&pHash->pTable, pNew, __ATOMIC_RELEASE);
+  } else {
+    // mostly deleted slots - rebuild in place so nothing needs retiring
+    if (!(pSlots = calloc(size, sizeof(hash_slot_t)))) {
+      return SWITCH_STATUS_MEMERR;
+    }
+    tableCopy(pSlots, pTable->mask, pTable);
+    memcpy(pTable->pSlots, pSlots, size * sizeof(hash_slot_t));
+    free(pSlots);
+  }
+  pHash->used = pHash->count;
+
+  return SWITCH_STATUS_SUCCESS;
 }
 
 switch_status_t hashCreate(hash_t *pHash, switch_memory_pool_t *pPool) {
@@ -52,84 +186,269 @@ switch_status_t hashCreate(hash_t *pHash, switch_memory_pool_t *pPool) {
   switch_assert(pHash);
   switch_assert(pPool);
 
+  memset(pHash, 0, sizeof(*pHash));
+
   status = switch_mutex_init(&pHash->pMutex, SWITCH_MUTEX_NESTED, pPool);
   if (status == SWITCH_STATUS_SUCCESS) {
-    status = switch_core_hash_init(&pHash->pTable);
-    if (status != SWITCH_STATUS_SUCCESS) {
+    if (!(pHash->pTable = tableAlloc(HASH_INITIAL_SIZE))) {
       (void) switch_mutex_destroy(pHash->pMutex);
+      pHash->pMutex = NULL;
+      status = SWITCH_STATUS_MEMERR;
     }
   }
 
   return status;
 }
 
-switch_status_t hashInsert(const hash_t *pHash, const janus_id_t id, const  void * const pData) {
+switch_status_t hashInsert(hash_t *pHash, const janus_id_t id, const  void * const pData) {
   switch_status_t status;
-  char *pIdStr = idToStr(id);
+  hash_table_t *pTable;
+  hash_slot_t *pFree = NULL;
+  uint32_t i;
 
   switch_assert(pHash);
   switch_assert(pData);
 
-  DEBUG(SWITCH_CHANNEL_LOG, "Insert id=%" SWITCH_UINT64_T_FMT "\n", id);
+  MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Insert id=%" SWITCH_UINT64_T_FMT "\n", id);
+
+  // zero marks an empty slot - Janus never hands out a zero id
+  if (!id) {
+    return SWITCH_STATUS_FALSE;
+  }
+
+  switch_mutex_lock(pHash->pMutex);
+  writeBegin(pHash);
+
+  if (!pHash->pTable) {
+    status = SWITCH_STATUS_FALSE;
+    goto done;
+  } else if ((status = makeRoom(pHash)) != SWITCH_STATUS_SUCCESS) {
+    goto done;
+  }
+
+  pTable = pHash->pTable;
+  for (i = idToSlot(id, pTable->mask); ; i = (i + 1) & pTable->mask) {
+    hash_slot_t *pSlot = &pTable->pSlots[i];
+
+    if (pSlot->id == id) {
+      // replace an existing (or deleted) entry in place
+      if (!pSlot->pData) {
+        pHash->count++;
+      }
+      slotSet(pSlot, id, (void *) pData);
+      break;
+    } else if (!pSlot->id) {
+      if (pFree) {
+        pSlot = pFree;
+      } else {
+        pHash->used++;
+      }
+      slotSet(pSlot, id, (void *) pData);
+      pHash->count++;
+      break;
+    } else if (!pSlot->pData && !pFree) {
+      pFree = pSlot;
+    }
+  }
 
-  status = switch_core_hash_insert_locked(pHash->pTable, pIdStr, pData, pHash->pMutex);
-  switch_safe_free(pIdStr);
+done:
+  writeEnd(pHash);
+  switch_mutex_unlock(pHash->pMutex);
 
   return status;
 }
 
 void *hashFind(const hash_t *pHash, const janus_id_t id) {
   void *pResult;
-  char *pIdStr = idToStr(id);
+  uint32_t seq;
 
   switch_assert(pHash);
 
-  DEBUG(SWITCH_CHANNEL_LOG, "Find id=%" SWITCH_UINT64_T_FMT "\n", id);
+  do {
+    const hash_table_t *pTable;
+    uint32_t i, n;
+
+    seq = readBegin(pHash);
+
+    pResult = NULL;
+    if (!(pTable = __atomic_load_n(&pHash->pTable, __ATOMIC_ACQUIRE))) {
+      return NULL;
+    }
+
+    // bounded so a torn read can't loop forever - the sequence check throws it away
+    for (i = idToSlot(id, pTable->mask), n = 0; n <= pTable->mask; i = (i + 1) & pTable->mask, n++) {
+      janus_id_t slotId = __atomic_load_n(&pTable->pSlots[i].id, __ATOMIC_RELAXED);
+
+      if (slotId == id) {
+        pResult = __atomic_load_n(&pTable->pSlots[i].pData, __ATOMIC_RELAXED);
+        break;
+      } else if (!slotId) {
+        break;
+      }
+    }
 
-  pResult = switch_core_hash_find_locked(pHash->pTable, pIdStr, pHash->pMutex);
-  switch_safe_free(pIdStr);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while (__atomic_load_n(&pHash->seq, __ATOMIC_RELAXED) != seq);
 
   return pResult;
 }
 
-switch_status_t hashDelete(const hash_t *pHash, const janus_id_t id) {
-  void *pResult;
-  char *pIdStr = idToStr(id);
+switch_status_t hashDelete(hash_t *pHash, const janus_id_t id) {
+  switch_status_t status = SWITCH_STATUS_FALSE;
+  hash_table_t *pTable;
+  uint32_t i;
 
   switch_assert(pHash);
 
-  DEBUG(SWITCH_CHANNEL_LOG, "Delete id=%" SWITCH_UINT64_T_FMT "\n", id);
+  MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Delete id=%" SWITCH_UINT64_T_FMT "\n", id);
+
+  if (!id) {
+    return SWITCH_STATUS_FALSE;
+  }
 
-  pResult = switch_core_hash_delete_locked(pHash->pTable, pIdStr, pHash->pMutex);
-  switch_safe_free(pIdStr);
+  switch_mutex_lock(pHash->pMutex);
 
-  return pResult ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
+  if (!(pTable = pHash->pTable)) {
+    goto done;
+  }
+
+  for (i = idToSlot(id, pTable->mask); pTable->pSlots[i].id; i = (i + 1) & pTable->mask) {
+    if (pTable->pSlots[i].id != id) {
+      continue;
+    }
+    if (!pTable->pSlots[i].pData) {
+      break;
+    }
+
+    writeBegin(pHash);
+    slotSet(&pTable->pSlots[i], id, NULL);
+    pHash->count--;
+
+    // at the end of a probe chain the deleted slots can go back to being empty
+    if (!pTable->pSlots[(i + 1) & pTable->mask].id) {
+      while (pTable->pSlots[i].id && !pTable->pSlots[i].pData) {
+        slotSet(&pTable->pSlots[i], 0, NULL);
+        pHash->used--;
+        i = (i - 1) & pTable->mask;
+      }
+    }
+    writeEnd(pHash);
+
+    status = SWITCH_STATUS_SUCCESS;
+    break;
+  }
+
+done:
+  switch_mutex_unlock(pHash->pMutex);
+
+  return status;
 }
 
-void *hashIterate(hash_t *pHash, switch_hash_index_t **pIndex) {
-	void *pVal = NULL;
-	const void *pVar;
+// returns the next live entry from *pIndex onwards - entries may be deleted during the walk
+void *hashIterate(hash_t *pHash, hash_index_t *pIndex) {
+  void *pVal = NULL;
+  hash_table_t *pTable;
 
   switch_assert(pHash);
+  switch_assert(pIndex);
 
-  if (!*pIndex) {
-    *pIndex = switch_core_hash_first(pHash->pTable);
-  } else {
-    *pIndex = switch_core_hash_next(pIndex);
+  switch_mutex_lock(pHash->pMutex);
+  if ((pTable = pHash->pTable)) {
+    while (*pIndex <= pTable->mask && !pVal) {
+      pVal = pTable->pSlots[(*pIndex)++].pData;
+    }
   }
+  switch_mutex_unlock(pHash->pMutex);
+
+  return pVal;
+}
 
-  if (*pIndex) {
-    switch_core_hash_this(*pIndex, &pVar, NULL, &pVal);
+uint32_t hashCount(const hash_t *pHash) {
+  switch_assert(pHash);
+  return __atomic_load_n(&pHash->count, __ATOMIC_RELAXED);
+}
+
+// removes every entry - unlike hashDestroy() the table stays allocated, so
+// hashFind() may still be running against it
+void hashClear(hash_t *pHash) {
+  hash_table_t *pTable;
+
+  switch_assert(pHash);
+
+  if (!pHash->pMutex) {
+    return;
   }
 
-  return pVal;
+  switch_mutex_lock(pHash->pMutex);
+  if ((pTable = pHash->pTable)) {
+    uint32_t i;
+
+    writeBegin(pHash);
+    for (i = 0; i <= pTable->mask; i++) {
+      slotSet(&pTable->pSlots[i], 0, NULL);
+    }
+    pHash->count = pHash->used = 0;
+    writeEnd(pHash);
+  }
+  switch_mutex_unlock(pHash->pMutex);
+}
+
+// as hashDestroy() for a table that may still be in use: lookups from now on
+// find nothing and inserts fail, but the memory is only freed by
+// hashFreeRetired()
+void hashRetire(hash_t *pHash) {
+  hash_table_t *pTable, *pTail;
+
+  switch_assert(pHash);
+
+  if (!pHash->pMutex) {
+    return;
+  }
+
+  switch_mutex_lock(pHash->pMutex);
+  writeBegin(pHash);
+  pTable = pHash->pTable;
+  __atomic_store_n(&pHash->pTable, NULL, __ATOMIC_RELEASE);
+  pHash->count = pHash->used = 0;
+  writeEnd(pHash);
+  switch_mutex_unlock(pHash->pMutex);
+
+  if (!pTable) {
+    return;
+  }
+
+  // the outgrown tables go too
+  for (pTail = pTable; pTail->pRetired; pTail = pTail->pRetired);
+  pTail->pRetired = __atomic_load_n(&pRetiredTables, __ATOMIC_ACQUIRE);
+  while (!__atomic_compare_exchange_n(&pRetiredTables, &pTail->pRetired, pTable, SWITCH_FALSE,
+      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
 }
 
+// once no thread can be probing a retired table
+void hashFreeRetired(void) {
+  tableFree(__atomic_exchange_n(&pRetiredTables, NULL, __ATOMIC_ACQ_REL));
+}
+
+// frees the table, so must only be called once nothing can look it up
 switch_status_t hashDestroy(hash_t *pHash) {
   switch_status_t status;
+  hash_table_t *pTable;
+
+  if (!pHash->pMutex) {
+    return SWITCH_STATUS_FALSE;
+  }
+
+  switch_mutex_lock(pHash->pMutex);
+  writeBegin(pHash);
+  pTable = pHash->pTable;
+  __atomic_store_n(&pHash->pTable, NULL, __ATOMIC_RELEASE);
+  pHash->count = pHash->used = 0;
+  writeEnd(pHash);
+  switch_mutex_unlock(pHash->pMutex);
+
+  tableFree(pTable);
 
-  status = switch_core_hash_destroy(&pHash->pTable);
-  status = switch_mutex_destroy(pHash->pMutex) | status;
+  status = switch_mutex_destroy(pHash->pMutex);
   pHash->pMutex = NULL;
 
   return status;
@@ -29,8 +29,10 @@
  *
  * hash.h -- Hash headers for janus endpoint module
  *
- * Thin wrapper that takes a key as a uin64_t and translates it
- * to a string that is acceptable by the standard hash functions
+ * Open-addressing table keyed directly on the 64-bit Janus id.  Lookups
+ * are lock-free (guarded by a sequence counter) and never allocate;
+ * writers are serialised by the mutex.  A table still reachable by other
+ * threads is cleared or retired rather than destroyed
  *
  */
 #ifndef _HASH_H_
@@ -48,16 +50,40 @@
  */
 typedef uint64_t janus_id_t;
 
+typedef struct {
+  janus_id_t id;          // 0 - empty slot
+  void *pData;            // NULL with a non-zero id - deleted slot
+} hash_slot_t;
+
+typedef struct hash_table_s {
+  uint32_t mask;          // capacity - 1, capacity is a power of 2
+  hash_slot_t *pSlots;
+  struct hash_table_s *pRetired;  // replaced tables, freed by hashDestroy
+} hash_table_t;
+
 typedef struct {
   switch_mutex_t *pMutex;
-  switch_hash_t *pTable;
+  hash_table_t *pTable;
+  uint32_t seq;           // odd while a writer is changing the table
+  uint32_t count;         // live entries
+  uint32_t used;          // live + deleted slots
 } hash_t;
 
+// position of a hashIterate() walk - start at 0
+typedef uint32_t hash_index_t;
+
 switch_status_t hashCreate(hash_t *pHash, switch_memory_pool_t *pPool);
-switch_status_t hashInsert(const hash_t *pHash, const janus_id_t id, const  void *pData);
+switch_status_t hashInsert(hash_t *pHash, const janus_id_t id, const  void *pData);
 void *hashFind(const hash_t *pHash, const janus_id_t id);
-switch_status_t hashDelete(const hash_t *pHash, const janus_id_t id);
-void *hashIterate(hash_t *pHash, switch_hash_index_t **pIndex);
+switch_status_t hashDelete(hash_t *pHash, const janus_id_t id);
+void *hashIterate(hash_t *pHash, hash_index_t *pIndex);
+uint32_t hashCount(const hash_t *pHash);
+// for tables that other threads may still be looking up - hashClear() empties
+// the table in place, hashRetire() sets it aside until hashFreeRetired()
+void hashClear(hash_t *pHash);
+void hashRetire(hash_t *pHash);
+void hashFreeRetired(void);
+// frees the table straight away - only once no thread can look it up
 switch_status_t hashDestroy(hash_t *pHash);
 
 #endif //_HASH_H_
@@ -37,7 +37,65 @@
 #include  "globals.h"
 #include  "http.h"
 
+#if defined(__linux__)
+#include  <errno.h>
+#include  <sys/epoll.h>
+#include  <sys/eventfd.h>
+#include  <unistd.h>
+#endif
+
 #define INITIAL_BODY_SIZE 1000
+// a stream's buffer is only kept for the next body up to this size
+#define STREAM_KEEP_SIZE (64 * 1024)
+
+// CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE (h2c) arrived after the rest of what
+// HTTP/2 needs, so it marks whether a pool can be multiplexed
+#if LIBCURL_VERSION_NUM >= 0x073100
+#define HTTP_HAVE_HTTP2 1
+#endif
+
+typedef struct {
+  switch_CURL *pCurl;
+  switch_time_t lastUsed;
+} http_handle_t;
+
+struct http_pool_s {
+  char name[256];
+  switch_mutex_t *pMutex;
+  CURLSH *pShare;
+  switch_mutex_t *pShareMutex[CURL_LOCK_DATA_LAST];
+
+  // idle handles, used as a stack so that the most recently released handle
+  // (the one most likely to have a live connection) is handed out first
+  http_handle_t *pIdle;
+  unsigned int idleCount;
+  unsigned int size;
+  switch_interval_time_t idleTimeout;
+
+  unsigned int hits;
+  unsigned int misses;
+  // new connections the pool's requests had to open
+  unsigned int connects;
+
+  // requests are HTTP/2 streams multiplexed on one connection
+  switch_bool_t http2;
+
+  // parsers (and their buffers) left by finished streamed requests
+  http_stream_t *pIdleStreams;
+
+  // bumped by httpCancel - requests started under an older generation fail
+  volatile uint32_t generation;
+
+  // requests holding one of the pool's handles
+  unsigned int active;
+  // how many idle handles pIdle has room for
+  unsigned int capacity;
+  // set by httpPoolDestroy - handles released from then on are closed
+  switch_bool_t closed;
+  // on the free list, so httpPoolCreate can hand it out again
+  switch_bool_t retired;
+  struct http_pool_s *pNextFree;
+};
 
 static size_t write_callback(char *ptr, size_t size, size_t nmemb, void *userdata) {
   switch_buffer_t *pBuffer = (switch_buffer_t *) userdata;
@@ -45,126 +103,1384 @@ static size_t write_callback(char *ptr, size_t size, size_t nmemb, void *userdat
   return nmemb;
 }
 
-cJSON *httpPost(const char *pUrl, const unsigned int timeout, cJSON *pJsonRequest)
-{
-  cJSON *pJsonResponse = NULL;
-  switch_CURL *curl_handle = NULL;
-  switch_CURLcode curl_status = CURLE_UNKNOWN_OPTION;
-  long httpRes = 0;
-  switch_curl_slist_t *headers = NULL;
-  char *pJsonStr = NULL;
-  switch_buffer_t *pBody = NULL;
-  const char *pBodyStr;
+typedef enum {
+  HTTP_STREAM_START,
+  HTTP_STREAM_ARRAY,
+  HTTP_STREAM_WHOLE,
+  HTTP_STREAM_DONE,
+  HTTP_STREAM_FAILED
+} http_stream_state_t;
 
-  switch_assert(pUrl);
+struct http_stream_s {
+  // the body from the start of the element being received
+  char *pData;
+  size_t len;
+  size_t size;
+  // how far the scan has got
+  size_t scanned;
+  // where the element being received starts, -1 between elements
+  long elementStart;
+  // where the last element handed over ends
+  size_t consumed;
+  unsigned int depth;
+  switch_bool_t inString;
+  switch_bool_t escaped;
+  http_stream_state_t state;
 
-  switch_buffer_create_dynamic(&pBody, INITIAL_BODY_SIZE, INITIAL_BODY_SIZE, 0);
+  http_element_func_t pFunc;
+  void *pUserData;
+  // cleared once pFunc has refused an element so that the order is kept
+  switch_bool_t streaming;
+  // the elements pFunc didn't take
+  cJSON *pKept;
+  unsigned int elements;
 
-  curl_handle = switch_curl_easy_init();
-  if (!curl_handle) {
-    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't get CURL handle\n");
-    return NULL;
+  struct http_stream_s *pNext;
+};
+
+http_stream_t *httpStreamCreate(void) {
+  http_stream_t *pStream;
+
+  switch_zmalloc(pStream, sizeof(*pStream));
+  httpStreamReset(pStream, NULL, NULL);
+
+  return pStream;
+}
+
+void httpStreamDestroy(http_stream_t **ppStream) {
+  http_stream_t *pStream;
+
+  if (!ppStream || !(pStream = *ppStream)) {
+    return;
   }
+  *ppStream = NULL;
 
-  headers = switch_curl_slist_append(headers, "Content-Type: application/json");
-  headers = switch_curl_slist_append(headers, "Accept: application/json");
+  cJSON_Delete(pStream->pKept);
+  switch_safe_free(pStream->pData);
+  free(pStream);
+}
 
-  switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
-  switch_curl_easy_setopt(curl_handle, CURLOPT_URL, pUrl);
-  pJsonStr = cJSON_PrintUnformatted(pJsonRequest);
-  switch_curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, pJsonStr);
-  switch_curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "freeswitch-janus/1.0");
-  switch_curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, write_callback);
-  switch_curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *) pBody);
-  if (timeout) {
-    switch_curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT_MS, timeout);
-    switch_curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1);
+void httpStreamReset(http_stream_t *pStream, http_element_func_t pFunc, void *pUserData) {
+  switch_assert(pStream);
+
+  // don't hold on to the buffer an unusually large body needed
+  if (pStream->size > STREAM_KEEP_SIZE) {
+    switch_safe_free(pStream->pData);
+    pStream->size = 0;
   }
+  pStream->len = 0;
+  pStream->scanned = 0;
+  pStream->elementStart = -1;
+  pStream->consumed = 0;
+  pStream->depth = 0;
+  pStream->inString = SWITCH_FALSE;
+  pStream->escaped = SWITCH_FALSE;
+  pStream->state = HTTP_STREAM_START;
+  pStream->pFunc = pFunc;
+  pStream->pUserData = pUserData;
+  pStream->streaming = SWITCH_TRUE;
+  cJSON_Delete(pStream->pKept);
+  pStream->pKept = NULL;
+  pStream->elements = 0;
+}
 
-  DEBUG(SWITCH_CHANNEL_LOG, "HTTP POST url=%s json=%s\n", pUrl, pJsonStr);
+// makes room for len more bytes and a terminator
+static switch_bool_t httpStreamReserve(http_stream_t *pStream, const size_t len) {
+  size_t size = pStream->size ? pStream->size : INITIAL_BODY_SIZE;
+  char *pData;
 
-  curl_status = switch_curl_easy_perform(curl_handle);
-  switch_curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &httpRes);
+  if (pStream->len + len < pStream->size) {
+    return SWITCH_TRUE;
+  }
+  while (size <= pStream->len + len) {
+    size *= 2;
+  }
+  if (!(pData = realloc(pStream->pData, size))) {
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "No memory for a %" SWITCH_SIZE_T_FMT " byte response\n", size);
+    return SWITCH_FALSE;
+  }
+  pStream->pData = pData;
+  pStream->size = size;
 
-  if (curl_status == CURLE_OK) {
-    // terminate the string
-    (void) switch_buffer_write(pBody, "\0", 1);
+  return SWITCH_TRUE;
+}
 
-    (void) switch_buffer_peek_zerocopy(pBody, (const void **) &pBodyStr);
+// parses the element that ends at end and hands it over
+static void httpStreamElement(http_stream_t *pStream, const size_t end) {
+  const char saved = pStream->pData[end];
+  cJSON *pElement;
 
-    DEBUG(SWITCH_CHANNEL_LOG, "result=%s\n", pBodyStr);
+  // the buffer always has room for the terminator
+  pStream->pData[end] = '\0';
+  pElement = cJSON_Parse(&pStream->pData[pStream->elementStart]);
+  pStream->pData[end] = saved;
 
-    pJsonResponse = cJSON_Parse(pBodyStr);
+  pStream->elementStart = -1;
+  pStream->consumed = end;
+
+  if (!pElement) {
+    pStream->state = HTTP_STREAM_FAILED;
+    return;
+  }
+  pStream->elements++;
+
+  if (pStream->streaming && pStream->pFunc && pStream->pFunc(pElement, pStream->pUserData)) {
+    return;
+  }
+  pStream->streaming = SWITCH_FALSE;
+  if (!pStream->pKept) {
+    pStream->pKept = cJSON_CreateArray();
+  }
+  cJSON_AddItemToArray(pStream->pKept, pElement);
+}
+
+// Only tracks enough of the JSON grammar to find where each of the top level
+// array's elements ends - cJSON validates the elements themselves
+static void httpStreamScan(http_stream_t *pStream) {
+  size_t i;
+
+  for (i = pStream->scanned; i < pStream->len; i++) {
+    const char c = pStream->pData[i];
+
+    if (pStream->inString) {
+      if (pStream->escaped) {
+        pStream->escaped = SWITCH_FALSE;
+      } else if (c == '\\') {
+        pStream->escaped = SWITCH_TRUE;
+      } else if (c == '"') {
+        pStream->inString = SWITCH_FALSE;
+      }
+      continue;
+    }
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+      continue;
+    }
+
+    if (pStream->state == HTTP_STREAM_START) {
+      if (c != '[') {
+        // not an array - it is parsed whole once it has all arrived
+        pStream->state = HTTP_STREAM_WHOLE;
+        return;
+      }
+      pStream->state = HTTP_STREAM_ARRAY;
+      pStream->depth = 1;
+      pStream->consumed = i + 1;
+      continue;
+    }
+
+    if (pStream->depth == 1 && (c == ',' || c == ']')) {
+      // the end of a number, string or literal element
+      if (pStream->elementStart >= 0) {
+        httpStreamElement(pStream, i);
+      }
+      if (c == ']') {
+        pStream->depth = 0;
+        pStream->state = (pStream->state == HTTP_STREAM_FAILED) ? HTTP_STREAM_FAILED : HTTP_STREAM_DONE;
+      }
+      pStream->consumed = i + 1;
+      if (pStream->state != HTTP_STREAM_ARRAY) {
+        break;
+      }
+      continue;
+    }
+
+    if (pStream->depth == 1 && pStream->elementStart < 0) {
+      pStream->elementStart = (long) i;
+    }
+    if (c == '"') {
+      pStream->inString = SWITCH_TRUE;
+    } else if (c == '{' || c == '[') {
+      pStream->depth++;
+    } else if (c == '}' || c == ']') {
+      // an object or array element is handed over without waiting for the
+      // comma after it
+      if (--pStream->depth == 1) {
+        httpStreamElement(pStream, i + 1);
+        if (pStream->state != HTTP_STREAM_ARRAY) {
+          break;
+        }
+      }
+    }
+  }
+
+  // drop what has been handed over so the buffer only holds one element
+  if (pStream->state == HTTP_STREAM_ARRAY && pStream->consumed) {
+    memmove(pStream->pData, &pStream->pData[pStream->consumed], pStream->len - pStream->consumed);
+    pStream->len -= pStream->consumed;
+    if (pStream->elementStart >= 0) {
+      pStream->elementStart -= (long) pStream->consumed;
+    }
+    i -= pStream->consumed;
+    pStream->consumed = 0;
+  }
+  pStream->scanned = i;
+}
+
+switch_status_t httpStreamFeed(http_stream_t *pStream, const char *pData, const size_t len) {
+  switch_assert(pStream);
+
+  if (pStream->state == HTTP_STREAM_FAILED) {
+    return SWITCH_STATUS_FALSE;
+  }
+  if (pStream->state == HTTP_STREAM_DONE || !len) {
+    // only whitespace can follow the array
+    return SWITCH_STATUS_SUCCESS;
+  }
+
+  if (!httpStreamReserve(pStream, len)) {
+    pStream->state = HTTP_STREAM_FAILED;
+    return SWITCH_STATUS_FALSE;
+  }
+  memcpy(&pStream->pData[pStream->len], pData, len);
+  pStream->len += len;
+
+  if (pStream->state != HTTP_STREAM_WHOLE) {
+    httpStreamScan(pStream);
+  }
+
+  return pStream->state == HTTP_STREAM_FAILED ? SWITCH_STATUS_FALSE : SWITCH_STATUS_SUCCESS;
+}
+
+cJSON *httpStreamFinish(http_stream_t *pStream) {
+  cJSON *pJson = NULL;
+
+  switch_assert(pStream);
+
+  switch (pStream->state) {
+  case HTTP_STREAM_WHOLE:
+    pStream->pData[pStream->len] = '\0';
+    pJson = cJSON_Parse(pStream->pData);
+    break;
+  case HTTP_STREAM_DONE:
+    pJson = pStream->pKept ? pStream->pKept : cJSON_CreateArray();
+    pStream->pKept = NULL;
+    break;
+  default:
+    // nothing, a truncated array or invalid JSON
+    break;
+  }
+
+  return pJson;
+}
+
+static size_t stream_write_callback(char *ptr, size_t size, size_t nmemb, void *userdata) {
+  http_stream_t *pStream = (http_stream_t *) userdata;
+
+  // anything short of the whole chunk fails the transfer
+  return httpStreamFeed(pStream, ptr, size * nmemb) == SWITCH_STATUS_SUCCESS ? size * nmemb : 0;
+}
+
+static void share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+  http_pool_t *pPool = (http_pool_t *) userptr;
+  (void) handle;
+  (void) access;
+  switch_mutex_lock(pPool->pShareMutex[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+  http_pool_t *pPool = (http_pool_t *) userptr;
+  (void) handle;
+  switch_mutex_unlock(pPool->pShareMutex[data]);
+}
+
+// destroyed pools are kept for reuse rather than allocating another from the
+// module pool for every pod the registry adds
+static switch_mutex_t *pPoolMutex = NULL;
+static http_pool_t *pFreePools = NULL;
+
+http_pool_t *httpPoolCreate(const char *pName, const unsigned int size, const unsigned int idleTimeoutSec, const switch_bool_t http2) {
+  http_pool_t *pPool;
+  int i;
+
+  switch_mutex_lock(pPoolMutex);
+  if ((pPool = pFreePools)) {
+    pFreePools = pPool->pNextFree;
+  }
+  switch_mutex_unlock(pPoolMutex);
+
+  if (!pPool) {
+    pPool = switch_core_alloc(globals.pModulePool, sizeof(*pPool));
+    switch_mutex_init(&pPool->pMutex, SWITCH_MUTEX_NESTED, globals.pModulePool);
+    for (i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+      switch_mutex_init(&pPool->pShareMutex[i], SWITCH_MUTEX_DEFAULT, globals.pModulePool);
+    }
+  }
+
+  // a request that kept hold of the pool after it was destroyed may still
+  // release its handle, so this is done under the lock
+  switch_mutex_lock(pPool->pMutex);
+  switch_copy_string(pPool->name, pName, sizeof(pPool->name));
+  if (pPool->capacity < size) {
+    pPool->pIdle = switch_core_alloc(globals.pModulePool, sizeof(*pPool->pIdle) * size);
+    pPool->capacity = size;
+  }
+  pPool->size = size;
+  pPool->idleTimeout = (switch_interval_time_t) idleTimeoutSec * 1000000;
+  pPool->hits = pPool->misses = pPool->connects = 0;
+  pPool->http2 = SWITCH_FALSE;
+  pPool->closed = SWITCH_FALSE;
+  pPool->retired = SWITCH_FALSE;
+  pPool->pNextFree = NULL;
+  switch_mutex_unlock(pPool->pMutex);
+
+  // a pool of size 0 keeps nothing between requests - it is only there so
+  // that the server's requests can be cancelled together
+  if (!size) {
+    if (http2) {
+      switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Server=%s HTTP/2 needs an HTTP pool - using HTTP/1.1\n", pName);
+    }
+    pPool->pShare = NULL;
+  } else if ((pPool->pShare = curl_share_init())) {
+    curl_share_setopt(pPool->pShare, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(pPool->pShare, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    curl_share_setopt(pPool->pShare, CURLSHOPT_USERDATA, pPool);
+    curl_share_setopt(pPool->pShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(pPool->pShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+    curl_share_setopt(pPool->pShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
   } else {
-    // nothing downloaded or download interrupted
-    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Received curl error %d HTTP error code %ld trying to fetch %s\n", curl_status, httpRes, pUrl);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Server=%s couldn't create CURL share, connections will not be shared\n", pName);
   }
 
-  switch_curl_easy_cleanup(curl_handle);
-  switch_safe_free(pJsonStr);
-  switch_buffer_destroy(&pBody);
-  switch_curl_slist_free_all(headers);
+  if (http2 && size) {
+#if defined(HTTP_HAVE_HTTP2)
+    const curl_version_info_data *pVersion = curl_version_info(CURLVERSION_NOW);
 
-  return pJsonResponse;
+    if (pVersion && (pVersion->features & CURL_VERSION_HTTP2)) {
+      pPool->http2 = SWITCH_TRUE;
+    } else {
+      switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Server=%s libcurl has no HTTP/2 support - using HTTP/1.1\n", pName);
+    }
+#else
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Server=%s built against a libcurl too old for HTTP/2 - using HTTP/1.1\n", pName);
+#endif
+  }
+
+  DEBUG(SWITCH_CHANNEL_LOG, "Server=%s HTTP pool size=%u idle-timeout=%u http2=%s\n", pName, size, idleTimeoutSec,
+      pPool->http2 ? "true" : "false");
+
+  return pPool;
 }
 
-cJSON *httpGet(const char *pUrl, const unsigned int timeout)
-{
-  cJSON *pJsonResponse = NULL;
-  switch_CURL *curl_handle = NULL;
-	switch_CURLcode curl_status = CURLE_UNKNOWN_OPTION;
-  long httpRes = 0;
-  switch_curl_slist_t *headers = NULL;
-  switch_buffer_t *pBody = NULL;
-  const char *pBodyStr;
+// closes every idle handle (and with it any connection it is keeping alive).
+// Handles that are in use are returned to the pool as normal
+void httpPoolFlush(http_pool_t *pPool) {
+  if (!pPool) {
+    return;
+  }
+
+  switch_mutex_lock(pPool->pMutex);
+  while (pPool->idleCount > 0) {
+    switch_curl_easy_cleanup(pPool->pIdle[--pPool->idleCount].pCurl);
+  }
+  switch_mutex_unlock(pPool->pMutex);
+}
+
+// the share goes once no handle is using it, then the pool waits for reuse
+static void httpPoolRetire(http_pool_t *pPool) {
+  if (pPool->pShare) {
+    curl_share_cleanup(pPool->pShare);
+    pPool->pShare = NULL;
+  }
+
+  switch_mutex_lock(pPoolMutex);
+  pPool->pNextFree = pFreePools;
+  pFreePools = pPool;
+  switch_mutex_unlock(pPoolMutex);
+}
+
+// requests still in flight finish as normal and close their handles as they
+// do; the pool is only reused once the last of them has
+void httpPoolDestroy(http_pool_t **ppPool) {
+  http_pool_t *pPool;
+  switch_bool_t retire = SWITCH_FALSE;
+
+  if (!ppPool || !(pPool = *ppPool)) {
+    return;
+  }
+  *ppPool = NULL;
+
+  switch_mutex_lock(pPool->pMutex);
+  pPool->closed = SWITCH_TRUE;
+  while (pPool->idleCount > 0) {
+    switch_curl_easy_cleanup(pPool->pIdle[--pPool->idleCount].pCurl);
+  }
+  while (pPool->pIdleStreams) {
+    http_stream_t *pStream = pPool->pIdleStreams;
+    pPool->pIdleStreams = pStream->pNext;
+    httpStreamDestroy(&pStream);
+  }
+  if (!pPool->active && !pPool->retired) {
+    pPool->retired = retire = SWITCH_TRUE;
+  }
+  switch_mutex_unlock(pPool->pMutex);
+
+  if (retire) {
+    httpPoolRetire(pPool);
+  }
+}
+
+void httpPoolStats(http_pool_t *pPool, unsigned int *pHits, unsigned int *pMisses, unsigned int *pConnects) {
+  unsigned int hits = 0, misses = 0, connects = 0;
+
+  if (pPool) {
+    switch_mutex_lock(pPool->pMutex);
+    hits = pPool->hits;
+    misses = pPool->misses;
+    connects = pPool->connects;
+    switch_mutex_unlock(pPool->pMutex);
+  }
+
+  if (pHits) {
+    *pHits = hits;
+  }
+  if (pMisses) {
+    *pMisses = misses;
+  }
+  if (pConnects) {
+    *pConnects = connects;
+  }
+}
+
+static void httpHandleRelease(http_pool_t *pPool, switch_CURL *pCurl);
+
+static switch_CURL *httpHandleAcquire(http_pool_t *pPool) {
+  switch_CURL *pCurl = NULL;
+
+  if (pPool) {
+    const switch_time_t now = switch_time_now();
+
+    switch_mutex_lock(pPool->pMutex);
+    pPool->active++;
+    // the top of the stack is the most recently used - if that has been idle
+    // too long then so have all the others
+    if (pPool->idleCount > 0 && pPool->idleTimeout &&
+        (now - pPool->pIdle[pPool->idleCount - 1].lastUsed) > pPool->idleTimeout) {
+      while (pPool->idleCount > 0) {
+        switch_curl_easy_cleanup(pPool->pIdle[--pPool->idleCount].pCurl);
+      }
+    }
+    if (pPool->idleCount > 0) {
+      pCurl = pPool->pIdle[--pPool->idleCount].pCurl;
+      pPool->hits++;
+    } else {
+      pPool->misses++;
+    }
+    switch_mutex_unlock(pPool->pMutex);
+  }
+
+  if (!pCurl) {
+    pCurl = switch_curl_easy_init();
+  }
+
+  if (!pCurl && pPool) {
+    httpHandleRelease(pPool, NULL);
+  } else if (pCurl && pPool) {
+    // a destroyed pool's share is cleaned up with its last handle
+    if (pPool->pShare && !pPool->closed) {
+      switch_curl_easy_setopt(pCurl, CURLOPT_SHARE, pPool->pShare);
+    }
+    switch_curl_easy_setopt(pCurl, CURLOPT_TCP_KEEPALIVE, 1L);
+#if LIBCURL_VERSION_NUM >= 0x074100
+    if (pPool->idleTimeout) {
+      switch_curl_easy_setopt(pCurl, CURLOPT_MAXAGE_CONN, (long) (pPool->idleTimeout / 1000000));
+    }
+#endif
+  }
+
+  return pCurl;
+}
+
+// must be the request's last use of the pool, which may be reused after it
+static void httpHandleRelease(http_pool_t *pPool, switch_CURL *pCurl) {
+  const switch_time_t now = switch_time_now();
+  switch_bool_t retire = SWITCH_FALSE;
+
+  if (!pPool) {
+    switch_curl_easy_cleanup(pCurl);
+    return;
+  }
+
+  // drops the per-request options but keeps the connection & session caches
+  if (pCurl) {
+    curl_easy_reset(pCurl);
+  }
+
+  switch_mutex_lock(pPool->pMutex);
+  // reap handles from the bottom of the stack which have been idle too long
+  while (pPool->idleCount > 0 && pPool->idleTimeout && (now - pPool->pIdle[0].lastUsed) > pPool->idleTimeout) {
+    switch_curl_easy_cleanup(pPool->pIdle[0].pCurl);
+    memmove(&pPool->pIdle[0], &pPool->pIdle[1], sizeof(*pPool->pIdle) * --pPool->idleCount);
+  }
+  if (pCurl && !pPool->closed && pPool->idleCount < pPool->size) {
+    pPool->pIdle[pPool->idleCount].pCurl = pCurl;
+    pPool->pIdle[pPool->idleCount].lastUsed = now;
+    pPool->idleCount++;
+    pCurl = NULL;
+  }
+  pPool->active--;
+  if (pPool->closed && !pPool->active && !pPool->retired) {
+    pPool->retired = retire = SWITCH_TRUE;
+  }
+  switch_mutex_unlock(pPool->pMutex);
+
+  if (pCurl) {
+    switch_curl_easy_cleanup(pCurl);
+  }
+  if (retire) {
+    httpPoolRetire(pPool);
+  }
+}
+
+static http_stream_t *httpStreamAcquire(http_pool_t *pPool) {
+  http_stream_t *pStream = NULL;
+
+  if (pPool) {
+    switch_mutex_lock(pPool->pMutex);
+    if ((pStream = pPool->pIdleStreams)) {
+      pPool->pIdleStreams = pStream->pNext;
+    }
+    switch_mutex_unlock(pPool->pMutex);
+  }
+
+  return pStream ? pStream : httpStreamCreate();
+}
+
+static void httpStreamRelease(http_pool_t *pPool, http_stream_t *pStream) {
+  if (!pPool) {
+    httpStreamDestroy(&pStream);
+    return;
+  }
+
+  httpStreamReset(pStream, NULL, NULL);
+
+  switch_mutex_lock(pPool->pMutex);
+  if (!pPool->closed) {
+    pStream->pNext = pPool->pIdleStreams;
+    pPool->pIdleStreams = pStream;
+    pStream = NULL;
+  }
+  switch_mutex_unlock(pPool->pMutex);
+
+  if (pStream) {
+    httpStreamDestroy(&pStream);
+  }
+}
+
+// a single request, owned either by the caller (blocking mode) or by the
+// engine thread that drives it
+typedef struct http_request_s {
+  http_pool_t *pPool;
+  switch_CURL *pCurl;
+  switch_curl_slist_t *headers;
+  switch_buffer_t *pBody;
+  // set instead of pBody when the response is parsed as it arrives
+  http_stream_t *pStream;
+  char *pJsonStr;
+  char *pUrl;
+  http_complete_func_t pFunc;
+  void *pUserData;
+  uint32_t generation;
+  struct http_request_s *pPrev;
+  struct http_request_s *pNext;
+} http_request_t;
+
+static switch_bool_t httpRequestCancelled(const http_request_t *pRequest) {
+  return (pRequest->pPool && pRequest->generation != pRequest->pPool->generation) ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+#if LIBCURL_VERSION_NUM >= 0x072000
+// lets a blocking request notice httpCancel - the engine fails its own
+// requests without waiting for curl to call this
+static int progress_callback(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+  (void) dltotal;
+  (void) dlnow;
+  (void) ultotal;
+  (void) ulnow;
+  return httpRequestCancelled((const http_request_t *) clientp) ? 1 : 0;
+}
+#endif
+
+// takes ownership of pJsonStr and pStream
+static http_request_t *httpRequestCreate(http_pool_t *pPool, const char *pUrl, const unsigned int timeout, char *pJsonStr,
+    http_stream_t *pStream) {
+  http_request_t *pRequest;
 
   switch_assert(pUrl);
 
-  switch_buffer_create_dynamic(&pBody, INITIAL_BODY_SIZE, INITIAL_BODY_SIZE, 0);
+  switch_zmalloc(pRequest, sizeof(*pRequest));
+  pRequest->pPool = pPool;
+  pRequest->pJsonStr = pJsonStr;
+  pRequest->pStream = pStream;
+  if (pPool) {
+    pRequest->generation = pPool->generation;
+  }
 
-  curl_handle = switch_curl_easy_init();
-  if (!curl_handle) {
+  pRequest->pCurl = httpHandleAcquire(pPool);
+  if (!pRequest->pCurl) {
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't get CURL handle\n");
+    switch_safe_free(pRequest->pJsonStr);
+    if (pStream) {
+      httpStreamRelease(pPool, pStream);
+    }
+    free(pRequest);
     return NULL;
   }
 
-  headers = switch_curl_slist_append(headers, "Accept: application/json");
+  pRequest->pUrl = strdup(pUrl);
+  if (!pStream) {
+    switch_buffer_create_dynamic(&pRequest->pBody, INITIAL_BODY_SIZE, INITIAL_BODY_SIZE, 0);
+  }
 
-  switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
-  switch_curl_easy_setopt(curl_handle, CURLOPT_URL, pUrl);
-  switch_curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "freeswitch-janus/1.0");
-  switch_curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, write_callback);
-  switch_curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *) pBody);
+  if (pJsonStr) {
+    pRequest->headers = switch_curl_slist_append(pRequest->headers, "Content-Type: application/json");
+  }
+  pRequest->headers = switch_curl_slist_append(pRequest->headers, "Accept: application/json");
+
+  switch_curl_easy_setopt(pRequest->pCurl, CURLOPT_HTTPHEADER, pRequest->headers);
+  switch_curl_easy_setopt(pRequest->pCurl, CURLOPT_URL, pRequest->pUrl);
+  if (pJsonStr) {
+    switch_curl_easy_setopt(pRequest->pCurl, CURLOPT_POSTFIELDS, pJsonStr);
+  }
+  switch_curl_easy_setopt(pRequest->pCurl, CURLOPT_USERAGENT, "freeswitch-janus/1.0");
+  if (pStream) {
+    switch_curl_easy_setopt(pRequest->pCurl, CURLOPT_WRITEFUNCTION, stream_write_callback);
+    switch_curl_easy_setopt(pRequest->pCurl, CURLOPT_WRITEDATA, (void *) pStream);
+  } else {
+    switch_curl_easy_setopt(pRequest->pCurl, CURLOPT_WRITEFUNCTION, write_callback);
+    switch_curl_easy_setopt(pRequest->pCurl, CURLOPT_WRITEDATA, (void *) pRequest->pBody);
+  }
+  switch_curl_easy_setopt(pRequest->pCurl, CURLOPT_PRIVATE, (void *) pRequest);
+#if LIBCURL_VERSION_NUM >= 0x072000
+  if (pPool) {
+    switch_curl_easy_setopt(pRequest->pCurl, CURLOPT_XFERINFOFUNCTION, progress_callback);
+    switch_curl_easy_setopt(pRequest->pCurl, CURLOPT_XFERINFODATA, (void *) pRequest);
+    switch_curl_easy_setopt(pRequest->pCurl, CURLOPT_NOPROGRESS, 0L);
+  }
+#endif
   if (timeout) {
-    switch_curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT_MS, timeout);
-    switch_curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1);
+    switch_curl_easy_setopt(pRequest->pCurl, CURLOPT_TIMEOUT_MS, timeout);
+    switch_curl_easy_setopt(pRequest->pCurl, CURLOPT_NOSIGNAL, 1);
   }
+#if defined(HTTP_HAVE_HTTP2)
+  if (pPool && pPool->http2) {
+    // https negotiates h2 through ALPN (falling back to HTTP/1.1), plain
+    // http speaks h2c from the start
+    switch_curl_easy_setopt(pRequest->pCurl, CURLOPT_HTTP_VERSION,
+        strncasecmp(pUrl, "https://", 8) ? (long) CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE : (long) CURL_HTTP_VERSION_2TLS);
+    // wait for a connection being set up to the same host to confirm it
+    // can multiplex rather than opening another
+    switch_curl_easy_setopt(pRequest->pCurl, CURLOPT_PIPEWAIT, 1L);
+  }
+#endif
 
-  DEBUG(SWITCH_CHANNEL_LOG, "HTTP GET url=%s\n", pUrl);
+  return pRequest;
+}
+
+static cJSON *httpRequestResult(http_request_t *pRequest, const switch_CURLcode curl_status) {
+  cJSON *pJsonResponse = NULL;
+  long httpRes = 0;
+  const char *pBodyStr;
+
+  switch_curl_easy_getinfo(pRequest->pCurl, CURLINFO_RESPONSE_CODE, &httpRes);
 
-  curl_status = switch_curl_easy_perform(curl_handle);
-  switch_curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &httpRes);
+  if (pRequest->pPool) {
+    long connects = 0;
+
+    switch_curl_easy_getinfo(pRequest->pCurl, CURLINFO_NUM_CONNECTS, &connects);
+    if (connects > 0) {
+      switch_mutex_lock(pRequest->pPool->pMutex);
+      pRequest->pPool->connects += (unsigned int) connects;
+      switch_mutex_unlock(pRequest->pPool->pMutex);
+    }
+  }
 
-  if (curl_status == CURLE_OK) {
+  if (curl_status == CURLE_OK && pRequest->pStream) {
+    // the elements handed over already aren't in this
+    pJsonResponse = httpStreamFinish(pRequest->pStream);
+
+    DEBUG(SWITCH_CHANNEL_LOG, "code=%ld streamed=%u result=%s\n", httpRes, pRequest->pStream->elements,
+        pJsonResponse ? "ok" : "invalid");
+  } else if (curl_status == CURLE_OK) {
     // terminate the string
-    (void) switch_buffer_write(pBody, "\0", 1);
+    (void) switch_buffer_write(pRequest->pBody, "\0", 1);
 
-    (void) switch_buffer_peek_zerocopy(pBody, (const void **) &pBodyStr);
+    (void) switch_buffer_peek_zerocopy(pRequest->pBody, (const void **) &pBodyStr);
 
     DEBUG(SWITCH_CHANNEL_LOG, "code=%ld result=%s\n", httpRes, pBodyStr);
 
     pJsonResponse = cJSON_Parse(pBodyStr);
+  } else if (curl_status == CURLE_ABORTED_BY_CALLBACK) {
+    DEBUG(SWITCH_CHANNEL_LOG, "Cancelled request for %s\n", pRequest->pUrl);
   } else {
     // nothing downloaded or download interrupted
-    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Received curl error %d HTTP error code %ld trying to fetch %s\n", curl_status, httpRes, pUrl);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Received curl error %d HTTP error code %ld trying to fetch %s\n", curl_status, httpRes, pRequest->pUrl);
+  }
+
+  return pJsonResponse;
+}
+
+static void httpRequestDestroy(http_request_t *pRequest) {
+  switch_buffer_destroy(&pRequest->pBody);
+  if (pRequest->pStream) {
+    httpStreamRelease(pRequest->pPool, pRequest->pStream);
+  }
+  httpHandleRelease(pRequest->pPool, pRequest->pCurl);
+  switch_curl_slist_free_all(pRequest->headers);
+  switch_safe_free(pRequest->pJsonStr);
+  switch_safe_free(pRequest->pUrl);
+  free(pRequest);
+}
+
+// completes the request, hands the response to the submitter and frees it
+static void httpRequestComplete(http_request_t *pRequest, cJSON *pJsonResponse) {
+  http_complete_func_t pFunc = pRequest->pFunc;
+  void *pUserData = pRequest->pUserData;
+
+  httpRequestDestroy(pRequest);
+
+  if (pFunc) {
+    pFunc(pJsonResponse, pUserData);
+  } else if (pJsonResponse) {
+    cJSON_Delete(pJsonResponse);
+  }
+}
+
+#if defined(__linux__)
+
+#define ENGINE_MAX_EVENTS 64
+// upper bound on how long a thread sleeps so it notices it is being stopped
+#define ENGINE_MAX_WAIT_MS 1000
+
+typedef struct {
+  unsigned int index;
+  CURLM *pMulti;
+  int epollFd;
+  int eventFd;
+  switch_thread_t *pThread;
+
+  // guards everything below
+  switch_mutex_t *pMutex;
+  switch_bool_t terminating;
+  switch_bool_t cancelling;
+  http_request_t *pPendingHead;
+  http_request_t *pPendingTail;
+  http_request_t *pInFlight;
+  unsigned int inFlight;
+
+  // only touched by the engine thread
+  switch_time_t timerDeadline;
+} http_engine_thread_t;
+
+static struct {
+  http_engine_thread_t *pThreads;
+  unsigned int count;
+  unsigned int next;
+} engine;
+
+static int engine_socket_cb(CURL *pCurl, curl_socket_t s, int what, void *userp, void *socketp) {
+  http_engine_thread_t *pThread = (http_engine_thread_t *) userp;
+  struct epoll_event ev;
+
+  (void) pCurl;
+
+  if (what == CURL_POLL_REMOVE) {
+    (void) epoll_ctl(pThread->epollFd, EPOLL_CTL_DEL, s, NULL);
+    curl_multi_assign(pThread->pMulti, s, NULL);
+    return 0;
+  }
+
+  memset(&ev, 0, sizeof(ev));
+  ev.data.fd = s;
+  ev.events = ((what & CURL_POLL_IN) ? EPOLLIN : 0) | ((what & CURL_POLL_OUT) ? EPOLLOUT : 0);
+
+  if (!socketp) {
+    // the descriptor may have been recycled without curl telling us it went
+    if (epoll_ctl(pThread->epollFd, EPOLL_CTL_ADD, s, &ev) < 0 && errno == EEXIST) {
+      (void) epoll_ctl(pThread->epollFd, EPOLL_CTL_MOD, s, &ev);
+    }
+    curl_multi_assign(pThread->pMulti, s, (void *) pThread);
+  } else if (epoll_ctl(pThread->epollFd, EPOLL_CTL_MOD, s, &ev) < 0 && errno == ENOENT) {
+    (void) epoll_ctl(pThread->epollFd, EPOLL_CTL_ADD, s, &ev);
+  }
+
+  return 0;
+}
+
+static int engine_timer_cb(CURLM *pMulti, long timeoutMs, void *userp) {
+  http_engine_thread_t *pThread = (http_engine_thread_t *) userp;
+
+  (void) pMulti;
+
+  pThread->timerDeadline = (timeoutMs < 0) ? 0 : switch_time_now() + (switch_time_t) timeoutMs * 1000;
+  return 0;
+}
+
+static void engine_unlink(http_engine_thread_t *pThread, http_request_t *pRequest) {
+  switch_mutex_lock(pThread->pMutex);
+  if (pRequest->pPrev) {
+    pRequest->pPrev->pNext = pRequest->pNext;
+  } else {
+    pThread->pInFlight = pRequest->pNext;
   }
+  if (pRequest->pNext) {
+    pRequest->pNext->pPrev = pRequest->pPrev;
+  }
+  pThread->inFlight--;
+  switch_mutex_unlock(pThread->pMutex);
+}
+
+static void engine_remove(http_engine_thread_t *pThread, http_request_t *pRequest) {
+  curl_multi_remove_handle(pThread->pMulti, pRequest->pCurl);
+  engine_unlink(pThread, pRequest);
+}
+
+static void engine_add_pending(http_engine_thread_t *pThread) {
+  http_request_t *pRequest;
+
+  switch_mutex_lock(pThread->pMutex);
+  pRequest = pThread->pPendingHead;
+  pThread->pPendingHead = pThread->pPendingTail = NULL;
+  switch_mutex_unlock(pThread->pMutex);
+
+  while (pRequest) {
+    http_request_t *pNext = pRequest->pNext;
+
+    if (httpRequestCancelled(pRequest)) {
+      httpRequestComplete(pRequest, NULL);
+      pRequest = pNext;
+      continue;
+    }
+
+    pRequest->pPrev = NULL;
+    switch_mutex_lock(pThread->pMutex);
+    pRequest->pNext = pThread->pInFlight;
+    if (pThread->pInFlight) {
+      pThread->pInFlight->pPrev = pRequest;
+    }
+    pThread->pInFlight = pRequest;
+    pThread->inFlight++;
+    switch_mutex_unlock(pThread->pMutex);
+
+    if (curl_multi_add_handle(pThread->pMulti, pRequest->pCurl) != CURLM_OK) {
+      switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't start request for %s\n", pRequest->pUrl);
+      engine_unlink(pThread, pRequest);
+      httpRequestComplete(pRequest, NULL);
+    }
+
+    pRequest = pNext;
+  }
+}
+
+// fails the requests whose pool has been cancelled since they started
+static void engine_cancel(http_engine_thread_t *pThread) {
+  http_request_t *pRequest, *pNext;
+  switch_bool_t cancelling;
+
+  switch_mutex_lock(pThread->pMutex);
+  cancelling = pThread->cancelling;
+  pThread->cancelling = SWITCH_FALSE;
+  pRequest = pThread->pInFlight;
+  switch_mutex_unlock(pThread->pMutex);
+
+  // only this thread changes the in-flight list
+  for (; cancelling && pRequest; pRequest = pNext) {
+    pNext = pRequest->pNext;
+    if (httpRequestCancelled(pRequest)) {
+      engine_remove(pThread, pRequest);
+      httpRequestComplete(pRequest, NULL);
+    }
+  }
+}
+
+static void engine_check_done(http_engine_thread_t *pThread) {
+  CURLMsg *pMsg;
+  int pending;
+
+  while ((pMsg = curl_multi_info_read(pThread->pMulti, &pending))) {
+    http_request_t *pRequest = NULL;
+    cJSON *pJsonResponse;
+
+    if (pMsg->msg != CURLMSG_DONE) {
+      continue;
+    }
+
+    curl_easy_getinfo(pMsg->easy_handle, CURLINFO_PRIVATE, (char **) &pRequest);
+    switch_assert(pRequest);
+
+    pJsonResponse = httpRequestResult(pRequest, pMsg->data.result);
+    engine_remove(pThread, pRequest);
+    httpRequestComplete(pRequest, pJsonResponse);
+  }
+}
+
+static void *SWITCH_THREAD_FUNC engine_run(switch_thread_t *pSwitchThread, void *pObj) {
+  http_engine_thread_t *pThread = (http_engine_thread_t *) pObj;
+  struct epoll_event events[ENGINE_MAX_EVENTS];
+  int running = 0;
+
+  (void) pSwitchThread;
+
+  DEBUG(SWITCH_CHANNEL_LOG, "HTTP engine thread=%u started\n", pThread->index);
+
+  while (!pThread->terminating) {
+    int waitMs = ENGINE_MAX_WAIT_MS;
+    int n, i;
+
+    if (pThread->timerDeadline) {
+      const switch_time_t remaining = pThread->timerDeadline - switch_time_now();
+      waitMs = (remaining <= 0) ? 0 : (int) ((remaining + 999) / 1000);
+      if (waitMs > ENGINE_MAX_WAIT_MS) {
+        waitMs = ENGINE_MAX_WAIT_MS;
+      }
+    }
+
+    n = epoll_wait(pThread->epollFd, events, ENGINE_MAX_EVENTS, waitMs);
+    if (n < 0 && errno != EINTR) {
+      switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "HTTP engine thread=%u epoll failed errno=%d\n", pThread->index, errno);
+      switch_yield(100000);
+    }
+
+    for (i = 0; i < n; i++) {
+      int flags = 0;
+
+      if (events[i].data.fd == pThread->eventFd) {
+        uint64_t value;
+        (void) !read(pThread->eventFd, &value, sizeof(value));
+        engine_add_pending(pThread);
+        engine_cancel(pThread);
+        continue;
+      }
+
+      if (events[i].events & EPOLLIN) {
+        flags |= CURL_CSELECT_IN;
+      }
+      if (events[i].events & EPOLLOUT) {
+        flags |= CURL_CSELECT_OUT;
+      }
+      if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+        flags |= CURL_CSELECT_ERR;
+      }
+      curl_multi_socket_action(pThread->pMulti, events[i].data.fd, flags, &running);
+    }
+
+    if (pThread->timerDeadline && switch_time_now() >= pThread->timerDeadline) {
+      pThread->timerDeadline = 0;
+      curl_multi_socket_action(pThread->pMulti, CURL_SOCKET_TIMEOUT, 0, &running);
+    }
+
+    engine_check_done(pThread);
+  }
+
+  // fail anything that hasn't completed so that no submitter is left waiting
+  for (;;) {
+    http_request_t *pRequest;
 
-  switch_curl_easy_cleanup(curl_handle);
-  switch_buffer_destroy(&pBody);
-  switch_curl_slist_free_all(headers);
+    switch_mutex_lock(pThread->pMutex);
+    if ((pRequest = pThread->pPendingHead)) {
+      pThread->pPendingHead = pRequest->pNext;
+      if (!pThread->pPendingHead) {
+        pThread->pPendingTail = NULL;
+      }
+      switch_mutex_unlock(pThread->pMutex);
+      httpRequestComplete(pRequest, NULL);
+      continue;
+    }
+    pRequest = pThread->pInFlight;
+    switch_mutex_unlock(pThread->pMutex);
+
+    if (!pRequest) {
+      break;
+    }
+    engine_remove(pThread, pRequest);
+    httpRequestComplete(pRequest, NULL);
+  }
+
+  DEBUG(SWITCH_CHANNEL_LOG, "HTTP engine thread=%u stopped\n", pThread->index);
+
+  return NULL;
+}
+
+switch_status_t httpEngineStart(const unsigned int threads) {
+  switch_threadattr_t *pThreadAttr = NULL;
+  unsigned int i;
+
+  if (engine.count || !threads) {
+    return SWITCH_STATUS_SUCCESS;
+  }
+
+  engine.pThreads = switch_core_alloc(globals.pModulePool, sizeof(*engine.pThreads) * threads);
+
+  for (i = 0; i < threads; i++) {
+    http_engine_thread_t *pThread = &engine.pThreads[i];
+    struct epoll_event ev;
+
+    pThread->index = i;
+    switch_mutex_init(&pThread->pMutex, SWITCH_MUTEX_NESTED, globals.pModulePool);
+
+    pThread->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    pThread->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    pThread->pMulti = curl_multi_init();
+    if (pThread->epollFd < 0 || pThread->eventFd < 0 || !pThread->pMulti) {
+      switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't create HTTP engine thread=%u\n", i);
+      goto fail;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = pThread->eventFd;
+    (void) epoll_ctl(pThread->epollFd, EPOLL_CTL_ADD, pThread->eventFd, &ev);
+
+    curl_multi_setopt(pThread->pMulti, CURLMOPT_SOCKETFUNCTION, engine_socket_cb);
+    curl_multi_setopt(pThread->pMulti, CURLMOPT_SOCKETDATA, pThread);
+    curl_multi_setopt(pThread->pMulti, CURLMOPT_TIMERFUNCTION, engine_timer_cb);
+    curl_multi_setopt(pThread->pMulti, CURLMOPT_TIMERDATA, pThread);
+#if defined(HTTP_HAVE_HTTP2)
+    // a pool's requests all run on this thread, so an HTTP/2 pool's requests
+    // can share one connection - the default only since libcurl 7.62
+    curl_multi_setopt(pThread->pMulti, CURLMOPT_PIPELINING, (long) CURLPIPE_MULTIPLEX);
+#endif
+  }
+
+  for (i = 0; i < threads; i++) {
+    switch_threadattr_create(&pThreadAttr, globals.pModulePool);
+    switch_threadattr_stacksize_set(pThreadAttr, SWITCH_THREAD_STACKSIZE);
+    switch_thread_create(&engine.pThreads[i].pThread, pThreadAttr, engine_run, &engine.pThreads[i], globals.pModulePool);
+  }
+
+  engine.count = threads;
+
+  switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "HTTP engine started with %u thread(s)\n", threads);
+
+  return SWITCH_STATUS_SUCCESS;
+
+fail:
+  for (i = 0; i < threads; i++) {
+    http_engine_thread_t *pThread = &engine.pThreads[i];
+
+    if (pThread->pMulti) {
+      curl_multi_cleanup(pThread->pMulti);
+    }
+    if (pThread->epollFd > 0) {
+      close(pThread->epollFd);
+    }
+    if (pThread->eventFd > 0) {
+      close(pThread->eventFd);
+    }
+  }
+  engine.pThreads = NULL;
+
+  return SWITCH_STATUS_FALSE;
+}
+
+void httpEngineStop(void) {
+  unsigned int i, count = engine.count;
+
+  if (!count) {
+    return;
+  }
+
+  // stop accepting work - new requests fall back to blocking mode
+  engine.count = 0;
+
+  for (i = 0; i < count; i++) {
+    http_engine_thread_t *pThread = &engine.pThreads[i];
+    const uint64_t one = 1;
+
+    switch_mutex_lock(pThread->pMutex);
+    pThread->terminating = SWITCH_TRUE;
+    switch_mutex_unlock(pThread->pMutex);
+    (void) !write(pThread->eventFd, &one, sizeof(one));
+  }
+
+  for (i = 0; i < count; i++) {
+    http_engine_thread_t *pThread = &engine.pThreads[i];
+    switch_status_t returnValue;
+
+    (void) switch_thread_join(&returnValue, pThread->pThread);
+    curl_multi_cleanup(pThread->pMulti);
+    close(pThread->epollFd);
+    close(pThread->eventFd);
+  }
+
+  switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "HTTP engine stopped\n");
+}
+
+switch_bool_t httpEngineRunning(void) {
+  return engine.count ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+unsigned int httpEngineInFlight(void) {
+  unsigned int i, total = 0;
+
+  for (i = 0; i < engine.count; i++) {
+    switch_mutex_lock(engine.pThreads[i].pMutex);
+    total += engine.pThreads[i].inFlight;
+    switch_mutex_unlock(engine.pThreads[i].pMutex);
+  }
+
+  return total;
+}
+
+static http_engine_thread_t *engine_pool_thread(const http_pool_t *pPool, const unsigned int count) {
+  return &engine.pThreads[((uintptr_t) pPool >> 4) % count];
+}
+
+static switch_status_t engineSubmit(http_request_t *pRequest) {
+  const unsigned int count = engine.count;
+  http_engine_thread_t *pThread;
+  const uint64_t one = 1;
+
+  if (!count) {
+    return SWITCH_STATUS_FALSE;
+  }
+
+  // keep all of a server's requests on one thread so that they share
+  // its connections; one-shot requests are spread round robin
+  if (pRequest->pPool) {
+    pThread = engine_pool_thread(pRequest->pPool, count);
+  } else {
+    pThread = &engine.pThreads[engine.next++ % count];
+  }
+
+  pRequest->pNext = NULL;
+
+  switch_mutex_lock(pThread->pMutex);
+  if (pThread->terminating) {
+    switch_mutex_unlock(pThread->pMutex);
+    return SWITCH_STATUS_FALSE;
+  }
+  if (pThread->pPendingTail) {
+    pThread->pPendingTail->pNext = pRequest;
+  } else {
+    pThread->pPendingHead = pRequest;
+  }
+  pThread->pPendingTail = pRequest;
+  switch_mutex_unlock(pThread->pMutex);
+
+  (void) !write(pThread->eventFd, &one, sizeof(one));
+
+  return SWITCH_STATUS_SUCCESS;
+}
+
+static void engineCancel(http_pool_t *pPool) {
+  const unsigned int count = engine.count;
+  http_engine_thread_t *pThread;
+  const uint64_t one = 1;
+
+  if (!count) {
+    return;
+  }
+
+  pThread = engine_pool_thread(pPool, count);
+
+  switch_mutex_lock(pThread->pMutex);
+  pThread->cancelling = SWITCH_TRUE;
+  switch_mutex_unlock(pThread->pMutex);
+
+  (void) !write(pThread->eventFd, &one, sizeof(one));
+}
+
+#else
+
+switch_status_t httpEngineStart(const unsigned int threads) {
+  if (threads) {
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "HTTP engine is not supported on this platform - using blocking requests\n");
+  }
+  return SWITCH_STATUS_SUCCESS;
+}
+
+void httpEngineStop(void) {
+}
+
+switch_bool_t httpEngineRunning(void) {
+  return SWITCH_FALSE;
+}
+
+unsigned int httpEngineInFlight(void) {
+  return 0;
+}
+
+static switch_status_t engineSubmit(http_request_t *pRequest) {
+  (void) pRequest;
+  return SWITCH_STATUS_FALSE;
+}
+
+static void engineCancel(http_pool_t *pPool) {
+  (void) pPool;
+}
+
+#endif
+
+// takes ownership of pJsonStr and pStream
+static switch_status_t httpSubmitStr(http_pool_t *pPool, const char *pUrl, const unsigned int timeout, char *pJsonStr,
+    http_stream_t *pStream, http_complete_func_t pFunc, void *pUserData) {
+  http_request_t *pRequest;
+
+  if (!(pRequest = httpRequestCreate(pPool, pUrl, timeout, pJsonStr, pStream))) {
+    return SWITCH_STATUS_FALSE;
+  }
+  pRequest->pFunc = pFunc;
+  pRequest->pUserData = pUserData;
+
+  if (engineSubmit(pRequest) != SWITCH_STATUS_SUCCESS) {
+    // no engine - run it on this thread instead
+    httpRequestComplete(pRequest, httpRequestResult(pRequest, switch_curl_easy_perform(pRequest->pCurl)));
+  }
+
+  return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t httpSubmit(http_pool_t *pPool, const char *pUrl, const unsigned int timeout, cJSON *pJsonRequest,
+    http_complete_func_t pFunc, void *pUserData) {
+  char *pJsonStr = NULL;
+
+  switch_assert(pUrl);
+
+  if (pJsonRequest) {
+    if (!(pJsonStr = cJSON_PrintUnformatted(pJsonRequest))) {
+      switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't serialise request for %s\n", pUrl);
+      return SWITCH_STATUS_FALSE;
+    }
+    DEBUG(SWITCH_CHANNEL_LOG, "HTTP POST url=%s json=%s\n", pUrl, pJsonStr);
+  } else {
+    DEBUG(SWITCH_CHANNEL_LOG, "HTTP GET url=%s\n", pUrl);
+  }
+
+  return httpSubmitStr(pPool, pUrl, timeout, pJsonStr, NULL, pFunc, pUserData);
+}
+
+switch_status_t httpSubmitStream(http_pool_t *pPool, const char *pUrl, const unsigned int timeout,
+    http_element_func_t pElementFunc, http_complete_func_t pFunc, void *pUserData) {
+  http_stream_t *pStream;
+
+  switch_assert(pUrl);
+
+  DEBUG(SWITCH_CHANNEL_LOG, "HTTP GET url=%s (streamed)\n", pUrl);
+
+  pStream = httpStreamAcquire(pPool);
+  httpStreamReset(pStream, pElementFunc, pUserData);
+
+  return httpSubmitStr(pPool, pUrl, timeout, NULL, pStream, pFunc, pUserData);
+}
+
+// fails every request already started on the pool - completions get a NULL
+// response straight away instead of at their timeout.  Requests started
+// afterwards are unaffected
+void httpCancel(http_pool_t *pPool) {
+  if (!pPool) {
+    return;
+  }
+
+  switch_mutex_lock(pPool->pMutex);
+  pPool->generation++;
+  switch_mutex_unlock(pPool->pMutex);
+
+  DEBUG(SWITCH_CHANNEL_LOG, "Server=%s cancelling HTTP requests\n", pPool->name);
+
+  engineCancel(pPool);
+}
+
+// the blocking calls wait on a recycled waiter rather than creating a
+// mutex & condition for every request
+typedef struct http_waiter_s {
+  switch_mutex_t *pMutex;
+  switch_thread_cond_t *pCond;
+  switch_bool_t done;
+  cJSON *pJsonResponse;
+  struct http_waiter_s *pNext;
+} http_waiter_t;
+
+static switch_mutex_t *pWaiterMutex = NULL;
+static http_waiter_t *pFreeWaiters = NULL;
+
+void httpInit(void) {
+  switch_mutex_init(&pWaiterMutex, SWITCH_MUTEX_NESTED, globals.pModulePool);
+  switch_mutex_init(&pPoolMutex, SWITCH_MUTEX_NESTED, globals.pModulePool);
+}
+
+static http_waiter_t *httpWaiterAcquire(void) {
+  http_waiter_t *pWaiter;
+
+  switch_mutex_lock(pWaiterMutex);
+  if ((pWaiter = pFreeWaiters)) {
+    pFreeWaiters = pWaiter->pNext;
+  } else {
+    pWaiter = switch_core_alloc(globals.pModulePool, sizeof(*pWaiter));
+    switch_mutex_init(&pWaiter->pMutex, SWITCH_MUTEX_NESTED, globals.pModulePool);
+    switch_thread_cond_create(&pWaiter->pCond, globals.pModulePool);
+  }
+  switch_mutex_unlock(pWaiterMutex);
+
+  pWaiter->done = SWITCH_FALSE;
+  pWaiter->pJsonResponse = NULL;
+  pWaiter->pNext = NULL;
+
+  return pWaiter;
+}
+
+static void httpWaiterRelease(http_waiter_t *pWaiter) {
+  switch_mutex_lock(pWaiterMutex);
+  pWaiter->pNext = pFreeWaiters;
+  pFreeWaiters = pWaiter;
+  switch_mutex_unlock(pWaiterMutex);
+}
+
+static void httpWaiterComplete(cJSON *pJsonResponse, void *pUserData) {
+  http_waiter_t *pWaiter = (http_waiter_t *) pUserData;
+
+  switch_mutex_lock(pWaiter->pMutex);
+  pWaiter->pJsonResponse = pJsonResponse;
+  pWaiter->done = SWITCH_TRUE;
+  switch_thread_cond_signal(pWaiter->pCond);
+  switch_mutex_unlock(pWaiter->pMutex);
+}
+
+static cJSON *httpWait(http_pool_t *pPool, const char *pUrl, const unsigned int timeout, char *pJsonStr) {
+  http_waiter_t *pWaiter = httpWaiterAcquire();
+  cJSON *pJsonResponse;
+
+  switch_mutex_lock(pWaiter->pMutex);
+  if (httpSubmitStr(pPool, pUrl, timeout, pJsonStr, NULL, httpWaiterComplete, pWaiter) == SWITCH_STATUS_SUCCESS) {
+    // the engine enforces the request timeout so this always completes
+    while (!pWaiter->done) {
+      switch_thread_cond_wait(pWaiter->pCond, pWaiter->pMutex);
+    }
+  }
+  pJsonResponse = pWaiter->pJsonResponse;
+  switch_mutex_unlock(pWaiter->pMutex);
+
+  httpWaiterRelease(pWaiter);
 
   return pJsonResponse;
 }
+
+cJSON *httpPost(http_pool_t *pPool, const char *pUrl, const unsigned int timeout, cJSON *pJsonRequest)
+{
+  char *pJsonStr;
+
+  switch_assert(pUrl);
+
+  pJsonStr = cJSON_PrintUnformatted(pJsonRequest);
+  if (!pJsonStr) {
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't serialise request for %s\n", pUrl);
+    return NULL;
+  }
+
+  DEBUG(SWITCH_CHANNEL_LOG, "HTTP POST url=%s json=%s\n", pUrl, pJsonStr);
+
+  return httpWait(pPool, pUrl, timeout, pJsonStr);
+}
+
+cJSON *httpGet(http_pool_t *pPool, const char *pUrl, const unsigned int timeout)
+{
+  switch_assert(pUrl);
+
+  DEBUG(SWITCH_CHANNEL_LOG, "HTTP GET url=%s\n", pUrl);
+
+  return httpWait(pPool, pUrl, timeout, NULL);
+}
 /* For Emacs:
  * Local Variables:
  * mode:c
@@ -34,9 +34,71 @@
 #define _HTTP_H_
 
 #include  "cJSON.h"
+#include  "switch.h"
 
-cJSON *httpPost(const char *url, const unsigned int timeout, cJSON *pJsonRequest);
-cJSON *httpGet(const char *url, const unsigned int timeout);
+#define HTTP_POOL_DEFAULT_SIZE 8
+#define HTTP_POOL_DEFAULT_IDLE_TIMEOUT 30
+#define HTTP_ENGINE_DEFAULT_THREADS 2
+
+// per-server pool of reusable curl handles sharing one connection, DNS and
+// TLS session cache.  A pool of size 0 keeps no handles but still lets
+// httpCancel fail the server's requests; a NULL pool falls back to a one-shot
+// handle per request that can't be cancelled.
+// With http2 set the pool's requests are streams on one HTTP/2 connection
+// where libcurl supports it (HTTP/1.1 otherwise) - they can only share it
+// while the engine is running
+typedef struct http_pool_s http_pool_t;
+
+http_pool_t *httpPoolCreate(const char *pName, const unsigned int size, const unsigned int idleTimeoutSec, const switch_bool_t http2);
+void httpPoolFlush(http_pool_t *pPool);
+void httpPoolDestroy(http_pool_t **ppPool);
+// pConnects counts the new connections the pool's requests had to open
+void httpPoolStats(http_pool_t *pPool, unsigned int *pHits, unsigned int *pMisses, unsigned int *pConnects);
+
+// completion for httpSubmit - runs on an engine thread so must not block.
+// Takes ownership of pJsonResponse which is NULL on failure
+typedef void (*http_complete_func_t)(cJSON *pJsonResponse, void *pUserData);
+
+// Incremental parser for a response body that is a JSON array: each element
+// is handed to an http_element_func_t as soon as it has been received rather
+// than once the whole body has.  A body that isn't an array is parsed whole
+// at the end.  Reset reuses the stream's buffer for the next body
+typedef struct http_stream_s http_stream_t;
+
+// takes ownership of pElement and returns SWITCH_TRUE, or returns SWITCH_FALSE
+// to leave it (and the elements after it) in the array httpStreamFinish returns
+typedef switch_bool_t (*http_element_func_t)(cJSON *pElement, void *pUserData);
+
+http_stream_t *httpStreamCreate(void);
+void httpStreamDestroy(http_stream_t **ppStream);
+void httpStreamReset(http_stream_t *pStream, http_element_func_t pFunc, void *pUserData);
+// fails once the body can't be valid JSON
+switch_status_t httpStreamFeed(http_stream_t *pStream, const char *pData, const size_t len);
+// the array less the elements handed over, the whole body when it isn't an
+// array or NULL if it is incomplete or invalid
+cJSON *httpStreamFinish(http_stream_t *pStream);
+
+void httpInit(void);
+switch_status_t httpEngineStart(const unsigned int threads);
+void httpEngineStop(void);
+switch_bool_t httpEngineRunning(void);
+unsigned int httpEngineInFlight(void);
+
+// a NULL pJsonRequest performs a GET.  If the engine isn't running the
+// request is performed, and pFunc called, before this returns
+switch_status_t httpSubmit(http_pool_t *pPool, const char *url, const unsigned int timeout, cJSON *pJsonRequest,
+		http_complete_func_t pFunc, void *pUserData);
+// as httpSubmit for a GET, but the elements of an array response are handed
+// to pElementFunc (on an engine thread, so it must not block) as they arrive
+// and pFunc gets what is left - see http_stream_t.  The pool keeps the
+// parsers' buffers for its next requests
+switch_status_t httpSubmitStream(http_pool_t *pPool, const char *url, const unsigned int timeout,
+		http_element_func_t pElementFunc, http_complete_func_t pFunc, void *pUserData);
+// fails the requests in flight on the pool, e.g. when its server is stopped
+void httpCancel(http_pool_t *pPool);
+
+cJSON *httpPost(http_pool_t *pPool, const char *url, const unsigned int timeout, cJSON *pJsonRequest);
+cJSON *httpGet(http_pool_t *pPool, const char *url, const unsigned int timeout);
 
 #endif //_HTTP_H_
 /* For Emacs:
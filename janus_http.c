@@ -0,0 +1,397 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ * janus_http.c -- Janus REST (HTTP long-poll) transport
+ *
+ */
+#include  "switch.h"
+#include  "cJSON.h"
+#include  "globals.h"
+#include  "servers.h"
+#include  "http.h"
+#include  "auth.h"
+#include  "api.h"
+#include  "dispatch.h"
+#include  "loop.h"
+#include  "transport.h"
+#include  "janus_http.h"
+
+#define	MAX_POLL_EVENTS 10
+// maxev grows towards this while polls keep coming back full
+#define	MAX_POLL_EVENTS_LIMIT 160
+// each event is queued on its own as it arrives, then the end of its poll.
+// Only one poll is outstanding at a time: Janus hands a session's events to
+// whichever of its polls it is holding, so two polls (on two connections)
+// could complete in either order and split a call's events out of order
+#define POLL_QUEUE_SIZE (MAX_POLL_EVENTS_LIMIT + 1)
+// how long a poll waits for a response before returning to its caller
+#define POLL_WAIT_SLICE_US 1000000
+// The long-poll request has a 30 seconds timeout. If it has no event to report, a simple keep-alive message will be triggered
+#define HTTP_GET_TIMEOUT TRANSPORT_POLL_TIMEOUT
+
+// the pool (if any) is created with the server's configuration
+static switch_status_t janus_http_open(server_t *pServer)
+{
+	(void) pServer;
+	return SWITCH_STATUS_SUCCESS;
+}
+
+// connections are pooled and closed by the pool
+static void janus_http_close(server_t *pServer)
+{
+	(void) pServer;
+}
+
+/*
+ * The ids go in the URL: the root for create, /<serverId> for the session
+ * (claim, attach) and /<serverId>/<senderId> for everything sent to a handle.
+ */
+static cJSON *janus_http_send(server_t *pServer, cJSON *pJsonRequest, const char *pTransactionId,
+	const janus_id_t serverId, const janus_id_t senderId, const char *pLabel)
+{
+	char url[1024];
+	int n;
+
+	(void) pTransactionId;
+
+	if (!serverId) {
+		n = snprintf(url, sizeof(url), "%s", pServer->pUrl);
+	} else if (!senderId) {
+		n = snprintf(url, sizeof(url), "%s/%" SWITCH_UINT64_T_FMT, pServer->pUrl, serverId);
+	} else {
+		n = snprintf(url, sizeof(url), "%s/%" SWITCH_UINT64_T_FMT "/%" SWITCH_UINT64_T_FMT,
+			pServer->pUrl, serverId, senderId);
+	}
+	if (n < 0 || (size_t) n >= sizeof(url)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Could not generate URL\n");
+		return NULL;
+	}
+	MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Sending HTTP %s - url=%s\n", pLabel, url);
+	return httpPost(pServer->pHttpPool, url, TRANSPORT_REQUEST_TIMEOUT, pJsonRequest);
+}
+
+// What the poll thread is handed: each event of a poll's response as soon as
+// it has been received, then the end of the poll with any events that
+// couldn't be queued on their own
+typedef struct {
+	server_t *pServer;
+	janus_id_t serverId;
+	cJSON *pJsonResponse;
+	switch_time_t received;
+	// the poll has completed - pJsonResponse is NULL if it failed
+	switch_bool_t done;
+	// the events already queued on their own
+	unsigned int events;
+} janus_http_poll_result_t;
+
+// runs on an HTTP engine thread as each event arrives - hand it to the poll
+// thread without waiting for the rest of the response
+static switch_bool_t janus_http_poll_event(cJSON *pEvent, void *pUserData)
+{
+	janus_http_poll_result_t *pPoll = (janus_http_poll_result_t *) pUserData;
+	server_t *pServer = pPoll->pServer;
+	janus_http_poll_result_t *pResult;
+
+	switch_zmalloc(pResult, sizeof(*pResult));
+	pResult->pServer = pServer;
+	pResult->serverId = pPoll->serverId;
+	pResult->pJsonResponse = pEvent;
+	pResult->received = switch_time_now();
+
+	if (switch_queue_trypush(pServer->pPollQueue, pResult) != SWITCH_STATUS_SUCCESS) {
+		// it (and the rest) stays in the response instead
+		free(pResult);
+		return SWITCH_FALSE;
+	}
+	pPoll->events++;
+	loopWake(pServer);
+
+	return SWITCH_TRUE;
+}
+
+// runs on an HTTP engine thread - hand the end of the poll to the poll thread
+static void janus_http_poll_complete(cJSON *pJsonResponse, void *pUserData)
+{
+	janus_http_poll_result_t *pResult = (janus_http_poll_result_t *) pUserData;
+	server_t *pServer = pResult->pServer;
+
+	pResult->pJsonResponse = pJsonResponse;
+	pResult->received = switch_time_now();
+	pResult->done = SWITCH_TRUE;
+
+	if (switch_queue_trypush(pServer->pPollQueue, pResult) == SWITCH_STATUS_SUCCESS) {
+		loopWake(pServer);
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Server=%s poll queue full - dropping response\n", pServer->name);
+		switch_mutex_lock(pServer->mutex);
+		pServer->pollOutstanding--;
+		switch_mutex_unlock(pServer->mutex);
+		cJSON_Delete(pJsonResponse);
+		free(pResult);
+	}
+}
+
+static switch_status_t janus_http_poll_submit(server_t *pServer, const janus_id_t serverId)
+{
+	switch_status_t result = SWITCH_STATUS_SUCCESS;
+	janus_http_poll_result_t *pResult = NULL;
+	char signedToken[AUTH_TOKEN_MAX];
+	const char *pAuthToken;
+	char url[1024];
+
+	if (snprintf(url, sizeof(url), "%s/%" SWITCH_UINT64_T_FMT "?maxev=%u", pServer->pUrl, serverId, pServer->pollMaxEvents) < 0) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Could not generate URL\n");
+		result = SWITCH_STATUS_FALSE;
+		goto done;
+	}
+
+	if (pServer->pSecret) {
+		size_t len = strlen(url);
+		if (snprintf(&url[len], sizeof(url) - len, "&apisecret=%s", pServer->pSecret) < 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Could not generate secret\n");
+			result = SWITCH_STATUS_FALSE;
+			goto done;
+		}
+	}
+
+	/*
+	 * In signed-mode, every request (including long-poll GETs) needs a
+	 * signed token that hasn't expired since old ones can expire
+	 * mid-session. The lifecycle TTL is short on purpose — the cache
+	 * re-signs the token once hmac-token-refresh percent of it has passed,
+	 * so leaking a URL to logs only exposes a 5-minute window.
+	 */
+	pAuthToken = pServer->pAuthToken;
+	if (pServer->pAuthCache) {
+		const char *pDescriptors[1] = { JANUS_PLUGIN };
+		if (authCacheSign(pServer->pAuthCache, API_HMAC_DEFAULT_LIFECYCLE_TTL, pDescriptors, 1, signedToken, sizeof(signedToken)) < 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot sign poll token\n");
+			result = SWITCH_STATUS_FALSE;
+			goto done;
+		}
+		pAuthToken = signedToken; /* overrides any stored-mode token */
+	}
+
+	if (pAuthToken) {
+		size_t len = strlen(url);
+		if (snprintf(&url[len], sizeof(url) - len, "&token=%s", pAuthToken) < 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Could not generate token\n");
+			result = SWITCH_STATUS_FALSE;
+			goto done;
+		}
+	}
+
+	switch_zmalloc(pResult, sizeof(*pResult));
+	pResult->pServer = pServer;
+	pResult->serverId = serverId;
+
+	switch_mutex_lock(pServer->mutex);
+	pServer->pollOutstanding++;
+	switch_mutex_unlock(pServer->mutex);
+
+	MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Sending HTTP request - url=%s\n", url);
+	if (httpSubmitStream(pServer->pHttpPool, url, HTTP_GET_TIMEOUT, janus_http_poll_event, janus_http_poll_complete, pResult) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot submit poll\n");
+		switch_mutex_lock(pServer->mutex);
+		pServer->pollOutstanding--;
+		switch_mutex_unlock(pServer->mutex);
+		free(pResult);
+		result = SWITCH_STATUS_FALSE;
+	}
+
+done:
+	return result;
+}
+
+// submits the next poll unless one is already outstanding
+static switch_status_t janus_http_poll_fill(server_t *pServer, const janus_id_t serverId)
+{
+	unsigned int outstanding;
+
+	switch_mutex_lock(pServer->mutex);
+	outstanding = pServer->pollOutstanding;
+	switch_mutex_unlock(pServer->mutex);
+
+	if (outstanding) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+	return janus_http_poll_submit(pServer, serverId);
+}
+
+static void janus_http_poll_dispatch(server_t *pServer, cJSON *pEvent, const switch_time_t received,
+	const api_dispatch_t *pDispatch)
+{
+	const switch_time_t latency = switch_time_now() - received;
+
+	switch_mutex_lock(pServer->mutex);
+	pServer->pollEvents++;
+	// exponentially weighted average over roughly the last 8 events
+	pServer->pollLatencyAvg += (latency - pServer->pollLatencyAvg) / 8;
+	if (latency > pServer->pollLatencyMax) {
+		pServer->pollLatencyMax = latency;
+	}
+	switch_mutex_unlock(pServer->mutex);
+
+	dispatchEvent(pServer, pEvent, pDispatch);
+}
+
+// handles one event, or the end of a poll, taken from the queue
+static switch_status_t janus_http_poll_result(server_t *pServer, const janus_id_t serverId,
+	janus_http_poll_result_t *pResult, const api_dispatch_t *pDispatch)
+{
+	cJSON *pEvent;
+	unsigned int count;
+
+	if (pResult->done) {
+		switch_mutex_lock(pServer->mutex);
+		pServer->pollOutstanding--;
+		switch_mutex_unlock(pServer->mutex);
+	}
+
+	if (pResult->serverId != serverId) {
+		// left over from a previous session
+		MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Discarding poll for old serverId=%" SWITCH_UINT64_T_FMT "\n", pResult->serverId);
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (!pResult->done) {
+		janus_http_poll_dispatch(pServer, pResult->pJsonResponse, pResult->received, pDispatch);
+		pResult->pJsonResponse = NULL;
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (pResult->pJsonResponse == NULL) {
+		// a stopping server's polls are cancelled on purpose
+		if (!switch_test_flag(pServer, SFLAG_TERMINATING)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid response\n");
+		}
+		return SWITCH_STATUS_FALSE;
+	}
+
+	// get the next poll into Janus before working through what is left - its
+	// events are queued behind this one's end so they are dispatched after
+	// these.  Without the engine a submitted poll blocks until it completes
+	if (httpEngineRunning() && janus_http_poll_fill(pServer, serverId) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot submit next poll\n");
+	}
+
+	count = pResult->events;
+	for (pEvent = pResult->pJsonResponse->child; pEvent; pEvent = pEvent->next) {
+		count++;
+	}
+
+	// a full batch means more events are probably waiting; a sparse one
+	// means a smaller batch will do
+	if (count >= pServer->pollMaxEvents && pServer->pollMaxEvents < MAX_POLL_EVENTS_LIMIT) {
+		pServer->pollMaxEvents *= 2;
+		if (pServer->pollMaxEvents > MAX_POLL_EVENTS_LIMIT) {
+			pServer->pollMaxEvents = MAX_POLL_EVENTS_LIMIT;
+		}
+	} else if (count < pServer->pollMaxEvents / 4 && pServer->pollMaxEvents > MAX_POLL_EVENTS) {
+		pServer->pollMaxEvents /= 2;
+		if (pServer->pollMaxEvents < MAX_POLL_EVENTS) {
+			pServer->pollMaxEvents = MAX_POLL_EVENTS;
+		}
+	}
+
+	pEvent = pResult->pJsonResponse->child;
+	while (pEvent) {
+		cJSON *next = pEvent->next;
+
+		janus_http_poll_dispatch(pServer, cJSON_DetachItemViaPointer(pResult->pJsonResponse, pEvent), pResult->received, pDispatch);
+		pEvent = next;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t janus_http_poll(server_t *pServer, const janus_id_t serverId, const switch_bool_t block,
+	const api_dispatch_t *pDispatch)
+{
+	switch_status_t result = SWITCH_STATUS_SUCCESS;
+	void *pPop = NULL;
+
+	switch_assert(pServer);
+	switch_assert(pServer->pUrl);
+
+	// only the server thread polls so these need no locking
+	if (!pServer->pPollQueue) {
+		switch_queue_create(&pServer->pPollQueue, POLL_QUEUE_SIZE, globals.pModulePool);
+	}
+	if (!pServer->pollMaxEvents) {
+		pServer->pollMaxEvents = MAX_POLL_EVENTS;
+	}
+
+	if (janus_http_poll_fill(pServer, serverId) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if ((block ? switch_queue_pop_timeout(pServer->pPollQueue, &pPop, POLL_WAIT_SLICE_US) :
+			switch_queue_trypop(pServer->pPollQueue, &pPop)) != SWITCH_STATUS_SUCCESS) {
+		// nothing yet - let the caller check whether it should stop
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	// one wake may stand for several events, so take everything queued
+	do {
+		janus_http_poll_result_t *pResult = (janus_http_poll_result_t *) pPop;
+
+		result = janus_http_poll_result(pServer, serverId, pResult, pDispatch);
+		cJSON_Delete(pResult->pJsonResponse);
+		free(pResult);
+		pPop = NULL;
+	} while (result == SWITCH_STATUS_SUCCESS && switch_queue_trypop(pServer->pPollQueue, &pPop) == SWITCH_STATUS_SUCCESS);
+
+	return result;
+}
+
+// a stopping server's outstanding polls and requests complete at once
+static void janus_http_cancel(server_t *pServer)
+{
+	httpCancel(pServer->pHttpPool);
+}
+
+const transport_t janus_http_transport = {
+	"HTTP long-poll",
+	janus_http_open,
+	janus_http_close,
+	janus_http_send,
+	janus_http_poll,
+	janus_http_cancel
+};
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
@@ -0,0 +1,861 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * janus_socket.c -- Message socket sessions (WebSocket, Unix socket) for mod_janus.
+ *
+ * Design:
+ *   - The WebSocket (janus_ws.c) and Unix socket (janus_unix.c) transports
+ *     both carry one JSON message per frame or packet, with session_id /
+ *     handle_id in the body and replies matched to requests by transaction.
+ *     They supply a janus_socket_ops_t for their connection and share the
+ *     rest from here.
+ *   - A reader reads every message as soon as it arrives.  Connections
+ *     with a descriptor (the fd op) share one reader thread waiting on all
+ *     of them with epoll, so the number of servers doesn't drive the number
+ *     of threads; any other connection has a reader thread of its own.
+ *     Writes are serialized under ctx->write_mutex and never wait for the
+ *     reader.
+ *   - In-flight RPCs live in ctx->txns keyed by transaction id.  The reader
+ *     completes the matching entry and signals that caller's condition, so
+ *     any number of RPCs can be outstanding on the one connection.
+ *   - Every other message is queued on ctx->deferred and the pump (the
+ *     server's thread or loop) is woken to dispatch it.  Callbacks never run
+ *     on the reader because some of them make RPCs whose replies the reader
+ *     must read.
+ *   - ctx is reference counted: RPC callers, the pump and interrupt hold a
+ *     reference while they use it, so close never frees it under them.
+ */
+#include "janus_socket.h"
+#include "dispatch.h"
+#include "loop.h"
+#include "cJSON.h"
+#include "globals.h"
+#include "switch_stun.h"
+
+/* epoll - and the only transport with a descriptor (janus_unix.c) is
+ * Linux-only anyway */
+#if defined(__linux__)
+#define JANUS_SOCKET_SHARED_READER 1
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+/* How often an idle reader wakes to check whether it should stop. */
+#define JANUS_SOCKET_READER_WAIT_MS 1000
+
+#define JANUS_SOCKET_TXN_ID_MAX 64
+
+/* Ready connections the shared reader takes from each epoll_wait. */
+#define JANUS_SOCKET_SHARED_EVENTS 64
+
+typedef struct janus_socket_deferred_s {
+	cJSON *root;
+	struct janus_socket_deferred_s *next;
+} janus_socket_deferred_t;
+
+/* One outstanding RPC.  Entries are recycled through ctx->txn_free so the
+ * condition is created once per concurrent caller, not once per request. */
+typedef struct janus_socket_txn_s {
+	char id[JANUS_SOCKET_TXN_ID_MAX];
+	cJSON *result;
+	switch_thread_cond_t *cond;
+	struct janus_socket_txn_s *next;
+} janus_socket_txn_t;
+
+typedef struct janus_socket_ctx_s {
+	server_t *server;
+	unsigned int refs;           /* under server->mutex - see janus_socket_ctx_acquire */
+	const janus_socket_ops_t *ops;
+	void *conn;
+	switch_memory_pool_t *pool;
+	switch_thread_t *reader;     /* unless shared */
+	switch_bool_t shared;        /* read by the shared reader */
+	struct janus_socket_ctx_s *shared_next;
+
+	switch_mutex_t *write_mutex; /* serializes ops->write and ops->close */
+	switch_bool_t closed;        /* ops->close has run - under write_mutex */
+
+	/* Everything below is protected by txn_mutex. */
+	switch_mutex_t *txn_mutex;
+	switch_hash_t *txns;         /* in-flight RPCs */
+	janus_socket_txn_t *txn_free;
+	switch_bool_t running;       /* cleared to stop the reader */
+	switch_bool_t closing;       /* reader gone - no more replies */
+
+	/* Messages other than RPC replies, waiting for the pump. */
+	janus_socket_deferred_t *deferred_head;
+	janus_socket_deferred_t *deferred_tail;
+	switch_thread_cond_t *pump_cond;
+} janus_socket_ctx_t;
+
+static struct {
+	switch_mutex_t *mutex;       /* held while the reader reads a batch */
+	switch_thread_t *thread;
+	int epfd;
+	int wakefd;                  /* wakes the reader to stop */
+	janus_socket_ctx_t *ctxs;    /* the sessions it reads */
+	switch_bool_t running;
+} janus_socket_shared;
+
+/* -------------------------------------------------------------------------- */
+/* helpers                                                                    */
+/* -------------------------------------------------------------------------- */
+
+static void janus_socket_ctx_destroy(janus_socket_ctx_t *ctx);
+
+/* Take a reference to the session in *handle.  The connection holds one
+ * reference of its own, dropped by janus_socket_close, so whichever of the
+ * closer and the RPC callers still inside it lets go last frees it. */
+static janus_socket_ctx_t *janus_socket_ctx_acquire(server_t *server, void **handle)
+{
+	janus_socket_ctx_t *ctx;
+
+	if (!server) {
+		return NULL;
+	}
+	switch_mutex_lock(server->mutex);
+	if ((ctx = (janus_socket_ctx_t *) *handle)) {
+		ctx->refs++;
+	}
+	switch_mutex_unlock(server->mutex);
+	return ctx;
+}
+
+static void janus_socket_ctx_release(janus_socket_ctx_t *ctx)
+{
+	server_t *server = ctx->server;
+	unsigned int refs;
+
+	switch_mutex_lock(server->mutex);
+	refs = --ctx->refs;
+	switch_mutex_unlock(server->mutex);
+
+	if (!refs) {
+		janus_socket_ctx_destroy(ctx);
+	}
+}
+
+/* Add `root` to the deferred list and wake the pump. Takes ownership on
+ * success; caller must cJSON_Delete(root) if this returns SWITCH_FALSE. */
+static switch_bool_t janus_socket_defer_event(janus_socket_ctx_t *ctx, cJSON *root)
+{
+	janus_socket_deferred_t *node = malloc(sizeof(*node));
+	if (!node) {
+		return SWITCH_FALSE;
+	}
+	node->root = root;
+	node->next = NULL;
+	switch_mutex_lock(ctx->txn_mutex);
+	if (ctx->deferred_tail) {
+		ctx->deferred_tail->next = node;
+	} else {
+		ctx->deferred_head = node;
+	}
+	ctx->deferred_tail = node;
+	switch_thread_cond_signal(ctx->pump_cond);
+	switch_mutex_unlock(ctx->txn_mutex);
+	loopWake(ctx->server);
+	return SWITCH_TRUE;
+}
+
+/* Caller MUST hold ctx->txn_mutex. */
+static janus_socket_txn_t *janus_socket_txn_acquire(janus_socket_ctx_t *ctx)
+{
+	janus_socket_txn_t *txn = ctx->txn_free;
+
+	if (txn) {
+		ctx->txn_free = txn->next;
+	} else {
+		txn = switch_core_alloc(ctx->pool, sizeof(*txn));
+		switch_thread_cond_create(&txn->cond, ctx->pool);
+	}
+	txn->result = NULL;
+	txn->next = NULL;
+	return txn;
+}
+
+/* Caller MUST hold ctx->txn_mutex. */
+static void janus_socket_txn_release(janus_socket_ctx_t *ctx, janus_socket_txn_t *txn)
+{
+	txn->next = ctx->txn_free;
+	ctx->txn_free = txn;
+}
+
+/* Wake every waiting RPC caller and the pump. Caller MUST hold ctx->txn_mutex. */
+static void janus_socket_wake_all(janus_socket_ctx_t *ctx)
+{
+	switch_hash_index_t *hi;
+
+	for (hi = switch_core_hash_first(ctx->txns); hi; hi = switch_core_hash_next(&hi)) {
+		void *val = NULL;
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		switch_thread_cond_signal(((janus_socket_txn_t *) val)->cond);
+	}
+	switch_thread_cond_broadcast(ctx->pump_cond);
+	loopWake(ctx->server);
+}
+
+/* Test whether `root` is the reply to one of the in-flight RPCs (ctx->txns).
+ * Takes ownership of `root` on match and wakes the waiting caller. */
+static switch_bool_t janus_socket_match_rpc_reply(janus_socket_ctx_t *ctx, cJSON *root)
+{
+	janus_socket_txn_t *pending;
+	cJSON *txn;
+	cJSON *jt;
+
+	txn = cJSON_GetObjectItemCaseSensitive(root, "transaction");
+	jt  = cJSON_GetObjectItemCaseSensitive(root, "janus");
+	if (!cJSON_IsString(txn) || !cJSON_IsString(jt)) {
+		return SWITCH_FALSE;
+	}
+	if (strcmp(jt->valuestring, "success") &&
+		strcmp(jt->valuestring, "ack") &&
+		strcmp(jt->valuestring, "error")) {
+		return SWITCH_FALSE;
+	}
+
+	switch_mutex_lock(ctx->txn_mutex);
+	if ((pending = (janus_socket_txn_t *) switch_core_hash_find(ctx->txns, txn->valuestring))) {
+		/* a later event with the same transaction (after an ack) is dispatched */
+		switch_core_hash_delete(ctx->txns, pending->id);
+		pending->result = root;
+		switch_thread_cond_signal(pending->cond);
+	}
+	switch_mutex_unlock(ctx->txn_mutex);
+
+	return pending ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+static switch_status_t janus_socket_write_text(janus_socket_ctx_t *ctx, const char *payload)
+{
+	switch_status_t status = SWITCH_STATUS_FALSE;
+
+	DEBUG(SWITCH_CHANNEL_LOG, "%s send %s\n", ctx->ops->name, payload);
+
+	switch_mutex_lock(ctx->write_mutex);
+	if (!ctx->closed) {
+		status = ctx->ops->write(ctx->conn, payload);
+	}
+	switch_mutex_unlock(ctx->write_mutex);
+
+	return status;
+}
+
+/* -------------------------------------------------------------------------- */
+/* reader                                                                     */
+/* -------------------------------------------------------------------------- */
+
+/* Read every message currently available.
+ *
+ * For each one:
+ *   - If it matches an in-flight RPC transaction: complete that RPC.
+ *   - Else: append to ctx->deferred and wake the pump.
+ *
+ * Only called from the session's reader, its own or the shared one.
+ */
+static switch_status_t janus_socket_drain(janus_socket_ctx_t *ctx)
+{
+	for (;;) {
+		char *text = NULL;
+		cJSON *root;
+
+		if (ctx->ops->read(ctx->conn, &text) != SWITCH_STATUS_SUCCESS) {
+			return SWITCH_STATUS_FALSE;
+		}
+		if (!text) {
+			return SWITCH_STATUS_SUCCESS;
+		}
+
+		DEBUG(SWITCH_CHANNEL_LOG, "%s recv %s\n", ctx->ops->name, text);
+
+		root = cJSON_Parse(text);
+		free(text);
+		if (!root) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s: invalid JSON\n", ctx->ops->name);
+			continue;
+		}
+		if (janus_socket_match_rpc_reply(ctx, root)) {
+			continue; /* owned by the waiting RPC */
+		}
+		if (!janus_socket_defer_event(ctx, root)) {
+			cJSON_Delete(root);
+		}
+	}
+}
+
+/* No more replies will arrive - fail the waiting RPCs and the pump. */
+static void janus_socket_reader_done(janus_socket_ctx_t *ctx)
+{
+	switch_bool_t running;
+
+	switch_mutex_lock(ctx->txn_mutex);
+	running = ctx->running;
+	ctx->closing = SWITCH_TRUE;
+	janus_socket_wake_all(ctx);
+	switch_mutex_unlock(ctx->txn_mutex);
+
+	if (running) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s: server=%s connection lost\n",
+			ctx->ops->name, ctx->server->name);
+	}
+}
+
+static void *SWITCH_THREAD_FUNC janus_socket_reader_run(switch_thread_t *thread, void *obj)
+{
+	janus_socket_ctx_t *ctx = (janus_socket_ctx_t *) obj;
+	switch_bool_t running;
+
+	(void) thread;
+
+	for (;;) {
+		int ready;
+
+		switch_mutex_lock(ctx->txn_mutex);
+		running = ctx->running;
+		switch_mutex_unlock(ctx->txn_mutex);
+		if (!running) {
+			break;
+		}
+
+		if ((ready = ctx->ops->wait(ctx->conn, JANUS_SOCKET_READER_WAIT_MS)) < 0 ||
+			(ready > 0 && janus_socket_drain(ctx) != SWITCH_STATUS_SUCCESS)) {
+			break;
+		}
+	}
+
+	janus_socket_reader_done(ctx);
+
+	return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* shared reader                                                              */
+/* -------------------------------------------------------------------------- */
+
+#if defined(JANUS_SOCKET_SHARED_READER)
+
+/* Where ctx is linked into janus_socket_shared.ctxs, or NULL once it has
+ * left.  Caller MUST hold janus_socket_shared.mutex. */
+static janus_socket_ctx_t **janus_socket_shared_find(janus_socket_ctx_t *ctx)
+{
+	janus_socket_ctx_t **link;
+
+	for (link = &janus_socket_shared.ctxs; *link; link = &(*link)->shared_next) {
+		if (*link == ctx) {
+			return link;
+		}
+	}
+	return NULL;
+}
+
+/* Caller MUST hold janus_socket_shared.mutex. */
+static switch_bool_t janus_socket_shared_remove(janus_socket_ctx_t *ctx)
+{
+	janus_socket_ctx_t **link;
+
+	if (!(link = janus_socket_shared_find(ctx))) {
+		return SWITCH_FALSE;
+	}
+	*link = ctx->shared_next;
+	ctx->shared_next = NULL;
+	(void) epoll_ctl(janus_socket_shared.epfd, EPOLL_CTL_DEL, ctx->ops->fd(ctx->conn), NULL);
+	return SWITCH_TRUE;
+}
+
+static void *SWITCH_THREAD_FUNC janus_socket_shared_run(switch_thread_t *thread, void *obj)
+{
+	struct epoll_event events[JANUS_SOCKET_SHARED_EVENTS];
+
+	(void) thread;
+	(void) obj;
+
+	for (;;) {
+		int ready;
+		int i;
+
+		if ((ready = epoll_wait(janus_socket_shared.epfd, events, JANUS_SOCKET_SHARED_EVENTS, -1)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "janus_socket: epoll_wait failed errno=%d\n", errno);
+			break;
+		}
+
+		switch_mutex_lock(janus_socket_shared.mutex);
+		if (!janus_socket_shared.running) {
+			switch_mutex_unlock(janus_socket_shared.mutex);
+			break;
+		}
+		for (i = 0; i < ready; i++) {
+			janus_socket_ctx_t *ctx = (janus_socket_ctx_t *) events[i].data.ptr;
+
+			/* A session closed since epoll_wait returned may be gone, or be
+			 * a new one at the same address that just has nothing to read. */
+			if (!ctx || !janus_socket_shared_find(ctx)) {
+				continue;
+			}
+			if (janus_socket_drain(ctx) != SWITCH_STATUS_SUCCESS) {
+				(void) janus_socket_shared_remove(ctx);
+				janus_socket_reader_done(ctx);
+			}
+		}
+		switch_mutex_unlock(janus_socket_shared.mutex);
+	}
+
+	/* fail whatever it was still reading rather than leave it unread */
+	switch_mutex_lock(janus_socket_shared.mutex);
+	janus_socket_shared.running = SWITCH_FALSE;
+	while (janus_socket_shared.ctxs) {
+		janus_socket_ctx_t *ctx = janus_socket_shared.ctxs;
+		(void) janus_socket_shared_remove(ctx);
+		janus_socket_reader_done(ctx);
+	}
+	switch_mutex_unlock(janus_socket_shared.mutex);
+
+	return NULL;
+}
+
+/* Hand ctx to the shared reader - SWITCH_FALSE when it needs one of its own. */
+static switch_bool_t janus_socket_shared_add(janus_socket_ctx_t *ctx)
+{
+	struct epoll_event event;
+	switch_bool_t added = SWITCH_FALSE;
+	int fd;
+
+	if (!ctx->ops->fd || !janus_socket_shared.mutex || (fd = ctx->ops->fd(ctx->conn)) < 0) {
+		return SWITCH_FALSE;
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.ptr = ctx;
+
+	switch_mutex_lock(janus_socket_shared.mutex);
+	if (janus_socket_shared.running) {
+		if (epoll_ctl(janus_socket_shared.epfd, EPOLL_CTL_ADD, fd, &event) == 0) {
+			ctx->shared_next = janus_socket_shared.ctxs;
+			janus_socket_shared.ctxs = ctx;
+			added = SWITCH_TRUE;
+		} else {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s: epoll_ctl failed errno=%d\n", ctx->ops->name, errno);
+		}
+	}
+	switch_mutex_unlock(janus_socket_shared.mutex);
+
+	return added;
+}
+
+/* Once this returns the shared reader has finished with ctx. */
+static void janus_socket_shared_leave(janus_socket_ctx_t *ctx)
+{
+	switch_mutex_lock(janus_socket_shared.mutex);
+	(void) janus_socket_shared_remove(ctx);
+	switch_mutex_unlock(janus_socket_shared.mutex);
+}
+
+switch_status_t janus_socket_start(void)
+{
+	switch_threadattr_t *thd_attr = NULL;
+	struct epoll_event event;
+
+	if (janus_socket_shared.running) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	switch_mutex_init(&janus_socket_shared.mutex, SWITCH_MUTEX_NESTED, globals.pModulePool);
+	janus_socket_shared.ctxs = NULL;
+	janus_socket_shared.wakefd = -1;
+	if ((janus_socket_shared.epfd = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+		(janus_socket_shared.wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "janus_socket: shared reader setup failed errno=%d\n", errno);
+		goto fail;
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+	if (epoll_ctl(janus_socket_shared.epfd, EPOLL_CTL_ADD, janus_socket_shared.wakefd, &event) < 0) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "janus_socket: shared reader setup failed errno=%d\n", errno);
+		goto fail;
+	}
+
+	janus_socket_shared.running = SWITCH_TRUE;
+	switch_threadattr_create(&thd_attr, globals.pModulePool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+	if (switch_thread_create(&janus_socket_shared.thread, thd_attr, janus_socket_shared_run, NULL, globals.pModulePool) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "janus_socket: shared reader thread failed\n");
+		janus_socket_shared.running = SWITCH_FALSE;
+		janus_socket_shared.thread = NULL;
+		goto fail;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+
+fail:
+	if (janus_socket_shared.wakefd >= 0) {
+		close(janus_socket_shared.wakefd);
+	}
+	if (janus_socket_shared.epfd >= 0) {
+		close(janus_socket_shared.epfd);
+	}
+	janus_socket_shared.wakefd = janus_socket_shared.epfd = -1;
+	return SWITCH_STATUS_FALSE;
+}
+
+void janus_socket_stop(void)
+{
+	switch_status_t retval;
+	const uint64_t one = 1;
+
+	if (!janus_socket_shared.thread) {
+		return;
+	}
+
+	switch_mutex_lock(janus_socket_shared.mutex);
+	janus_socket_shared.running = SWITCH_FALSE;
+	switch_mutex_unlock(janus_socket_shared.mutex);
+	if (write(janus_socket_shared.wakefd, &one, sizeof(one)) < 0) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "janus_socket: couldn't wake the shared reader errno=%d\n", errno);
+	}
+	switch_thread_join(&retval, janus_socket_shared.thread);
+	janus_socket_shared.thread = NULL;
+
+	close(janus_socket_shared.wakefd);
+	close(janus_socket_shared.epfd);
+	janus_socket_shared.wakefd = janus_socket_shared.epfd = -1;
+}
+
+#else
+
+static switch_bool_t janus_socket_shared_add(janus_socket_ctx_t *ctx)
+{
+	(void) ctx;
+	return SWITCH_FALSE;
+}
+
+static void janus_socket_shared_leave(janus_socket_ctx_t *ctx)
+{
+	(void) ctx;
+}
+
+/* nothing here has a descriptor to share - every session has its own reader */
+switch_status_t janus_socket_start(void)
+{
+	return SWITCH_STATUS_SUCCESS;
+}
+
+void janus_socket_stop(void)
+{
+}
+
+#endif /* JANUS_SOCKET_SHARED_READER */
+
+static void janus_socket_flush_deferred(janus_socket_ctx_t *ctx, const api_dispatch_t *dispatch)
+{
+	janus_socket_deferred_t *node;
+
+	switch_mutex_lock(ctx->txn_mutex);
+	node = ctx->deferred_head;
+	ctx->deferred_head = ctx->deferred_tail = NULL;
+	switch_mutex_unlock(ctx->txn_mutex);
+
+	while (node) {
+		janus_socket_deferred_t *next = node->next;
+		if (dispatch) {
+			dispatchEvent(ctx->server, node->root, dispatch); /* takes ownership */
+		} else {
+			cJSON_Delete(node->root);
+		}
+		free(node);
+		node = next;
+	}
+}
+
+/* -------------------------------------------------------------------------- */
+/* public: synchronous RPC                                                    */
+/* -------------------------------------------------------------------------- */
+
+cJSON *janus_socket_rpc(server_t *server, void **handle, cJSON *request, const char *transaction,
+	switch_interval_time_t timeout_us)
+{
+	janus_socket_ctx_t *ctx;
+	janus_socket_txn_t *txn;
+	char *payload = NULL;
+	cJSON *result = NULL;
+	switch_time_t deadline;
+
+	if (!request || !transaction) {
+		return NULL;
+	}
+	if (!(ctx = janus_socket_ctx_acquire(server, handle))) {
+		return NULL;
+	}
+	if (strlen(transaction) >= JANUS_SOCKET_TXN_ID_MAX) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
+			"%s: transaction id too long transaction=%s\n", ctx->ops->name, transaction);
+		janus_socket_ctx_release(ctx);
+		return NULL;
+	}
+
+	payload = cJSON_PrintUnformatted(request);
+	if (!payload) {
+		janus_socket_ctx_release(ctx);
+		return NULL;
+	}
+
+	/* Registered before the write so that a fast reply can't be missed. */
+	switch_mutex_lock(ctx->txn_mutex);
+	if (ctx->closing) {
+		switch_mutex_unlock(ctx->txn_mutex);
+		cJSON_free(payload);
+		janus_socket_ctx_release(ctx);
+		return NULL;
+	}
+	txn = janus_socket_txn_acquire(ctx);
+	switch_copy_string(txn->id, transaction, sizeof(txn->id));
+	switch_core_hash_insert(ctx->txns, txn->id, txn);
+	switch_mutex_unlock(ctx->txn_mutex);
+
+	if (janus_socket_write_text(ctx, payload) != SWITCH_STATUS_SUCCESS) {
+		switch_mutex_lock(ctx->txn_mutex);
+		goto done;
+	}
+
+	deadline = switch_time_now() + timeout_us;
+
+	switch_mutex_lock(ctx->txn_mutex);
+	while (!txn->result && !ctx->closing) {
+		switch_interval_time_t remaining = deadline - switch_time_now();
+
+		if (remaining <= 0) {
+			break;
+		}
+		(void) switch_thread_cond_timedwait(txn->cond, ctx->txn_mutex, remaining);
+	}
+
+	if (!txn->result && !ctx->closing) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
+			"%s: RPC timeout transaction=%s\n", ctx->ops->name, transaction);
+	}
+
+done:
+	/* txn_mutex is held from here */
+	if (!txn->result) {
+		switch_core_hash_delete(ctx->txns, txn->id);
+	}
+	result = txn->result;
+	janus_socket_txn_release(ctx, txn);
+	switch_mutex_unlock(ctx->txn_mutex);
+
+	cJSON_free(payload);
+	janus_socket_ctx_release(ctx);
+	return result;
+}
+
+/* -------------------------------------------------------------------------- */
+/* public: event pump                                                         */
+/* -------------------------------------------------------------------------- */
+
+/* Sent without waiting for the reply - the ack is dropped as a no-op event. */
+static void janus_socket_send_keepalive(server_t *server, janus_socket_ctx_t *ctx, janus_id_t session_id)
+{
+	cJSON *ka = cJSON_CreateObject();
+	char txn[17] = {0};
+	char sid[32];
+	char *payload;
+
+	if (!ka) {
+		return;
+	}
+	switch_stun_random_string(txn, sizeof(txn) - 1, NULL);
+	cJSON_AddStringToObject(ka, "janus", "keepalive");
+	(void) snprintf(sid, sizeof(sid), "%" SWITCH_UINT64_T_FMT, (uint64_t) session_id);
+	cJSON_AddRawToObject(ka, "session_id", sid);
+	cJSON_AddStringToObject(ka, "transaction", txn);
+	if (server->pSecret) {
+		cJSON_AddStringToObject(ka, "apisecret", server->pSecret);
+	}
+	if ((payload = cJSON_PrintUnformatted(ka))) {
+		(void) janus_socket_write_text(ctx, payload);
+		cJSON_free(payload);
+	}
+	cJSON_Delete(ka);
+}
+
+switch_status_t janus_socket_pump(server_t *server, void **handle, janus_id_t session_id,
+	switch_interval_time_t wait_us,
+	switch_interval_time_t keepalive_interval_us,
+	switch_time_t *last_activity_ref,
+	const api_dispatch_t *dispatch)
+{
+	janus_socket_ctx_t *ctx = janus_socket_ctx_acquire(server, handle);
+	switch_time_t deadline;
+	switch_bool_t closing;
+	switch_bool_t got_messages = SWITCH_FALSE;
+
+	if (!ctx) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (keepalive_interval_us > 0 && session_id && last_activity_ref && *last_activity_ref > 0 &&
+		(switch_time_now() - *last_activity_ref) > keepalive_interval_us) {
+		janus_socket_send_keepalive(server, ctx, session_id);
+		*last_activity_ref = switch_time_now();
+	}
+
+	/* Sleep until the reader hands over a message, the connection goes or
+	 * the next keepalive is due - no periodic wakeups on an idle server. */
+	deadline = switch_time_now() + wait_us;
+	if (keepalive_interval_us > 0 && last_activity_ref && *last_activity_ref > 0 &&
+		*last_activity_ref + keepalive_interval_us < deadline) {
+		deadline = *last_activity_ref + keepalive_interval_us + 1;
+	}
+
+	switch_mutex_lock(ctx->txn_mutex);
+	while (!ctx->deferred_head && !ctx->closing) {
+		const switch_interval_time_t remaining = deadline - switch_time_now();
+		if (remaining <= 0) {
+			break;
+		}
+		(void) switch_thread_cond_timedwait(ctx->pump_cond, ctx->txn_mutex, remaining);
+	}
+	got_messages = ctx->deferred_head ? SWITCH_TRUE : SWITCH_FALSE;
+	closing = ctx->closing;
+	switch_mutex_unlock(ctx->txn_mutex);
+
+	janus_socket_flush_deferred(ctx, dispatch);
+
+	if (got_messages && last_activity_ref) {
+		*last_activity_ref = switch_time_now();
+	}
+
+	janus_socket_ctx_release(ctx);
+	return closing ? SWITCH_STATUS_FALSE : SWITCH_STATUS_SUCCESS;
+}
+
+/* -------------------------------------------------------------------------- */
+/* public: open / close                                                       */
+/* -------------------------------------------------------------------------- */
+
+switch_status_t janus_socket_open(server_t *server, void **handle, const janus_socket_ops_t *ops, void *conn)
+{
+	janus_socket_ctx_t *ctx;
+	switch_memory_pool_t *ctx_pool = NULL;
+	switch_threadattr_t *thd_attr = NULL;
+
+	if (switch_core_new_memory_pool(&ctx_pool) != SWITCH_STATUS_SUCCESS) {
+		ops->close(conn);
+		ops->destroy(conn);
+		return SWITCH_STATUS_FALSE;
+	}
+	ctx = switch_core_alloc(ctx_pool, sizeof(*ctx));
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->server = server;
+	ctx->refs   = 1;
+	ctx->ops    = ops;
+	ctx->conn   = conn;
+	ctx->pool   = ctx_pool;
+	switch_mutex_init(&ctx->write_mutex, SWITCH_MUTEX_NESTED, ctx->pool);
+	switch_mutex_init(&ctx->txn_mutex, SWITCH_MUTEX_NESTED, ctx->pool);
+	switch_thread_cond_create(&ctx->pump_cond, ctx->pool);
+	switch_core_hash_init(&ctx->txns);
+
+	ctx->running = SWITCH_TRUE;
+	if (!(ctx->shared = janus_socket_shared_add(ctx))) {
+		switch_threadattr_create(&thd_attr, ctx->pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		if (switch_thread_create(&ctx->reader, thd_attr, janus_socket_reader_run, ctx, ctx->pool) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s: reader thread failed for %s\n", ops->name, server->pUrl);
+			ctx->closed = SWITCH_TRUE;
+			ops->close(conn);
+			janus_socket_ctx_destroy(ctx);
+			return SWITCH_STATUS_FALSE;
+		}
+	}
+
+	switch_mutex_lock(server->mutex);
+	*handle = ctx;
+	switch_mutex_unlock(server->mutex);
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void janus_socket_ctx_destroy(janus_socket_ctx_t *ctx)
+{
+	switch_memory_pool_t *pool = ctx->pool;
+
+	ctx->ops->destroy(ctx->conn);
+	janus_socket_flush_deferred(ctx, NULL);
+	switch_core_hash_destroy(&ctx->txns);
+	switch_thread_cond_destroy(ctx->pump_cond);
+	switch_mutex_destroy(ctx->txn_mutex);
+	switch_mutex_destroy(ctx->write_mutex);
+	switch_core_destroy_memory_pool(&pool);
+}
+
+void janus_socket_close(server_t *server, void **handle)
+{
+	janus_socket_ctx_t *ctx;
+
+	if (!server) {
+		return;
+	}
+	/* no new reference can be taken once the handle is cleared */
+	switch_mutex_lock(server->mutex);
+	ctx = (janus_socket_ctx_t *) *handle;
+	*handle = NULL;
+	switch_mutex_unlock(server->mutex);
+
+	if (!ctx) {
+		return;
+	}
+
+	/* Stop the reader, then fail any RPC still waiting.  The callers let go
+	 * of their references as they leave and the last one out frees ctx. */
+	switch_mutex_lock(ctx->txn_mutex);
+	ctx->running = SWITCH_FALSE;
+	switch_mutex_unlock(ctx->txn_mutex);
+	if (ctx->shared) {
+		janus_socket_shared_leave(ctx);
+	} else {
+		if (ctx->ops->shutdown) {
+			ctx->ops->shutdown(ctx->conn);
+		}
+		if (ctx->reader) {
+			switch_status_t retval;
+			switch_thread_join(&retval, ctx->reader);
+		}
+	}
+
+	switch_mutex_lock(ctx->txn_mutex);
+	ctx->closing = SWITCH_TRUE;
+	janus_socket_wake_all(ctx);
+	switch_mutex_unlock(ctx->txn_mutex);
+
+	switch_mutex_lock(ctx->write_mutex);
+	ctx->closed = SWITCH_TRUE;
+	ctx->ops->close(ctx->conn);
+	switch_mutex_unlock(ctx->write_mutex);
+
+	janus_socket_ctx_release(ctx);
+}
+
+/* Fail the waiting RPCs and wake the pump as if the connection had gone, so
+ * a server being stopped doesn't sit out their timeouts.  The connection
+ * itself is left for janus_socket_close on the server's own thread. */
+void janus_socket_interrupt(server_t *server, void **handle)
+{
+	janus_socket_ctx_t *ctx;
+
+	if ((ctx = janus_socket_ctx_acquire(server, handle))) {
+		switch_mutex_lock(ctx->txn_mutex);
+		ctx->closing = SWITCH_TRUE;
+		janus_socket_wake_all(ctx);
+		switch_mutex_unlock(ctx->txn_mutex);
+		janus_socket_ctx_release(ctx);
+	}
+}
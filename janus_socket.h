@@ -0,0 +1,73 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * janus_socket.h -- Message socket sessions (WebSocket, Unix socket) for mod_janus
+ */
+#ifndef MOD_JANUS_JANUS_SOCKET_H
+#define MOD_JANUS_JANUS_SOCKET_H
+
+#include "servers.h"
+#include "api.h"
+
+/*
+ * What a transport that carries one JSON message per frame or packet
+ * supplies for its connection (conn); janus_socket.c does the rest - the
+ * transaction table, the reader, the RPC wait and the event pump.
+ */
+typedef struct {
+	/* prefixes the log lines - "janus_ws" */
+	const char *name;
+	/* Waits up to ms for something to read: > 0 when there is, 0 when
+	 * there isn't yet and < 0 once the connection has gone. */
+	int (*wait)(void *conn, int ms);
+	/* Optional - the descriptor that becomes readable when a message
+	 * arrives, so the shared reader can wait on it with every other such
+	 * connection.  Without it the connection has a reader thread of its own. */
+	int (*fd)(void *conn);
+	/* The next whole message, if one has arrived, as a malloc'd string
+	 * (*text is NULL when none has).  SWITCH_STATUS_FALSE once the
+	 * connection has gone. */
+	switch_status_t (*read)(void *conn, char **text);
+	switch_status_t (*write)(void *conn, const char *text);
+	/* Optional - wakes a reader blocked in wait. */
+	void (*shutdown)(void *conn);
+	/* Closes the connection once the reader has stopped and no write is in
+	 * progress. */
+	void (*close)(void *conn);
+	/* Frees conn once nothing can use it. */
+	void (*destroy)(void *conn);
+} janus_socket_ops_t;
+
+/* The reader shared by the connections with an fd op - with it stopped each
+ * connection is read on a thread of its own.  Stop once every session has
+ * been closed. */
+switch_status_t janus_socket_start(void);
+void janus_socket_stop(void);
+
+/* Takes over conn, connected, and starts reading it.  The session is kept in
+ * *handle (one of the server's transport handles).  On failure conn has been
+ * closed and destroyed. */
+switch_status_t janus_socket_open(server_t *server, void **handle, const janus_socket_ops_t *ops, void *conn);
+void janus_socket_close(server_t *server, void **handle);
+/* Fail in-flight RPCs and wake the pump - used when the server is stopped. */
+void janus_socket_interrupt(server_t *server, void **handle);
+
+/* Synchronous request/response over the session (blocking). */
+cJSON *janus_socket_rpc(server_t *server, void **handle, cJSON *request, const char *transaction,
+	switch_interval_time_t timeout_us);
+
+/*
+ * Wait up to wait_us for Janus messages and hand them to dispatch (see
+ * dispatchEvent).  Sends a keepalive when idle longer than
+ * keepalive_interval_us.
+ */
+switch_status_t janus_socket_pump(server_t *server, void **handle, janus_id_t session_id,
+	switch_interval_time_t wait_us,
+	switch_interval_time_t keepalive_interval_us,
+	switch_time_t *last_activity_ref,
+	const api_dispatch_t *dispatch);
+
+#endif /* MOD_JANUS_JANUS_SOCKET_H */
@@ -0,0 +1,264 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * janus_unix.c -- Janus Unix-sockets transport (pfunix) for mod_janus.
+ *
+ * Design:
+ *   - One SOCK_SEQPACKET connection per server_t (server->janus_unix_handle)
+ *     to the socket of Janus' janus.transport.pfunix.  Each packet carries
+ *     exactly one JSON message, so there is no HTTP or WebSocket framing to
+ *     build or parse - the request body is the whole message.
+ *   - Requests carry session_id / handle_id in the body as on a WebSocket,
+ *     and replies and events arrive the same way, so the session is
+ *     janus_socket.c's as for janus_ws.c; this file connects the socket and
+ *     sends and receives its packets.
+ *   - The socket is read by janus_socket.c's shared reader, which waits on
+ *     every Unix socket session with one epoll.  Without it the session's
+ *     own reader waits in poll and close shuts the socket down to wake it.
+ */
+#include "janus_unix.h"
+
+#if defined(HAVE_MOD_JANUS_UNIX)
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "janus_socket.h"
+#include "transport.h"
+#include "cJSON.h"
+#include "globals.h"
+
+typedef struct {
+	int fd;
+} janus_unix_conn_t;
+
+/* -------------------------------------------------------------------------- */
+/* connection (janus_socket.h)                                                */
+/* -------------------------------------------------------------------------- */
+
+static int janus_unix_wait(void *obj, int ms)
+{
+	janus_unix_conn_t *conn = (janus_unix_conn_t *) obj;
+	struct pollfd pfd = { conn->fd, POLLIN, 0 };
+	int rc;
+
+	if ((rc = poll(&pfd, 1, ms)) < 0) {
+		return errno == EINTR ? 0 : -1;
+	}
+	/* a hang up or error is picked up by the read */
+	return rc;
+}
+
+static int janus_unix_fd(void *obj)
+{
+	return ((janus_unix_conn_t *) obj)->fd;
+}
+
+/* Receives the next message, if one is waiting, into a buffer of its size. */
+static switch_status_t janus_unix_read(void *obj, char **text)
+{
+	janus_unix_conn_t *conn = (janus_unix_conn_t *) obj;
+	char peek;
+	ssize_t len;
+
+	*text = NULL;
+
+	/* MSG_TRUNC reports the real length of the waiting packet */
+	do {
+		len = recv(conn->fd, &peek, 1, MSG_PEEK | MSG_TRUNC | MSG_DONTWAIT);
+	} while (len < 0 && errno == EINTR);
+	if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+	if (len <= 0) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (!(*text = malloc((size_t) len + 1))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "janus_unix: no memory for a %ld byte message\n", (long) len);
+		return SWITCH_STATUS_FALSE;
+	}
+	do {
+		len = recv(conn->fd, *text, (size_t) len, MSG_DONTWAIT);
+	} while (len < 0 && errno == EINTR);
+	if (len <= 0) {
+		switch_safe_free(*text);
+		return SWITCH_STATUS_FALSE;
+	}
+	(*text)[len] = '\0';
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* One message is one packet - it is sent whole or not at all. */
+static switch_status_t janus_unix_write(void *obj, const char *text)
+{
+	janus_unix_conn_t *conn = (janus_unix_conn_t *) obj;
+	const size_t len = strlen(text);
+	ssize_t written;
+
+	do {
+		written = send(conn->fd, text, len, MSG_NOSIGNAL);
+	} while (written < 0 && errno == EINTR);
+
+	if (written != (ssize_t) len) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "janus_unix: send failed errno=%d\n", errno);
+		return SWITCH_STATUS_FALSE;
+	}
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void janus_unix_shutdown(void *obj)
+{
+	(void) shutdown(((janus_unix_conn_t *) obj)->fd, SHUT_RDWR);
+}
+
+static void janus_unix_close(void *obj)
+{
+	janus_unix_conn_t *conn = (janus_unix_conn_t *) obj;
+
+	if (conn->fd >= 0) {
+		close(conn->fd);
+		conn->fd = -1;
+	}
+}
+
+static void janus_unix_destroy(void *obj)
+{
+	free(obj);
+}
+
+static const janus_socket_ops_t janus_unix_ops = {
+	"janus_unix",
+	janus_unix_wait,
+	janus_unix_fd,
+	janus_unix_read,
+	janus_unix_write,
+	janus_unix_shutdown,
+	janus_unix_close,
+	janus_unix_destroy
+};
+
+/* -------------------------------------------------------------------------- */
+/* public                                                                     */
+/* -------------------------------------------------------------------------- */
+
+cJSON *janus_unix_rpc_json(server_t *server, cJSON *request, const char *transaction, switch_interval_time_t timeout_us)
+{
+	return server ? janus_socket_rpc(server, &server->janus_unix_handle, request, transaction, timeout_us) : NULL;
+}
+
+switch_status_t janus_unix_pump_once(server_t *server, janus_id_t session_id,
+	switch_interval_time_t wait_us,
+	switch_interval_time_t keepalive_interval_us,
+	switch_time_t *last_activity_ref,
+	const api_dispatch_t *dispatch)
+{
+	if (!server) {
+		return SWITCH_STATUS_FALSE;
+	}
+	return janus_socket_pump(server, &server->janus_unix_handle, session_id, wait_us, keepalive_interval_us,
+		last_activity_ref, dispatch);
+}
+
+switch_status_t janus_unix_server_open(server_t *server)
+{
+	janus_unix_conn_t *conn;
+	struct sockaddr_un addr;
+	const char *path;
+	int fd;
+
+	if (!server || !server->pUrl) {
+		return SWITCH_STATUS_FALSE;
+	}
+	if (server->janus_unix_handle) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	path = server->pUrl + strlen(JANUS_UNIX_SCHEME);
+	if (strncasecmp(server->pUrl, JANUS_UNIX_SCHEME, strlen(JANUS_UNIX_SCHEME)) || zstr(path) ||
+		strlen(path) >= sizeof(addr.sun_path)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "janus_unix: invalid socket url %s\n", server->pUrl);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	switch_copy_string(addr.sun_path, path, sizeof(addr.sun_path));
+
+	if ((fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) < 0) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "janus_unix: socket failed errno=%d\n", errno);
+		return SWITCH_STATUS_FALSE;
+	}
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "janus_unix: connect failed for %s errno=%d\n", path, errno);
+		close(fd);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (!(conn = malloc(sizeof(*conn)))) {
+		close(fd);
+		return SWITCH_STATUS_FALSE;
+	}
+	conn->fd = fd;
+
+	if (janus_socket_open(server, &server->janus_unix_handle, &janus_unix_ops, conn) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO,
+		"janus_unix: connected server=%s path=%s\n", server->name, path);
+	return SWITCH_STATUS_SUCCESS;
+}
+
+void janus_unix_server_close(server_t *server)
+{
+	if (server) {
+		janus_socket_close(server, &server->janus_unix_handle);
+	}
+}
+
+/* Fail the waiting RPCs and wake the pump as if the socket had gone, so a
+ * server being stopped doesn't sit out their timeouts. */
+void janus_unix_server_interrupt(server_t *server)
+{
+	if (server) {
+		janus_socket_interrupt(server, &server->janus_unix_handle);
+	}
+}
+
+/* -------------------------------------------------------------------------- */
+/* transport (transport.h)                                                    */
+/* -------------------------------------------------------------------------- */
+
+static cJSON *janus_unix_send(server_t *server, cJSON *request, const char *transaction,
+	const janus_id_t session_id, const janus_id_t handle_id, const char *label)
+{
+	transportAddIds(server, request, session_id, handle_id);
+	MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Sending Unix socket %s\n", label);
+	return janus_unix_rpc_json(server, request, transaction, (switch_interval_time_t) TRANSPORT_REQUEST_TIMEOUT * 1000);
+}
+
+static switch_status_t janus_unix_poll(server_t *server, const janus_id_t session_id, const switch_bool_t block,
+	const api_dispatch_t *dispatch)
+{
+	return janus_unix_pump_once(server, session_id,
+		block ? (switch_interval_time_t) TRANSPORT_POLL_TIMEOUT * 1000 : 0,
+		TRANSPORT_KEEPALIVE_US, &server->ws_last_poll, dispatch);
+}
+
+const transport_t janus_unix_transport = {
+	"Unix socket session",
+	janus_unix_server_open,
+	janus_unix_server_close,
+	janus_unix_send,
+	janus_unix_poll,
+	janus_unix_server_interrupt
+};
+
+#endif /* HAVE_MOD_JANUS_UNIX */
@@ -0,0 +1,50 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * janus_unix.h -- Janus Unix-sockets transport (pfunix) for mod_janus
+ */
+#ifndef MOD_JANUS_JANUS_UNIX_H
+#define MOD_JANUS_JANUS_UNIX_H
+
+#include "servers.h"
+#include "api.h"
+#include "transport.h"
+
+/* pfunix speaks SOCK_SEQPACKET, which needs a Linux AF_UNIX socket. */
+#if defined(__linux__)
+#define HAVE_MOD_JANUS_UNIX 1
+#endif
+
+/* unix:///path/to/socket - the path of Janus' janus.transport.pfunix. */
+#define JANUS_UNIX_SCHEME "unix://"
+
+#if defined(HAVE_MOD_JANUS_UNIX)
+
+switch_status_t janus_unix_server_open(server_t *server);
+void janus_unix_server_close(server_t *server);
+/* Fail in-flight RPCs and wake the pump - used when the server is stopped. */
+void janus_unix_server_interrupt(server_t *server);
+
+/* Synchronous request/response over the server's socket (blocking). */
+cJSON *janus_unix_rpc_json(server_t *server, cJSON *request, const char *transaction, switch_interval_time_t timeout_us);
+
+/*
+ * Wait up to wait_us for Janus messages and hand them to dispatch (see
+ * dispatchEvent).  Sends a keepalive when idle longer than
+ * keepalive_interval_us.
+ */
+switch_status_t janus_unix_pump_once(server_t *server, janus_id_t session_id,
+	switch_interval_time_t wait_us,
+	switch_interval_time_t keepalive_interval_us,
+	switch_time_t *last_activity_ref,
+	const api_dispatch_t *dispatch);
+
+/* The ops registered for JANUS_TP_UNIX servers. */
+extern const transport_t janus_unix_transport;
+
+#endif /* HAVE_MOD_JANUS_UNIX */
+
+#endif /* MOD_JANUS_JANUS_UNIX_H */
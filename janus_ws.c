@@ -8,50 +8,28 @@
  *
  * Design:
  *   - One persistent WebSocket per server_t (server->janus_ws_handle).
- *   - All socket I/O (write + poll + read) is serialized under ctx->io_mutex.
- *   - Because io_mutex makes every RPC strictly serial, the ctx only tracks
- *     ONE in-flight RPC transaction (ctx->rpc_txn / ctx->rpc_result) instead
- *     of a hash/cond/per-request subpool.
- *   - Non-RPC frames arriving during a sync RPC are stashed on ctx->deferred
- *     and dispatched by the next pump iteration, so Janus events are never
- *     silently dropped.
+ *   - Each text frame carries one JSON message, so the session - the
+ *     transaction table, the reader, the RPC wait and the event pump - is
+ *     janus_socket.c's; this file connects the socket and reads and writes
+ *     its frames through libks.
+ *   - Each WebSocket has a reader thread of its own waiting in
+ *     kws_wait_sock: libks (and TLS under it) buffers what it has read off
+ *     the socket inside kws_t, where a descriptor poll shared with other
+ *     sessions can't see it.
  */
 #if defined(HAVE_MOD_JANUS_WS)
 
 #include "libks/ks.h"
 #include "janus_ws.h"
-#include "api.h"
+#include "janus_socket.h"
+#include "transport.h"
 #include "cJSON.h"
 #include "globals.h"
-#include "switch_stun.h"
-
-#define JANUS_WS_DEFAULT_RPC_US (15 * 1000000)
-
-/* Max time the pump holds io_mutex across kws_wait_sock before releasing it
- * so RPC callers can interleave. 200 ms gives decent responsiveness while
- * keeping syscall overhead negligible. */
-#define JANUS_WS_PUMP_SLICE_MS  200
-
-typedef struct janus_ws_deferred_s {
-	cJSON *root;
-	struct janus_ws_deferred_s *next;
-} janus_ws_deferred_t;
 
 typedef struct {
-	server_t *server;
 	kws_t *kws;
 	ks_pool_t *kpool;
-	switch_mutex_t *io_mutex; /* serializes all kws_* I/O */
-	switch_memory_pool_t *pool;
-
-	/* Current synchronous RPC, protected by io_mutex. */
-	const char *rpc_txn;
-	cJSON *rpc_result;
-
-	/* Non-RPC frames captured during an RPC; dispatched by the pump. */
-	janus_ws_deferred_t *deferred_head;
-	janus_ws_deferred_t *deferred_tail;
-} janus_ws_ctx_t;
+} janus_ws_conn_t;
 
 /* -------------------------------------------------------------------------- */
 /* libks global init refcount                                                 */
@@ -99,105 +77,31 @@ void janus_ws_mod_global_shutdown(void)
 }
 
 /* -------------------------------------------------------------------------- */
-/* helpers                                                                    */
+/* connection (janus_socket.h)                                                */
 /* -------------------------------------------------------------------------- */
 
-static janus_ws_ctx_t *janus_ws_ctx_get(server_t *server)
-{
-	return server ? (janus_ws_ctx_t *) server->janus_ws_handle : NULL;
-}
-
-static void janus_ws_dbg_json(const char *dir, const char *json)
+static int janus_ws_wait(void *obj, int ms)
 {
-	if (json && *json) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "janus_ws %s %s\n", dir, json);
-	}
-}
+	janus_ws_conn_t *conn = (janus_ws_conn_t *) obj;
+	int pr = kws_wait_sock(conn->kws, (uint32_t) ms, KS_POLL_READ);
 
-/* Add `root` to the deferred list. Takes ownership on success; caller must
- * cJSON_Delete(root) if this returns SWITCH_FALSE. */
-static switch_bool_t janus_ws_defer_event(janus_ws_ctx_t *ctx, cJSON *root)
-{
-	janus_ws_deferred_t *node = malloc(sizeof(*node));
-	if (!node) {
-		return SWITCH_FALSE;
+	if (pr < 0 || (pr & KS_POLL_INVALID) ||
+		((pr & (KS_POLL_ERROR | KS_POLL_HUP)) && !(pr & KS_POLL_READ))) {
+		return -1;
 	}
-	node->root = root;
-	node->next = NULL;
-	if (ctx->deferred_tail) {
-		ctx->deferred_tail->next = node;
-	} else {
-		ctx->deferred_head = node;
-	}
-	ctx->deferred_tail = node;
-	return SWITCH_TRUE;
+	return (pr & KS_POLL_READ) ? 1 : 0;
 }
 
-/* Test whether `root` is the reply for the currently in-flight RPC (ctx->rpc_txn).
- * Takes ownership of `root` and stashes it on ctx->rpc_result on match. */
-static switch_bool_t janus_ws_match_rpc_reply(janus_ws_ctx_t *ctx, cJSON *root)
+static switch_status_t janus_ws_read(void *obj, char **text)
 {
-	cJSON *txn;
-	cJSON *jt;
+	janus_ws_conn_t *conn = (janus_ws_conn_t *) obj;
 
-	if (!ctx->rpc_txn) {
-		return SWITCH_FALSE;
-	}
-	txn = cJSON_GetObjectItemCaseSensitive(root, "transaction");
-	jt  = cJSON_GetObjectItemCaseSensitive(root, "janus");
-	if (!cJSON_IsString(txn) || !cJSON_IsString(jt)) {
-		return SWITCH_FALSE;
-	}
-	if (strcmp(txn->valuestring, ctx->rpc_txn) != 0) {
-		return SWITCH_FALSE;
-	}
-	if (strcmp(jt->valuestring, "success") &&
-		strcmp(jt->valuestring, "ack") &&
-		strcmp(jt->valuestring, "error")) {
-		return SWITCH_FALSE;
-	}
-	ctx->rpc_result = root;
-	return SWITCH_TRUE;
-}
-
-/* -------------------------------------------------------------------------- */
-/* drain                                                                      */
-/* -------------------------------------------------------------------------- */
-
-/* Read every frame currently available on the socket.
- *
- * For each TEXT frame:
- *   - If it matches the in-flight RPC transaction: store on ctx->rpc_result.
- *   - Else if `dispatch` is non-NULL: dispatch via api_dispatch_poll_event.
- *   - Else: append to ctx->deferred for the pump to process later.
- *
- * Caller MUST hold ctx->io_mutex.
- */
-typedef struct {
-	switch_status_t (*joined)(const janus_id_t, const janus_id_t, const janus_id_t, const janus_id_t);
-	switch_status_t (*accepted)(const janus_id_t, const janus_id_t, const char *);
-	switch_status_t (*trickle)(const janus_id_t, const janus_id_t, const char *);
-	switch_bool_t   (*answer_on_webrtcup)(const janus_id_t, const janus_id_t);
-	switch_status_t (*answered)(const janus_id_t, const janus_id_t);
-	switch_status_t (*hungup)(const janus_id_t, const janus_id_t, const char *);
-	api_participant_func_t participant;
-} janus_ws_dispatch_t;
-
-static void janus_ws_dispatch_event(cJSON *root, const janus_ws_dispatch_t *d)
-{
-	(void) api_dispatch_poll_event(root,
-		d->joined, d->accepted, d->trickle, d->answer_on_webrtcup, d->answered, d->hungup, d->participant);
-	cJSON_Delete(root);
-}
+	*text = NULL;
 
-static switch_status_t janus_ws_drain(janus_ws_ctx_t *ctx, const janus_ws_dispatch_t *dispatch)
-{
 	for (;;) {
 		kws_opcode_t oc = WSOC_INVALID;
 		uint8_t *data = NULL;
 		ks_ssize_t bytes;
-		char *text;
-		cJSON *root;
 
 		/*
 		 * libks kws_read_frame blocks for WS_BLOCK (10 s) when the socket is
@@ -206,17 +110,16 @@ static switch_status_t janus_ws_drain(janus_ws_ctx_t *ctx, const janus_ws_dispat
 		 * and only call kws_read_frame when we know data is ready. This also
 		 * picks up kws->unprocessed_buffer_len / SSL_pending via kws_wait_sock.
 		 */
-		{
-			int pr = kws_wait_sock(ctx->kws, 0, KS_POLL_READ);
-			if (pr < 0 || (pr & KS_POLL_INVALID) || ((pr & KS_POLL_ERROR) && !(pr & KS_POLL_READ))) {
-				return SWITCH_STATUS_FALSE;
-			}
-			if (!(pr & KS_POLL_READ)) {
-				return SWITCH_STATUS_SUCCESS;
-			}
+		switch (janus_ws_wait(conn, 0)) {
+		case 0:
+			return SWITCH_STATUS_SUCCESS;
+		case 1:
+			break;
+		default:
+			return SWITCH_STATUS_FALSE;
 		}
 
-		bytes = kws_read_frame(ctx->kws, &oc, &data);
+		bytes = kws_read_frame(conn->kws, &oc, &data);
 		if (bytes < 0) {
 			return SWITCH_STATUS_FALSE;
 		}
@@ -227,238 +130,85 @@ static switch_status_t janus_ws_drain(janus_ws_ctx_t *ctx, const janus_ws_dispat
 			continue;
 		}
 
-		text = malloc((size_t) bytes + 1);
-		if (!text) {
+		if (!(*text = malloc((size_t) bytes + 1))) {
 			return SWITCH_STATUS_FALSE;
 		}
-		memcpy(text, data, (size_t) bytes);
-		text[bytes] = '\0';
-		janus_ws_dbg_json("recv", text);
-
-		root = cJSON_Parse(text);
-		free(text);
-		if (!root) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "janus_ws: invalid JSON\n");
-			continue;
-		}
-
-		if (janus_ws_match_rpc_reply(ctx, root)) {
-			continue; /* owned by ctx->rpc_result */
-		}
-		if (dispatch) {
-			janus_ws_dispatch_event(root, dispatch);
-		} else if (!janus_ws_defer_event(ctx, root)) {
-			cJSON_Delete(root);
-		}
+		memcpy(*text, data, (size_t) bytes);
+		(*text)[bytes] = '\0';
+		return SWITCH_STATUS_SUCCESS;
 	}
 }
 
-static void janus_ws_flush_deferred(janus_ws_ctx_t *ctx, const janus_ws_dispatch_t *dispatch)
+static switch_status_t janus_ws_write(void *obj, const char *text)
 {
-	janus_ws_deferred_t *node = ctx->deferred_head;
-	ctx->deferred_head = ctx->deferred_tail = NULL;
-	while (node) {
-		janus_ws_deferred_t *next = node->next;
-		if (dispatch) {
-			janus_ws_dispatch_event(node->root, dispatch);
-		} else {
-			cJSON_Delete(node->root);
-		}
-		free(node);
-		node = next;
+	janus_ws_conn_t *conn = (janus_ws_conn_t *) obj;
+
+	if (kws_write_frame(conn->kws, WSOC_TEXT, text, strlen(text)) < 0) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "janus_ws: write failed\n");
+		return SWITCH_STATUS_FALSE;
 	}
+	return SWITCH_STATUS_SUCCESS;
 }
 
-/* -------------------------------------------------------------------------- */
-/* public: synchronous RPC                                                    */
-/* -------------------------------------------------------------------------- */
-
-cJSON *janus_ws_rpc_json(server_t *server, cJSON *request, const char *transaction, switch_interval_time_t timeout_us)
+static void janus_ws_close(void *obj)
 {
-	janus_ws_ctx_t *ctx = janus_ws_ctx_get(server);
-	char *payload = NULL;
-	cJSON *result = NULL;
-	switch_time_t deadline;
+	janus_ws_conn_t *conn = (janus_ws_conn_t *) obj;
 
-	if (!ctx || !ctx->kws || !request || !transaction) {
-		return NULL;
+	if (conn->kws) {
+		kws_close(conn->kws, WS_NONE);
+		kws_destroy(&conn->kws);
 	}
+}
 
-	switch_mutex_lock(ctx->io_mutex);
-
-	payload = cJSON_PrintUnformatted(request);
-	if (!payload) {
-		switch_mutex_unlock(ctx->io_mutex);
-		return NULL;
-	}
-	janus_ws_dbg_json("send", payload);
-
-	if (kws_write_frame(ctx->kws, WSOC_TEXT, payload, strlen(payload)) < 0) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "janus_ws: write failed\n");
-		cJSON_free(payload);
-		switch_mutex_unlock(ctx->io_mutex);
-		return NULL;
-	}
-	cJSON_free(payload);
-
-	ctx->rpc_txn    = transaction;
-	ctx->rpc_result = NULL;
-
-	deadline = switch_time_now() + timeout_us;
-	while (!ctx->rpc_result && switch_time_now() < deadline) {
-		switch_interval_time_t remaining = deadline - switch_time_now();
-		uint32_t slice_ms = (uint32_t) ((remaining < 100000 ? remaining : 100000) / 1000);
-		int pr = kws_wait_sock(ctx->kws, slice_ms, KS_POLL_READ);
-
-		if (pr < 0 || (pr & KS_POLL_INVALID) || ((pr & KS_POLL_ERROR) && !(pr & KS_POLL_READ))) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
-				"janus_ws: RPC wait poll error pr=%d\n", pr);
-			break;
-		}
-		if ((pr & KS_POLL_READ) && janus_ws_drain(ctx, NULL) != SWITCH_STATUS_SUCCESS) {
-			break;
-		}
-	}
+static void janus_ws_destroy(void *obj)
+{
+	janus_ws_conn_t *conn = (janus_ws_conn_t *) obj;
 
-	if (!ctx->rpc_result) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
-			"janus_ws: RPC timeout transaction=%s\n", transaction);
+	if (conn->kpool) {
+		ks_pool_close(&conn->kpool);
 	}
-
-	result = ctx->rpc_result;
-	ctx->rpc_txn    = NULL;
-	ctx->rpc_result = NULL;
-
-	switch_mutex_unlock(ctx->io_mutex);
-	return result;
+	free(conn);
+	janus_ws_libks_release();
 }
 
+/* The reader wakes from kws_wait_sock within JANUS_SOCKET_READER_WAIT_MS to
+ * see it is being stopped - libks has no way to interrupt it sooner. */
+static const janus_socket_ops_t janus_ws_ops = {
+	"janus_ws",
+	janus_ws_wait,
+	NULL,
+	janus_ws_read,
+	janus_ws_write,
+	NULL,
+	janus_ws_close,
+	janus_ws_destroy
+};
+
 /* -------------------------------------------------------------------------- */
-/* public: event pump                                                         */
+/* public                                                                     */
 /* -------------------------------------------------------------------------- */
 
+cJSON *janus_ws_rpc_json(server_t *server, cJSON *request, const char *transaction, switch_interval_time_t timeout_us)
+{
+	return server ? janus_socket_rpc(server, &server->janus_ws_handle, request, transaction, timeout_us) : NULL;
+}
+
 switch_status_t janus_ws_pump_once(server_t *server, janus_id_t session_id,
 	switch_interval_time_t wait_us,
 	switch_interval_time_t keepalive_interval_us,
 	switch_time_t *last_activity_ref,
-	switch_status_t (*pJoinedFunc)(const janus_id_t, const janus_id_t, const janus_id_t, const janus_id_t),
-	switch_status_t (*pAcceptedFunc)(const janus_id_t, const janus_id_t, const char *),
-	switch_status_t (*pTrickleFunc)(const janus_id_t, const janus_id_t, const char *),
-	switch_bool_t   (*pAnswerOnWebrtcupFunc)(const janus_id_t, const janus_id_t),
-	switch_status_t (*pAnsweredFunc)(const janus_id_t, const janus_id_t),
-	switch_status_t (*pHungupFunc)(const janus_id_t, const janus_id_t, const char *),
-	api_participant_func_t pParticipantFunc)
+	const api_dispatch_t *dispatch)
 {
-	janus_ws_ctx_t *ctx = janus_ws_ctx_get(server);
-	janus_ws_dispatch_t dispatch;
-	int pr;
-
-	if (!ctx || !ctx->kws) {
+	if (!server) {
 		return SWITCH_STATUS_FALSE;
 	}
-
-	dispatch.joined             = pJoinedFunc;
-	dispatch.accepted           = pAcceptedFunc;
-	dispatch.trickle            = pTrickleFunc;
-	dispatch.answer_on_webrtcup = pAnswerOnWebrtcupFunc;
-	dispatch.answered           = pAnsweredFunc;
-	dispatch.hungup             = pHungupFunc;
-	dispatch.participant        = pParticipantFunc;
-
-	/* Keepalive. Nested RPC re-enters io_mutex (NESTED), then drain happens below. */
-	if (keepalive_interval_us > 0 && session_id && last_activity_ref && *last_activity_ref > 0 &&
-		(switch_time_now() - *last_activity_ref) > keepalive_interval_us) {
-		cJSON *ka = cJSON_CreateObject();
-		if (ka) {
-			char txn[17] = {0};
-			char sid[32];
-			cJSON *resp;
-			switch_stun_random_string(txn, sizeof(txn) - 1, NULL);
-			cJSON_AddStringToObject(ka, "janus", "keepalive");
-			(void) snprintf(sid, sizeof(sid), "%" SWITCH_UINT64_T_FMT, (uint64_t) session_id);
-			cJSON_AddRawToObject(ka, "session_id", sid);
-			cJSON_AddStringToObject(ka, "transaction", txn);
-			if (server->pSecret) {
-				cJSON_AddStringToObject(ka, "apisecret", server->pSecret);
-			}
-			resp = janus_ws_rpc_json(server, ka, txn, JANUS_WS_DEFAULT_RPC_US);
-			cJSON_Delete(ka);
-			if (resp) {
-				cJSON_Delete(resp);
-			}
-			*last_activity_ref = switch_time_now();
-		}
-	}
-
-	/*
-	 * Slice the long pump wait into short windows so that concurrent RPC
-	 * callers (attach, createroom, joinroom, hangup, ...) can acquire
-	 * ctx->io_mutex between slices. Holding the mutex across a full
-	 * wait_us (up to 60 s) would starve all outbound RPCs — exactly the
-	 * "attach queued but not sent until next pump iteration" symptom.
-	 *
-	 * Slice length is capped at JANUS_WS_PUMP_SLICE_MS. Between slices we
-	 * release the mutex, yield, and re-check. If data becomes available we
-	 * drain it and return promptly so the outer loop can decide what to do.
-	 */
-	{
-		const switch_time_t deadline = switch_time_now() + wait_us;
-		for (;;) {
-			const switch_interval_time_t remain_us = deadline - switch_time_now();
-			uint32_t slice_ms;
-
-			if (remain_us <= 0) {
-				return SWITCH_STATUS_SUCCESS;
-			}
-			/* Clamp: never hold io_mutex longer than JANUS_WS_PUMP_SLICE_MS. */
-			slice_ms = (remain_us < (JANUS_WS_PUMP_SLICE_MS * 1000))
-				? (uint32_t) (remain_us / 1000)
-				: JANUS_WS_PUMP_SLICE_MS;
-			if (slice_ms == 0) {
-				slice_ms = 1;
-			}
-
-			switch_mutex_lock(ctx->io_mutex);
-
-			janus_ws_flush_deferred(ctx, &dispatch);
-
-			pr = kws_wait_sock(ctx->kws, slice_ms, KS_POLL_READ);
-			if (pr < 0 || (pr & KS_POLL_INVALID) ||
-				((pr & (KS_POLL_ERROR | KS_POLL_HUP)) && !(pr & KS_POLL_READ))) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
-					"janus_ws: pump poll failed pr=%d (0x%x) slice_ms=%u\n",
-					pr, (unsigned) pr, slice_ms);
-				switch_mutex_unlock(ctx->io_mutex);
-				return SWITCH_STATUS_FALSE;
-			}
-			if (pr & KS_POLL_READ) {
-				if (janus_ws_drain(ctx, &dispatch) != SWITCH_STATUS_SUCCESS) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "janus_ws: pump drain failed\n");
-					switch_mutex_unlock(ctx->io_mutex);
-					return SWITCH_STATUS_FALSE;
-				}
-				if (last_activity_ref) {
-					*last_activity_ref = switch_time_now();
-				}
-				switch_mutex_unlock(ctx->io_mutex);
-				return SWITCH_STATUS_SUCCESS;
-			}
-
-			switch_mutex_unlock(ctx->io_mutex);
-			/* Brief yield so any thread blocked on io_mutex wins the next round. */
-			switch_cond_next();
-		}
-	}
+	return janus_socket_pump(server, &server->janus_ws_handle, session_id, wait_us, keepalive_interval_us,
+		last_activity_ref, dispatch);
 }
 
-/* -------------------------------------------------------------------------- */
-/* public: connect / disconnect                                               */
-/* -------------------------------------------------------------------------- */
-
 switch_status_t janus_ws_server_open(server_t *server)
 {
-	janus_ws_ctx_t *ctx;
-	switch_memory_pool_t *ctx_pool = NULL;
+	janus_ws_conn_t *conn;
 	ks_json_t *params;
 	ks_status_t kst;
 
@@ -469,21 +219,16 @@ switch_status_t janus_ws_server_open(server_t *server)
 		return SWITCH_STATUS_SUCCESS;
 	}
 
-	janus_ws_libks_acquire(globals.pModulePool);
-
-	if (switch_core_new_memory_pool(&ctx_pool) != SWITCH_STATUS_SUCCESS) {
-		janus_ws_libks_release();
+	if (!(conn = calloc(1, sizeof(*conn)))) {
 		return SWITCH_STATUS_FALSE;
 	}
-	ctx = switch_core_alloc(ctx_pool, sizeof(*ctx));
-	memset(ctx, 0, sizeof(*ctx));
-	ctx->server = server;
-	ctx->pool   = ctx_pool;
-	switch_mutex_init(&ctx->io_mutex, SWITCH_MUTEX_NESTED, ctx->pool);
+	/* released by janus_ws_destroy from here on */
+	janus_ws_libks_acquire(globals.pModulePool);
 
-	if (ks_pool_open(&ctx->kpool) != KS_STATUS_SUCCESS) {
+	if (ks_pool_open(&conn->kpool) != KS_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "janus_ws: ks_pool_open failed\n");
-		goto fail;
+		janus_ws_destroy(conn);
+		return SWITCH_STATUS_FALSE;
 	}
 
 	params = ks_json_create_object();
@@ -492,55 +237,68 @@ switch_status_t janus_ws_server_open(server_t *server)
 #if defined(KS_VERSION_NUM) && KS_VERSION_NUM >= 20000
 	ks_json_add_number_to_object(params, "payload_size_max", 1000000);
 #endif
-	kst = kws_connect_ex(&ctx->kws, params, KWS_BLOCK, ctx->kpool, NULL, 30000);
+	kst = kws_connect_ex(&conn->kws, params, KWS_BLOCK, conn->kpool, NULL, 30000);
 	ks_json_delete(&params);
 
-	if (kst != KS_STATUS_SUCCESS || !ctx->kws) {
+	if (kst != KS_STATUS_SUCCESS || !conn->kws) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "janus_ws: connect failed for %s\n", server->pUrl);
-		goto fail;
+		janus_ws_close(conn);
+		janus_ws_destroy(conn);
+		return SWITCH_STATUS_FALSE;
 	}
 
-	server->janus_ws_handle = ctx;
+	if (janus_socket_open(server, &server->janus_ws_handle, &janus_ws_ops, conn) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO,
 		"janus_ws: connected server=%s url=%s\n", server->name, server->pUrl);
 	return SWITCH_STATUS_SUCCESS;
-
-fail:
-	if (ctx->kws) {
-		kws_destroy(&ctx->kws);
-	}
-	if (ctx->kpool) {
-		ks_pool_close(&ctx->kpool);
-	}
-	switch_mutex_destroy(ctx->io_mutex);
-	switch_core_destroy_memory_pool(&ctx->pool);
-	janus_ws_libks_release();
-	return SWITCH_STATUS_FALSE;
 }
 
 void janus_ws_server_close(server_t *server)
 {
-	janus_ws_ctx_t *ctx = janus_ws_ctx_get(server);
-
-	if (!ctx) {
-		return;
+	if (server) {
+		janus_socket_close(server, &server->janus_ws_handle);
 	}
-	server->janus_ws_handle = NULL;
+}
 
-	if (ctx->kws) {
-		kws_close(ctx->kws, WS_NONE);
-		kws_destroy(&ctx->kws);
-	}
-	if (ctx->kpool) {
-		ks_pool_close(&ctx->kpool);
-	}
-	if (ctx->rpc_result) {
-		cJSON_Delete(ctx->rpc_result);
+/* Fail the waiting RPCs and wake the pump as if the socket had gone, so a
+ * server being stopped doesn't sit out their timeouts.  The socket itself is
+ * left for janus_ws_server_close on the server's own thread. */
+void janus_ws_server_interrupt(server_t *server)
+{
+	if (server) {
+		janus_socket_interrupt(server, &server->janus_ws_handle);
 	}
-	janus_ws_flush_deferred(ctx, NULL);
-	switch_mutex_destroy(ctx->io_mutex);
-	switch_core_destroy_memory_pool(&ctx->pool);
-	janus_ws_libks_release();
 }
 
+/* -------------------------------------------------------------------------- */
+/* transport (transport.h)                                                    */
+/* -------------------------------------------------------------------------- */
+
+static cJSON *janus_ws_send(server_t *server, cJSON *request, const char *transaction,
+	const janus_id_t session_id, const janus_id_t handle_id, const char *label)
+{
+	transportAddIds(server, request, session_id, handle_id);
+	MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Sending WebSocket %s\n", label);
+	return janus_ws_rpc_json(server, request, transaction, (switch_interval_time_t) TRANSPORT_REQUEST_TIMEOUT * 1000);
+}
+
+static switch_status_t janus_ws_poll(server_t *server, const janus_id_t session_id, const switch_bool_t block,
+	const api_dispatch_t *dispatch)
+{
+	return janus_ws_pump_once(server, session_id,
+		block ? (switch_interval_time_t) TRANSPORT_POLL_TIMEOUT * 1000 : 0,
+		TRANSPORT_KEEPALIVE_US, &server->ws_last_poll, dispatch);
+}
+
+const transport_t janus_ws_transport = {
+	"WebSocket session",
+	janus_ws_server_open,
+	janus_ws_server_close,
+	janus_ws_send,
+	janus_ws_poll,
+	janus_ws_server_interrupt
+};
+
 #endif /* HAVE_MOD_JANUS_WS */
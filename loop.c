@@ -0,0 +1,360 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ * loop.c -- Shared server loop functions for janus endpoint module
+ *
+ */
+#include  "switch.h"
+
+#include  "globals.h"
+#include  "loop.h"
+#include  "http.h"
+#include  "dispatch.h"
+
+// the longest a loop sleeps, so reconnects and WebSocket keepalives are not
+// held up waiting for a wakeup
+#define LOOP_WAIT_US 1000000
+#define LOOP_WAKE_QUEUE_SIZE 1024
+
+struct server_loop_s {
+	switch_thread_t *pThread;
+	switch_mutex_t *pMutex;      // held while the servers are stepped
+	switch_thread_cond_t *pCond; // signalled when a server leaves the loop
+	switch_queue_t *pWake;
+	server_t *pServers;
+	unsigned int count;
+	switch_bool_t terminating;
+};
+
+static struct {
+	server_loop_t *pLoops;
+	unsigned int count;
+	loop_step_func_t pStepFunc;
+	switch_bool_t running;
+
+	// servers waiting for a connect thread, oldest first
+	loop_connect_func_t pConnectFunc;
+	switch_thread_t **pConnectThreads;
+	unsigned int connectCount;
+	switch_mutex_t *pConnectMutex;
+	switch_thread_cond_t *pConnectCond;
+	server_t *pConnectHead;
+	server_t *pConnectTail;
+	switch_bool_t connectTerminating;
+} loop;
+
+static void *SWITCH_THREAD_FUNC loop_run(switch_thread_t *pThread, void *pObj) {
+	server_loop_t *pLoop = (server_loop_t *) pObj;
+	void *pPop;
+
+	(void) pThread;
+
+	DEBUG(SWITCH_CHANNEL_LOG, "Server loop started\n");
+
+	for (;;) {
+		server_t **ppServer;
+
+		switch_mutex_lock(pLoop->pMutex);
+		if (pLoop->terminating) {
+			switch_mutex_unlock(pLoop->pMutex);
+			break;
+		}
+
+		ppServer = &pLoop->pServers;
+		while (*ppServer) {
+			server_t *pServer = *ppServer;
+
+			if (loop.pStepFunc(pServer, SWITCH_FALSE)) {
+				ppServer = &pServer->pLoopNext;
+				continue;
+			}
+
+			// finished - take it off the loop
+			*ppServer = pServer->pLoopNext;
+			pServer->pLoopNext = NULL;
+			pServer->pLoop = NULL;
+			pLoop->count --;
+			(void) switch_thread_cond_broadcast(pLoop->pCond);
+		}
+		switch_mutex_unlock(pLoop->pMutex);
+
+		// sleep until one of the servers has something to do, then take
+		// every wakeup since the servers are all stepped anyway
+		pPop = NULL;
+		if (switch_queue_pop_timeout(pLoop->pWake, &pPop, LOOP_WAIT_US) == SWITCH_STATUS_SUCCESS) {
+			while (switch_queue_trypop(pLoop->pWake, &pPop) == SWITCH_STATUS_SUCCESS);
+		}
+	}
+
+	DEBUG(SWITCH_CHANNEL_LOG, "Server loop stopped\n");
+
+	return NULL;
+}
+
+// A connect opens the transport and creates or claims the Janus session,
+// which can block for as long as the transport's connect timeout, so it is
+// done here rather than on the loop, which would hold up every other server
+static void *SWITCH_THREAD_FUNC loop_connect_run(switch_thread_t *pThread, void *pObj) {
+	(void) pThread;
+	(void) pObj;
+
+	for (;;) {
+		server_t *pServer;
+		switch_bool_t result;
+
+		switch_mutex_lock(loop.pConnectMutex);
+		while (!loop.pConnectHead && !loop.connectTerminating) {
+			(void) switch_thread_cond_wait(loop.pConnectCond, loop.pConnectMutex);
+		}
+		if (!(pServer = loop.pConnectHead)) {
+			switch_mutex_unlock(loop.pConnectMutex);
+			break;
+		}
+		if (!(loop.pConnectHead = pServer->pConnectNext)) {
+			loop.pConnectTail = NULL;
+		}
+		pServer->pConnectNext = NULL;
+		switch_mutex_unlock(loop.pConnectMutex);
+
+		result = loop.pConnectFunc(pServer);
+
+		switch_mutex_lock(pServer->mutex);
+		pServer->loopConnectResult = result;
+		pServer->loopConnecting = SWITCH_FALSE;
+		switch_mutex_unlock(pServer->mutex);
+
+		// the server can't leave its loop while it is connecting
+		loopWake(pServer);
+	}
+
+	return NULL;
+}
+
+switch_status_t loopStart(const unsigned int threads, loop_step_func_t pStepFunc, loop_connect_func_t pConnectFunc) {
+	switch_threadattr_t *pThreadAttr = NULL;
+	unsigned int i;
+
+	switch_assert(pStepFunc);
+	switch_assert(pConnectFunc);
+
+	if (loop.running || !threads) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	// without the engine an HTTP poll blocks, and without the workers an event
+	// handler sends its requests, on the loop that every other server shares
+	if (!httpEngineRunning()) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Server loops need the HTTP engine\n");
+		return SWITCH_STATUS_FALSE;
+	}
+	if (!dispatchRunning()) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Server loops need the dispatch workers\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	loop.pLoops = switch_core_alloc(globals.pModulePool, sizeof(server_loop_t) * threads);
+	loop.pStepFunc = pStepFunc;
+	loop.pConnectFunc = pConnectFunc;
+	loop.pConnectThreads = switch_core_alloc(globals.pModulePool, sizeof(switch_thread_t *) * threads);
+	loop.connectTerminating = SWITCH_FALSE;
+	switch_mutex_init(&loop.pConnectMutex, SWITCH_MUTEX_NESTED, globals.pModulePool);
+	switch_thread_cond_create(&loop.pConnectCond, globals.pModulePool);
+
+	for (i = 0; i < threads; i++) {
+		server_loop_t *pLoop = &loop.pLoops[i];
+
+		switch_mutex_init(&pLoop->pMutex, SWITCH_MUTEX_NESTED, globals.pModulePool);
+		switch_thread_cond_create(&pLoop->pCond, globals.pModulePool);
+		if (switch_queue_create(&pLoop->pWake, LOOP_WAKE_QUEUE_SIZE, globals.pModulePool) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't create server loop queue\n");
+			loop.count = i;
+			loopStop();
+			return SWITCH_STATUS_FALSE;
+		}
+
+		switch_threadattr_create(&pThreadAttr, globals.pModulePool);
+		switch_threadattr_stacksize_set(pThreadAttr, SWITCH_THREAD_STACKSIZE);
+		switch_thread_create(&pLoop->pThread, pThreadAttr, loop_run, pLoop, globals.pModulePool);
+	}
+
+	for (i = 0; i < threads; i++) {
+		switch_threadattr_create(&pThreadAttr, globals.pModulePool);
+		switch_threadattr_stacksize_set(pThreadAttr, SWITCH_THREAD_STACKSIZE);
+		switch_thread_create(&loop.pConnectThreads[i], pThreadAttr, loop_connect_run, NULL, globals.pModulePool);
+	}
+	loop.connectCount = threads;
+
+	loop.count = threads;
+	loop.running = SWITCH_TRUE;
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Server loops started with %u thread(s)\n", threads);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+void loopStop(void) {
+	unsigned int i;
+
+	loop.running = SWITCH_FALSE;
+
+	for (i = 0; i < loop.count; i++) {
+		server_loop_t *pLoop = &loop.pLoops[i];
+
+		switch_mutex_lock(pLoop->pMutex);
+		pLoop->terminating = SWITCH_TRUE;
+		switch_mutex_unlock(pLoop->pMutex);
+		(void) switch_queue_trypush(pLoop->pWake, pLoop);
+	}
+
+	for (i = 0; i < loop.count; i++) {
+		switch_status_t returnValue;
+		(void) switch_thread_join(&returnValue, loop.pLoops[i].pThread);
+	}
+
+	// every server has left its loop, so no connect is waiting
+	if (loop.connectCount) {
+		switch_mutex_lock(loop.pConnectMutex);
+		loop.connectTerminating = SWITCH_TRUE;
+		(void) switch_thread_cond_broadcast(loop.pConnectCond);
+		switch_mutex_unlock(loop.pConnectMutex);
+	}
+	for (i = 0; i < loop.connectCount; i++) {
+		switch_status_t returnValue;
+		(void) switch_thread_join(&returnValue, loop.pConnectThreads[i]);
+	}
+	loop.connectCount = 0;
+
+	if (loop.count) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Server loops stopped\n");
+	}
+	loop.count = 0;
+}
+
+switch_bool_t loopRunning(void) {
+	return loop.running;
+}
+
+switch_status_t loopAdd(server_t *pServer) {
+	server_loop_t *pLoop = NULL;
+	unsigned int i;
+
+	switch_assert(pServer);
+
+	if (!loop.running) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	for (i = 0; i < loop.count; i++) {
+		if (!pLoop || loop.pLoops[i].count < pLoop->count) {
+			pLoop = &loop.pLoops[i];
+		}
+	}
+
+	switch_mutex_lock(pLoop->pMutex);
+	pServer->pLoop = pLoop;
+	pServer->pLoopNext = pLoop->pServers;
+	pLoop->pServers = pServer;
+	pLoop->count ++;
+	switch_mutex_unlock(pLoop->pMutex);
+
+	loopWake(pServer);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+void loopRemove(server_t *pServer) {
+	server_loop_t *pLoop;
+
+	switch_assert(pServer);
+
+	if (!(pLoop = pServer->pLoop)) {
+		return;
+	}
+
+	loopWake(pServer);
+
+	switch_mutex_lock(pLoop->pMutex);
+	while (pServer->pLoop == pLoop) {
+		(void) switch_thread_cond_wait(pLoop->pCond, pLoop->pMutex);
+	}
+	switch_mutex_unlock(pLoop->pMutex);
+}
+
+void loopWake(server_t *pServer) {
+	server_loop_t *pLoop = pServer->pLoop;
+
+	// a full queue already has the loop awake
+	if (pLoop) {
+		(void) switch_queue_trypush(pLoop->pWake, pServer);
+	}
+}
+
+void loopConnect(server_t *pServer) {
+	switch_assert(pServer);
+
+	switch_mutex_lock(pServer->mutex);
+	pServer->loopConnecting = SWITCH_TRUE;
+	switch_mutex_unlock(pServer->mutex);
+
+	switch_mutex_lock(loop.pConnectMutex);
+	pServer->pConnectNext = NULL;
+	if (loop.pConnectTail) {
+		loop.pConnectTail->pConnectNext = pServer;
+	} else {
+		loop.pConnectHead = pServer;
+	}
+	loop.pConnectTail = pServer;
+	(void) switch_thread_cond_signal(loop.pConnectCond);
+	switch_mutex_unlock(loop.pConnectMutex);
+}
+
+switch_bool_t loopConnected(server_t *pServer, switch_bool_t *pResult) {
+	switch_bool_t connected;
+
+	switch_assert(pServer);
+
+	switch_mutex_lock(pServer->mutex);
+	if ((connected = !pServer->loopConnecting)) {
+		*pResult = pServer->loopConnectResult;
+	}
+	switch_mutex_unlock(pServer->mutex);
+
+	return connected;
+}
+
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
@@ -0,0 +1,83 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ * loop.h -- Shared server loop headers for janus endpoint module
+ *
+ */
+#ifndef _LOOP_H_
+#define _LOOP_H_
+
+#include  "switch.h"
+#include  "servers.h"
+
+#define LOOP_DEFAULT_THREADS 0
+
+// One step of a server's poll work - see server_step() in mod_janus.c.
+// Returns SWITCH_FALSE once the server has finished
+typedef switch_bool_t (*loop_step_func_t)(server_t *pServer, const switch_bool_t block);
+// Connects a server's Janus session - see server_connect() in mod_janus.c.
+// It blocks on the transport and Janus, so loops never call it themselves
+typedef switch_bool_t (*loop_connect_func_t)(server_t *pServer);
+
+// With loops running the servers share a fixed pool of threads instead of
+// each having a thread of its own.  A loop steps each of its servers in turn
+// without blocking, then sleeps until a poll response or WebSocket event for
+// one of them arrives or a second has passed, so the number of servers no
+// longer drives the number of threads.  Connects are handed to as many
+// connect threads as there are loops.  The loops need the HTTP engine and the
+// dispatch workers to be running.  With no loops running each server runs on
+// its own thread
+switch_status_t loopStart(const unsigned int threads, loop_step_func_t pStepFunc, loop_connect_func_t pConnectFunc);
+// the servers must have been removed first
+void loopStop(void);
+switch_bool_t loopRunning(void);
+
+// hands the server to the loop with the fewest servers
+switch_status_t loopAdd(server_t *pServer);
+// waits until the loop has finished with the server, which must be terminating
+void loopRemove(server_t *pServer);
+// there is work waiting for the server - may be called from any thread
+void loopWake(server_t *pServer);
+
+// connects the server on a connect thread, which wakes its loop when done
+void loopConnect(server_t *pServer);
+// SWITCH_TRUE once the connect has finished, with its result in *pResult
+switch_bool_t loopConnected(server_t *pServer, switch_bool_t *pResult);
+
+#endif //_LOOP_H_
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
@@ -38,12 +38,26 @@
 
 #include	"globals.h"
 #include	"http.h"
+#include	"dispatch.h"
+#include	"handles.h"
+#include	"teardown.h"
+#include	"loop.h"
+#include	"rooms.h"
 #include	"servers.h"
 #include	"api.h"
 #include	"hash.h"
+#if defined(HAVE_MOD_JANUS_BENCH)
+#include	"bench.h"
+#endif
+#include	"transport.h"
+#include	"janus_http.h"
 #if defined(HAVE_MOD_JANUS_WS)
 #include	"janus_ws.h"
 #endif
+#include	"janus_unix.h"
+#include	"janus_socket.h"
+
+#include	<errno.h>
 
 SWITCH_MODULE_LOAD_FUNCTION(mod_janus_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_janus_shutdown);
@@ -62,7 +76,10 @@ typedef enum {
 	TFLAG_HANGUP = (1 << 5),
 	TFLAG_LINEAR = (1 << 6),
 	TFLAG_CODEC = (1 << 7),
-	TFLAG_BREAK = (1 << 8)
+	TFLAG_BREAK = (1 << 8),
+	TFLAG_FAST_JOIN = (1 << 9),
+	TFLAG_ROOM_KNOWN = (1 << 10),
+	TFLAG_REJOINED = (1 << 11)
 } TFLAGS;
 
 struct private_object {
@@ -101,7 +118,11 @@ typedef struct private_object private_t;
 
 #define JANUS_ANSWER_PARTICIPANT_TIMEOUT_MS_DEFAULT 10000
 
-#define JANUS_SYNTAX "janus [debug|status|listgw]"
+#if defined(HAVE_MOD_JANUS_BENCH)
+#define JANUS_SYNTAX "janus [debug|status|list|stats|bench]"
+#else
+#define JANUS_SYNTAX "janus [debug|status|list|stats]"
+#endif
 #define JANUS_DEBUG_SYNTAX "janus debug [true|false]"
 #define	JANUS_GATEWAY_SYNTAX "janus server <name> [enable|disable]"
 
@@ -123,43 +144,18 @@ static switch_status_t channel_write_frame(switch_core_session_t *session, switc
 static switch_status_t channel_kill_channel(switch_core_session_t *session, int sig);
 
 
-switch_status_t joined(janus_id_t serverId, janus_id_t senderId, janus_id_t roomId, janus_id_t participantId) {
-	switch_core_session_t *session;
+// prepares the media for the Janus leg and generates the local SDP offer
+static switch_status_t generate_offer(switch_core_session_t *session, server_t *pServer) {
 	switch_channel_t *channel;
 	private_t *tech_pvt;
-	server_t *pServer;
 	switch_core_session_t *partner_session;
 
-	if (!(pServer = (server_t *) hashFind(&globals.serverIdLookup, serverId))) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "No server for serverId=%" SWITCH_UINT64_T_FMT "\n", serverId);
-		return SWITCH_STATUS_NOTFOUND;
-	}
-
-	if (!(session = (switch_core_session_t *) hashFind(&pServer->senderIdLookup, senderId))) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "No session for senderId=%" SWITCH_UINT64_T_FMT "\n", senderId);
-		return SWITCH_STATUS_NOTFOUND;
-	}
-
 	channel = switch_core_session_get_channel(session);
 	switch_assert(channel);
 
 	tech_pvt = switch_core_session_get_private(session);
 	switch_assert(tech_pvt);
 
-	if (switch_channel_var_true(channel, "janus-answer-on-participant-ready")) {
-		const char *pTimeout = switch_channel_get_variable(channel, "janus-answer-participant-timeout-ms");
-		int timeoutMs = pTimeout ? atoi(pTimeout) : 0;
-		if (timeoutMs <= 0) {
-			timeoutMs = JANUS_ANSWER_PARTICIPANT_TIMEOUT_MS_DEFAULT;
-		}
-		switch_mutex_lock(tech_pvt->flag_mutex);
-		tech_pvt->answerGate = SWITCH_TRUE;
-		tech_pvt->answerDeadline = switch_time_now() + (switch_time_t) timeoutMs * 1000;
-		switch_mutex_unlock(tech_pvt->flag_mutex);
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
-			"Answer gating enabled - deferring answer until a remote participant is ready (timeout=%dms)\n", timeoutMs);
-	}
-
 	switch_channel_set_variable(channel, "media_webrtc", "true");
 	switch_channel_set_flag(channel, CF_AUDIO);
 
@@ -220,17 +216,150 @@ switch_status_t joined(janus_id_t serverId, janus_id_t senderId, janus_id_t room
 
 	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Generated SDP=%s\n", tech_pvt->mparams.local_sdp_str);
 
-	if (apiConfigure(pServer,
-					tech_pvt->serverId,
-					tech_pvt->senderId,
-					switch_channel_var_true(channel, "janus-start-muted"),
-					switch_channel_var_true(channel, "janus-user-record"),
-					switch_channel_get_variable(channel, "janus-user-record-file"),
-					"offer", 
-					tech_pvt->mparams.local_sdp_str,
-					tech_pvt->callId) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Failed to configure\n");
-		switch_channel_hangup(channel, SWITCH_CAUSE_NETWORK_OUT_OF_ORDER);
+	return SWITCH_STATUS_SUCCESS;
+}
+
+// creates the call's room on Janus unless it is known to exist there
+static switch_status_t create_room(switch_core_session_t *session, server_t *pServer) {
+	switch_channel_t *channel;
+	private_t *tech_pvt;
+	switch_bool_t known = SWITCH_FALSE;
+
+	channel = switch_core_session_get_channel(session);
+	switch_assert(channel);
+
+	tech_pvt = switch_core_session_get_private(session);
+	switch_assert(tech_pvt);
+
+	if (roomsCreate(pServer, tech_pvt->serverId, tech_pvt->senderId, tech_pvt->roomId,
+					switch_channel_get_variable(channel, "janus-room-description"),
+					switch_channel_var_true(channel, "janus-room-record"),
+					switch_channel_get_variable(channel, "janus-room-record-file"),
+					switch_channel_get_variable(channel, "janus-room-pin"),
+					switch_channel_var_true(channel, "janus-room-allow-ws-participants"),
+					tech_pvt->pRoomIdStr, &known) == 0) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (known) {
+		switch_set_flag_locked(tech_pvt, TFLAG_ROOM_KNOWN);
+	} else {
+		switch_clear_flag_locked(tech_pvt, TFLAG_ROOM_KNOWN);
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+// sends the join for the call's room
+static switch_status_t join_room(switch_core_session_t *session, server_t *pServer) {
+	switch_channel_t *channel;
+	private_t *tech_pvt;
+	int hmacTokenTtl = 0;
+
+	channel = switch_core_session_get_channel(session);
+	switch_assert(channel);
+
+	tech_pvt = switch_core_session_get_private(session);
+	switch_assert(tech_pvt);
+
+	/*
+	 * Per-call signed-token TTL. Honour an operator-supplied
+	 * `janus-hmac-token-ttl` channel variable (seconds) and fall back to
+	 * API_HMAC_DEFAULT_CALL_TTL (2h) which comfortably covers the longest
+	 * sensible voice call. We cap at 24h to keep mis-typed values from
+	 * producing effectively-forever tokens.
+	 */
+	if (pServer->pHmacSecret) {
+		const char *pTtlVar = switch_channel_get_variable(channel, "janus-hmac-token-ttl");
+		if (!zstr(pTtlVar)) {
+			hmacTokenTtl = atoi(pTtlVar);
+			if (hmacTokenTtl < 0) {
+				hmacTokenTtl = 0;
+			} else if (hmacTokenTtl > 86400) {
+				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
+						"janus-hmac-token-ttl=%d capped at 86400s\n", hmacTokenTtl);
+				hmacTokenTtl = 86400;
+			}
+		}
+		if (hmacTokenTtl == 0) {
+			hmacTokenTtl = API_HMAC_DEFAULT_CALL_TTL;
+		}
+	}
+
+	return apiJoin(
+		pServer,
+		hmacTokenTtl,
+		tech_pvt->serverId,
+		tech_pvt->senderId,
+		tech_pvt->roomId,
+		tech_pvt->pDisplay,
+		switch_channel_get_variable(channel, "janus-room-pin"),
+		switch_channel_get_variable(channel, "janus-user-token"),
+		tech_pvt->callId,
+		tech_pvt->pRoomIdStr,
+		switch_channel_var_true(channel, "janus-start-muted"),
+		switch_channel_var_true(channel, "janus-user-record"),
+		switch_channel_get_variable(channel, "janus-user-record-file"),
+		switch_test_flag(tech_pvt, TFLAG_FAST_JOIN) ? tech_pvt->mparams.local_sdp_str : NULL);
+}
+
+switch_status_t joined(janus_id_t serverId, janus_id_t senderId, janus_id_t roomId, janus_id_t participantId) {
+	switch_core_session_t *session;
+	switch_channel_t *channel;
+	private_t *tech_pvt;
+	server_t *pServer;
+
+	if (!(pServer = (server_t *) hashFind(&globals.serverIdLookup, serverId))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "No server for serverId=%" SWITCH_UINT64_T_FMT "\n", serverId);
+		return SWITCH_STATUS_NOTFOUND;
+	}
+
+	if (!(session = (switch_core_session_t *) hashFind(&pServer->senderIdLookup, senderId))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "No session for senderId=%" SWITCH_UINT64_T_FMT "\n", senderId);
+		return SWITCH_STATUS_NOTFOUND;
+	}
+
+	channel = switch_core_session_get_channel(session);
+	switch_assert(channel);
+
+	tech_pvt = switch_core_session_get_private(session);
+	switch_assert(tech_pvt);
+
+	// the room exists - later calls to it needn't create it
+	roomsLearn(pServer, serverId, tech_pvt->roomId, tech_pvt->pRoomIdStr);
+
+	if (switch_channel_var_true(channel, "janus-answer-on-participant-ready")) {
+		const char *pTimeout = switch_channel_get_variable(channel, "janus-answer-participant-timeout-ms");
+		int timeoutMs = pTimeout ? atoi(pTimeout) : 0;
+		if (timeoutMs <= 0) {
+			timeoutMs = JANUS_ANSWER_PARTICIPANT_TIMEOUT_MS_DEFAULT;
+		}
+		switch_mutex_lock(tech_pvt->flag_mutex);
+		tech_pvt->answerGate = SWITCH_TRUE;
+		tech_pvt->answerDeadline = switch_time_now() + (switch_time_t) timeoutMs * 1000;
+		switch_mutex_unlock(tech_pvt->flag_mutex);
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
+			"Answer gating enabled - deferring answer until a remote participant is ready (timeout=%dms)\n", timeoutMs);
+	}
+
+	// a fast join has already sent the offer and the configure options with the join
+	if (!switch_test_flag(tech_pvt, TFLAG_FAST_JOIN)) {
+		if (generate_offer(session, pServer) != SWITCH_STATUS_SUCCESS) {
+			return SWITCH_STATUS_FALSE;
+		}
+
+		if (apiConfigure(pServer,
+						tech_pvt->serverId,
+						tech_pvt->senderId,
+						switch_channel_var_true(channel, "janus-start-muted"),
+						switch_channel_var_true(channel, "janus-user-record"),
+						switch_channel_get_variable(channel, "janus-user-record-file"),
+						"offer", 
+						tech_pvt->mparams.local_sdp_str,
+						tech_pvt->callId) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Failed to configure\n");
+			switch_channel_hangup(channel, SWITCH_CAUSE_NETWORK_OUT_OF_ORDER);
+		}
 	}
 
 	switch_channel_mark_ring_ready(channel);
@@ -515,170 +644,310 @@ switch_status_t hungup(janus_id_t serverId, janus_id_t senderId, const char *pRe
 	return SWITCH_STATUS_SUCCESS;
 }
 
-/* Human-readable transport label for log lines. */
-static const char *transport_name(const server_t *pServer) {
-#if defined(HAVE_MOD_JANUS_WS)
-	return (pServer && pServer->transport == JANUS_TP_WS) ? "WebSocket session" : "HTTP long-poll";
-#else
-	(void) pServer;
-	return "HTTP long-poll";
-#endif
-}
+// Janus has no such room.  A create that was skipped because the room was
+// cached means it has been destroyed since - create it and join it once more
+switch_status_t room_gone(janus_id_t serverId, janus_id_t senderId) {
+	switch_core_session_t *session;
+	private_t *tech_pvt;
+	server_t *pServer;
 
-static void *SWITCH_THREAD_FUNC server_thread_run(switch_thread_t *pThread, void *pObj) {
-	server_t *pServer = (server_t *) pObj;
-	janus_id_t serverId = 0;
-	int outer_reconnect_delay = 0;
-	switch_bool_t evict_idle = SWITCH_FALSE;
-	switch_bool_t evict_fail = SWITCH_FALSE;
+	if (!(pServer = (server_t *) hashFind(&globals.serverIdLookup, serverId))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "No server for serverId=%" SWITCH_UINT64_T_FMT "\n", serverId);
+		return SWITCH_STATUS_NOTFOUND;
+	}
 
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Thread started - server=%s\n", pServer->name);
+	if (!(session = (switch_core_session_t *) hashFind(&pServer->senderIdLookup, senderId))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "No session for senderId=%" SWITCH_UINT64_T_FMT "\n", senderId);
+		return SWITCH_STATUS_NOTFOUND;
+	}
 
-	(void) hashCreate(&pServer->senderIdLookup, globals.pModulePool);
+	tech_pvt = switch_core_session_get_private(session);
+	switch_assert(tech_pvt);
 
-	while (!switch_test_flag(pServer, SFLAG_TERMINATING)) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Server=%s invoking\n", pServer->name);
+	roomsForget(pServer, tech_pvt->roomId, tech_pvt->pRoomIdStr);
 
-		/* Back off before *re*connect attempts only. First pass must register immediately or outbound janus/... finds serverId=0. */
-		if (outer_reconnect_delay) {
-			switch_yield(5000000);
-		}
-		outer_reconnect_delay = 1;
+	if (!switch_test_flag(tech_pvt, TFLAG_ROOM_KNOWN) || switch_test_flag(tech_pvt, TFLAG_REJOINED)) {
+		return SWITCH_STATUS_FALSE;
+	}
+	switch_set_flag_locked(tech_pvt, TFLAG_REJOINED);
 
-#if defined(HAVE_MOD_JANUS_WS)
-		/*
-		 * One persistent WebSocket per server: open only when there is no handle.
-		 * Session recovery uses Janus "claim" (and keepalives inside the pump), not TCP churn.
-		 * Close the socket only on transport-level failure (see claim SOCKERR / create failure below).
-		 */
-		if (pServer->transport == JANUS_TP_WS && !pServer->janus_ws_handle) {
-			if (janus_ws_server_open(pServer) != SWITCH_STATUS_SUCCESS) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Server=%s WebSocket connect failed\n", pServer->name);
-				continue;
-			}
-		}
-#endif
+	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Cached room has gone - creating it again\n");
 
-		if (serverId) {
-			// the connection or Janus has restarted - try to re-use the same serverId
-			switch_status_t status =  apiClaimServerId(pServer, serverId);
-			if (status == SWITCH_STATUS_SOCKERR) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Server=%s claim socket error - closing WebSocket, will reconnect\n", pServer->name);
-#if defined(HAVE_MOD_JANUS_WS)
-				if (pServer->transport == JANUS_TP_WS && pServer->janus_ws_handle) {
-					janus_ws_server_close(pServer);
-				}
-#endif
-			} else if (status == SWITCH_STATUS_SUCCESS) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Server=%s claim success - serverId=%" SWITCH_UINT64_T_FMT "\n", pServer->name, serverId);
+	if (create_room(session, pServer) != SWITCH_STATUS_SUCCESS || join_room(session, pServer) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Failed to rejoin room\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+// back off before *re*connect attempts only
+#define SERVER_RECONNECT_DELAY_US 5000000
+
+// (re)creates or claims the server's Janus session - returns SWITCH_FALSE
+// when a dynamic server has failed too often and should be evicted
+static switch_bool_t server_connect(server_t *pServer) {
+	janus_id_t serverId = pServer->loopServerId;
+	switch_bool_t evict_idle = SWITCH_FALSE;
+	switch_bool_t evict_fail = SWITCH_FALSE;
+
+	// stopped while waiting for a connect thread
+	if (switch_test_flag(pServer, SFLAG_TERMINATING)) {
+		return SWITCH_TRUE;
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Server=%s invoking\n", pServer->name);
+
+	/*
+	 * One persistent connection per server (WebSocket or Unix socket): open
+	 * only when there is none.  Session recovery uses Janus "claim" (and
+	 * keepalives inside the poll), not reconnects.  Close the connection only
+	 * on transport-level failure (see claim SOCKERR / create failure below).
+	 */
+	if (pServer->pTransport->open(pServer) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Server=%s %s connect failed\n", pServer->name, pServer->pTransport->pName);
+		return SWITCH_TRUE;
+	}
+
+	if (serverId) {
+		// the connection or Janus has restarted - try to re-use the same serverId
+		switch_status_t status =  apiClaimServerId(pServer, serverId);
+		if (status == SWITCH_STATUS_SOCKERR) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Server=%s claim socket error - closing %s, will reconnect\n", pServer->name, pServer->pTransport->pName);
+			pServer->pTransport->close(pServer);
+		} else if (status == SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Server=%s claim success - serverId=%" SWITCH_UINT64_T_FMT "\n", pServer->name, serverId);
+			switch_mutex_lock(pServer->mutex);
+			pServer->serverId = serverId;
+			switch_mutex_unlock(pServer->mutex);
+			if (hashInsert(&globals.serverIdLookup, serverId, (void *) pServer) != SWITCH_STATUS_SUCCESS) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Couldn't insert server into hash table\n");
 				switch_mutex_lock(pServer->mutex);
-				pServer->serverId = serverId;
+				pServer->serverId = 0;
 				switch_mutex_unlock(pServer->mutex);
-				if (hashInsert(&globals.serverIdLookup, serverId, (void *) pServer) != SWITCH_STATUS_SUCCESS) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Couldn't insert server into hash table\n");
-					switch_mutex_lock(pServer->mutex);
-					pServer->serverId = 0;
-					switch_mutex_unlock(pServer->mutex);
-					serverId = 0;
-				}
+				serverId = 0;
 			} else {
-				// terminate all calls in progress on this server
-				switch_core_session_t *session;
-				private_t *tech_pvt;
-				switch_channel_t *channel;
-				switch_hash_index_t *pIndex = NULL;
+				handlesReset(pServer, serverId);
+				serversSignalActive(pServer);
+			}
+		} else {
+			// terminate all calls in progress on this server
+			switch_core_session_t *session;
+			private_t *tech_pvt;
+			switch_channel_t *channel;
+			hash_index_t index = 0;
 
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Server=%s claim failed - status=%d\n", pServer->name, status);
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Server=%s claim failed - status=%d\n", pServer->name, status);
 
-				while ((session = (switch_core_session_t *) hashIterate(&pServer->senderIdLookup, &pIndex)) != NULL) {
-					tech_pvt = switch_core_session_get_private(session);
+			while ((session = (switch_core_session_t *) hashIterate(&pServer->senderIdLookup, &index)) != NULL) {
+				tech_pvt = switch_core_session_get_private(session);
  					switch_assert(tech_pvt);
-					channel = switch_core_session_get_channel(session);
-					switch_assert(channel);
-					// the server is likely to have been removed by the time the hangup has completed
-					switch_channel_hangup(channel, SWITCH_CAUSE_DESTINATION_OUT_OF_ORDER);
-					(void) hashDelete(&pServer->senderIdLookup, tech_pvt->senderId);
+				channel = switch_core_session_get_channel(session);
+				switch_assert(channel);
+				// the server is likely to have been removed by the time the hangup has completed
+				switch_channel_hangup(channel, SWITCH_CAUSE_DESTINATION_OUT_OF_ORDER);
+				(void) hashDelete(&pServer->senderIdLookup, tech_pvt->senderId);
+			}
+			// reset serverId so we get a new one the next time around
+			serverId = 0;
+			handlesClear(pServer);
+			roomsClear(pServer);
+		}
+	} else {
+		// first time (or new session after claim loss)
+		serverId = apiGetServerId(pServer);
+		if (!serverId) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Error getting serverId\n");
+			/* Stale transport after Janus restart etc.: drop the connection so next loop opens a clean one. */
+			pServer->pTransport->close(pServer);
+			if (switch_test_flag(pServer, SFLAG_DYNAMIC)) {
+				serversDynamicRecordConnectFailure(pServer);
+				if (serversDynamicEvictable(pServer, &evict_idle, &evict_fail) && evict_fail) {
+					return SWITCH_FALSE;
 				}
-				// reset serverId so we get a new one the next time around
-				serverId = 0;
 			}
 		} else {
-			// first time (or new session after claim loss)
-			serverId = apiGetServerId(pServer);
-			if (!serverId) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Error getting serverId\n");
-#if defined(HAVE_MOD_JANUS_WS)
-				/* Stale transport after Janus restart etc.: drop TCP so next loop opens a clean socket. */
-				if (pServer->transport == JANUS_TP_WS && pServer->janus_ws_handle) {
-					janus_ws_server_close(pServer);
-				}
-#endif
-				if (switch_test_flag(pServer, SFLAG_DYNAMIC)) {
-					serversDynamicRecordConnectFailure(pServer);
-					if (serversDynamicEvictable(pServer, &evict_idle, &evict_fail) && evict_fail) {
-						switch_set_flag(pServer, SFLAG_EVICTED);
-						goto thread_done;
-					}
-				}
-			} else {
-				if (switch_test_flag(pServer, SFLAG_DYNAMIC)) {
-					serversDynamicResetConnectFailures(pServer);
-				}
-				switch_mutex_lock(pServer->mutex);
-				pServer->started = switch_time_now();
-				pServer->serverId = serverId;
-				pServer->callsInProgress = 0;
-				switch_mutex_unlock(pServer->mutex);
-				if (hashInsert(&globals.serverIdLookup, serverId, (void *) pServer) != SWITCH_STATUS_SUCCESS) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Couldn't insert server into hash table\n");
-					switch_mutex_lock(pServer->mutex);
-					pServer->serverId = 0;
-					switch_mutex_unlock(pServer->mutex);
-					serverId = 0;
-				}
+			if (switch_test_flag(pServer, SFLAG_DYNAMIC)) {
+				serversDynamicResetConnectFailures(pServer);
 			}
-		}
-
-#if defined(HAVE_MOD_JANUS_WS)
-		if (pServer->transport == JANUS_TP_WS) {
-			pServer->ws_last_poll = switch_time_now();
-		}
-#endif
-
-		while (!switch_test_flag(pServer, SFLAG_TERMINATING) && hashFind(&globals.serverIdLookup, serverId)) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG,
-				"Janus %s started (id=%" SWITCH_UINT64_T_FMT ")\n", transport_name(pServer), (janus_id_t)serverId);
-
-			if (apiPoll(pServer, serverId, joined, accepted, trickle, answer_on_webrtcup, answered, hungup, participant) != SWITCH_STATUS_SUCCESS) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
-					"Janus %s failed (id=%" SWITCH_UINT64_T_FMT ")\n", transport_name(pServer), (janus_id_t)serverId);
-				if (hashDelete(&globals.serverIdLookup, serverId) != SWITCH_STATUS_SUCCESS) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Couldn't remove server %ld from hash table\n", (long)serverId);
-				}
-				// Reset servers serverId/session_id
+			switch_mutex_lock(pServer->mutex);
+			pServer->started = switch_time_now();
+			pServer->serverId = serverId;
+			pServer->callsInProgress = 0;
+			switch_mutex_unlock(pServer->mutex);
+			if (hashInsert(&globals.serverIdLookup, serverId, (void *) pServer) != SWITCH_STATUS_SUCCESS) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Couldn't insert server into hash table\n");
 				switch_mutex_lock(pServer->mutex);
 				pServer->serverId = 0;
 				switch_mutex_unlock(pServer->mutex);
+				serverId = 0;
 			} else {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG,
-					"Janus %s completed (id=%" SWITCH_UINT64_T_FMT ")\n", transport_name(pServer), (janus_id_t)serverId);
+				handlesReset(pServer, serverId);
+				serversSignalActive(pServer);
 			}
 		}
 	}
-thread_done:
-	(void) hashDestroy(&pServer->senderIdLookup);
 
-	(void) hashDelete(&globals.serverIdLookup, serverId);
+	pServer->loopServerId = serverId;
 
-#if defined(HAVE_MOD_JANUS_WS)
-	if (pServer->transport == JANUS_TP_WS) {
-		janus_ws_server_close(pServer);
+	return SWITCH_TRUE;
+}
+
+// the server has stopped (or been evicted) - let go of its session
+static void server_finish(server_t *pServer) {
+	// before the transport is closed, which the detaches need
+	handlesDetach(pServer);
+	roomsClear(pServer);
+	// the workers may still be looking up this server's sessions
+	dispatchFlush(pServer);
+	// and so may its calls, so the table isn't freed here.  A server that
+	// stops keeps it for its next start; an evicted one won't start again
+	if (switch_test_flag(pServer, SFLAG_EVICTED)) {
+		hashRetire(&pServer->senderIdLookup);
+	} else {
+		hashClear(&pServer->senderIdLookup);
 	}
-#endif
+
+	(void) hashDelete(&globals.serverIdLookup, pServer->loopServerId);
+
+	pServer->pTransport->close(pServer);
+
+	pServer->loopState = SERVER_LOOP_DONE;
 
 	if (switch_test_flag(pServer, SFLAG_EVICTED)) {
 		serversDynamicRemoveFromLookup(pServer);
 	}
+}
+
+// carries on from server_connect() - returns SWITCH_FALSE once the server has finished
+static switch_bool_t server_connected(server_t *pServer, const switch_bool_t connected) {
+	janus_id_t serverId;
+
+	if (!connected) {
+		switch_set_flag(pServer, SFLAG_EVICTED);
+		server_finish(pServer);
+		return SWITCH_FALSE;
+	}
+	if (switch_test_flag(pServer, SFLAG_TERMINATING)) {
+		server_finish(pServer);
+		return SWITCH_FALSE;
+	}
+
+	pServer->loopState = SERVER_LOOP_CONNECT;
+	serverId = pServer->loopServerId;
+	if (!serverId || !hashFind(&globals.serverIdLookup, serverId)) {
+		return SWITCH_TRUE;
+	}
+
+	// the keepalive of a WebSocket or Unix socket session is due from here
+	pServer->ws_last_poll = switch_time_now();
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG,
+		"Janus %s started (id=%" SWITCH_UINT64_T_FMT ")\n", pServer->pTransport->pName, (janus_id_t)serverId);
+	pServer->loopState = SERVER_LOOP_POLL;
+	return SWITCH_TRUE;
+}
+
+// One step of a server's work: connecting its Janus session, reconnecting
+// it when it is lost and polling it for events.  With block set the step
+// waits for its next piece of work, as on the server's own thread; without
+// it only does what is ready, as on a shared loop (loop.c).  Returns
+// SWITCH_FALSE once the server has finished
+static switch_bool_t server_step(server_t *pServer, const switch_bool_t block) {
+	janus_id_t serverId = pServer->loopServerId;
+	switch_bool_t connected;
+	switch_time_t now;
+
+	switch (pServer->loopState) {
+	case SERVER_LOOP_START:
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Thread started - server=%s\n", pServer->name);
+
+		if (!pServer->senderIdLookup.pMutex) {
+			(void) hashCreate(&pServer->senderIdLookup, globals.pModulePool);
+		}
+		pServer->loopServerId = 0;
+		// the first pass must register immediately or outbound janus/... finds serverId=0
+		pServer->loopNextAttempt = 0;
+		pServer->loopState = SERVER_LOOP_CONNECT;
+		/* fall through */
+	case SERVER_LOOP_CONNECT:
+		if (switch_test_flag(pServer, SFLAG_TERMINATING)) {
+			server_finish(pServer);
+			return SWITCH_FALSE;
+		}
+
+		now = switch_time_now();
+		if (now < pServer->loopNextAttempt) {
+			if (!block) {
+				return SWITCH_TRUE;
+			}
+			// stopServerThread signals so that a stop doesn't sit out the back off
+			switch_mutex_lock(pServer->mutex);
+			while (!switch_test_flag(pServer, SFLAG_TERMINATING) && (now = switch_time_now()) < pServer->loopNextAttempt) {
+				(void) switch_thread_cond_timedwait(pServer->pStopCond, pServer->mutex, pServer->loopNextAttempt - now);
+			}
+			switch_mutex_unlock(pServer->mutex);
+			if (switch_test_flag(pServer, SFLAG_TERMINATING)) {
+				server_finish(pServer);
+				return SWITCH_FALSE;
+			}
+		}
+		pServer->loopNextAttempt = switch_time_now() + SERVER_RECONNECT_DELAY_US;
+
+		if (block) {
+			return server_connected(pServer, server_connect(pServer));
+		}
+		// a loop mustn't wait for the connect - a connect thread runs it
+		// and wakes the loop when it is done
+		pServer->loopState = SERVER_LOOP_CONNECTING;
+		loopConnect(pServer);
+		return SWITCH_TRUE;
+	case SERVER_LOOP_CONNECTING:
+		// a stop waits here too, since the connect thread still has the server
+		if (!loopConnected(pServer, &connected)) {
+			return SWITCH_TRUE;
+		}
+		return server_connected(pServer, connected);
+	case SERVER_LOOP_POLL:
+		if (switch_test_flag(pServer, SFLAG_TERMINATING)) {
+			server_finish(pServer);
+			return SWITCH_FALSE;
+		}
+		if (!hashFind(&globals.serverIdLookup, serverId)) {
+			pServer->loopNextAttempt = switch_time_now() + SERVER_RECONNECT_DELAY_US;
+			pServer->loopState = SERVER_LOOP_CONNECT;
+			return SWITCH_TRUE;
+		}
+
+		if (apiPoll(pServer, serverId, block, joined, accepted, trickle, answer_on_webrtcup, answered, hungup, room_gone, participant) != SWITCH_STATUS_SUCCESS) {
+			if (switch_test_flag(pServer, SFLAG_TERMINATING)) {
+				// the poll was cancelled by stopServerThread
+				server_finish(pServer);
+				return SWITCH_FALSE;
+			}
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
+				"Janus %s failed (id=%" SWITCH_UINT64_T_FMT ")\n", pServer->pTransport->pName, (janus_id_t)serverId);
+			if (hashDelete(&globals.serverIdLookup, serverId) != SWITCH_STATUS_SUCCESS) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Couldn't remove server %ld from hash table\n", (long)serverId);
+			}
+			// Reset servers serverId/session_id
+			switch_mutex_lock(pServer->mutex);
+			pServer->serverId = 0;
+			switch_mutex_unlock(pServer->mutex);
+		}
+		return SWITCH_TRUE;
+	case SERVER_LOOP_DONE:
+		break;
+	}
+
+	return SWITCH_FALSE;
+}
+
+static void *SWITCH_THREAD_FUNC server_thread_run(switch_thread_t *pThread, void *pObj) {
+	server_t *pServer = (server_t *) pObj;
+
+	(void) pThread;
+
+	while (server_step(pServer, SWITCH_TRUE));
 
 	return NULL;
 }
@@ -690,12 +959,17 @@ static void startServerThread(server_t *pServer, switch_bool_t force) {
 	switch_assert(pServer);
 
 	switch_mutex_lock(pServer->flag_mutex);
-	if (force || !switch_test_flag(pServer, SFLAG_ENABLED)) {
+	if ((force || !switch_test_flag(pServer, SFLAG_ENABLED)) && !pServer->pLoop) {
 		switch_set_flag(pServer, SFLAG_ENABLED);
 		switch_mutex_unlock(pServer->flag_mutex);
 
 		DEBUG(SWITCH_CHANNEL_LOG, "Starting server=%s\n", pServer->name);
 
+		pServer->loopState = SERVER_LOOP_START;
+		if (loopAdd(pServer) == SWITCH_STATUS_SUCCESS) {
+			return;
+		}
+
 		switch_threadattr_create(&pThreadAttr, globals.pModulePool);
 		//switch_threadattr_detach_set(pThreadAttr, 1);
 	  switch_threadattr_stacksize_set(pThreadAttr, SWITCH_THREAD_STACKSIZE);
@@ -706,6 +980,17 @@ static void startServerThread(server_t *pServer, switch_bool_t force) {
 	}
 }
 
+// wakes whatever the server is waiting on - the reconnect back off, the
+// long-poll or WebSocket pump and any request in flight - so that stopping
+// it takes milliseconds rather than a request timeout
+static void server_interrupt(server_t *pServer) {
+	switch_mutex_lock(pServer->mutex);
+	(void) switch_thread_cond_broadcast(pServer->pStopCond);
+	switch_mutex_unlock(pServer->mutex);
+
+	pServer->pTransport->cancel(pServer);
+}
+
 static void stopServerThread(server_t *pServer) {
 	switch_status_t status, returnValue;
 
@@ -713,20 +998,26 @@ static void stopServerThread(server_t *pServer) {
 
 	switch_mutex_lock(pServer->flag_mutex);
 	if (switch_test_flag(pServer, SFLAG_ENABLED) &&
-			!switch_test_flag(pServer, SFLAG_TERMINATING) && pServer->pThread) {
+			!switch_test_flag(pServer, SFLAG_TERMINATING) && (pServer->pThread || pServer->pLoop)) {
 		switch_set_flag(pServer, SFLAG_TERMINATING);
 		switch_mutex_unlock(pServer->flag_mutex);
 
 		DEBUG(SWITCH_CHANNEL_LOG, "Stopping server=%s\n", pServer->name);
 
-		// wait for the thread to terminate.  If we don't do this the thread is
-		// forcefully terminated and valgrind complains about memory being leaked.
-		status = switch_thread_join(&returnValue, pServer->pThread);
-		pServer->pThread = NULL;
+		server_interrupt(pServer);
 
-		if ((status != SWITCH_STATUS_SUCCESS) || (returnValue != SWITCH_STATUS_SUCCESS)) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Server=%s result from thread=%d %d\n",
-				pServer->name, status, returnValue);
+		if (pServer->pLoop) {
+			loopRemove(pServer);
+		} else {
+			// wait for the thread to terminate.  If we don't do this the thread is
+			// forcefully terminated and valgrind complains about memory being leaked.
+			status = switch_thread_join(&returnValue, pServer->pThread);
+			pServer->pThread = NULL;
+
+			if ((status != SWITCH_STATUS_SUCCESS) || (returnValue != SWITCH_STATUS_SUCCESS)) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Server=%s result from thread=%d %d\n",
+					pServer->name, status, returnValue);
+			}
 		}
 
 		switch_clear_flag_locked(pServer, SFLAG_TERMINATING | SFLAG_ENABLED);
@@ -795,7 +1086,10 @@ static switch_status_t channel_on_init(switch_core_session_t *session)
 		return SWITCH_STATUS_NOTFOUND;
 	}
 
-	tech_pvt->senderId = apiGetSenderId(pServer, tech_pvt->serverId, tech_pvt->callId);
+	// take a handle attached in advance if there is one
+	if (!(tech_pvt->senderId = handlesTake(pServer, tech_pvt->serverId))) {
+		tech_pvt->senderId = apiGetSenderId(pServer, tech_pvt->serverId, tech_pvt->callId);
+	}
 	if (!tech_pvt->senderId) {
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error getting senderId\n");
 		switch_channel_hangup(channel, SWITCH_CAUSE_INCOMPATIBLE_DESTINATION);
@@ -813,13 +1107,7 @@ static switch_status_t channel_on_init(switch_core_session_t *session)
 	}
 
 	if (switch_channel_var_false(channel, "janus-use-existing-room")) {
-		if (apiCreateRoom(pServer, tech_pvt->serverId, tech_pvt->senderId, tech_pvt->roomId,
-						switch_channel_get_variable(channel, "janus-room-description"),
-						switch_channel_var_true(channel, "janus-room-record"),
-						switch_channel_get_variable(channel, "janus-room-record-file"),
-						switch_channel_get_variable(channel, "janus-room-pin"),
-						switch_channel_var_true(channel, "janus-room-allow-ws-participants"),
-						tech_pvt->pRoomIdStr) == 0) {
+		if (create_room(session, pServer) != SWITCH_STATUS_SUCCESS) {
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Failed to create room\n");
 			switch_channel_hangup(channel, SWITCH_CAUSE_INCOMPATIBLE_DESTINATION);
 			return SWITCH_STATUS_FALSE;
@@ -874,42 +1162,20 @@ static switch_status_t channel_on_routing(switch_core_session_t *session)
 	}
 
 	/*
-	 * Per-call signed-token TTL. Honour an operator-supplied
-	 * `janus-hmac-token-ttl` channel variable (seconds) and fall back to
-	 * API_HMAC_DEFAULT_CALL_TTL (2h) which comfortably covers the longest
-	 * sensible voice call. We cap at 24h to keep mis-typed values from
-	 * producing effectively-forever tokens.
+	 * Fast join: generate the offer now and send it, with the options the
+	 * configure request would carry, in the join itself - Janus answers on
+	 * the joined event and the configure round trip is saved.
 	 */
-	int hmacTokenTtl = 0;
-	if (pServer->pHmacSecret) {
-		const char *pTtlVar = switch_channel_get_variable(channel, "janus-hmac-token-ttl");
-		if (!zstr(pTtlVar)) {
-			hmacTokenTtl = atoi(pTtlVar);
-			if (hmacTokenTtl < 0) {
-				hmacTokenTtl = 0;
-			} else if (hmacTokenTtl > 86400) {
-				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
-						"janus-hmac-token-ttl=%d capped at 86400s\n", hmacTokenTtl);
-				hmacTokenTtl = 86400;
-			}
-		}
-		if (hmacTokenTtl == 0) {
-			hmacTokenTtl = API_HMAC_DEFAULT_CALL_TTL;
+	if (switch_channel_var_true(channel, "janus-fast-join")) {
+		if (generate_offer(session, pServer) != SWITCH_STATUS_SUCCESS) {
+			return SWITCH_STATUS_FALSE;
 		}
+		switch_set_flag_locked(tech_pvt, TFLAG_FAST_JOIN);
 	}
 
-	if (apiJoin(
-				pServer,
-				hmacTokenTtl,
-				tech_pvt->serverId,
-				tech_pvt->senderId,
-				tech_pvt->roomId,
-				tech_pvt->pDisplay,
-				switch_channel_get_variable(channel, "janus-room-pin"),
-				switch_channel_get_variable(channel, "janus-user-token"),
-				tech_pvt->callId,
-				tech_pvt->pRoomIdStr) != SWITCH_STATUS_SUCCESS) {
+	if (join_room(session, pServer) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Failed to join room\n");
+		roomsForget(pServer, tech_pvt->roomId, tech_pvt->pRoomIdStr);
 		switch_channel_hangup(channel, SWITCH_CAUSE_INCOMPATIBLE_DESTINATION);
 		return SWITCH_STATUS_FALSE;
 	}
@@ -1007,15 +1273,9 @@ static switch_status_t channel_on_hangup(switch_core_session_t *session)
 		return SWITCH_STATUS_NOTFOUND;
 	}
 
-	if (apiLeave(pServer, tech_pvt->serverId, tech_pvt->senderId, tech_pvt->callId) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Failed to leave room\n");
-		// carry on regardless
-	}
-
-	if (apiDetach(pServer, tech_pvt->serverId, tech_pvt->senderId) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Failed to detach\n");
-		// carry on regardless
-	}
+	// detaching the handle takes the participant out of the room too - the
+	// session doesn't wait for it
+	teardownDetach(pServer, tech_pvt->serverId, tech_pvt->senderId);
 
 	(void) hashDelete(&pServer->senderIdLookup, tech_pvt->senderId);
 
@@ -1242,24 +1502,30 @@ static switch_status_t channel_receive_message(switch_core_session_t *session, s
 */
 static server_t *waitServerActive(server_t *pTmpServer, int timeout_ms)
 {
-	int waited = 0;
-	server_t *pServer;
+	switch_time_t deadline = switch_time_now() + (switch_time_t) timeout_ms * 1000;
+	switch_time_t now;
+	server_t *pServer = NULL;
 	janus_id_t serverId;
 
-	while (waited < timeout_ms) {
-		switch_mutex_lock(pTmpServer->mutex);
+	switch_mutex_lock(pTmpServer->mutex);
+	pTmpServer->activeWaiters++;
+	// the server thread signals once the session is in the lookup
+	for (;;) {
 		serverId = pTmpServer->serverId;
-		switch_mutex_unlock(pTmpServer->mutex);
-
 		if (serverId && (pServer = (server_t *) hashFind(&globals.serverIdLookup, serverId))) {
-			return pServer;
+			break;
 		}
 
-		switch_yield(100000);
-		waited += 100;
+		now = switch_time_now();
+		if (now >= deadline) {
+			break;
+		}
+		(void) switch_thread_cond_timedwait(pTmpServer->pActiveCond, pTmpServer->mutex, deadline - now);
 	}
+	pTmpServer->activeWaiters--;
+	switch_mutex_unlock(pTmpServer->mutex);
 
-	return NULL;
+	return pServer;
 }
 
 static server_t *resolveServerForDial(const char *pServerName, switch_core_session_t *session)
@@ -1268,7 +1534,7 @@ static server_t *resolveServerForDial(const char *pServerName, switch_core_sessi
 
 	pTmpServer = serversFind(pServerName);
 	if (!pTmpServer && !zstr(globals.headless_service_url)) {
-		(void) serversRegistryRefresh();
+		(void) serversRegistryRefreshForDial(pServerName);
 		pTmpServer = serversFind(pServerName);
 	}
 
@@ -1277,14 +1543,15 @@ static server_t *resolveServerForDial(const char *pServerName, switch_core_sessi
 		return NULL;
 	}
 
-	/* Verify a cached pod->IP mapping before dialing; refresh and re-resolve on
-	   mismatch so IP reuse during Rollouts can't misroute the media leg. */
+	/* Check the registry thread's verdict on a cached pod->IP mapping before
+	   dialing; refresh and re-resolve on a mismatch (or a verdict too old to
+	   trust) so IP reuse during Rollouts can't misroute the media leg. */
 	if (switch_test_flag(pTmpServer, SFLAG_DYNAMIC) && !serversVerifyDynamicIdentity(pTmpServer)) {
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
 			"Server=%s failed pod identity check; refreshing registry and re-resolving\n", pServerName);
 
 		if (!zstr(globals.headless_service_url)) {
-			(void) serversRegistryRefresh();
+			(void) serversRegistryRefreshForDial(pServerName);
 			pTmpServer = serversFind(pServerName);
 		}
 
@@ -1502,6 +1769,30 @@ static char *normalize_headless_service_url(switch_memory_pool_t *pool, const ch
 	}
 }
 
+// more than this is a typo rather than a deployment
+#define SETTINGS_MAX_THREADS 256
+#define SETTINGS_MAX_REFRESH_SEC 86400
+#define SETTINGS_MAX_FAIL_MAX 100000
+
+// a whole number between min and max, otherwise the param is logged and
+// *pValue keeps its default
+static void parse_setting_uint(const char *pVarStr, const char *pValStr, const unsigned int min, const unsigned int max,
+	unsigned int *pValue)
+{
+	unsigned long value;
+	char *pEnd = NULL;
+
+	errno = 0;
+	value = strtoul(pValStr, &pEnd, 10);
+	if (strchr(pValStr, '-') || pEnd == pValStr || *pEnd || errno || value < min || value > max) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid %s %s (%u-%u) - using %u\n",
+			pVarStr, pValStr, min, max, *pValue);
+		return;
+	}
+
+	*pValue = (unsigned int) value;
+}
+
 static switch_status_t load_config(void)
 {
 	char *cf = "janus.conf";
@@ -1525,9 +1816,24 @@ static switch_status_t load_config(void)
 			} else if ((!strcmp(pVarStr, "headless-service-url") || !strcmp(pVarStr, "pod-url-template")) && !zstr(pValStr)) {
 				globals.headless_service_url = normalize_headless_service_url(globals.pModulePool, pValStr);
 			} else if (!strcmp(pVarStr, "registry-refresh-sec") && !zstr(pValStr)) {
-				globals.registry_refresh_sec = (unsigned int) atoi(pValStr);
+				parse_setting_uint(pVarStr, pValStr, 0, SETTINGS_MAX_REFRESH_SEC, &globals.registry_refresh_sec);
 			} else if (!strcmp(pVarStr, "pod-server-fail-max") && !zstr(pValStr)) {
-				globals.pod_server_fail_max = (unsigned int) atoi(pValStr);
+				parse_setting_uint(pVarStr, pValStr, 0, SETTINGS_MAX_FAIL_MAX, &globals.pod_server_fail_max);
+			} else if (!strcmp(pVarStr, "http-engine-threads") && !zstr(pValStr)) {
+				parse_setting_uint(pVarStr, pValStr, 0, SETTINGS_MAX_THREADS, &globals.http_engine_threads);
+			} else if (!strcmp(pVarStr, "dispatch-threads") && !zstr(pValStr)) {
+				parse_setting_uint(pVarStr, pValStr, 0, SETTINGS_MAX_THREADS, &globals.dispatch_threads);
+			} else if (!strcmp(pVarStr, "teardown-threads") && !zstr(pValStr)) {
+				parse_setting_uint(pVarStr, pValStr, 0, SETTINGS_MAX_THREADS, &globals.teardown_threads);
+			} else if (!strcmp(pVarStr, "server-loop-threads") && !zstr(pValStr)) {
+				if (!strcasecmp(pValStr, "auto")) {
+					globals.server_loop_threads = switch_core_cpu_count();
+					if (globals.server_loop_threads > SETTINGS_MAX_THREADS) {
+						globals.server_loop_threads = SETTINGS_MAX_THREADS;
+					}
+				} else {
+					parse_setting_uint(pVarStr, pValStr, 0, SETTINGS_MAX_THREADS, &globals.server_loop_threads);
+				}
 			}
 		}
 	}
@@ -1580,10 +1886,28 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_janus_load)
 	switch_find_local_ip(globals.guess_ip, sizeof(globals.guess_ip), NULL, AF_INET);
 
 	switch_mutex_init(&globals.mutex, SWITCH_MUTEX_NESTED, globals.pModulePool);
+	switch_mutex_init(&globals.registry_mutex, SWITCH_MUTEX_NESTED, globals.pModulePool);
+	switch_thread_cond_create(&globals.registry_cond, globals.pModulePool);
+	switch_thread_cond_create(&globals.registry_stop_cond, globals.pModulePool);
+	switch_core_hash_init(&globals.pRegistryUnknown);
 	// default values
 	globals.debug = SWITCH_FALSE;
+	globals.http_engine_threads = HTTP_ENGINE_DEFAULT_THREADS;
+	globals.dispatch_threads = DISPATCH_DEFAULT_THREADS;
+	globals.teardown_threads = TEARDOWN_DEFAULT_THREADS;
+	globals.server_loop_threads = LOOP_DEFAULT_THREADS;
 
+	// before the servers are configured, which look their transport up
+	transportRegister(JANUS_TP_HTTP, &janus_http_transport);
+#if defined(HAVE_MOD_JANUS_WS)
+	transportRegister(JANUS_TP_WS, &janus_ws_transport);
+#endif
+#if defined(HAVE_MOD_JANUS_UNIX)
+	transportRegister(JANUS_TP_UNIX, &janus_unix_transport);
+#endif
 
+	// the servers' HTTP pools come from here
+	httpInit();
 	load_config();
 
 	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
@@ -1598,6 +1922,17 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_janus_load)
 	switch_console_set_complete("add janus debug ::[true:false");
 	switch_console_set_complete("add janus status");
 	switch_console_set_complete("add janus list");
+	switch_console_set_complete("add janus stats");
+#if defined(HAVE_MOD_JANUS_BENCH)
+	switch_console_set_complete("add janus bench hash");
+	switch_console_set_complete("add janus bench auth");
+	switch_console_set_complete("add janus bench registry");
+	switch_console_set_complete("add janus bench ws");
+	switch_console_set_complete("add janus bench unix");
+	switch_console_set_complete("add janus bench http2");
+	switch_console_set_complete("add janus bench stream");
+	switch_console_set_complete("add janus bench decode");
+#endif
 	switch_console_set_complete("add janus server ::janus::listServers enable");
 	switch_console_set_complete("add janus server ::janus::listServers disable");
 	switch_console_add_complete_func("::janus::listServers", serversList);
@@ -1609,6 +1944,25 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_janus_load)
 		return SWITCH_STATUS_FALSE;
 	}
 
+	if (httpEngineStart(globals.http_engine_threads) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot start HTTP engine - using blocking requests\n");
+	}
+	if (dispatchStart(globals.dispatch_threads) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot start event dispatch - dispatching on server threads\n");
+	}
+	if (teardownStart(globals.teardown_threads) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot start call teardown - detaching on hangup\n");
+	}
+	if (handlesStart() != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot start handle pool - attaching on call setup\n");
+	}
+	if (janus_socket_start() != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot start socket reader - reading each socket on a thread of its own\n");
+	}
+	if (loopStart(globals.server_loop_threads, server_step, server_connect) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot start server loops - running a thread per server\n");
+	}
+
 	serversBindStartThread(startServerThread);
 	serversBindStopThread(stopServerThread);
 
@@ -1640,13 +1994,25 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_janus_shutdown)
 
   serversStopRegistry();
 
+	// send the detaches of calls already hung up while the sessions are still there
+	teardownStop();
+
   while ((pServer = serversIterate(&pIndex)) != NULL) {
 		stopServerThread(pServer);
   }
+	loopStop();
+	// every socket session has been closed with its server
+	janus_socket_stop();
+
+	// workers may still be making requests so stop them first
+	handlesStop();
+	dispatchStop();
+	httpEngineStop();
 
 	(void) hashDestroy(&globals.serverIdLookup);
 
 	(void) serversDestroy();
+	hashFreeRetired();
 
 	switch_curl_destroy();
 
@@ -1673,8 +2039,9 @@ SWITCH_STANDARD_API(janus_api_commands)
 		stream->write_function(stream, "USAGE %s\n", JANUS_SYNTAX);
 		status = SWITCH_STATUS_FALSE;
 	} else if (argv[0] && !strncasecmp(argv[0], "status", 6)) {
-		stream->write_function(stream, "totalCalls|callsInProgress|started\n");
-		stream->write_function(stream, "%u|%u|%lld\n", globals.totalCalls, globals.callsInProgress, globals.started);
+		stream->write_function(stream, "totalCalls|callsInProgress|started|httpInFlight\n");
+		stream->write_function(stream, "%u|%u|%lld|%u\n", globals.totalCalls, globals.callsInProgress, globals.started,
+			httpEngineInFlight());
 	} else if (argv[0] && !strncasecmp(argv[0], "debug", 5)) {
 		if ((argc >= 2) && argv[1]) {
 			globals.debug = switch_true(argv[1]);
@@ -1684,6 +2051,12 @@ SWITCH_STANDARD_API(janus_api_commands)
 		}
 	} else if (argv[0] && !strncasecmp(argv[0], "list", 6)) {
 		serversSummary(stream);
+	} else if (argv[0] && !strncasecmp(argv[0], "stats", 5)) {
+		serversStats(stream);
+#if defined(HAVE_MOD_JANUS_BENCH)
+	} else if (argv[0] && !strncasecmp(argv[0], "bench", 5)) {
+		(void) benchCommand(argc - 1, &argv[1], stream);
+#endif
 	} else if (argv[0] && !strncasecmp(argv[0], "server", 7)) {
 		if (argc >= 3 && argv[1] && argv[2]) {
 			server_t *pServer = serversFind(argv[1]);
@@ -0,0 +1,241 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ * registry.c -- Headless service registry snapshot functions for janus endpoint module
+ *
+ */
+#include  "switch.h"
+
+#include  "registry.h"
+
+static int registryCompare(const void *pA, const void *pB) {
+	const registry_endpoint_t *pEndpointA = (const registry_endpoint_t *) pA;
+	const registry_endpoint_t *pEndpointB = (const registry_endpoint_t *) pB;
+	int result = strcmp(pEndpointA->pod_name, pEndpointB->pod_name);
+
+	// the same pod seen at two addresses - keep a consistent one
+	return result ? result : strcmp(pEndpointA->pod_ip, pEndpointB->pod_ip);
+}
+
+registry_snapshot_t *registryCreate(const uint32_t size) {
+	switch_memory_pool_t *pPool = NULL;
+	registry_snapshot_t *pSnapshot;
+
+	if (switch_core_new_memory_pool(&pPool) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't create registry memory pool\n");
+		return NULL;
+	}
+
+	pSnapshot = switch_core_alloc(pPool, sizeof(*pSnapshot));
+	pSnapshot->pPool = pPool;
+	pSnapshot->size = size;
+	pSnapshot->pEndpoints = size ? switch_core_alloc(pPool, sizeof(registry_endpoint_t) * size) : NULL;
+
+	return pSnapshot;
+}
+
+switch_status_t registryAdd(registry_snapshot_t *pSnapshot, const char *pPodName, const char *pPodIp,
+		const char *pUrl, const switch_time_t latency) {
+	registry_endpoint_t *pEndpoint;
+
+	switch_assert(pSnapshot);
+	switch_assert(pPodName);
+
+	if (pSnapshot->count >= pSnapshot->size) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	pEndpoint = &pSnapshot->pEndpoints[pSnapshot->count++];
+	pEndpoint->pod_name = switch_core_strdup(pSnapshot->pPool, pPodName);
+	switch_copy_string(pEndpoint->pod_ip, pPodIp ? pPodIp : "", sizeof(pEndpoint->pod_ip));
+	pEndpoint->url = switch_core_strdup(pSnapshot->pPool, pUrl ? pUrl : "");
+	pEndpoint->latency = latency;
+	pEndpoint->gone = SWITCH_FALSE;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+void registrySeal(registry_snapshot_t *pSnapshot) {
+	uint32_t i, count = 0;
+
+	switch_assert(pSnapshot);
+
+	if (pSnapshot->count < 2) {
+		return;
+	}
+
+	qsort(pSnapshot->pEndpoints, pSnapshot->count, sizeof(registry_endpoint_t), registryCompare);
+
+	for (i = 0; i < pSnapshot->count; i++) {
+		if (count && !strcmp(pSnapshot->pEndpoints[count - 1].pod_name, pSnapshot->pEndpoints[i].pod_name)) {
+			continue;
+		}
+		if (count != i) {
+			pSnapshot->pEndpoints[count] = pSnapshot->pEndpoints[i];
+		}
+		count++;
+	}
+	pSnapshot->count = count;
+}
+
+registry_endpoint_t *registryFind(registry_snapshot_t *pSnapshot, const char *pPodName) {
+	uint32_t low = 0, high;
+
+	if (!pSnapshot || !pPodName) {
+		return NULL;
+	}
+
+	high = pSnapshot->count;
+	while (low < high) {
+		const uint32_t mid = low + (high - low) / 2;
+		const int result = strcmp(pSnapshot->pEndpoints[mid].pod_name, pPodName);
+
+		if (!result) {
+			return &pSnapshot->pEndpoints[mid];
+		} else if (result < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return NULL;
+}
+
+// merges the endpoints kept by the diff back into the new snapshot
+static void registryKeep(registry_snapshot_t *pNew, const registry_endpoint_t *pKept, const uint32_t kept) {
+	registry_endpoint_t *pEndpoints;
+	uint32_t i = 0, j = 0, count = 0;
+
+	pEndpoints = switch_core_alloc(pNew->pPool, sizeof(registry_endpoint_t) * (pNew->count + kept));
+
+	while (i < pNew->count || j < kept) {
+		if (j == kept || (i < pNew->count && strcmp(pNew->pEndpoints[i].pod_name, pKept[j].pod_name) < 0)) {
+			pEndpoints[count++] = pNew->pEndpoints[i++];
+		} else {
+			pEndpoints[count] = pKept[j++];
+			// the strings belong to the old snapshot
+			pEndpoints[count].pod_name = switch_core_strdup(pNew->pPool, pEndpoints[count].pod_name);
+			pEndpoints[count].url = switch_core_strdup(pNew->pPool, pEndpoints[count].url);
+			count++;
+		}
+	}
+
+	pNew->pEndpoints = pEndpoints;
+	pNew->count = count;
+	pNew->size = count;
+}
+
+uint32_t registryDiff(registry_snapshot_t *pOld, registry_snapshot_t *pNew, registry_diff_func_t pFunc,
+		void *pUserData) {
+	const uint32_t oldCount = pOld ? pOld->count : 0;
+	registry_endpoint_t *pKept = NULL;
+	uint32_t i = 0, j = 0, kept = 0, changes = 0;
+
+	switch_assert(pNew);
+	switch_assert(pFunc);
+
+	while (i < oldCount || j < pNew->count) {
+		const registry_endpoint_t *pOldEndpoint = i < oldCount ? &pOld->pEndpoints[i] : NULL;
+		const registry_endpoint_t *pNewEndpoint = j < pNew->count ? &pNew->pEndpoints[j] : NULL;
+		int result;
+
+		if (pOldEndpoint && pOldEndpoint->gone) {
+			// not in the server list any more, so as far as the diff goes it never was
+			i++;
+			if (pNewEndpoint && !strcmp(pOldEndpoint->pod_name, pNewEndpoint->pod_name)) {
+				(void) pFunc(REGISTRY_ADDED, NULL, pNewEndpoint, pUserData);
+				changes++;
+				j++;
+			}
+			continue;
+		}
+
+		if (!pOldEndpoint) {
+			result = 1;
+		} else if (!pNewEndpoint) {
+			result = -1;
+		} else {
+			result = strcmp(pOldEndpoint->pod_name, pNewEndpoint->pod_name);
+		}
+
+		if (result < 0) {
+			if (!pFunc(REGISTRY_REMOVED, pOldEndpoint, NULL, pUserData)) {
+				if (!pKept) {
+					pKept = switch_core_alloc(pNew->pPool, sizeof(registry_endpoint_t) * oldCount);
+				}
+				pKept[kept++] = *pOldEndpoint;
+			}
+			changes++;
+			i++;
+		} else if (result > 0) {
+			(void) pFunc(REGISTRY_ADDED, NULL, pNewEndpoint, pUserData);
+			changes++;
+			j++;
+		} else {
+			if (strcmp(pOldEndpoint->pod_ip, pNewEndpoint->pod_ip) || strcmp(pOldEndpoint->url, pNewEndpoint->url)) {
+				(void) pFunc(REGISTRY_CHANGED, pOldEndpoint, pNewEndpoint, pUserData);
+				changes++;
+			}
+			i++;
+			j++;
+		}
+	}
+
+	if (kept) {
+		registryKeep(pNew, pKept, kept);
+	}
+
+	pNew->version = (pOld ? pOld->version : 0) + (changes ? 1 : 0);
+
+	return changes;
+}
+
+void registryDestroy(registry_snapshot_t **ppSnapshot) {
+	switch_memory_pool_t *pPool;
+
+	if (!ppSnapshot || !*ppSnapshot) {
+		return;
+	}
+
+	pPool = (*ppSnapshot)->pPool;
+	*ppSnapshot = NULL;
+	switch_core_destroy_memory_pool(&pPool);
+}
+
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
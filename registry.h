@@ -0,0 +1,95 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ * registry.h -- Headless service registry snapshot headers for janus endpoint module
+ *
+ */
+#ifndef _REGISTRY_H_
+#define _REGISTRY_H_
+
+#include  "switch.h"
+#include  <arpa/inet.h>
+
+#include  "globals.h"
+
+// A snapshot holds the pods found by one registry refresh, sorted by pod
+// name.  Each refresh builds a new snapshot and diffs it against the current
+// one, so only pods that were added, moved to another address or removed
+// touch the server list
+typedef struct registry_endpoint_s {
+	const char *pod_name;
+	char pod_ip[INET_ADDRSTRLEN];
+	const char *url;
+	switch_time_t latency; // usec the /info probe took
+	switch_bool_t gone;    // server removed itself - treat the pod as unknown
+} registry_endpoint_t;
+
+struct registry_snapshot_s {
+	switch_memory_pool_t *pPool;
+	uint32_t version; // bumped whenever a diff finds a change
+	uint32_t count;
+	uint32_t size;
+	registry_endpoint_t *pEndpoints;
+};
+
+typedef enum {
+	REGISTRY_ADDED,
+	REGISTRY_CHANGED,
+	REGISTRY_REMOVED
+} registry_change_t;
+
+// called for each difference; returning SWITCH_FALSE for REGISTRY_REMOVED
+// keeps the old endpoint in the new snapshot so it is removed again next time
+typedef switch_bool_t (*registry_diff_func_t)(const registry_change_t change, const registry_endpoint_t *pOld,
+	const registry_endpoint_t *pNew, void *pUserData);
+
+// an empty snapshot with room for size endpoints
+registry_snapshot_t *registryCreate(const uint32_t size);
+switch_status_t registryAdd(registry_snapshot_t *pSnapshot, const char *pPodName, const char *pPodIp,
+	const char *pUrl, const switch_time_t latency);
+// sorts the endpoints - keeping one per pod name - once they have all been added
+void registrySeal(registry_snapshot_t *pSnapshot);
+registry_endpoint_t *registryFind(registry_snapshot_t *pSnapshot, const char *pPodName);
+// walks both (sealed) snapshots calling pFunc for each difference and
+// returns the number of differences.  pOld may be NULL
+uint32_t registryDiff(registry_snapshot_t *pOld, registry_snapshot_t *pNew, registry_diff_func_t pFunc,
+	void *pUserData);
+void registryDestroy(registry_snapshot_t **ppSnapshot);
+
+#endif //_REGISTRY_H_
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
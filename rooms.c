@@ -0,0 +1,262 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ * rooms.c -- Room cache functions for janus endpoint module
+ *
+ */
+#include  "switch.h"
+
+#include  "globals.h"
+#include  "api.h"
+#include  "rooms.h"
+
+// how long a call waits for another call's create of the same room
+#define ROOMS_CREATE_WAIT_US (10 * 1000000)
+// expired rooms are swept out after this many creates
+#define ROOMS_PRUNE_INTERVAL 64
+
+typedef struct room_s {
+	janus_id_t serverId; // session the room was seen on
+	janus_id_t result;   // returned to callers - as apiCreateRoom()
+	switch_time_t expires;
+	switch_bool_t creating;
+} room_t;
+
+typedef struct {
+	switch_time_t now;
+	unsigned int removed;
+} rooms_prune_t;
+
+static const char *roomsKey(char *pBuf, const size_t size, const janus_id_t roomId, const char *pRoomIdStr) {
+	if (pRoomIdStr && *pRoomIdStr) {
+		return pRoomIdStr;
+	}
+	(void) switch_snprintf(pBuf, size, "%" SWITCH_UINT64_T_FMT, roomId);
+	return pBuf;
+}
+
+static switch_bool_t roomsRemoveAll(const void *pKey, const void *pVal, void *pData) {
+	free((void *) pVal);
+	return SWITCH_TRUE;
+}
+
+static switch_bool_t roomsRemoveExpired(const void *pKey, const void *pVal, void *pData) {
+	const room_t *pRoom = (const room_t *) pVal;
+	rooms_prune_t *pPrune = (rooms_prune_t *) pData;
+
+	if (pRoom->creating || pRoom->expires > pPrune->now) {
+		return SWITCH_FALSE;
+	}
+	free((void *) pVal);
+	pPrune->removed ++;
+	return SWITCH_TRUE;
+}
+
+// called with pServer->mutex held
+static void roomsRemove(server_t *pServer, const char *pKey) {
+	room_t *pRoom;
+
+	if ((pRoom = (room_t *) switch_core_hash_delete(pServer->pRooms, pKey)) != NULL) {
+		free(pRoom);
+		pServer->roomCount --;
+	}
+}
+
+// called with pServer->mutex held
+static void roomsPrune(server_t *pServer) {
+	rooms_prune_t prune;
+
+	prune.now = switch_time_now();
+	prune.removed = 0;
+	(void) switch_core_hash_delete_multi(pServer->pRooms, roomsRemoveExpired, &prune);
+	pServer->roomCount -= prune.removed;
+}
+
+void roomsInit(server_t *pServer) {
+	switch_assert(pServer);
+
+	(void) switch_core_hash_init(&pServer->pRooms);
+	(void) switch_thread_cond_create(&pServer->pRoomCond, globals.pModulePool);
+	pServer->roomCacheTtl = ROOM_CACHE_DEFAULT_TTL;
+}
+
+janus_id_t roomsCreate(server_t *pServer, const janus_id_t serverId,
+		const janus_id_t senderId, const janus_id_t roomId, const char *pDescription,
+		switch_bool_t record, const char *pRecordingFile, const char *pPin,
+		switch_bool_t allow_ws_participants, const char *pRoomIdStr, switch_bool_t *pKnown) {
+	char keyBuf[32];
+	const char *pKey = roomsKey(keyBuf, sizeof(keyBuf), roomId, pRoomIdStr);
+	switch_time_t deadline = switch_time_now() + ROOMS_CREATE_WAIT_US;
+	room_t *pRoom;
+	janus_id_t result;
+
+	switch_assert(pServer);
+
+	if (pKnown) {
+		*pKnown = SWITCH_FALSE;
+	}
+
+	if (!pServer->roomCacheTtl || !pServer->pRooms) {
+		return apiCreateRoom(pServer, serverId, senderId, roomId, pDescription,
+			record, pRecordingFile, pPin, allow_ws_participants, pRoomIdStr);
+	}
+
+	switch_mutex_lock(pServer->mutex);
+	for (;;) {
+		switch_time_t now = switch_time_now();
+
+		pRoom = (room_t *) switch_core_hash_find(pServer->pRooms, pKey);
+		if (!pRoom || (!pRoom->creating && (pRoom->serverId != serverId || pRoom->expires <= now))) {
+			break;
+		}
+
+		if (!pRoom->creating) {
+			result = pRoom->result;
+			pServer->roomHits ++;
+			switch_mutex_unlock(pServer->mutex);
+			if (pKnown) {
+				*pKnown = SWITCH_TRUE;
+			}
+			MOD_JANUS_DBG(SWITCH_CHANNEL_LOG, "Room=%s known - not creating\n", pKey);
+			return result;
+		}
+
+		// another call is creating it - wait for the result
+		if (now >= deadline) {
+			pServer->roomMisses ++;
+			switch_mutex_unlock(pServer->mutex);
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Room=%s create still in progress - creating anyway\n", pKey);
+			return apiCreateRoom(pServer, serverId, senderId, roomId, pDescription,
+				record, pRecordingFile, pPin, allow_ws_participants, pRoomIdStr);
+		}
+		(void) switch_thread_cond_timedwait(pServer->pRoomCond, pServer->mutex, deadline - now);
+	}
+
+	if (!pRoom) {
+		switch_zmalloc(pRoom, sizeof(*pRoom));
+		(void) switch_core_hash_insert(pServer->pRooms, pKey, pRoom);
+		pServer->roomCount ++;
+	}
+	pRoom->serverId = serverId;
+	pRoom->creating = SWITCH_TRUE;
+	if (!(++ pServer->roomMisses % ROOMS_PRUNE_INTERVAL)) {
+		roomsPrune(pServer);
+	}
+	switch_mutex_unlock(pServer->mutex);
+
+	result = apiCreateRoom(pServer, serverId, senderId, roomId, pDescription,
+		record, pRecordingFile, pPin, allow_ws_participants, pRoomIdStr);
+
+	switch_mutex_lock(pServer->mutex);
+	// the entry has gone if the session was lost in the meantime
+	pRoom = (room_t *) switch_core_hash_find(pServer->pRooms, pKey);
+	if (pRoom && pRoom->creating && pRoom->serverId == serverId) {
+		if (result) {
+			pRoom->result = result;
+			pRoom->expires = switch_time_now() + (switch_time_t) pServer->roomCacheTtl * 1000000;
+			pRoom->creating = SWITCH_FALSE;
+		} else {
+			// let a waiting call have a go
+			roomsRemove(pServer, pKey);
+		}
+	}
+	(void) switch_thread_cond_broadcast(pServer->pRoomCond);
+	switch_mutex_unlock(pServer->mutex);
+
+	return result;
+}
+
+void roomsLearn(server_t *pServer, const janus_id_t serverId, const janus_id_t roomId, const char *pRoomIdStr) {
+	char keyBuf[32];
+	const char *pKey = roomsKey(keyBuf, sizeof(keyBuf), roomId, pRoomIdStr);
+	room_t *pRoom;
+
+	switch_assert(pServer);
+
+	if (!pServer->roomCacheTtl || !pServer->pRooms || !serverId) {
+		return;
+	}
+
+	switch_mutex_lock(pServer->mutex);
+	if (!(pRoom = (room_t *) switch_core_hash_find(pServer->pRooms, pKey))) {
+		switch_zmalloc(pRoom, sizeof(*pRoom));
+		(void) switch_core_hash_insert(pServer->pRooms, pKey, pRoom);
+		pServer->roomCount ++;
+	}
+	// a create in flight records its own result
+	if (!pRoom->creating) {
+		pRoom->serverId = serverId;
+		pRoom->result = roomId ? roomId : 1; // never 0 - see apiCreateRoom()
+		pRoom->expires = switch_time_now() + (switch_time_t) pServer->roomCacheTtl * 1000000;
+	}
+	switch_mutex_unlock(pServer->mutex);
+}
+
+void roomsForget(server_t *pServer, const janus_id_t roomId, const char *pRoomIdStr) {
+	char keyBuf[32];
+	const char *pKey = roomsKey(keyBuf, sizeof(keyBuf), roomId, pRoomIdStr);
+	room_t *pRoom;
+
+	switch_assert(pServer);
+
+	if (!pServer->pRooms) {
+		return;
+	}
+
+	switch_mutex_lock(pServer->mutex);
+	if ((pRoom = (room_t *) switch_core_hash_find(pServer->pRooms, pKey)) != NULL && !pRoom->creating) {
+		roomsRemove(pServer, pKey);
+	}
+	switch_mutex_unlock(pServer->mutex);
+}
+
+void roomsClear(server_t *pServer) {
+	switch_assert(pServer);
+
+	if (!pServer->pRooms) {
+		return;
+	}
+
+	switch_mutex_lock(pServer->mutex);
+	(void) switch_core_hash_delete_multi(pServer->pRooms, roomsRemoveAll, NULL);
+	pServer->roomCount = 0;
+	// calls waiting on a create that was in flight will create it again
+	(void) switch_thread_cond_broadcast(pServer->pRoomCond);
+	switch_mutex_unlock(pServer->mutex);
+}
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
@@ -0,0 +1,70 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ * rooms.h -- Room cache headers for janus endpoint module
+ *
+ */
+#ifndef _ROOMS_H_
+#define _ROOMS_H_
+
+#include  "switch.h"
+#include  "servers.h"
+
+#define ROOM_CACHE_DEFAULT_TTL 300
+
+// Each server remembers the rooms known to exist on its Janus session, learnt
+// from creates (including "already exists") and joined events, so that a
+// call to a known room skips the create request.  Creates of the same room
+// from concurrent calls are coalesced into one request
+void roomsInit(server_t *pServer);
+
+// creates the room unless it is known to exist - same result as apiCreateRoom().
+// *pKnown (if given) is set when no create was sent because the room was known
+janus_id_t roomsCreate(server_t *pServer, const janus_id_t serverId,
+	const janus_id_t senderId, const janus_id_t roomId, const char *pDescription,
+	switch_bool_t record, const char *pRecordingFile, const char *pPin,
+	switch_bool_t allow_ws_participants, const char *pRoomIdStr, switch_bool_t *pKnown);
+// a call has joined the room on serverId
+void roomsLearn(server_t *pServer, const janus_id_t serverId, const janus_id_t roomId, const char *pRoomIdStr);
+// the room may no longer exist - e.g. a join to it failed
+void roomsForget(server_t *pServer, const janus_id_t roomId, const char *pRoomIdStr);
+// the session has gone - forget every room
+void roomsClear(server_t *pServer);
+
+#endif //_ROOMS_H_
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
@@ -33,11 +33,38 @@
 #include  "globals.h"
 #include  "servers.h"
 #include  "http.h"
+#include  "handles.h"
+#include  "rooms.h"
+#include  "registry.h"
+#include  "transport.h"
+#include  "janus_unix.h"
 
 #include  <arpa/inet.h>
+#include  <errno.h>
 #include  <netdb.h>
 #include  <sys/socket.h>
 
+#define SERVER_PARAM_MAX_POOL 1024
+#define SERVER_PARAM_MAX_SECONDS 86400
+
+// a whole number between min and max, otherwise the param is logged and
+// *pValue keeps its default
+static void serversParseUint(const char *pName, const char *pVarStr, const char *pValStr,
+		const unsigned int min, const unsigned int max, unsigned int *pValue) {
+	unsigned long value;
+	char *pEnd = NULL;
+
+	errno = 0;
+	value = strtoul(pValStr, &pEnd, 10);
+	if (strchr(pValStr, '-') || pEnd == pValStr || *pEnd || errno || value < min || value > max) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Server=%s  Invalid %s %s (%u-%u) - using %u\n",
+				pName, pVarStr, pValStr, min, max, *pValue);
+		return;
+	}
+
+	*pValue = (unsigned int) value;
+}
+
 switch_status_t serversList(const char *pLine, const char *pCursor, switch_console_callback_match_t **matches) {
 	switch_hash_index_t *pIndex = NULL;
 	server_t *pServer;
@@ -84,12 +111,23 @@ switch_status_t serversAdd(switch_xml_t xmlint) {
   pServer->pThread = NULL;
   pServer->transport = JANUS_TP_HTTP;
   pServer->janus_ws_handle = NULL;
+  pServer->janus_unix_handle = NULL;
   pServer->ws_last_poll = 0;
+  pServer->pHttpPool = NULL;
+  switch_thread_cond_create(&pServer->pActiveCond, globals.pModulePool);
+  switch_thread_cond_create(&pServer->pStopCond, globals.pModulePool);
+  switch_thread_cond_create(&pServer->pDispatchCond, globals.pModulePool);
 
 	// set default values
 	pServer->name = switch_core_strdup(globals.pModulePool, pName);
   pServer->codec_string = "opus";
   pServer->local_network = "localnet.auto";
+  pServer->httpPoolSize = HTTP_POOL_DEFAULT_SIZE;
+  pServer->httpPoolIdleTimeout = HTTP_POOL_DEFAULT_IDLE_TIMEOUT;
+  pServer->http2 = SWITCH_FALSE;
+  pServer->handlePoolSize = HANDLE_POOL_DEFAULT_SIZE;
+  pServer->hmacTokenRefresh = AUTH_CACHE_DEFAULT_REFRESH;
+  roomsInit(pServer);
 
 	for (param = switch_xml_child(xmlint, "param"); param; param = param->next) {
 		char *pVarStr = (char *) switch_xml_attr_soft(param, "name");
@@ -104,6 +142,8 @@ switch_status_t serversAdd(switch_xml_t xmlint) {
 			pServer->pAuthToken = switch_core_strdup(globals.pModulePool, pValStr);
 		} else if (!strcmp(pVarStr, "hmac-secret") && !zstr(pValStr)) {
 			pServer->pHmacSecret = switch_core_strdup(globals.pModulePool, pValStr);
+		} else if (!strcmp(pVarStr, "hmac-token-refresh") && !zstr(pValStr)) {
+			serversParseUint(pName, pVarStr, pValStr, 0, AUTH_CACHE_MAX_REFRESH, &pServer->hmacTokenRefresh);
 		} else if (!strcmp(pVarStr, "local-network-acl") && !zstr(pValStr)) {
       if (strcasecmp(pValStr, "none")) {
 	      pServer->local_network = switch_core_strdup(globals.pModulePool, pValStr);
@@ -167,6 +207,22 @@ switch_status_t serversAdd(switch_xml_t xmlint) {
       }
     } else if (!strcasecmp(pVarStr, "codec-string") && !zstr(pValStr)) {
       pServer->codec_string = switch_core_strdup(globals.pModulePool, pValStr);
+		} else if (!strcmp(pVarStr, "http-pool-size") && !zstr(pValStr)) {
+			serversParseUint(pName, pVarStr, pValStr, 0, SERVER_PARAM_MAX_POOL, &pServer->httpPoolSize);
+		} else if (!strcmp(pVarStr, "http-pool-idle-timeout") && !zstr(pValStr)) {
+			serversParseUint(pName, pVarStr, pValStr, 0, SERVER_PARAM_MAX_SECONDS, &pServer->httpPoolIdleTimeout);
+		} else if (!strcmp(pVarStr, "http-version") && !zstr(pValStr)) {
+			if (!strcmp(pValStr, "2")) {
+				pServer->http2 = SWITCH_TRUE;
+			} else if (!strcmp(pValStr, "1.1")) {
+				pServer->http2 = SWITCH_FALSE;
+			} else {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Server=%s  Unknown http-version %s - using 1.1\n", pName, pValStr);
+			}
+		} else if (!strcmp(pVarStr, "handle-pool-size") && !zstr(pValStr)) {
+			serversParseUint(pName, pVarStr, pValStr, 0, SERVER_PARAM_MAX_POOL, &pServer->handlePoolSize);
+		} else if (!strcmp(pVarStr, "room-cache-ttl") && !zstr(pValStr)) {
+			serversParseUint(pName, pVarStr, pValStr, 0, SERVER_PARAM_MAX_SECONDS, &pServer->roomCacheTtl);
 		} else if (!strcmp(pVarStr, "enabled") && !zstr(pValStr)) {
 			// set the flag to the opposite state so that we will do the right thine
       if (switch_true(pValStr)) {
@@ -190,9 +246,32 @@ switch_status_t serversAdd(switch_xml_t xmlint) {
 				"Server=%s  WebSocket URL '%s' but mod_janus was built without libks support\n",
 				pName, pServer->pUrl);
 		return SWITCH_STATUS_FALSE;
+#endif
+	} else if (!strncasecmp(pServer->pUrl, JANUS_UNIX_SCHEME, strlen(JANUS_UNIX_SCHEME))) {
+#if defined(HAVE_MOD_JANUS_UNIX)
+		pServer->transport = JANUS_TP_UNIX;
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO,
+				"Server=%s  Unix socket transport selected (url=%s)\n", pName, pServer->pUrl);
+#else
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR,
+				"Server=%s  Unix socket URL '%s' but this platform has no SOCK_SEQPACKET support\n",
+				pName, pServer->pUrl);
+		return SWITCH_STATUS_FALSE;
 #endif
 	} else {
 		pServer->transport = JANUS_TP_HTTP;
+		pServer->pHttpPool = httpPoolCreate(pName, pServer->httpPoolSize, pServer->httpPoolIdleTimeout, pServer->http2);
+	}
+
+	if (!(pServer->pTransport = transportGet(pServer->transport))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Server=%s  No transport registered for url=%s\n", pName, pServer->pUrl);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (pServer->pHmacSecret && (!(pServer->pAuth = authCreate(globals.pModulePool, pServer->pHmacSecret)) ||
+			!(pServer->pAuthCache = authCacheCreate(globals.pModulePool, pServer->pAuth, pServer->hmacTokenRefresh)))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Server=%s  Cannot prepare the HMAC signing key\n", pName);
+		return SWITCH_STATUS_FALSE;
 	}
 
 	if (pServer->pHmacSecret && pServer->pAuthToken) {
@@ -219,6 +298,14 @@ static void serverCloneDefaults(server_t *dst, const server_t *src) {
 	dst->pSecret = src->pSecret;
 	dst->pAuthToken = src->pAuthToken;
 	dst->pHmacSecret = src->pHmacSecret;
+	dst->pAuth = src->pAuth;
+	dst->hmacTokenRefresh = src->hmacTokenRefresh;
+	dst->pAuthCache = src->pAuthCache;
+	dst->httpPoolSize = src->httpPoolSize;
+	dst->httpPoolIdleTimeout = src->httpPoolIdleTimeout;
+	dst->http2 = src->http2;
+	dst->handlePoolSize = src->handlePoolSize;
+	dst->roomCacheTtl = src->roomCacheTtl;
 	dst->cand_acl_count = src->cand_acl_count;
 	for (uint32_t i = 0; i < src->cand_acl_count; i++) {
 		dst->cand_acl[i] = src->cand_acl[i];
@@ -264,10 +351,22 @@ switch_bool_t serversPodNameValid(const char *pod_name) {
 	return SWITCH_TRUE;
 }
 
-#define REGISTRY_MAX_ENDPOINTS 64
+/* Per-pod /info timeout, and how long a refresh waits for all of its probes. */
+#define REGISTRY_PROBE_TIMEOUT_MS 2000
+#define REGISTRY_PROBE_DEADLINE_US (2500 * 1000)
 
-/* Trust a pod-identity check for this long before re-probing on the next dial. */
+/* How long a dial waits for a refresh started by another call. */
+#define REGISTRY_DIAL_WAIT_US (2 * REGISTRY_PROBE_DEADLINE_US)
+/* A pod name no refresh could find is not refreshed for again for this long. */
+#define REGISTRY_UNKNOWN_TTL_US (5 * 1000000)
+/* Expired unknown pod names are swept out once there are this many. */
+#define REGISTRY_UNKNOWN_PRUNE 256
+
+/* The registry thread re-checks the identity of every registry pod this often. */
 #define SERVER_VERIFY_TTL_US (5 * 1000000)
+/* A dial trusts a verdict up to this old; past it (the pod has not answered
+ * its last checks) the dial refreshes the registry rather than trust it. */
+#define SERVER_VERIFY_MAX_AGE_US (3 * SERVER_VERIFY_TTL_US)
 
 void serversBindStartThread(void (*start_fn)(server_t *pServer, switch_bool_t wait_for_active))
 {
@@ -356,28 +455,26 @@ static switch_bool_t serversParseHttpUrlParts(const char *url, char *host, size_
 	return SWITCH_TRUE;
 }
 
-static char *serversBuildJanusUrl(const char *ip, const char *port, const char *path)
+static void serversBuildJanusUrl(char *url, size_t url_size, const char *ip, const char *port, const char *path)
 {
-	char url[512];
-
 	if (zstr(path)) {
 		path = "/janus";
 	}
 
-	(void) snprintf(url, sizeof(url), "http://%s:%s%s", ip, port, path);
-	return switch_core_strdup(globals.pModulePool, url);
+	(void) snprintf(url, url_size, "http://%s:%s%s", ip, port, path);
 }
 
-static switch_bool_t serversProbeJanusPodAtIp(const char *ip, const char *port, const char *path,
-	char *pod_name_out, size_t pod_name_size)
+static void serversBuildInfoUrl(char *info_url, size_t info_url_size, const char *ip, const char *port, const char *path)
+{
+	(void) snprintf(info_url, info_url_size, "http://%s:%s%s/info", ip, port, zstr(path) ? "/janus" : path);
+}
+
+/* Takes ownership of json (the /info response, NULL on failure). */
+static switch_bool_t serversParseInfo(cJSON *json, char *pod_name_out, size_t pod_name_size)
 {
-	char info_url[512];
-	cJSON *json;
 	cJSON *server_name;
 	switch_bool_t ok = SWITCH_FALSE;
 
-	(void) snprintf(info_url, sizeof(info_url), "http://%s:%s%s/info", ip, port, zstr(path) ? "/janus" : path);
-	json = httpGet(info_url, 2000);
 	if (!json) {
 		return SWITCH_FALSE;
 	}
@@ -393,11 +490,146 @@ static switch_bool_t serversProbeJanusPodAtIp(const char *ip, const char *port,
 	return ok;
 }
 
-typedef struct registry_endpoint_s {
-	char pod_name[64];
+/*
+ * A refresh probes every pod at once through the HTTP engine and waits for
+ * the answers up to REGISTRY_PROBE_DEADLINE_US. The batch is shared by the
+ * refresh and the outstanding probes and freed by whichever finishes last,
+ * so a pod answering after the deadline is simply picked up next refresh.
+ */
+typedef struct registry_probe_batch_s registry_probe_batch_t;
+
+typedef struct {
+	registry_probe_batch_t *pBatch;
 	char pod_ip[INET_ADDRSTRLEN];
-	char *url;
-} registry_endpoint_t;
+	char pod_name[64];
+	switch_bool_t ok;
+	switch_bool_t done;
+	switch_time_t latency; /* usec from submit to answer */
+} registry_probe_t;
+
+struct registry_probe_batch_s {
+	switch_memory_pool_t *pPool;
+	switch_mutex_t *pMutex;
+	switch_thread_cond_t *pCond;
+	unsigned int pending;
+	unsigned int refs;
+	switch_time_t started;
+	int count;
+	registry_probe_t *probes;
+};
+
+static void serversProbeBatchRelease(registry_probe_batch_t *pBatch)
+{
+	switch_memory_pool_t *pPool;
+	unsigned int refs;
+
+	switch_mutex_lock(pBatch->pMutex);
+	refs = --pBatch->refs;
+	switch_mutex_unlock(pBatch->pMutex);
+
+	if (!refs) {
+		pPool = pBatch->pPool;
+		switch_core_destroy_memory_pool(&pPool);
+	}
+}
+
+// runs on an HTTP engine thread
+static void serversProbeComplete(cJSON *pJsonResponse, void *pUserData)
+{
+	registry_probe_t *pProbe = (registry_probe_t *) pUserData;
+	registry_probe_batch_t *pBatch = pProbe->pBatch;
+	switch_bool_t ok;
+	char pod_name[64] = "";
+
+	ok = serversParseInfo(pJsonResponse, pod_name, sizeof(pod_name));
+
+	switch_mutex_lock(pBatch->pMutex);
+	switch_copy_string(pProbe->pod_name, pod_name, sizeof(pProbe->pod_name));
+	pProbe->ok = ok;
+	pProbe->done = SWITCH_TRUE;
+	pProbe->latency = switch_time_now() - pBatch->started;
+	if (!--pBatch->pending) {
+		(void) switch_thread_cond_signal(pBatch->pCond);
+	}
+	switch_mutex_unlock(pBatch->pMutex);
+
+	serversProbeBatchRelease(pBatch);
+}
+
+static registry_probe_batch_t *serversProbeBatchCreate(const int size)
+{
+	switch_memory_pool_t *pPool = NULL;
+	registry_probe_batch_t *pBatch;
+
+	if (switch_core_new_memory_pool(&pPool) != SWITCH_STATUS_SUCCESS) {
+		return NULL;
+	}
+
+	pBatch = switch_core_alloc(pPool, sizeof(*pBatch));
+	pBatch->pPool = pPool;
+	pBatch->probes = switch_core_alloc(pPool, sizeof(registry_probe_t) * (size ? size : 1));
+	switch_mutex_init(&pBatch->pMutex, SWITCH_MUTEX_NESTED, pPool);
+	switch_thread_cond_create(&pBatch->pCond, pPool);
+	pBatch->refs = 1; /* the refresh */
+
+	return pBatch;
+}
+
+// submits a probe of every address and waits until they have all answered or the deadline passes
+static void serversProbeBatchRun(registry_probe_batch_t *pBatch, const char *port, const char *path)
+{
+	char info_url[512];
+	switch_time_t deadline;
+	int i;
+
+	pBatch->started = switch_time_now();
+	deadline = pBatch->started + REGISTRY_PROBE_DEADLINE_US;
+
+	switch_mutex_lock(pBatch->pMutex);
+	pBatch->pending = (unsigned int) pBatch->count;
+	pBatch->refs += (unsigned int) pBatch->count;
+	switch_mutex_unlock(pBatch->pMutex);
+
+	for (i = 0; i < pBatch->count; i++) {
+		registry_probe_t *pProbe = &pBatch->probes[i];
+
+		pProbe->pBatch = pBatch;
+		// without the engine each probe can take its full timeout - stop
+		// sending them once the module is going
+		if (globals.registry_terminating) {
+			serversProbeComplete(NULL, pProbe);
+			continue;
+		}
+		serversBuildInfoUrl(info_url, sizeof(info_url), pProbe->pod_ip, port, path);
+		// without the engine this completes before returning
+		if (httpSubmit(NULL, info_url, REGISTRY_PROBE_TIMEOUT_MS, NULL, serversProbeComplete, pProbe) != SWITCH_STATUS_SUCCESS) {
+			serversProbeComplete(NULL, pProbe);
+		}
+	}
+
+	switch_mutex_lock(pBatch->pMutex);
+	while (pBatch->pending) {
+		switch_time_t now = switch_time_now();
+
+		if (now >= deadline) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
+				"Headless Janus registry: %u of %d probe(s) still outstanding after %dms - leaving them to the next refresh\n",
+				pBatch->pending, pBatch->count, (int) (REGISTRY_PROBE_DEADLINE_US / 1000));
+			break;
+		}
+		(void) switch_thread_cond_timedwait(pBatch->pCond, pBatch->pMutex, deadline - now);
+	}
+	switch_mutex_unlock(pBatch->pMutex);
+}
+
+/* What a refresh has to do once the registry lock is released. */
+typedef struct {
+	server_t **ppStart;
+	int start_count;
+	server_t **ppEvict;
+	int evict_count;
+	int kept;
+} registry_apply_t;
 
 static server_t *serversCreateRegistryServer(const char *pod_name, const char *pod_ip, const char *url)
 {
@@ -412,16 +644,25 @@ static server_t *serversCreateRegistryServer(const char *pod_name, const char *p
 	pServer->callsInProgress = 0;
 	pServer->pThread = NULL;
 	pServer->transport = JANUS_TP_HTTP;
+	pServer->pTransport = transportGet(JANUS_TP_HTTP);
 	pServer->janus_ws_handle = NULL;
+	pServer->janus_unix_handle = NULL;
 	pServer->ws_last_poll = 0;
+	switch_thread_cond_create(&pServer->pActiveCond, globals.pModulePool);
+	switch_thread_cond_create(&pServer->pStopCond, globals.pModulePool);
+	switch_thread_cond_create(&pServer->pDispatchCond, globals.pModulePool);
 	pServer->last_activity = switch_time_now();
 	pServer->connect_failures = 0;
-	pServer->last_verified = 0;
+	// the refresh has just had this name from the pod at this address
+	pServer->last_verified = switch_time_now();
+	pServer->identity_mismatch = SWITCH_FALSE;
 	pServer->name = switch_core_strdup(globals.pModulePool, pod_name);
 	pServer->pUrl = switch_core_strdup(globals.pModulePool, url);
 	pServer->pod_ip = switch_core_strdup(globals.pModulePool, pod_ip);
+	roomsInit(pServer);
 
 	serverCloneDefaults(pServer, globals.pod_defaults);
+	pServer->pHttpPool = httpPoolCreate(pServer->name, pServer->httpPoolSize, pServer->httpPoolIdleTimeout, pServer->http2);
 	switch_set_flag(pServer, SFLAG_ENABLED);
 	switch_set_flag(pServer, SFLAG_DYNAMIC);
 
@@ -430,10 +671,6 @@ static server_t *serversCreateRegistryServer(const char *pod_name, const char *p
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO,
 		"Registered headless Janus pod=%s ip=%s url=%s\n", pod_name, pod_ip, url);
 
-	if (globals.start_server_thread) {
-		globals.start_server_thread(pServer, SWITCH_TRUE);
-	}
-
 	return pServer;
 }
 
@@ -450,9 +687,12 @@ static void serversUpdateRegistryServer(server_t *pServer, const char *pod_ip, c
 	if (!zstr(url) && (!pServer->pUrl || strcmp(pServer->pUrl, url))) {
 		pServer->pUrl = switch_core_strdup(globals.pModulePool, url);
 		url_changed = SWITCH_TRUE;
-		pServer->last_verified = 0; /* IP changed; re-verify on next dial */
 	}
 
+	// the refresh has just had this name from the pod at this address
+	pServer->last_verified = switch_time_now();
+	pServer->identity_mismatch = SWITCH_FALSE;
+
 	pServer->last_activity = switch_time_now();
 	pServer->connect_failures = 0;
 	switch_mutex_unlock(pServer->mutex);
@@ -464,17 +704,14 @@ static void serversUpdateRegistryServer(server_t *pServer, const char *pod_ip, c
 }
 
 /* Confirm the pod answering at a dynamic server's cached IP still reports the
- * expected server-name. Returns TRUE when trusted (static, recently verified,
- * or freshly matched), FALSE when stale and the caller should refresh. */
+ * expected server-name.  Only the verdict kept by the registry thread is
+ * read - a dial never waits on a probe of its own.  Returns TRUE when trusted
+ * (static or recently verified), FALSE when mismatched or too old to trust
+ * and the caller should refresh. */
 switch_bool_t serversVerifyDynamicIdentity(server_t *pServer)
 {
-	char url[512];
-	char pod_ip[INET_ADDRSTRLEN];
-	char host[256];
-	char port[16];
-	char path[128];
-	char pod_name[64] = "";
 	switch_time_t last_verified;
+	switch_bool_t mismatch;
 
 	if (!pServer || !switch_test_flag(pServer, SFLAG_DYNAMIC)) {
 		return SWITCH_TRUE;
@@ -482,40 +719,147 @@ switch_bool_t serversVerifyDynamicIdentity(server_t *pServer)
 
 	switch_mutex_lock(pServer->mutex);
 	last_verified = pServer->last_verified;
-	switch_copy_string(url, pServer->pUrl ? pServer->pUrl : "", sizeof(url));
-	switch_copy_string(pod_ip, pServer->pod_ip ? pServer->pod_ip : "", sizeof(pod_ip));
+	mismatch = pServer->identity_mismatch;
 	switch_mutex_unlock(pServer->mutex);
 
-	if (last_verified && (switch_time_now() - last_verified) < SERVER_VERIFY_TTL_US) {
+	if (mismatch) {
+		return SWITCH_FALSE;
+	}
+
+	if (last_verified && (switch_time_now() - last_verified) < SERVER_VERIFY_MAX_AGE_US) {
 		return SWITCH_TRUE;
 	}
 
-	if (zstr(pod_ip) || !serversParseHttpUrlParts(url, host, sizeof(host), port, sizeof(port), path, sizeof(path))) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
-			"Cannot verify Janus pod=%s: missing ip/url (ip=%s url=%s)\n",
-			pServer->name, zstr(pod_ip) ? "<none>" : pod_ip, zstr(url) ? "<none>" : url);
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
+		"Janus pod=%s identity not verified for %" SWITCH_INT64_T_FMT "ms; mapping may be stale\n",
+		pServer->name, (int64_t) ((switch_time_now() - last_verified) / 1000));
+
+	return SWITCH_FALSE;
+}
+
+typedef struct {
+	switch_time_t now;
+	unsigned int removed;
+} registry_unknown_prune_t;
+
+static switch_bool_t serversRegistryUnknownExpired(const void *pKey, const void *pVal, void *pData)
+{
+	registry_unknown_prune_t *pPrune = (registry_unknown_prune_t *) pData;
+
+	(void) pKey;
+
+	if (pPrune->now && *(const switch_time_t *) pVal > pPrune->now) {
 		return SWITCH_FALSE;
 	}
+	free((void *) pVal);
+	pPrune->removed++;
+	return SWITCH_TRUE;
+}
 
-	if (zstr(path)) {
-		switch_copy_string(path, "/janus", sizeof(path));
+// called with the registry lock held
+static void serversRegistryUnknownPrune(const switch_time_t now)
+{
+	registry_unknown_prune_t prune;
+
+	if (!globals.pRegistryUnknown) {
+		return;
+	}
+
+	prune.now = now;
+	prune.removed = 0;
+	(void) switch_core_hash_delete_multi(globals.pRegistryUnknown, serversRegistryUnknownExpired, &prune);
+	globals.registry_unknown_count -= prune.removed;
+}
+
+// called with the registry lock held
+static void serversRegistryKnown(const char *pod_name)
+{
+	switch_time_t *pExpires;
+
+	if (globals.registry_unknown_count &&
+			(pExpires = (switch_time_t *) switch_core_hash_delete(globals.pRegistryUnknown, pod_name))) {
+		free(pExpires);
+		globals.registry_unknown_count--;
 	}
+}
+
+// runs under the registry lock for each pod the refresh added, moved or lost
+static switch_bool_t serversRegistryChange(const registry_change_t change, const registry_endpoint_t *pOld,
+	const registry_endpoint_t *pNew, void *pUserData)
+{
+	registry_apply_t *pApply = (registry_apply_t *) pUserData;
+	server_t *pServer;
+	unsigned int calls;
+
+	switch_mutex_lock(globals.mutex);
+	pServer = serversFind(change == REGISTRY_REMOVED ? pOld->pod_name : pNew->pod_name);
+
+	switch (change) {
+	case REGISTRY_ADDED:
+		serversRegistryKnown(pNew->pod_name);
+		if (!pServer) {
+			pServer = serversCreateRegistryServer(pNew->pod_name, pNew->pod_ip, pNew->url);
+			pApply->ppStart[pApply->start_count++] = pServer;
+			break;
+		}
+		/* fall through - e.g. a pod that was removed while it still had calls */
+	case REGISTRY_CHANGED:
+		if (pServer && switch_test_flag(pServer, SFLAG_DYNAMIC)) {
+			serversUpdateRegistryServer(pServer, pNew->pod_ip, pNew->url);
+			if (!switch_test_flag(pServer, SFLAG_ENABLED)) {
+				pApply->ppStart[pApply->start_count++] = pServer;
+			}
+		}
+		break;
+	case REGISTRY_REMOVED:
+		if (!pServer || !switch_test_flag(pServer, SFLAG_DYNAMIC)) {
+			break;
+		}
 
-	if (serversProbeJanusPodAtIp(pod_ip, port, path, pod_name, sizeof(pod_name)) &&
-			!strcmp(pod_name, pServer->name)) {
 		switch_mutex_lock(pServer->mutex);
-		pServer->last_verified = switch_time_now();
-		pServer->last_activity = pServer->last_verified;
-		pServer->connect_failures = 0;
+		calls = pServer->callsInProgress;
 		switch_mutex_unlock(pServer->mutex);
-		return SWITCH_TRUE;
+
+		if (calls > 0) {
+			switch_mutex_unlock(globals.mutex);
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO,
+				"Headless Janus pod=%s no longer in registry but has active calls; keeping server\n", pServer->name);
+			pApply->kept++;
+			return SWITCH_FALSE;
+		}
+		pApply->ppEvict[pApply->evict_count++] = pServer;
+		break;
 	}
 
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
-		"Janus pod=%s identity check failed at ip=%s (server-name=%s); mapping is stale\n",
-		pServer->name, pod_ip, zstr(pod_name) ? "<none>" : pod_name);
+	switch_mutex_unlock(globals.mutex);
+	return SWITCH_TRUE;
+}
 
-	return SWITCH_FALSE;
+// the server has left the lookup (e.g. evicted after failing to connect) so
+// the next refresh that finds the pod registers it again
+static void serversRegistryForget(const char *pod_name)
+{
+	registry_endpoint_t *pEndpoint;
+
+	switch_mutex_lock(globals.registry_mutex);
+	if ((pEndpoint = registryFind(globals.pRegistry, pod_name))) {
+		pEndpoint->gone = SWITCH_TRUE;
+	}
+	switch_mutex_unlock(globals.registry_mutex);
+}
+
+static switch_time_t serversRegistryProbeLatency(const char *pod_name)
+{
+	registry_endpoint_t *pEndpoint;
+	switch_time_t latency = 0;
+
+	switch_mutex_lock(globals.registry_mutex);
+	if ((pEndpoint = registryFind(globals.pRegistry, pod_name))) {
+		latency = pEndpoint->latency;
+	}
+	switch_mutex_unlock(globals.registry_mutex);
+
+	return latency;
 }
 
 switch_status_t serversRegistryRefresh(void)
@@ -523,16 +867,16 @@ switch_status_t serversRegistryRefresh(void)
 	char headless_host[256];
 	char port[16];
 	char path[128];
+	char url[512];
 	struct addrinfo hints, *res, *rp;
-	registry_endpoint_t endpoints[REGISTRY_MAX_ENDPOINTS];
-	server_t *evict_list[REGISTRY_MAX_ENDPOINTS];
-	int endpoint_count = 0;
-	int evict_count = 0;
-	switch_hash_t *seen_pods = NULL;
-	switch_hash_index_t *pIndex = NULL;
-	server_t *pServer;
+	registry_probe_batch_t *pBatch;
+	registry_snapshot_t *pSnapshot;
+	registry_snapshot_t *pPrevious;
+	registry_apply_t apply;
+	uint32_t changes, version, pods;
+	uint32_t *pAddrs;
+	int addr_count = 0;
 	int i;
-	switch_status_t status = SWITCH_STATUS_SUCCESS;
 
 	if (zstr(globals.headless_service_url) || !globals.pod_defaults) {
 		return SWITCH_STATUS_FALSE;
@@ -559,120 +903,329 @@ switch_status_t serversRegistryRefresh(void)
 		return SWITCH_STATUS_FALSE;
 	}
 
-	for (rp = res; rp && endpoint_count < REGISTRY_MAX_ENDPOINTS; rp = rp->ai_next) {
-		char ip[INET_ADDRSTRLEN];
-		char pod_name[64];
+	for (rp = res; rp; rp = rp->ai_next) {
+		addr_count++;
+	}
+
+	if (!(pBatch = serversProbeBatchCreate(addr_count))) {
+		freeaddrinfo(res);
+		return SWITCH_STATUS_MEMERR;
+	}
+	pAddrs = switch_core_alloc(pBatch->pPool, sizeof(uint32_t) * (addr_count ? addr_count : 1));
+
+	for (rp = res; rp; rp = rp->ai_next) {
+		const struct in_addr *pAddr;
 		int j;
-		switch_bool_t duplicate = SWITCH_FALSE;
 
 		if (rp->ai_family != AF_INET) {
 			continue;
 		}
 
-		if (!inet_ntop(AF_INET, &((struct sockaddr_in *) rp->ai_addr)->sin_addr, ip, sizeof(ip))) {
+		// the lookup repeats each address per protocol
+		pAddr = &((struct sockaddr_in *) rp->ai_addr)->sin_addr;
+		for (j = 0; j < pBatch->count && pAddrs[j] != pAddr->s_addr; j++);
+		if (j < pBatch->count) {
 			continue;
 		}
 
-		if (!serversProbeJanusPodAtIp(ip, port, path, pod_name, sizeof(pod_name))) {
+		if (!inet_ntop(AF_INET, pAddr, pBatch->probes[pBatch->count].pod_ip, INET_ADDRSTRLEN)) {
 			continue;
 		}
+		pAddrs[pBatch->count++] = pAddr->s_addr;
+	}
 
-		for (j = 0; j < endpoint_count; j++) {
-			if (!strcmp(endpoints[j].pod_name, pod_name)) {
-				duplicate = SWITCH_TRUE;
-				break;
-			}
-		}
-		if (duplicate) {
+	freeaddrinfo(res);
+
+	serversProbeBatchRun(pBatch, port, path);
+
+	if (!(pSnapshot = registryCreate((uint32_t) pBatch->count))) {
+		serversProbeBatchRelease(pBatch);
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	switch_mutex_lock(pBatch->pMutex);
+	for (i = 0; i < pBatch->count; i++) {
+		registry_probe_t *pProbe = &pBatch->probes[i];
+
+		if (!pProbe->done || !pProbe->ok) {
 			continue;
 		}
 
-		endpoints[endpoint_count].url = serversBuildJanusUrl(ip, port, path);
-		switch_copy_string(endpoints[endpoint_count].pod_name, pod_name, sizeof(endpoints[endpoint_count].pod_name));
-		switch_copy_string(endpoints[endpoint_count].pod_ip, ip, sizeof(endpoints[endpoint_count].pod_ip));
-		endpoint_count++;
+		serversBuildJanusUrl(url, sizeof(url), pProbe->pod_ip, port, path);
+		(void) registryAdd(pSnapshot, pProbe->pod_name, pProbe->pod_ip, url, pProbe->latency);
+	}
+	switch_mutex_unlock(pBatch->pMutex);
+	serversProbeBatchRelease(pBatch);
+
+	registrySeal(pSnapshot);
+
+	memset(&apply, 0, sizeof(apply));
+
+	// only the pods that changed since the last refresh touch the server list
+	switch_mutex_lock(globals.registry_mutex);
+	pPrevious = globals.pRegistry;
+	apply.ppStart = malloc(sizeof(server_t *) * (pSnapshot->count + 1));
+	apply.ppEvict = malloc(sizeof(server_t *) * ((pPrevious ? pPrevious->count : 0) + 1));
+	if (!apply.ppStart || !apply.ppEvict) {
+		switch_mutex_unlock(globals.registry_mutex);
+		switch_safe_free(apply.ppStart);
+		switch_safe_free(apply.ppEvict);
+		registryDestroy(&pSnapshot);
+		return SWITCH_STATUS_MEMERR;
 	}
+	changes = registryDiff(pPrevious, pSnapshot, serversRegistryChange, &apply);
+	globals.pRegistry = pSnapshot;
+	version = pSnapshot->version;
+	pods = pSnapshot->count;
+	switch_mutex_unlock(globals.registry_mutex);
 
-	freeaddrinfo(res);
+	registryDestroy(&pPrevious);
 
-	switch_core_hash_init(&seen_pods);
-	switch_mutex_lock(globals.mutex);
+	if (globals.start_server_thread) {
+		for (i = 0; i < apply.start_count; i++) {
+			globals.start_server_thread(apply.ppStart[i], SWITCH_TRUE);
+		}
+	}
 
-	for (i = 0; i < endpoint_count; i++) {
-		pServer = serversFind(endpoints[i].pod_name);
-		if (!pServer) {
-			(void) serversCreateRegistryServer(endpoints[i].pod_name, endpoints[i].pod_ip, endpoints[i].url);
-		} else if (switch_test_flag(pServer, SFLAG_DYNAMIC)) {
-			serversUpdateRegistryServer(pServer, endpoints[i].pod_ip, endpoints[i].url);
-			if (!switch_test_flag(pServer, SFLAG_ENABLED) && globals.start_server_thread) {
-				globals.start_server_thread(pServer, SWITCH_TRUE);
-			}
+	for (i = 0; i < apply.evict_count; i++) {
+		server_t *pServer = apply.ppEvict[i];
+
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO,
+			"Removing headless Janus pod=%s from registry\n", pServer->name);
+		switch_set_flag(pServer, SFLAG_EVICTED);
+		if (globals.stop_server_thread) {
+			globals.stop_server_thread(pServer);
+		} else {
+			serversDynamicRemoveFromLookup(pServer);
+		}
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG,
+		"Headless Janus registry refresh: %u pod(s) from %s, %u change(s) (%d started, %d removed, %d kept), version %u\n",
+		pods, headless_host, changes, apply.start_count, apply.evict_count, apply.kept, version);
+
+	free(apply.ppStart);
+	free(apply.ppEvict);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* Refreshes the registry unless a refresh (for a dial or the registry
+ * thread) is already running, in which case its result will do and this
+ * waits for it instead.  Called with the registry lock held; returns with it
+ * released. */
+static switch_status_t serversRegistryRefreshShared(void)
+{
+	switch_time_t now = switch_time_now();
+	switch_time_t deadline = now + REGISTRY_DIAL_WAIT_US;
+	unsigned int generation;
+	switch_status_t status;
+
+	if (globals.registry_refreshing) {
+		generation = globals.registry_generation;
+		while (globals.registry_refreshing && generation == globals.registry_generation && now < deadline) {
+			(void) switch_thread_cond_timedwait(globals.registry_cond, globals.registry_mutex, deadline - now);
+			now = switch_time_now();
+		}
+		status = (generation != globals.registry_generation) ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_TIMEOUT;
+		switch_mutex_unlock(globals.registry_mutex);
+	} else {
+		globals.registry_refreshing = SWITCH_TRUE;
+		switch_mutex_unlock(globals.registry_mutex);
+
+		status = serversRegistryRefresh();
+
+		switch_mutex_lock(globals.registry_mutex);
+		globals.registry_refreshing = SWITCH_FALSE;
+		globals.registry_generation++;
+		(void) switch_thread_cond_broadcast(globals.registry_cond);
+		switch_mutex_unlock(globals.registry_mutex);
+	}
+
+	return status;
+}
+
+switch_status_t serversRegistryRefreshForDial(const char *pod_name)
+{
+	switch_time_t now = switch_time_now();
+	switch_time_t *pExpires;
+	switch_status_t status;
+
+	switch_mutex_lock(globals.registry_mutex);
+
+	if (!zstr(pod_name) && globals.pRegistryUnknown &&
+			(pExpires = (switch_time_t *) switch_core_hash_find(globals.pRegistryUnknown, pod_name)) && *pExpires > now) {
+		switch_mutex_unlock(globals.registry_mutex);
+		DEBUG(SWITCH_CHANNEL_LOG, "Headless Janus pod=%s was not found by a recent refresh\n", pod_name);
+		return SWITCH_STATUS_NOTFOUND;
+	}
+
+	status = serversRegistryRefreshShared();
+
+	if (status != SWITCH_STATUS_SUCCESS || zstr(pod_name) || serversFind(pod_name)) {
+		return status;
+	}
+
+	// remember the miss so further calls to it don't each start a refresh
+	switch_mutex_lock(globals.registry_mutex);
+	if (globals.pRegistryUnknown) {
+		now = switch_time_now();
+		if (globals.registry_unknown_count >= REGISTRY_UNKNOWN_PRUNE) {
+			serversRegistryUnknownPrune(now);
+		}
+
+		if ((pExpires = (switch_time_t *) switch_core_hash_find(globals.pRegistryUnknown, pod_name))) {
+			*pExpires = now + REGISTRY_UNKNOWN_TTL_US;
+		} else if (globals.registry_unknown_count < REGISTRY_UNKNOWN_PRUNE) {
+			switch_zmalloc(pExpires, sizeof(*pExpires));
+			*pExpires = now + REGISTRY_UNKNOWN_TTL_US;
+			switch_core_hash_insert(globals.pRegistryUnknown, pod_name, pExpires);
+			globals.registry_unknown_count++;
 		}
-		switch_core_hash_insert(seen_pods, endpoints[i].pod_name, (void *) 1);
+	}
+	switch_mutex_unlock(globals.registry_mutex);
+
+	return SWITCH_STATUS_NOTFOUND;
+}
+
+/* Checks every registry pod is still the one answering at its address, all
+ * at once like a refresh. A pod that answers with another name is marked so
+ * dials to it stop straight away; returns how many were. */
+static unsigned int serversVerifyRegistryServers(void)
+{
+	char headless_host[256];
+	char port[16];
+	char path[128];
+	registry_probe_batch_t *pBatch;
+	switch_hash_index_t *pIndex = NULL;
+	server_t **ppServers;
+	server_t *pServer;
+	unsigned int mismatches = 0;
+	int count = 0;
+	int i;
+
+	if (zstr(globals.headless_service_url) || !serversParseHttpUrlParts(globals.headless_service_url, headless_host,
+			sizeof(headless_host), port, sizeof(port), path, sizeof(path))) {
+		return 0;
+	}
+
+	if (zstr(path)) {
+		switch_copy_string(path, "/janus", sizeof(path));
+	}
+
+	switch_mutex_lock(globals.mutex);
+	while (serversIterate(&pIndex)) {
+		count++;
 	}
 
+	if (!count || !(pBatch = serversProbeBatchCreate(count))) {
+		switch_mutex_unlock(globals.mutex);
+		return 0;
+	}
+	ppServers = switch_core_alloc(pBatch->pPool, sizeof(server_t *) * count);
+
 	pIndex = NULL;
 	while ((pServer = serversIterate(&pIndex)) != NULL) {
-		if (!switch_test_flag(pServer, SFLAG_DYNAMIC)) {
+		if (!switch_test_flag(pServer, SFLAG_DYNAMIC) || !switch_test_flag(pServer, SFLAG_ENABLED)) {
 			continue;
 		}
 
-		if (switch_core_hash_find(seen_pods, pServer->name)) {
+		switch_mutex_lock(pServer->mutex);
+		if (!zstr(pServer->pod_ip)) {
+			switch_copy_string(pBatch->probes[pBatch->count].pod_ip, pServer->pod_ip, INET_ADDRSTRLEN);
+			ppServers[pBatch->count++] = pServer;
+		}
+		switch_mutex_unlock(pServer->mutex);
+	}
+	switch_mutex_unlock(globals.mutex);
+
+	serversProbeBatchRun(pBatch, port, path);
+
+	switch_mutex_lock(pBatch->pMutex);
+	for (i = 0; i < pBatch->count; i++) {
+		registry_probe_t *pProbe = &pBatch->probes[i];
+
+		// a pod that doesn't answer keeps its verdict until it gets too old
+		if (!pProbe->done || !pProbe->ok) {
 			continue;
 		}
 
+		pServer = ppServers[i];
 		switch_mutex_lock(pServer->mutex);
-		if (pServer->callsInProgress > 0) {
+		// skip a server the refresh has moved since
+		if (!pServer->pod_ip || strcmp(pServer->pod_ip, pProbe->pod_ip)) {
 			switch_mutex_unlock(pServer->mutex);
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO,
-				"Headless Janus pod=%s no longer in registry but has active calls; keeping server\n", pServer->name);
 			continue;
 		}
+		if (!strcmp(pProbe->pod_name, pServer->name)) {
+			pServer->last_verified = switch_time_now();
+			pServer->identity_mismatch = SWITCH_FALSE;
+			switch_mutex_unlock(pServer->mutex);
+			continue;
+		}
+		pServer->identity_mismatch = SWITCH_TRUE;
 		switch_mutex_unlock(pServer->mutex);
 
-		if (evict_count < REGISTRY_MAX_ENDPOINTS) {
-			evict_list[evict_count++] = pServer;
-		}
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
+			"Janus pod=%s identity check failed at ip=%s (server-name=%s); mapping is stale\n",
+			pServer->name, pProbe->pod_ip, pProbe->pod_name);
+		mismatches++;
 	}
+	switch_mutex_unlock(pBatch->pMutex);
+	serversProbeBatchRelease(pBatch);
 
-	switch_mutex_unlock(globals.mutex);
-	switch_core_hash_destroy(&seen_pods);
+	return mismatches;
+}
 
-	for (i = 0; i < evict_count; i++) {
-		pServer = evict_list[i];
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO,
-			"Removing headless Janus pod=%s from registry\n", pServer->name);
-		switch_set_flag(pServer, SFLAG_EVICTED);
-		if (globals.stop_server_thread) {
-			globals.stop_server_thread(pServer);
-		} else {
-			serversDynamicRemoveFromLookup(pServer);
-		}
+// SWITCH_FALSE when woken by serversStopRegistry
+static switch_bool_t serversRegistrySleep(const switch_interval_time_t usec)
+{
+	switch_time_t now = switch_time_now();
+	const switch_time_t deadline = now + usec;
+	switch_bool_t terminating;
+
+	switch_mutex_lock(globals.registry_mutex);
+	while (!globals.registry_terminating && now < deadline) {
+		(void) switch_thread_cond_timedwait(globals.registry_stop_cond, globals.registry_mutex, deadline - now);
+		now = switch_time_now();
 	}
+	terminating = globals.registry_terminating;
+	switch_mutex_unlock(globals.registry_mutex);
 
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG,
-		"Headless Janus registry refresh: %d pod(s) from %s\n", endpoint_count, headless_host);
-
-	return status;
+	return terminating ? SWITCH_FALSE : SWITCH_TRUE;
 }
 
 static void *SWITCH_THREAD_FUNC servers_registry_run(switch_thread_t *pThread, void *pObj)
 {
-	unsigned int refresh_usec;
+	switch_time_t refresh_usec;
+	switch_time_t next_refresh;
+	unsigned int mismatches;
 
 	(void) pThread;
 	(void) pObj;
 
-	refresh_usec = (globals.registry_refresh_sec ? globals.registry_refresh_sec : 30) * 1000000;
+	refresh_usec = (switch_time_t) (globals.registry_refresh_sec ? globals.registry_refresh_sec : 30) * 1000000;
 
-	(void) serversRegistryRefresh();
+	switch_mutex_lock(globals.registry_mutex);
+	(void) serversRegistryRefreshShared();
+	next_refresh = switch_time_now() + refresh_usec;
 
-	while (!globals.registry_terminating) {
-		switch_yield(refresh_usec);
-		if (globals.registry_terminating || zstr(globals.headless_service_url)) {
+	// check identities between refreshes and refresh early when one has moved
+	while (serversRegistrySleep(SERVER_VERIFY_TTL_US)) {
+		if (zstr(globals.headless_service_url)) {
 			break;
 		}
-		(void) serversRegistryRefresh();
+		mismatches = serversVerifyRegistryServers();
+		// the checks can take a probe deadline - don't follow them with a refresh once stopping
+		if (globals.registry_terminating) {
+			break;
+		}
+		if (mismatches || switch_time_now() >= next_refresh) {
+			// shared with the dials so a dial's refresh isn't repeated straight away
+			switch_mutex_lock(globals.registry_mutex);
+			(void) serversRegistryRefreshShared();
+			next_refresh = switch_time_now() + refresh_usec;
+		}
 	}
 
 	return NULL;
@@ -697,18 +1250,39 @@ void serversStopRegistry(void)
 	switch_status_t status;
 	switch_status_t returnValue;
 
-	if (!globals.registry_thread) {
-		return;
+	if (globals.registry_thread) {
+		switch_mutex_lock(globals.registry_mutex);
+		globals.registry_terminating = SWITCH_TRUE;
+		(void) switch_thread_cond_signal(globals.registry_stop_cond);
+		switch_mutex_unlock(globals.registry_mutex);
+		status = switch_thread_join(&returnValue, globals.registry_thread);
+		globals.registry_thread = NULL;
+
+		if (status != SWITCH_STATUS_SUCCESS || returnValue != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
+				"Headless registry thread join status=%d return=%d\n", status, returnValue);
+		}
 	}
 
-	globals.registry_terminating = SWITCH_TRUE;
-	status = switch_thread_join(&returnValue, globals.registry_thread);
-	globals.registry_thread = NULL;
+	switch_mutex_lock(globals.registry_mutex);
+	registryDestroy(&globals.pRegistry);
+	if (globals.pRegistryUnknown) {
+		serversRegistryUnknownPrune(0);
+		switch_core_hash_destroy(&globals.pRegistryUnknown);
+	}
+	switch_mutex_unlock(globals.registry_mutex);
+}
 
-	if (status != SWITCH_STATUS_SUCCESS || returnValue != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
-			"Headless registry thread join status=%d return=%d\n", status, returnValue);
+// the server's session has been created or claimed - wake the dials waiting for it
+void serversSignalActive(server_t *pServer)
+{
+	switch_assert(pServer);
+
+	switch_mutex_lock(pServer->mutex);
+	if (pServer->activeWaiters) {
+		(void) switch_thread_cond_broadcast(pServer->pActiveCond);
 	}
+	switch_mutex_unlock(pServer->mutex);
 }
 
 void serversDynamicRecordActivity(server_t *pServer)
@@ -784,6 +1358,10 @@ void serversDynamicRemoveFromLookup(server_t *pServer)
 	switch_assert(pServer);
 	switch_assert(globals.pServerNameLookup);
 
+	if (switch_test_flag(pServer, SFLAG_DYNAMIC)) {
+		serversRegistryForget(pServer->name);
+	}
+
 	switch_mutex_lock(globals.mutex);
 
 	if (!switch_test_flag(pServer, SFLAG_DYNAMIC)) {
@@ -809,6 +1387,10 @@ void serversDynamicRemoveFromLookup(server_t *pServer)
 	switch_core_hash_delete(globals.pServerNameLookup, name);
 	switch_clear_flag_locked(pServer, SFLAG_ENABLED);
 
+	// the pod has gone so there is no point keeping connections open to it,
+	// and the server is no longer in the lookup for serversDestroy to find
+	httpPoolDestroy(&pServer->pHttpPool);
+
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO,
 		"Evicted dynamic server=%s\n", name);
 
@@ -819,21 +1401,29 @@ switch_status_t serversSummary(switch_stream_handle_t *pStream) {
   switch_hash_index_t *pIndex = NULL;
 	server_t *pServer;
   char text[512];
+  unsigned int httpHits, httpMisses, httpConnects;
+  switch_time_t probeLatency;
 
   switch_assert(globals.pServerNameLookup);
 
-  pStream->write_function(pStream, "name|enabled|registry|pod_ip|url|totalCalls|callsInProgress|started|id\n");
+  pStream->write_function(pStream, "name|enabled|registry|pod_ip|url|totalCalls|callsInProgress|started|id|httpHits|httpMisses|httpConnects"
+		"|teardownQueued|teardownDrainAvgUs|teardownDrainMaxUs|teardownFailures|probeLatencyUs\n");
   while ((pServer = serversIterate(&pIndex)) != NULL) {
+    httpPoolStats(pServer->pHttpPool, &httpHits, &httpMisses, &httpConnects);
+    probeLatency = switch_test_flag(pServer, SFLAG_DYNAMIC) ? serversRegistryProbeLatency(pServer->name) : 0;
+
     switch_mutex_lock(pServer->mutex);
     (void) snprintf(text, sizeof(text),
-		"%s|%s|%s|%s|%s|%u|%u|%" SWITCH_INT64_T_FMT "|%" SWITCH_UINT64_T_FMT "\n",
+		"%s|%s|%s|%s|%s|%u|%u|%" SWITCH_INT64_T_FMT "|%" SWITCH_UINT64_T_FMT "|%u|%u|%u|%u|%" SWITCH_INT64_T_FMT "|%" SWITCH_INT64_T_FMT "|%u|%" SWITCH_INT64_T_FMT "\n",
 		pServer->name,
         switch_test_flag(pServer, SFLAG_ENABLED) ? "true" : "false",
 		switch_test_flag(pServer, SFLAG_DYNAMIC) ? "true" : "false",
 		pServer->pod_ip ? pServer->pod_ip : "",
 		pServer->pUrl ? pServer->pUrl : "",
 		pServer->totalCalls,
-        pServer->callsInProgress, pServer->started, pServer->serverId);
+        pServer->callsInProgress, pServer->started, pServer->serverId, httpHits, httpMisses, httpConnects,
+		pServer->teardownQueued, pServer->teardownDrainAvg, pServer->teardownDrainMax, pServer->teardownFailures,
+		probeLatency);
     switch_mutex_unlock(pServer->mutex);
 
     pStream->write_function(pStream, text);
@@ -842,6 +1432,32 @@ switch_status_t serversSummary(switch_stream_handle_t *pStream) {
   return SWITCH_STATUS_SUCCESS;
 }
 
+switch_status_t serversStats(switch_stream_handle_t *pStream) {
+  switch_hash_index_t *pIndex = NULL;
+	server_t *pServer;
+  char text[512];
+
+  switch_assert(globals.pServerNameLookup);
+
+  pStream->write_function(pStream, "name|pollOutstanding|pollMaxEvents|pollEvents|pollLatencyAvgUs|pollLatencyMaxUs"
+		"|dispatchQueued|dispatchLagAvgUs|dispatchLagMaxUs|handlesPooled|handleHits|handleMisses"
+		"|roomsCached|roomHits|roomMisses|dialsWaiting\n");
+  while ((pServer = serversIterate(&pIndex)) != NULL) {
+    switch_mutex_lock(pServer->mutex);
+    (void) snprintf(text, sizeof(text),
+		"%s|%u|%u|%u|%" SWITCH_INT64_T_FMT "|%" SWITCH_INT64_T_FMT "|%u|%" SWITCH_INT64_T_FMT "|%" SWITCH_INT64_T_FMT "|%u|%u|%u|%u|%u|%u|%u\n",
+		pServer->name, pServer->pollOutstanding, pServer->pollMaxEvents, pServer->pollEvents,
+		pServer->pollLatencyAvg, pServer->pollLatencyMax,
+		pServer->dispatchQueued, pServer->dispatchLagAvg, pServer->dispatchLagMax,
+		pServer->handleCount, pServer->handleHits, pServer->handleMisses,
+		pServer->roomCount, pServer->roomHits, pServer->roomMisses, pServer->activeWaiters);
+    switch_mutex_unlock(pServer->mutex);
+
+    pStream->write_function(pStream, text);
+  }
+  return SWITCH_STATUS_SUCCESS;
+}
+
 server_t *serversFind(const char * const pName) {
   switch_assert(globals.pServerNameLookup);
 
@@ -869,6 +1485,19 @@ server_t *serversIterate(switch_hash_index_t **pIndex) {
 }
 
 switch_status_t serversDestroy() {
+	switch_hash_index_t *pIndex = NULL;
+	server_t *pServer;
+
+	while ((pServer = serversIterate(&pIndex)) != NULL) {
+		httpPoolDestroy(&pServer->pHttpPool);
+		// the threads that look up the server's calls have all stopped
+		(void) hashDestroy(&pServer->senderIdLookup);
+		// pods share the cache of the server their defaults came from
+		if (!switch_test_flag(pServer, SFLAG_DYNAMIC)) {
+			authCacheDestroy(pServer->pAuthCache);
+		}
+	}
+
 	return switch_core_hash_destroy(&globals.pServerNameLookup);
 }
 /* For Emacs:
@@ -35,6 +35,8 @@
 
 #include	"switch.h"
 #include	"hash.h"
+#include	"http.h"
+#include	"auth.h"
 
 typedef enum {
 	SFLAG_ENABLED        = (1 << 0),
@@ -46,9 +48,21 @@ typedef enum {
 
 typedef enum {
 	JANUS_TP_HTTP = 0,
-	JANUS_TP_WS
+	JANUS_TP_WS,
+	JANUS_TP_UNIX,
+	JANUS_TP_COUNT
 } janus_transport_t;
 
+typedef enum {
+	SERVER_LOOP_START = 0,
+	SERVER_LOOP_CONNECT,
+	SERVER_LOOP_CONNECTING,
+	SERVER_LOOP_POLL,
+	SERVER_LOOP_DONE
+} server_loop_state_t;
+
+typedef struct server_loop_s server_loop_t;
+
 typedef struct server_s {
 	char *name;
 	char *pUrl;
@@ -60,6 +74,9 @@ typedef struct server_s {
 	 * well as to the audiobridge join body so that per-room signed_tokens
 	 * enforcement (PR #3635) accepts them. */
 	char *pHmacSecret;
+	auth_ctx_t *pAuth; /* signing context prepared from pHmacSecret */
+	unsigned int hmacTokenRefresh; /* percent of a token's lifetime it is reused for */
+	auth_cache_t *pAuthCache; /* signed tokens; shared by the pods cloned from this server */
 	char *pod_ip;
 	switch_thread_t *pThread;
 
@@ -73,6 +90,11 @@ typedef struct server_s {
 	char *rtpip6;
 	char *codec_string;
 
+	unsigned int httpPoolSize;
+	unsigned int httpPoolIdleTimeout;
+	switch_bool_t http2; /* http-version 2 - multiplex the pool's requests on one connection */
+	http_pool_t *pHttpPool; /* keep-alive handles for REST requests; keeps none with http-pool-size 0 */
+
 	switch_mutex_t *flag_mutex;
 	unsigned int flags;
 
@@ -90,11 +112,68 @@ typedef struct server_s {
 	unsigned int callsInProgress;
 
 	janus_transport_t transport;
+	const struct transport_s *pTransport; /* the registered ops for transport (transport.h) */
 	void *janus_ws_handle; /* janus_ws_ctx_t when transport == JANUS_TP_WS */
-	switch_time_t ws_last_poll; /* WebSocket keepalive / activity timestamp */
+	void *janus_unix_handle; /* janus_unix_ctx_t when transport == JANUS_TP_UNIX */
+	switch_time_t ws_last_poll; /* WebSocket / Unix socket keepalive and activity timestamp */
 	switch_time_t last_activity; /* last use or successful Janus contact (dynamic servers) */
 	unsigned int connect_failures; /* consecutive REST connect/register failures */
 	switch_time_t last_verified; /* last /info pod-identity confirmation (dynamic servers) */
+	switch_bool_t identity_mismatch; /* another pod answered at pod_ip - don't dial until a refresh */
+
+	/* HTTP long-poll (janus_http.c); the queue holds events as they arrive and completed polls */
+	switch_queue_t *pPollQueue;
+	unsigned int pollOutstanding;
+	unsigned int pollMaxEvents;
+	unsigned int pollEvents;
+	switch_time_t pollLatencyAvg; /* usec from an event being received to its dispatch */
+	switch_time_t pollLatencyMax;
+
+	/* pre-attached audiobridge handles (handles.c) */
+	unsigned int handlePoolSize;
+	janus_id_t *pHandles;
+	unsigned int handleCount;
+	janus_id_t handleServerId; /* session the pooled handles are attached to */
+	switch_bool_t handleRefilling;
+	unsigned int handleHits;
+	unsigned int handleMisses;
+
+	/* rooms known to exist on the Janus session (rooms.c) */
+	unsigned int roomCacheTtl; /* seconds; 0 disables the cache */
+	switch_hash_t *pRooms;
+	switch_thread_cond_t *pRoomCond; /* signalled when a room create completes */
+	unsigned int roomCount;
+	unsigned int roomHits;
+	unsigned int roomMisses;
+
+	/* where the server's poll work has got to (mod_janus.c) and the shared
+	 * loop stepping it (loop.c) when it has no thread of its own */
+	server_loop_state_t loopState;
+	janus_id_t loopServerId;
+	switch_time_t loopNextAttempt; /* earliest (re)connect attempt */
+	server_loop_t *pLoop;
+	struct server_s *pLoopNext;
+	struct server_s *pConnectNext;
+	switch_bool_t loopConnecting;    /* on a connect thread - under mutex */
+	switch_bool_t loopConnectResult;
+	switch_thread_cond_t *pStopCond; /* signalled on pServer->mutex when the server is told to stop */
+
+	/* dials waiting for the Janus session to be created or claimed */
+	switch_thread_cond_t *pActiveCond; /* signalled once the session is in serverIdLookup */
+	unsigned int activeWaiters;
+
+	/* handles of hung up calls waiting to be detached (teardown.c) */
+	unsigned int teardownQueued;
+	unsigned int teardownFailures;
+	switch_time_t teardownDrainAvg; /* usec from hangup to the detach completing */
+	switch_time_t teardownDrainMax;
+	unsigned int teardownInFlight; /* detaches being sent - under the teardown lock */
+
+	/* events waiting in the dispatch stage (dispatch.c) */
+	unsigned int dispatchQueued;
+	switch_thread_cond_t *pDispatchCond; /* broadcast when dispatchQueued drops to 0 */
+	switch_time_t dispatchLagAvg; /* usec from being queued to a worker picking it up */
+	switch_time_t dispatchLagMax;
 } server_t;
 
 switch_status_t serversList(const char *pLine, const char *pCursor, switch_console_callback_match_t **matches);
@@ -104,15 +183,21 @@ switch_bool_t serversPodNameValid(const char *pod_name);
 void serversBindStartThread(void (*start_fn)(server_t *pServer, switch_bool_t wait_for_active));
 void serversBindStopThread(void (*stop_fn)(server_t *pServer));
 switch_status_t serversRegistryRefresh(void);
+/* Refresh on behalf of a call dialling pod_name: joins a refresh already in
+ * flight rather than starting another, and skips the refresh altogether for
+ * a pod name that a recent one could not find. */
+switch_status_t serversRegistryRefreshForDial(const char *pod_name);
 switch_bool_t serversVerifyDynamicIdentity(server_t *pServer);
 void serversStartRegistry(void);
 void serversStopRegistry(void);
+void serversSignalActive(server_t *pServer);
 void serversDynamicRecordActivity(server_t *pServer);
 void serversDynamicRecordConnectFailure(server_t *pServer);
 void serversDynamicResetConnectFailures(server_t *pServer);
 switch_bool_t serversDynamicEvictable(server_t *pServer, switch_bool_t *pIdle, switch_bool_t *pFail);
 void serversDynamicRemoveFromLookup(server_t *pServer);
 switch_status_t serversSummary(switch_stream_handle_t *pStream);
+switch_status_t serversStats(switch_stream_handle_t *pStream);
 server_t *serversFind(const char * const pName);
 server_t *serversIterate(switch_hash_index_t **pIndex);
 switch_status_t serversDestroy();
@@ -0,0 +1,327 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ * teardown.c -- Call teardown functions for janus endpoint module
+ *
+ */
+#include  "switch.h"
+
+#include  "globals.h"
+#include  "api.h"
+#include  "teardown.h"
+
+#define TEARDOWN_QUEUE_SIZE 4096
+#define TEARDOWN_MAX_ATTEMPTS 3
+#define TEARDOWN_RETRY_US 500000
+
+typedef struct teardown_job_s {
+	server_t *pServer;
+	janus_id_t serverId;
+	janus_id_t senderId;
+	switch_time_t queued;
+	// a retry waits in the queue until then rather than on a worker
+	switch_time_t due;
+	unsigned int attempts;
+	struct teardown_job_s *pNext;
+} teardown_job_t;
+
+static struct {
+	switch_mutex_t *pMutex;
+	switch_thread_cond_t *pCond;
+	// jobs in the order they were queued (or last retried)
+	teardown_job_t *pHead;
+	teardown_job_t *pTail;
+	unsigned int backlog;
+	// the most workers one server's detaches may hold at once
+	unsigned int serverMax;
+	switch_thread_t **pThreads;
+	unsigned int count;
+	switch_bool_t running;
+} teardown;
+
+static switch_bool_t teardownRunning(void) {
+	switch_bool_t running;
+
+	if (!teardown.pMutex) {
+		return SWITCH_FALSE;
+	}
+
+	switch_mutex_lock(teardown.pMutex);
+	running = teardown.running;
+	switch_mutex_unlock(teardown.pMutex);
+
+	return running;
+}
+
+// a failed detach is only worth repeating if Janus didn't answer and the
+// handle's session is still the server's current one
+static switch_bool_t teardownRetry(teardown_job_t *pJob, switch_status_t status) {
+	janus_id_t serverId;
+
+	if (status != SWITCH_STATUS_SOCKERR || pJob->attempts >= TEARDOWN_MAX_ATTEMPTS || !teardownRunning() ||
+			switch_test_flag(pJob->pServer, SFLAG_TERMINATING)) {
+		return SWITCH_FALSE;
+	}
+
+	switch_mutex_lock(pJob->pServer->mutex);
+	serverId = pJob->pServer->serverId;
+	switch_mutex_unlock(pJob->pServer->mutex);
+
+	return serverId == pJob->serverId ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+// sends the detach once - returns SWITCH_TRUE when it should be tried again
+static switch_bool_t teardownRun(teardown_job_t *pJob) {
+	server_t *pServer = pJob->pServer;
+	switch_status_t status;
+	switch_time_t drain;
+
+	status = apiDetach(pServer, pJob->serverId, pJob->senderId);
+	pJob->attempts ++;
+	if (status != SWITCH_STATUS_SUCCESS && teardownRetry(pJob, status)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Server=%s detach senderId=%" SWITCH_UINT64_T_FMT " no response - retrying\n",
+			pServer->name, pJob->senderId);
+		return SWITCH_TRUE;
+	}
+
+	if (status != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Server=%s failed to detach senderId=%" SWITCH_UINT64_T_FMT "\n",
+			pServer->name, pJob->senderId);
+	}
+
+	drain = switch_time_now() - pJob->queued;
+
+	switch_mutex_lock(pServer->mutex);
+	pServer->teardownQueued --;
+	pServer->teardownDrainAvg += (drain - pServer->teardownDrainAvg) / 8;
+	if (drain > pServer->teardownDrainMax) {
+		pServer->teardownDrainMax = drain;
+	}
+	if (status != SWITCH_STATUS_SUCCESS) {
+		pServer->teardownFailures ++;
+	}
+	switch_mutex_unlock(pServer->mutex);
+
+	return SWITCH_FALSE;
+}
+
+// must be called with teardown.pMutex held
+static void teardownAppend(teardown_job_t *pJob) {
+	pJob->pNext = NULL;
+	if (teardown.pTail) {
+		teardown.pTail->pNext = pJob;
+	} else {
+		teardown.pHead = pJob;
+	}
+	teardown.pTail = pJob;
+	teardown.backlog ++;
+}
+
+// Takes the first job that is due and whose server has a worker to spare,
+// waiting until there is one.  Once stopping, retries are no longer waited
+// for and NULL is returned when nothing is left.  Called with teardown.pMutex held
+static teardown_job_t *teardownNext(void) {
+	for (;;) {
+		const switch_time_t now = switch_time_now();
+		teardown_job_t *pJob, *pPrev = NULL;
+		switch_time_t wake = 0;
+
+		for (pJob = teardown.pHead; pJob; pPrev = pJob, pJob = pJob->pNext) {
+			if (pJob->pServer->teardownInFlight >= teardown.serverMax) {
+				continue;
+			}
+			if (pJob->due <= now || !teardown.running) {
+				break;
+			}
+			if (!wake || pJob->due < wake) {
+				wake = pJob->due;
+			}
+		}
+
+		if (pJob) {
+			if (pPrev) {
+				pPrev->pNext = pJob->pNext;
+			} else {
+				teardown.pHead = pJob->pNext;
+			}
+			if (teardown.pTail == pJob) {
+				teardown.pTail = pPrev;
+			}
+			teardown.backlog --;
+			pJob->pServer->teardownInFlight ++;
+			return pJob;
+		}
+		if (!teardown.running && !teardown.pHead) {
+			return NULL;
+		}
+
+		// a finished detach or a new job broadcasts
+		if (wake) {
+			(void) switch_thread_cond_timedwait(teardown.pCond, teardown.pMutex, wake - now);
+		} else {
+			(void) switch_thread_cond_wait(teardown.pCond, teardown.pMutex);
+		}
+	}
+}
+
+static void *SWITCH_THREAD_FUNC teardown_run(switch_thread_t *pThread, void *pObj) {
+	teardown_job_t *pJob;
+
+	(void) pThread;
+	(void) pObj;
+
+	DEBUG(SWITCH_CHANNEL_LOG, "Teardown worker started\n");
+
+	switch_mutex_lock(teardown.pMutex);
+	while ((pJob = teardownNext())) {
+		switch_bool_t retry;
+
+		switch_mutex_unlock(teardown.pMutex);
+		retry = teardownRun(pJob);
+		switch_mutex_lock(teardown.pMutex);
+
+		pJob->pServer->teardownInFlight --;
+		if (retry) {
+			pJob->due = switch_time_now() + TEARDOWN_RETRY_US * pJob->attempts;
+			teardownAppend(pJob);
+		} else {
+			free(pJob);
+		}
+		(void) switch_thread_cond_broadcast(teardown.pCond);
+	}
+	switch_mutex_unlock(teardown.pMutex);
+
+	DEBUG(SWITCH_CHANNEL_LOG, "Teardown worker stopped\n");
+
+	return NULL;
+}
+
+switch_status_t teardownStart(const unsigned int threads) {
+	switch_threadattr_t *pThreadAttr = NULL;
+	unsigned int i;
+
+	if (teardownRunning() || !threads) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (!teardown.pMutex) {
+		switch_mutex_init(&teardown.pMutex, SWITCH_MUTEX_NESTED, globals.pModulePool);
+		if (switch_thread_cond_create(&teardown.pCond, globals.pModulePool) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't create teardown condition\n");
+			return SWITCH_STATUS_FALSE;
+		}
+	}
+
+	teardown.pThreads = switch_core_alloc(globals.pModulePool, sizeof(*teardown.pThreads) * threads);
+	// a server that has stopped answering can only hold up half the workers
+	teardown.serverMax = threads > 1 ? threads / 2 : 1;
+
+	switch_mutex_lock(teardown.pMutex);
+	teardown.running = SWITCH_TRUE;
+	switch_mutex_unlock(teardown.pMutex);
+
+	for (i = 0; i < threads; i++) {
+		switch_threadattr_create(&pThreadAttr, globals.pModulePool);
+		switch_threadattr_stacksize_set(pThreadAttr, SWITCH_THREAD_STACKSIZE);
+		switch_thread_create(&teardown.pThreads[i], pThreadAttr, teardown_run, NULL, globals.pModulePool);
+	}
+
+	teardown.count = threads;
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Call teardown started with %u worker(s)\n", threads);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+void teardownStop(void) {
+	unsigned int i;
+
+	if (!teardownRunning()) {
+		return;
+	}
+
+	// new detaches are now sent on the calling thread, and the queued ones
+	// are sent once more without waiting for their retry
+	switch_mutex_lock(teardown.pMutex);
+	teardown.running = SWITCH_FALSE;
+	(void) switch_thread_cond_broadcast(teardown.pCond);
+	switch_mutex_unlock(teardown.pMutex);
+
+	for (i = 0; i < teardown.count; i++) {
+		switch_status_t returnValue;
+		(void) switch_thread_join(&returnValue, teardown.pThreads[i]);
+	}
+	teardown.count = 0;
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Call teardown stopped\n");
+}
+
+void teardownDetach(server_t *pServer, const janus_id_t serverId, const janus_id_t senderId) {
+	teardown_job_t *pJob;
+	switch_bool_t queued = SWITCH_FALSE;
+
+	switch_assert(pServer);
+
+	switch_zmalloc(pJob, sizeof(*pJob));
+	pJob->pServer = pServer;
+	pJob->serverId = serverId;
+	pJob->senderId = senderId;
+	pJob->queued = pJob->due = switch_time_now();
+
+	switch_mutex_lock(pServer->mutex);
+	pServer->teardownQueued ++;
+	switch_mutex_unlock(pServer->mutex);
+
+	if (teardown.pMutex) {
+		switch_mutex_lock(teardown.pMutex);
+		if (teardown.running && teardown.backlog < TEARDOWN_QUEUE_SIZE) {
+			teardownAppend(pJob);
+			(void) switch_thread_cond_broadcast(teardown.pCond);
+			queued = SWITCH_TRUE;
+		}
+		switch_mutex_unlock(teardown.pMutex);
+	}
+
+	if (!queued) {
+		while (teardownRun(pJob)) {
+			switch_yield(TEARDOWN_RETRY_US * pJob->attempts);
+		}
+		free(pJob);
+	}
+}
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
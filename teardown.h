@@ -0,0 +1,64 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ * teardown.h -- Call teardown headers for janus endpoint module
+ *
+ */
+#ifndef _TEARDOWN_H_
+#define _TEARDOWN_H_
+
+#include  "switch.h"
+#include  "servers.h"
+
+#define TEARDOWN_DEFAULT_THREADS 4
+
+// The handles of hung up calls are detached by a pool of workers so that the
+// session never waits on Janus - detaching the handle also takes the
+// participant out of the room.  The number of workers bounds the detaches in
+// flight, and no server may hold more than half of them so that a pod which
+// has stopped answering doesn't hold up the others.  A detach that got no
+// answer goes back on the queue to be retried later rather than keeping its
+// worker.  With no workers running the handle is detached on the calling thread
+switch_status_t teardownStart(const unsigned int threads);
+// detaches already queued are sent before the workers exit
+void teardownStop(void);
+
+void teardownDetach(server_t *pServer, const janus_id_t serverId, const janus_id_t senderId);
+
+#endif //_TEARDOWN_H_
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
@@ -0,0 +1,82 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ * transport.c -- Janus transport registry for janus endpoint module
+ *
+ */
+#include  "switch.h"
+
+#include  "globals.h"
+#include  "transport.h"
+
+static const transport_t *transports[JANUS_TP_COUNT];
+
+void transportRegister(const janus_transport_t type, const transport_t *pTransport) {
+	switch_assert(type < JANUS_TP_COUNT);
+	transports[type] = pTransport;
+}
+
+const transport_t *transportGet(const janus_transport_t type) {
+	return type < JANUS_TP_COUNT ? transports[type] : NULL;
+}
+
+/*
+ * Add a uint64 field as a raw JSON integer. cJSON stores numbers as `double`
+ * and its printer may fall back to `%1.15g` (e.g. "8.31461053888952e+15"),
+ * which Janus/Jansson parses as a JSON real and rejects for integer-only
+ * fields like session_id / handle_id. Emit the value verbatim instead.
+ */
+static void transport_add_u64(cJSON *pJson, const char *pName, const uint64_t value) {
+	char buf[32];
+	(void) snprintf(buf, sizeof(buf), "%" SWITCH_UINT64_T_FMT, value);
+	cJSON_AddRawToObject(pJson, pName, buf);
+}
+
+void transportAddIds(server_t *pServer, cJSON *pJsonRequest, const janus_id_t serverId, const janus_id_t senderId) {
+	if (serverId) {
+		transport_add_u64(pJsonRequest, "session_id", (uint64_t) serverId);
+	}
+	if (senderId) {
+		transport_add_u64(pJsonRequest, "handle_id", (uint64_t) senderId);
+	}
+	// a signed token has been added at the top level by encode()
+	if (!pServer->pHmacSecret && !zstr(pServer->pAuthToken)) {
+		cJSON_AddStringToObject(pJsonRequest, "token", pServer->pAuthToken);
+	}
+}
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
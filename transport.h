@@ -0,0 +1,91 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Richard Screene <richard.screene@thisisdrum.com>
+ *
+ *
+ * transport.h -- Janus transport interface for janus endpoint module
+ *
+ */
+#ifndef _TRANSPORT_H_
+#define _TRANSPORT_H_
+
+#include  "switch.h"
+#include  "cJSON.h"
+#include  "servers.h"
+#include  "api.h"
+
+// how long a request waits for its answer (ms)
+#define TRANSPORT_REQUEST_TIMEOUT 3000
+// how long a blocking poll waits for events (ms) - Janus answers a long-poll
+// with a keep-alive after 30 seconds
+#define TRANSPORT_POLL_TIMEOUT 60000
+// a WebSocket or Unix socket session is kept alive after this long idle (us)
+#define TRANSPORT_KEEPALIVE_US 25000000
+
+// The ways of talking to Janus.  api.c builds the requests and mod_janus.c
+// runs the session; neither needs to know which transport carries them.
+// Each janus_transport_t has one of these registered at load
+typedef struct transport_s {
+	// for log lines - "Janus <name> started"
+	const char *pName;
+	// connects, when there is nothing connected already
+	switch_status_t (*open)(server_t *pServer);
+	// drops the connection, if any - the next open starts afresh
+	void (*close)(server_t *pServer);
+	// sends one request to the session (serverId) or handle (senderId) and
+	// waits for the answer.  The caller keeps pJsonRequest and must
+	// cJSON_Delete() the answer, which is NULL on failure
+	cJSON *(*send)(server_t *pServer, cJSON *pJsonRequest, const char *pTransactionId,
+		const janus_id_t serverId, const janus_id_t senderId, const char *pLabel);
+	// hands the session's events to pDispatch - with block set waits a while
+	// for them, otherwise only handles those already received
+	switch_status_t (*poll)(server_t *pServer, const janus_id_t serverId, const switch_bool_t block,
+		const api_dispatch_t *pDispatch);
+	// fails the requests and polls in flight - may be called from any thread
+	void (*cancel)(server_t *pServer);
+} transport_t;
+
+void transportRegister(const janus_transport_t type, const transport_t *pTransport);
+// NULL when this build has no such transport
+const transport_t *transportGet(const janus_transport_t type);
+
+// For transports that carry the ids in the body rather than the URL: adds
+// session_id, handle_id and, in stored-token mode, the auth-token.  A
+// signed token has already been added by api.c
+void transportAddIds(server_t *pServer, cJSON *pJsonRequest, const janus_id_t serverId, const janus_id_t senderId);
+
+#endif //_TRANSPORT_H_
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */